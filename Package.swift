@@ -31,8 +31,11 @@ let package = Package(
                     "src/language.c",
                     "src/alloc.c",
                     "src/subtree.c",
+                    "src/subtree_cache.c",
                     "src/tree.c",
-                    "src/query.c"
+                    "src/query.c",
+                    "src/query_session.c",
+                    "src/regex.c"
                 ],
                 sources: ["src/lib.c"]),
     ]
@@ -4,7 +4,7 @@ use std::collections::BTreeMap;
 use std::path::{Path, PathBuf};
 use std::time::Instant;
 use std::{env, fs, str, usize};
-use tree_sitter::{Language, Parser, Query};
+use tree_sitter::{InputEdit, Language, Parser, Point, Query, SubtreeCache};
 use tree_sitter_loader::Loader;
 
 include!("../src/tests/helpers/dirs.rs");
@@ -78,6 +78,7 @@ fn main() {
     let mut parser = Parser::new();
     let mut all_normal_speeds = Vec::new();
     let mut all_error_speeds = Vec::new();
+    let mut all_query_speeds = Vec::new();
 
     for (language_path, (example_paths, query_paths)) in
         EXAMPLE_AND_QUERY_PATHS_BY_LANGUAGE_DIR.iter()
@@ -95,6 +96,7 @@ fn main() {
         parser.set_language(language).unwrap();
 
         eprintln!("  Constructing Queries");
+        let mut query_speeds = Vec::new();
         for path in query_paths {
             if let Some(filter) = EXAMPLE_FILTER.as_ref() {
                 if !path.to_str().unwrap().contains(filter.as_str()) {
@@ -102,11 +104,11 @@ fn main() {
                 }
             }
 
-            parse(&path, max_path_length, |source| {
+            query_speeds.push(parse(&path, max_path_length, |source| {
                 Query::new(language, str::from_utf8(source).unwrap())
                     .with_context(|| format!("Query file path: {path:?}"))
                     .expect("Failed to parse query");
-            });
+            }));
         }
 
         eprintln!("  Parsing Valid Code:");
@@ -123,6 +125,27 @@ fn main() {
             }));
         }
 
+        eprintln!("  Computing Changed Ranges (small edits):");
+        for example_path in example_paths {
+            if let Some(filter) = EXAMPLE_FILTER.as_ref() {
+                if !example_path.to_str().unwrap().contains(filter.as_str()) {
+                    continue;
+                }
+            }
+
+            compute_changed_ranges(&mut parser, example_path, max_path_length);
+        }
+
+        eprintln!("  Parsing Documents With Shared Text:");
+        let shared_text_paths = example_paths
+            .iter()
+            .filter(|path| match EXAMPLE_FILTER.as_ref() {
+                Some(filter) => path.to_str().unwrap().contains(filter.as_str()),
+                None => true,
+            })
+            .collect::<Vec<_>>();
+        parse_with_subtree_cache(&mut parser, &shared_text_paths);
+
         eprintln!("  Parsing Invalid Code (mismatched languages):");
         let mut error_speeds = Vec::new();
         for (other_language_path, (example_paths, _)) in
@@ -153,8 +176,14 @@ fn main() {
             eprintln!("  Worst Speed (errors):   {} bytes/ms", worst_error);
         }
 
+        if let Some((average_query, worst_query)) = aggregate(&query_speeds) {
+            eprintln!("  Average Speed (queries): {} bytes/ms", average_query);
+            eprintln!("  Worst Speed (queries):   {} bytes/ms", worst_query);
+        }
+
         all_normal_speeds.extend(normal_speeds);
         all_error_speeds.extend(error_speeds);
+        all_query_speeds.extend(query_speeds);
     }
 
     eprintln!("\n  Overall");
@@ -167,6 +196,11 @@ fn main() {
         eprintln!("  Average Speed (errors): {} bytes/ms", average_error);
         eprintln!("  Worst Speed (errors):   {} bytes/ms", worst_error);
     }
+
+    if let Some((average_query, worst_query)) = aggregate(&all_query_speeds) {
+        eprintln!("  Average Speed (queries): {} bytes/ms", average_query);
+        eprintln!("  Worst Speed (queries):   {} bytes/ms", worst_query);
+    }
     eprintln!("");
 }
 
@@ -206,6 +240,125 @@ fn parse(path: &Path, max_path_length: usize, mut action: impl FnMut(&[u8])) ->
     speed as usize
 }
 
+fn compute_changed_ranges(parser: &mut Parser, path: &Path, max_path_length: usize) {
+    eprint!(
+        "    {:width$}\t",
+        path.file_name().unwrap().to_str().unwrap(),
+        width = max_path_length
+    );
+
+    let source_code = fs::read(path)
+        .with_context(|| format!("Failed to read {:?}", path))
+        .unwrap();
+
+    // Insert a single space at the whitespace character closest to the middle
+    // of the file, so that most of the tree can be reused.
+    let position = source_code[source_code.len() / 2..]
+        .iter()
+        .position(|c| c.is_ascii_whitespace())
+        .map_or(source_code.len(), |i| source_code.len() / 2 + i);
+    let mut new_source_code = source_code.clone();
+    new_source_code.insert(position, b' ');
+
+    let row = source_code[..position]
+        .iter()
+        .filter(|c| **c == b'\n')
+        .count();
+    let column = position
+        - source_code[..position]
+            .iter()
+            .rposition(|c| *c == b'\n')
+            .map_or(0, |i| i + 1);
+    let start_point = Point::new(row, column);
+
+    let mut old_tree = parser.parse(&source_code, None).expect("Failed to parse");
+    old_tree.edit(&InputEdit {
+        start_byte: position,
+        old_end_byte: position,
+        new_end_byte: position + 1,
+        start_position: start_point,
+        old_end_position: start_point,
+        new_end_position: Point::new(row, column + 1),
+    });
+    let new_tree = parser
+        .parse(&new_source_code, Some(&old_tree))
+        .expect("Failed to parse");
+
+    let time = Instant::now();
+    let mut range_count = 0;
+    for _ in 0..*REPETITION_COUNT {
+        range_count = old_tree.changed_ranges(&new_tree).count();
+    }
+    let duration = time.elapsed() / (*REPETITION_COUNT as u32);
+    eprintln!(
+        "time {} us\tranges {}",
+        duration.as_micros() as usize,
+        range_count
+    );
+}
+
+fn parse_with_subtree_cache(parser: &mut Parser, paths: &[&PathBuf]) {
+    const DOCUMENT_COUNT: usize = 200;
+    const FRAGMENTS_PER_DOCUMENT: usize = 3;
+
+    // Build many documents that each combine a few of the example files, so
+    // that the same text appears in many of the documents.
+    let fragments = paths
+        .iter()
+        .map(|path| {
+            fs::read(path)
+                .with_context(|| format!("Failed to read {:?}", path))
+                .unwrap()
+        })
+        .collect::<Vec<_>>();
+    if fragments.is_empty() {
+        return;
+    }
+    let documents = (0..DOCUMENT_COUNT)
+        .map(|i| {
+            (0..FRAGMENTS_PER_DOCUMENT)
+                .flat_map(|k| {
+                    let fragment = &fragments[(i * 7 + k * 3) % fragments.len()];
+                    fragment.iter().chain(b"\n").cloned()
+                })
+                .collect::<Vec<_>>()
+        })
+        .collect::<Vec<_>>();
+    let byte_count = documents.iter().map(|d| d.len()).sum::<usize>();
+
+    for (label, use_cache) in [("without cache", false), ("with cache", true)] {
+        let cache = SubtreeCache::new();
+        if use_cache {
+            unsafe { parser.set_subtree_cache(Some(&cache)) };
+        }
+
+        let time = Instant::now();
+        let trees = documents
+            .iter()
+            .map(|document| parser.parse(document, None).expect("Failed to parse"))
+            .collect::<Vec<_>>();
+        let duration_ms = time.elapsed().as_millis();
+        unsafe { parser.set_subtree_cache(None) };
+
+        // Nodes that are shared with the cache or with other trees are counted
+        // once, as part of the cache.
+        let tree_bytes = trees
+            .iter()
+            .map(|tree| {
+                let usage = tree.memory_usage();
+                usage.total_bytes - usage.shared_bytes
+            })
+            .sum::<usize>();
+        eprintln!(
+            "    {:13}\ttime {} ms\tspeed {} bytes/ms\tmemory {} bytes",
+            label,
+            duration_ms as usize,
+            byte_count as u128 / (duration_ms + 1),
+            tree_bytes + cache.memory_usage()
+        );
+    }
+}
+
 fn get_language(path: &Path) -> Language {
     let src_dir = GRAMMARS_DIR.join(path).join("src");
     TEST_LOADER
@@ -9,6 +9,7 @@ use std::{
 
 #[ctor::ctor]
 unsafe fn initialize_allocation_recording() {
+    tree_sitter::set_allocation_counting(true);
     tree_sitter::set_allocator(
         Some(ts_record_malloc),
         Some(ts_record_calloc),
@@ -1,17 +1,30 @@
 use super::helpers::{
     allocations,
-    fixtures::get_language,
+    edits::get_random_edit,
+    fixtures::{get_language, get_test_language},
     query_helpers::{assert_query_matches, Match, Pattern},
+    random::Rand,
     ITERATION_COUNT,
 };
-use crate::tests::helpers::query_helpers::{collect_captures, collect_matches};
+use crate::{
+    generate::generate_parser_for_grammar,
+    parse::{perform_edit, Edit},
+    tests::helpers::query_helpers::{collect_captures, collect_matches},
+};
 use indoc::indoc;
 use lazy_static::lazy_static;
 use rand::{prelude::StdRng, SeedableRng};
-use std::{env, fmt::Write};
+use std::{
+    env,
+    fmt::Write,
+    mem::{self, MaybeUninit},
+    os::raw::{c_char, c_void},
+    ptr,
+};
 use tree_sitter::{
-    CaptureQuantifier, Language, Node, Parser, Point, Query, QueryCursor, QueryError,
-    QueryErrorKind, QueryPredicate, QueryPredicateArg, QueryProperty,
+    ffi, CaptureQuantifier, Language, Node, Parser, Point, Query, QueryCursor, QueryError,
+    QueryErrorKind, QueryPredicate, QueryPredicateArg, QueryProperty, QuerySession,
+    QuerySessionMatch, Tree,
 };
 use unindent::Unindent;
 
@@ -710,6 +723,38 @@ fn test_query_matches_with_many_overlapping_results() {
     });
 }
 
+#[test]
+fn test_query_matches_with_rare_nodes_in_large_subtrees() {
+    allocations::record(|| {
+        let language = get_language("javascript");
+        let query = Query::new(
+            language,
+            r#"
+            (regex) @regex
+            ((comment) @comment (debugger_statement) @debugger)
+            "#,
+        )
+        .unwrap();
+
+        // Most of the subtrees contain none of the queried node types.
+        let mut source = "function a() {\n".to_string();
+        source += &"  if (b) { return [c, d, {e: f(g)}]; }\n".repeat(50);
+        source += "  // x\n  debugger;\n}\n";
+        source += &"const h = i.map(j => j + 1);\n".repeat(50);
+        source += "const k = l.filter(m => /n/.test(m));\n";
+
+        assert_query_matches(
+            language,
+            &query,
+            &source,
+            &[
+                (1, vec![("comment", "// x"), ("debugger", "debugger;")]),
+                (0, vec![("regex", "/n/")]),
+            ],
+        );
+    });
+}
+
 #[test]
 fn test_query_matches_capturing_error_nodes() {
     allocations::record(|| {
@@ -1691,6 +1736,48 @@ fn test_query_matches_with_too_many_permutations_to_track() {
     });
 }
 
+#[test]
+fn test_query_matches_with_capture_memory_limit() {
+    allocations::record(|| {
+        let language = get_language("javascript");
+        let query = Query::new(
+            language,
+            "
+            (array (identifier) @pre (identifier) @post)
+        ",
+        )
+        .unwrap();
+
+        let mut source = "hello, ".repeat(50);
+        source.insert(0, '[');
+        source.push_str("];");
+
+        let mut parser = Parser::new();
+        parser.set_language(language).unwrap();
+        let tree = parser.parse(&source, None).unwrap();
+
+        // By default, every permutation is tracked until it finishes.
+        let mut cursor = QueryCursor::new();
+        assert_eq!(cursor.capture_memory_limit(), 0);
+        let matches = cursor.matches(&query, tree.root_node(), source.as_bytes());
+        assert_eq!(
+            collect_matches(matches, &query, source.as_str()).len(),
+            50 * 49 / 2
+        );
+        assert_eq!(cursor.did_exceed_match_limit(), false);
+
+        // When the captures don't fit within the memory limit, some of the
+        // permutations are dropped, and the cursor reports this.
+        cursor.set_capture_memory_limit(4096);
+        assert_eq!(cursor.capture_memory_limit(), 4096);
+        let matches = cursor.matches(&query, tree.root_node(), source.as_bytes());
+        let matches = collect_matches(matches, &query, source.as_str());
+        assert!(matches.len() < 50 * 49 / 2);
+        assert_eq!(matches[0], (0, vec![("pre", "hello"), ("post", "hello")]));
+        assert_eq!(cursor.did_exceed_match_limit(), true);
+    });
+}
+
 #[test]
 fn test_query_sibling_patterns_dont_match_children_of_an_error() {
     allocations::record(|| {
@@ -2798,6 +2885,759 @@ fn test_query_captures_with_text_conditions() {
     });
 }
 
+#[test]
+fn test_query_matches_with_text_conditions_and_different_text_providers() {
+    allocations::record(|| {
+        let language = get_language("javascript");
+        let query = Query::new(
+            language,
+            r#"
+            (assignment_expression
+              left: (identifier) @left
+              right: (identifier) @right
+              (#eq? @left @right))
+
+            (assignment_expression
+              left: (identifier) @other
+              right: (_)
+              (#not-eq? @other "b"))
+            "#,
+        )
+        .unwrap();
+
+        let source = "a = a; b = c; dd = d; b = b; e = 1;";
+
+        let mut parser = Parser::new();
+        parser.set_language(language).unwrap();
+        let tree = parser.parse(&source, None).unwrap();
+        let mut cursor = QueryCursor::new();
+        let expected = &[
+            (0, vec![("left", "a"), ("right", "a")]),
+            (1, vec![("other", "a")]),
+            (1, vec![("other", "dd")]),
+            (0, vec![("left", "b"), ("right", "b")]),
+            (1, vec![("other", "e")]),
+        ];
+
+        // When the source is given as a slice, the query cursor evaluates these
+        // predicates itself.
+        let matches = cursor.matches(&query, tree.root_node(), source.as_bytes());
+        assert_eq!(collect_matches(matches, &query, source), expected);
+
+        let matches = cursor.matches(&query, tree.root_node(), |node: Node| {
+            std::iter::once(&source.as_bytes()[node.byte_range()])
+        });
+        assert_eq!(collect_matches(matches, &query, source), expected);
+
+        let captures = cursor.captures(&query, tree.root_node(), source.as_bytes());
+        assert_eq!(
+            collect_captures(captures, &query, source),
+            &[
+                ("left", "a"),
+                ("other", "a"),
+                ("right", "a"),
+                ("other", "dd"),
+                ("left", "b"),
+                ("right", "b"),
+                ("other", "e"),
+            ]
+        );
+    });
+}
+
+#[test]
+fn test_query_captures_with_regex_conditions_and_non_ascii_text() {
+    allocations::record(|| {
+        let language = get_language("javascript");
+        let query = Query::new(
+            language,
+            r#"
+            ((identifier) @type
+             (#match? @type "^[A-Z]\\w*$"))
+
+            ((identifier) @variable
+             (#not-match? @variable "^[A-Z]"))
+            "#,
+        )
+        .unwrap();
+
+        // Whether `\w` matches non-ASCII characters can't be decided by the query
+        // cursor, so it leaves those matches to the regex in the binding.
+        let source = "Foo; bar; Café; BAZ_1; élan;";
+
+        let mut parser = Parser::new();
+        parser.set_language(language).unwrap();
+        let tree = parser.parse(&source, None).unwrap();
+        let mut cursor = QueryCursor::new();
+
+        let captures = cursor.captures(&query, tree.root_node(), source.as_bytes());
+        assert_eq!(
+            collect_captures(captures, &query, source),
+            &[
+                ("type", "Foo"),
+                ("variable", "bar"),
+                ("type", "Café"),
+                ("type", "BAZ_1"),
+                ("variable", "élan"),
+            ],
+        );
+    });
+}
+
+#[test]
+fn test_query_cursor_regex_predicates() {
+    // The binding re-checks every `#match?` predicate with its own regex engine, so
+    // the query cursor's built-in engine is tested directly through the C API.
+    allocations::record(|| {
+        let (parser_name, parser_code) = generate_parser_for_grammar(
+            r#"
+            {
+                "name": "test_query_cursor_regex_predicates",
+                "extras": [],
+                "rules": {
+                    "program": {
+                        "type": "REPEAT",
+                        "content": {
+                            "type": "SEQ",
+                            "members": [
+                                {"type": "SYMBOL", "name": "item"},
+                                {"type": "STRING", "value": ";"}
+                            ]
+                        }
+                    },
+                    "item": {"type": "PATTERN", "value": "[^;]+"}
+                }
+            }
+            "#,
+        )
+        .unwrap();
+        let language = get_test_language(&parser_name, &parser_code, None);
+
+        let cases: &[(&str, &[&str], &[&str])] = &[
+            // Anchors
+            (
+                r#"#match? @item "^ab""#,
+                &["ab", "cab", "abc"],
+                &["ab", "abc"],
+            ),
+            (
+                r#"#match? @item "ab$""#,
+                &["ab", "cab", "abc"],
+                &["ab", "cab"],
+            ),
+            (
+                r#"#match? @item "^(ab|cd)$""#,
+                &["ab", "cd", "abcd"],
+                &["ab", "cd"],
+            ),
+            (r#"#not-match? @item "^ab""#, &["ab", "cab"], &["cab"]),
+            // Range and negated classes
+            (
+                r#"#match? @item "^[a-c]+$""#,
+                &["abc", "abd", "ABC"],
+                &["abc"],
+            ),
+            (
+                r#"#match? @item "^[^0-9 ]+$""#,
+                &["abc", "a1c", "a c"],
+                &["abc"],
+            ),
+            // Ranges of multi-byte characters
+            (
+                r#"#match? @item "^[α-ω]+$""#,
+                &["αβγ", "abc", "Ωω"],
+                &["αβγ"],
+            ),
+            (
+                r#"#match? @item "^[一-龥]+$""#,
+                &["中文", "日本ご"],
+                &["中文"],
+            ),
+            (
+                r#"#match? @item "^[😀-😏]$""#,
+                &["😃", "😐", "😀😀"],
+                &["😃"],
+            ),
+            (
+                r#"#match? @item "^[^α-ω]+$""#,
+                &["abc", "aβc", "Ω"],
+                &["abc", "Ω"],
+            ),
+            // Literal prefixes, including ones that start inside a partial match
+            (
+                r#"#match? @item "foobar\\d""#,
+                &[
+                    "xxfoobar1",
+                    "foobaz1foobar",
+                    "fofoobar2",
+                    "foobar",
+                    "ffoobar3",
+                ],
+                &["xxfoobar1", "fofoobar2", "ffoobar3"],
+            ),
+            (
+                r#"#match? @item "αβ""#,
+                &["xαβ", "αxβ", "ααβ"],
+                &["xαβ", "ααβ"],
+            ),
+            // Unsupported syntax fails to compile, so the predicate is left to the caller.
+            (r#"#match? @item "^a(?=b)""#, &["ab", "xy"], &["ab", "xy"]),
+            (r#"#not-match? @item "a\\1""#, &["ab", "xy"], &["ab", "xy"]),
+            // Non-ASCII characters can't be tested against `\w` or `\d`, so the
+            // predicate is left to the caller unless the result is decided elsewhere.
+            (
+                r#"#match? @item "^\\w+$""#,
+                &["hello", "héllo", "a-b"],
+                &["hello", "héllo"],
+            ),
+            (r#"#match? @item "\\d""#, &["é1", "é", "x"], &["é1", "é"]),
+            (r#"#not-match? @item "\\d""#, &["1é", "é", "x"], &["é", "x"]),
+        ];
+
+        // The text is read in small chunks, so that matches span the boundaries
+        // between chunks, including in the middle of multi-byte characters.
+        for (predicate, items, expected) in cases {
+            for chunk_size in [1, 2, 3, usize::MAX] {
+                assert_eq!(
+                    get_raw_predicate_matches(language, predicate, items, chunk_size),
+                    *expected,
+                    "predicate: {predicate}, chunk size: {chunk_size}",
+                );
+            }
+        }
+    });
+}
+
+fn get_raw_predicate_matches(
+    language: Language,
+    predicate: &str,
+    items: &[&str],
+    chunk_size: usize,
+) -> Vec<String> {
+    struct ChunkedText<'a> {
+        text: &'a [u8],
+        chunk_size: usize,
+    }
+
+    unsafe extern "C" fn read(
+        payload: *mut c_void,
+        byte_offset: u32,
+        _: ffi::TSPoint,
+        bytes_read: *mut u32,
+    ) -> *const c_char {
+        let input = &*(payload as *const ChunkedText);
+        let start = (byte_offset as usize).min(input.text.len());
+        let end = start.saturating_add(input.chunk_size).min(input.text.len());
+        *bytes_read = (end - start) as u32;
+        input.text[start..].as_ptr() as *const c_char
+    }
+
+    let source = items
+        .iter()
+        .map(|item| format!("{item};"))
+        .collect::<String>();
+    let query_source = format!("((item) @item ({predicate}))");
+    let mut text = ChunkedText {
+        text: source.as_bytes(),
+        chunk_size,
+    };
+
+    let mut result = Vec::new();
+    unsafe {
+        // `Language` is a transparent wrapper around the C language pointer.
+        let language = mem::transmute::<Language, *const ffi::TSLanguage>(language);
+        let parser = ffi::ts_parser_new();
+        assert!(ffi::ts_parser_set_language(parser, language));
+        let tree = ffi::ts_parser_parse_string(
+            parser,
+            ptr::null(),
+            source.as_ptr() as *const c_char,
+            source.len() as u32,
+        );
+
+        let mut error_offset = 0;
+        let mut error_type = ffi::TSQueryError_TSQueryErrorNone;
+        let query = ffi::ts_query_new(
+            language,
+            query_source.as_ptr() as *const c_char,
+            query_source.len() as u32,
+            &mut error_offset,
+            &mut error_type,
+        );
+        assert!(!query.is_null());
+
+        let cursor = ffi::ts_query_cursor_new();
+        ffi::ts_query_cursor_set_text_input(
+            cursor,
+            ffi::TSInput {
+                payload: &mut text as *mut ChunkedText as *mut c_void,
+                read: Some(read),
+                encoding: ffi::TSInputEncoding_TSInputEncodingUTF8,
+            },
+        );
+        ffi::ts_query_cursor_exec(cursor, query, ffi::ts_tree_root_node(tree));
+        let mut m = MaybeUninit::<ffi::TSQueryMatch>::uninit();
+        while ffi::ts_query_cursor_next_match(cursor, m.as_mut_ptr()) {
+            let node = (*m.assume_init_ref().captures).node;
+            let range =
+                ffi::ts_node_start_byte(node) as usize..ffi::ts_node_end_byte(node) as usize;
+            result.push(source[range].to_string());
+        }
+
+        ffi::ts_query_cursor_delete(cursor);
+        ffi::ts_query_delete(query);
+        ffi::ts_tree_delete(tree);
+        ffi::ts_parser_delete(parser);
+    }
+    result
+}
+
+#[test]
+fn test_query_serialization() {
+    allocations::record(|| {
+        let language = get_language("javascript");
+        let mut query = Query::new(
+            language,
+            r#"
+            (assignment_expression
+              left: (identifier) @left
+              right: (identifier) @right
+              (#eq? @left @right))
+
+            ((identifier) @constant
+             (#match? @constant "^[A-Z][A-Z_\\d]*$")
+             (#set! kind "constant"))
+
+            (call_expression
+              function: (identifier) @function
+              arguments: (arguments) @arguments)
+            "#,
+        )
+        .unwrap();
+        query.disable_capture("arguments");
+
+        let data = query.serialize();
+        let restored_query = Query::deserialize(language, &data).unwrap();
+        assert_eq!(restored_query.pattern_count(), query.pattern_count());
+        assert_eq!(restored_query.capture_names(), query.capture_names());
+        assert_eq!(
+            restored_query.property_settings(1),
+            &[QueryProperty::new("kind", Some("constant"), None)]
+        );
+        assert_eq!(restored_query.serialize(), data);
+
+        let source = "a = a; b = c; MAX_SIZE = 1; f(NAME, x);";
+        let mut parser = Parser::new();
+        parser.set_language(language).unwrap();
+        let tree = parser.parse(&source, None).unwrap();
+        let mut cursor = QueryCursor::new();
+        let matches = cursor.matches(&query, tree.root_node(), source.as_bytes());
+        let expected = collect_matches(matches, &query, source);
+        let matches = cursor.matches(&restored_query, tree.root_node(), source.as_bytes());
+        assert_eq!(collect_matches(matches, &restored_query, source), expected);
+        assert_eq!(
+            expected,
+            &[
+                (0, vec![("left", "a"), ("right", "a")]),
+                (1, vec![("constant", "MAX_SIZE")]),
+                (2, vec![("function", "f")]),
+                (1, vec![("constant", "NAME")]),
+            ]
+        );
+
+        assert!(Query::deserialize(language, &data[0..data.len() - 1]).is_none());
+        assert!(Query::deserialize(get_language("python"), &data).is_none());
+    });
+}
+
+#[test]
+fn test_query_serialization_with_a_different_language_of_the_same_size() {
+    // These grammars have the same numbers of symbols, fields and states, and
+    // differ only in the name of a symbol or a field.
+    let get_grammar_language = |grammar_name: &str, symbol_name: &str, field_name: &str| {
+        let (parser_name, parser_code) = generate_parser_for_grammar(&format!(
+            r#"
+            {{
+                "name": "{grammar_name}",
+                "extras": [{{"type": "PATTERN", "value": "\\s+"}}],
+                "rules": {{
+                    "program": {{"type": "REPEAT", "content": {{"type": "SYMBOL", "name": "pair"}}}},
+                    "pair": {{
+                        "type": "SEQ",
+                        "members": [
+                            {{
+                                "type": "FIELD",
+                                "name": "{field_name}",
+                                "content": {{"type": "SYMBOL", "name": "{symbol_name}"}}
+                            }},
+                            {{"type": "STRING", "value": ";"}}
+                        ]
+                    }},
+                    "{symbol_name}": {{"type": "PATTERN", "value": "[a-z]+"}}
+                }}
+            }}
+            "#
+        ))
+        .unwrap();
+        get_test_language(&parser_name, &parser_code, None)
+    };
+    let language = get_grammar_language("test_query_serialization_a", "word", "name");
+    let renamed_symbol_language =
+        get_grammar_language("test_query_serialization_b", "term", "name");
+    let renamed_field_language =
+        get_grammar_language("test_query_serialization_c", "word", "label");
+    assert_eq!(
+        renamed_symbol_language.node_kind_count(),
+        language.node_kind_count()
+    );
+    assert_eq!(renamed_field_language.field_count(), language.field_count());
+
+    let query = Query::new(language, "(pair name: (word) @word)").unwrap();
+    let data = query.serialize();
+    assert!(Query::deserialize(language, &data).is_some());
+    assert!(Query::deserialize(renamed_symbol_language, &data).is_none());
+    assert!(Query::deserialize(renamed_field_language, &data).is_none());
+}
+
+#[test]
+fn test_query_matches_for_multiple_queries() {
+    allocations::record(|| {
+        let language = get_language("javascript");
+        let queries = [
+            Query::new(
+                language,
+                r#"
+                (call_expression
+                  function: (identifier) @function)
+                ((identifier) @constant
+                 (#match? @constant "^[A-Z][A-Z_]*$"))
+                "#,
+            )
+            .unwrap(),
+            Query::new(language, "(string) @string").unwrap(),
+            Query::new(
+                language,
+                r#"
+                (assignment_expression
+                  left: (identifier) @left
+                  right: (identifier) @right
+                  (#eq? @left @right))
+                (call_expression
+                  function: (identifier) @callee
+                  arguments: (arguments (string) @arg))
+                "#,
+            )
+            .unwrap(),
+        ];
+        let query_refs = queries.iter().collect::<Vec<_>>();
+
+        let source = "a = a; f(MAX, 'x'); b = c; g('y', MIN);";
+        let mut parser = Parser::new();
+        parser.set_language(language).unwrap();
+        let tree = parser.parse(&source, None).unwrap();
+        let mut cursor = QueryCursor::new();
+
+        let mut combined_matches = vec![Vec::new(); queries.len()];
+        for (query_index, m) in cursor
+            .matches_for_queries(&query_refs, tree.root_node(), source.as_bytes())
+            .unwrap()
+        {
+            let query = &queries[query_index];
+            let captures = m
+                .captures
+                .iter()
+                .map(|c| {
+                    (
+                        query.capture_names()[c.index as usize].as_str(),
+                        c.node.utf8_text(source.as_bytes()).unwrap(),
+                    )
+                })
+                .collect::<Vec<_>>();
+            combined_matches[query_index].push((m.pattern_index, captures));
+        }
+
+        let mut combined_captures = vec![Vec::new(); queries.len()];
+        for (query_index, m, capture_index) in cursor
+            .captures_for_queries(&query_refs, tree.root_node(), source.as_bytes())
+            .unwrap()
+        {
+            let capture = m.captures[capture_index];
+            combined_captures[query_index].push((
+                queries[query_index].capture_names()[capture.index as usize].as_str(),
+                capture.node.utf8_text(source.as_bytes()).unwrap(),
+            ));
+        }
+
+        for (query_index, query) in queries.iter().enumerate() {
+            let matches = cursor.matches(query, tree.root_node(), source.as_bytes());
+            assert_eq!(
+                combined_matches[query_index],
+                collect_matches(matches, query, source)
+            );
+            let captures = cursor.captures(query, tree.root_node(), source.as_bytes());
+            assert_eq!(
+                combined_captures[query_index],
+                collect_captures(captures, query, source)
+            );
+        }
+        assert_eq!(
+            combined_matches[2],
+            &[
+                (0, vec![("left", "a"), ("right", "a")]),
+                (1, vec![("callee", "f"), ("arg", "'x'")]),
+                (1, vec![("callee", "g"), ("arg", "'y'")]),
+            ]
+        );
+
+        let python_query = Query::new(get_language("python"), "(string) @string").unwrap();
+        assert!(cursor
+            .matches_for_queries(
+                &[&queries[0], &python_query],
+                tree.root_node(),
+                source.as_bytes()
+            )
+            .is_none());
+    });
+}
+
+#[test]
+fn test_query_matches_in_parallel() {
+    allocations::record(|| {
+        let language = get_language("javascript");
+        let query = Query::new(
+            language,
+            r#"
+            (call_expression
+              function: (identifier) @function
+              arguments: (arguments (string) @arg))
+            ((comment) @doc
+             .
+             (function_declaration name: (identifier) @name))
+            (
+              (expression_statement) @first
+              .
+              (expression_statement) @second
+            )
+            ((identifier) @constant
+             (#match? @constant "^[A-Z][A-Z_]*$"))
+            "#,
+        )
+        .unwrap();
+
+        let source = "
+            // one
+            function one() { f('a'); g(MAX); }
+            x = 1; y = 2;
+            // two
+            function two() { f('b'); h(MIN, 'c'); }
+        "
+        .repeat(20);
+        let mut parser = Parser::new();
+        parser.set_language(language).unwrap();
+        let tree = parser.parse(&source, None).unwrap();
+        let mut cursor = QueryCursor::new();
+
+        let describe = |pattern_index: usize, captures: &[QueryCapture]| {
+            let captures = captures
+                .iter()
+                .map(|c| {
+                    (
+                        query.capture_names()[c.index as usize].as_str(),
+                        c.node.start_byte(),
+                        c.node.end_byte(),
+                    )
+                })
+                .collect::<Vec<_>>();
+            (pattern_index, captures)
+        };
+
+        let mut expected = cursor
+            .matches(&query, tree.root_node(), source.as_bytes())
+            .map(|m| describe(m.pattern_index, m.captures))
+            .collect::<Vec<_>>();
+        expected.sort_unstable();
+        assert!(expected.len() > 100);
+
+        for thread_count in [1, 3, 8] {
+            let mut actual = cursor
+                .matches_in_parallel(&query, tree.root_node(), source.as_bytes(), thread_count)
+                .iter()
+                .map(|m| describe(m.pattern_index, &m.captures))
+                .collect::<Vec<_>>();
+            actual.sort_unstable();
+            assert_eq!(actual, expected, "thread count {}", thread_count);
+        }
+
+        // Adjacent match start ranges divide the matches between them, even when a range
+        // ends in the middle of a match.
+        let midpoint = source.find("x = 1").unwrap() + 3;
+        let mut actual = Vec::new();
+        for range in [0..midpoint, midpoint..source.len(), source.len()..0] {
+            cursor.set_match_start_byte_range(range);
+            actual.extend(
+                cursor
+                    .matches(&query, tree.root_node(), source.as_bytes())
+                    .map(|m| describe(m.pattern_index, m.captures)),
+            );
+        }
+        actual.sort_unstable();
+        assert_eq!(actual, expected);
+    });
+}
+
+#[test]
+fn test_query_session() {
+    allocations::record(|| {
+        let language = get_language("javascript");
+        let query = Query::new(
+            language,
+            r#"
+            (call_expression function: (identifier) @function)
+            ((comment) @doc
+             .
+             (function_declaration name: (identifier) @name))
+            ((identifier) @constant
+             (#match? @constant "^[A-Z][A-Z_]*$"))
+            "#,
+        )
+        .unwrap();
+
+        let mut input = "
+            // one
+            function one() { f('a'); g(MAX); }
+            x = 1; y = 2;
+        "
+        .repeat(10)
+        .into_bytes();
+        let mut parser = Parser::new();
+        parser.set_language(language).unwrap();
+        let mut tree = parser.parse(&input, None).unwrap();
+        let mut cursor = QueryCursor::new();
+        let mut session = QuerySession::new(&query);
+
+        // Describe matches by their pattern and their captures' names, kinds and positions.
+        let describe_session_matches = |matches: &[QuerySessionMatch]| {
+            let mut result = matches
+                .iter()
+                .map(|m| {
+                    let captures = m
+                        .captures
+                        .iter()
+                        .map(|c| {
+                            (
+                                query.capture_names()[c.index as usize].as_str(),
+                                c.kind_id,
+                                c.range.start_byte,
+                                c.range.end_byte,
+                            )
+                        })
+                        .collect::<Vec<_>>();
+                    (m.pattern_index, captures)
+                })
+                .collect::<Vec<_>>();
+            result.sort_unstable();
+            result
+        };
+        let mut describe_tree_matches = |tree: &Tree, input: &[u8]| {
+            let mut result = cursor
+                .matches(&query, tree.root_node(), input)
+                .filter(|m| !m.captures.is_empty())
+                .map(|m| {
+                    let captures = m
+                        .captures
+                        .iter()
+                        .map(|c| {
+                            (
+                                query.capture_names()[c.index as usize].as_str(),
+                                c.node.kind_id(),
+                                c.node.start_byte(),
+                                c.node.end_byte(),
+                            )
+                        })
+                        .collect::<Vec<_>>();
+                    (m.pattern_index, captures)
+                })
+                .collect::<Vec<_>>();
+            result.sort_unstable();
+            result.dedup();
+            result
+        };
+        let ids = |matches: &[QuerySessionMatch]| {
+            let mut result = matches.iter().map(|m| m.id).collect::<Vec<_>>();
+            result.sort_unstable();
+            result
+        };
+
+        // The first update finds all of the matches, and reports them as added.
+        session.update(&tree, &input);
+        let matches = session.matches();
+        assert_eq!(matches.len(), 40);
+        assert_eq!(
+            describe_session_matches(&matches),
+            describe_tree_matches(&tree, &input)
+        );
+        assert_eq!(session.added_matches(), matches);
+        assert!(session.removed_matches().is_empty());
+
+        // After an edit, only the affected matches are added and removed. The
+        // other matches keep their ids.
+        let position = input.windows(3).position(|w| w == b"MAX").unwrap();
+        let edit = Edit {
+            position,
+            deleted_length: 3,
+            inserted_text: b"max".to_vec(),
+        };
+        let edit = perform_edit(&mut tree, &mut input, &edit);
+        session.edit(&edit);
+        tree = parser.parse(&input, Some(&tree)).unwrap();
+        session.update(&tree, &input);
+        let removed_matches = session.removed_matches();
+        assert_eq!(
+            describe_session_matches(&removed_matches),
+            [(
+                2,
+                vec![(
+                    "constant",
+                    language.id_for_node_kind("identifier", true),
+                    position,
+                    position + 3
+                )]
+            )]
+        );
+        assert!(session.added_matches().is_empty());
+        let mut expected_ids = ids(&matches);
+        expected_ids.retain(|id| *id != removed_matches[0].id);
+        assert_eq!(ids(&session.matches()), expected_ids);
+
+        // After random edits, the session's matches are the same as the query's matches
+        // in the whole tree.
+        let mut rand = Rand::new(0);
+        for _ in 0..20 {
+            let previous_matches = session.matches();
+            let edit = get_random_edit(&mut rand, &input);
+            let edit = perform_edit(&mut tree, &mut input, &edit);
+            session.edit(&edit);
+            tree = parser.parse(&input, Some(&tree)).unwrap();
+            session.update(&tree, &input);
+
+            let matches = session.matches();
+            assert_eq!(
+                describe_session_matches(&matches),
+                describe_tree_matches(&tree, &input),
+                "input: {:?}",
+                String::from_utf8_lossy(&input),
+            );
+
+            let removed_ids = ids(&session.removed_matches());
+            let mut expected_ids = ids(&previous_matches);
+            expected_ids.retain(|id| removed_ids.binary_search(id).is_err());
+            expected_ids.extend(ids(&session.added_matches()));
+            expected_ids.sort_unstable();
+            assert_eq!(ids(&matches), expected_ids);
+        }
+    });
+}
+
 #[test]
 fn test_query_captures_with_predicates() {
     allocations::record(|| {
@@ -4109,6 +4949,14 @@ fn test_query_is_pattern_rooted() {
             ]"#,
             is_rooted: false,
         },
+        Row {
+            description: "two siblings, the first of which contains an alternative",
+            pattern: r#"(
+                (list [(integer) (string)])
+                (comment)
+            )"#,
+            is_rooted: false,
+        },
     ];
 
     allocations::record(|| {
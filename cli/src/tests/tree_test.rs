@@ -1,8 +1,12 @@
 use super::helpers::edits::invert_edit;
-use super::helpers::fixtures::get_language;
+use super::helpers::fixtures::{get_language, get_test_language};
+use super::helpers::scope_sequence::ScopeSequence;
+use crate::generate::generate_parser_for_grammar;
 use crate::parse::{perform_edit, Edit};
 use std::str;
-use tree_sitter::{InputEdit, Parser, Point, Range, Tree};
+use tree_sitter::{
+    DeletionQueue, EditBatchError, InputEdit, NodeChangeKind, Parser, Point, Range, Tree,
+};
 
 #[test]
 fn test_tree_edit() {
@@ -232,6 +236,79 @@ fn test_tree_edit() {
     }
 }
 
+#[test]
+fn test_tree_edit_batch() {
+    let mut parser = Parser::new();
+    parser.set_language(get_language("javascript")).unwrap();
+    let source = "abc + cde;\nfgh - ijk;";
+    let tree = parser.parse(source, None).unwrap();
+
+    // The edits are expressed in terms of the original source and can be given in any order.
+    let edits = [
+        InputEdit {
+            start_byte: 17,
+            old_end_byte: 20,
+            new_end_byte: 18,
+            start_position: Point::new(1, 6),
+            old_end_position: Point::new(1, 9),
+            new_end_position: Point::new(1, 7),
+        },
+        InputEdit {
+            start_byte: 1,
+            old_end_byte: 1,
+            new_end_byte: 4,
+            start_position: Point::new(0, 1),
+            old_end_position: Point::new(0, 1),
+            new_end_position: Point::new(0, 4),
+        },
+    ];
+
+    // Applying the edits as a batch is equivalent to applying them one at a time,
+    // from the last one to the first.
+    let mut batch_tree = tree.clone();
+    batch_tree.edit_batch(&edits).unwrap();
+    let mut sequential_tree = tree.clone();
+    sequential_tree.edit(&edits[0]);
+    sequential_tree.edit(&edits[1]);
+    assert_eq!(
+        batch_tree.root_node().to_sexp(),
+        sequential_tree.root_node().to_sexp()
+    );
+
+    let statement1 = batch_tree.root_node().child(0).unwrap();
+    let statement2 = batch_tree.root_node().child(1).unwrap();
+    assert!(statement1.has_changes());
+    assert_eq!(statement1.byte_range(), 0..13);
+    assert!(statement2.has_changes());
+    assert_eq!(statement2.byte_range(), 14..22);
+    assert_eq!(
+        statement2.byte_range(),
+        sequential_tree.root_node().child(1).unwrap().byte_range()
+    );
+
+    let new_source = "a * bc + cde;\nfgh - x;";
+    let new_tree = parser.parse(new_source, Some(&batch_tree)).unwrap();
+    assert_eq!(
+        new_tree.root_node().to_sexp(),
+        parser
+            .parse(new_source, None)
+            .unwrap()
+            .root_node()
+            .to_sexp()
+    );
+
+    // Overlapping edits are rejected, and the tree is left unchanged.
+    let mut tree = tree.clone();
+    let mut overlapping_edit = edits[0];
+    overlapping_edit.start_byte = 0;
+    overlapping_edit.start_position = Point::new(0, 0);
+    assert_eq!(
+        tree.edit_batch(&[edits[1], overlapping_edit]),
+        Err(EditBatchError(0))
+    );
+    assert!(!tree.root_node().has_changes());
+}
+
 #[test]
 fn test_tree_edit_with_included_ranges() {
     let mut parser = Parser::new();
@@ -596,6 +673,308 @@ fn test_get_changed_ranges() {
     }
 }
 
+#[test]
+fn test_get_changed_ranges_with_shared_subtrees() {
+    let mut parser = Parser::new();
+    parser.set_language(get_language("javascript")).unwrap();
+
+    // Each edit leaves most of the document's subtrees shared between the old
+    // and new trees, including ones beneath invisible nodes like statements and
+    // expressions, and ones that have aliases, like property identifiers. The
+    // changed ranges must still contain every position at which the stacks of
+    // visible nodes differ, including when a shared subtree is aliased
+    // differently in the new tree.
+    let function = "function f(a) { return {b: a, c, d: [a, c]}; }\n";
+    let cases = [
+        // Editing one of many identical functions.
+        (function.repeat(10), "return {b", 0, 0, "x + "),
+        // Turning an expression statement into a labeled statement.
+        (format!("a;\n{}", function.repeat(5)), "a;", 1, 0, ": b"),
+        // Turning an object into a destructuring pattern.
+        (
+            format!("{}({{b, c: [d, e]}});\n", function.repeat(5)),
+            "]})",
+            2,
+            0,
+            " = x",
+        ),
+        // Wrapping a shared subtree in parentheses.
+        (function.repeat(5), "[a, c]", 0, 0, "("),
+        // Deleting a function between two others.
+        (
+            function.repeat(5),
+            "function",
+            function.len(),
+            function.len(),
+            "",
+        ),
+    ];
+
+    for (source_code, substring, offset, deleted_length, inserted_text) in cases {
+        let mut source_code = source_code.into_bytes();
+        let mut tree = parser.parse(&source_code, None).unwrap();
+        let position = index_of(&source_code, substring) + offset;
+        let edit = Edit {
+            position,
+            deleted_length,
+            inserted_text: inserted_text.as_bytes().to_vec(),
+        };
+        perform_edit(&mut tree, &mut source_code, &edit);
+        let new_tree = parser.parse(&source_code, Some(&tree)).unwrap();
+        let ranges = tree.changed_ranges(&new_tree).collect::<Vec<_>>();
+        ScopeSequence::new(&tree)
+            .check_changes(&ScopeSequence::new(&new_tree), &source_code, &ranges)
+            .unwrap();
+        for range in &ranges {
+            assert!(range.end_byte <= source_code.len());
+        }
+    }
+}
+
+#[test]
+fn test_get_changed_nodes() {
+    let source_code = b"{a: null};\n".to_vec();
+
+    let mut parser = Parser::new();
+    parser.set_language(get_language("javascript")).unwrap();
+    let tree = parser.parse(&source_code, None).unwrap();
+
+    // Replacing a token with a token of a different type
+    {
+        let mut tree = tree.clone();
+        let mut source_code = source_code.clone();
+
+        // Replace `null` with `nothing` - one node is removed and another is inserted
+        let edit = Edit {
+            position: index_of(&source_code, "ull"),
+            deleted_length: 3,
+            inserted_text: b"othing".to_vec(),
+        };
+        let changes = get_changed_nodes(&mut parser, &mut tree, &mut source_code, edit);
+        assert_eq!(
+            changes,
+            vec![
+                (NodeChangeKind::Removed, Some("null"), None),
+                (NodeChangeKind::Inserted, None, Some("identifier")),
+            ]
+        );
+    }
+
+    // Changing the text of a token
+    {
+        let mut tree = tree.clone();
+        let mut source_code = source_code.clone();
+
+        // Replace `a` with `abc` - the node is modified
+        let edit = Edit {
+            position: index_of(&source_code, "a") + 1,
+            deleted_length: 0,
+            inserted_text: b"bc".to_vec(),
+        };
+        let changes = get_changed_nodes(&mut parser, &mut tree, &mut source_code, edit);
+        assert_eq!(
+            changes,
+            vec![(
+                NodeChangeKind::Modified,
+                Some("property_identifier"),
+                Some("property_identifier")
+            )]
+        );
+    }
+}
+
+#[test]
+fn test_tree_serialization() {
+    let mut source_code = b"def a():\n    return [1, 2]\n\nclass B:\n    pass\n".to_vec();
+
+    let mut parser = Parser::new();
+    parser.set_language(get_language("python")).unwrap();
+    let mut tree = parser.parse(&source_code, None).unwrap();
+
+    let data = tree.serialize();
+    let mut restored_tree = Tree::deserialize(get_language("python"), &data).unwrap();
+    assert_eq!(
+        restored_tree.root_node().to_sexp(),
+        tree.root_node().to_sexp()
+    );
+    assert_eq!(restored_tree.serialize(), data);
+
+    // The restored tree can be used for incremental parsing.
+    let edit = Edit {
+        position: index_of(&source_code, "2]") + 1,
+        deleted_length: 0,
+        inserted_text: b", 3".to_vec(),
+    };
+    let input_edit = perform_edit(&mut tree, &mut source_code, &edit);
+    restored_tree.edit(&input_edit);
+    let new_tree = parser.parse(&source_code, Some(&tree)).unwrap();
+    let new_restored_tree = parser.parse(&source_code, Some(&restored_tree)).unwrap();
+    assert_eq!(
+        new_restored_tree.root_node().to_sexp(),
+        new_tree.root_node().to_sexp()
+    );
+    assert_eq!(
+        restored_tree
+            .changed_ranges(&new_restored_tree)
+            .collect::<Vec<_>>(),
+        tree.changed_ranges(&new_tree).collect::<Vec<_>>()
+    );
+
+    // Incomplete data, and data from a different language, are rejected.
+    assert!(Tree::deserialize(get_language("python"), &data[0..data.len() - 1]).is_none());
+    assert!(Tree::deserialize(get_language("javascript"), &data).is_none());
+
+    // Trees of empty documents round-trip with the same node-level data, and
+    // can be reused for incremental parsing.
+    for language_name in ["python", "javascript", "json"] {
+        parser.set_language(get_language(language_name)).unwrap();
+        let mut source_code = Vec::new();
+        let mut tree = parser.parse(&source_code, None).unwrap();
+        let data = tree.serialize();
+        let mut restored_tree = Tree::deserialize(get_language(language_name), &data).unwrap();
+        assert_eq!(restored_tree.serialize(), data);
+
+        let root = tree.root_node();
+        let restored_root = restored_tree.root_node();
+        assert_eq!(restored_root.to_sexp(), root.to_sexp());
+        assert_eq!(restored_root.child_count(), root.child_count());
+        assert_eq!(restored_root.byte_range(), root.byte_range());
+        assert_eq!(restored_root.is_named(), root.is_named());
+        assert_eq!(restored_root.has_error(), root.has_error());
+
+        let edit = Edit {
+            position: 0,
+            deleted_length: 0,
+            inserted_text: b"1".to_vec(),
+        };
+        let input_edit = perform_edit(&mut tree, &mut source_code, &edit);
+        restored_tree.edit(&input_edit);
+        let new_tree = parser.parse(&source_code, Some(&tree)).unwrap();
+        let new_restored_tree = parser.parse(&source_code, Some(&restored_tree)).unwrap();
+        assert_eq!(
+            new_restored_tree.root_node().to_sexp(),
+            new_tree.root_node().to_sexp()
+        );
+    }
+}
+
+#[test]
+fn test_tree_serialization_with_a_different_language_of_the_same_size() {
+    // These grammars have the same numbers of symbols, states and productions,
+    // and differ only in the name of a symbol or a field.
+    let get_grammar_language = |grammar_name: &str, symbol_name: &str, field_name: &str| {
+        let (parser_name, parser_code) = generate_parser_for_grammar(&format!(
+            r#"
+            {{
+                "name": "{grammar_name}",
+                "extras": [{{"type": "PATTERN", "value": "\\s+"}}],
+                "rules": {{
+                    "program": {{"type": "REPEAT", "content": {{"type": "SYMBOL", "name": "pair"}}}},
+                    "pair": {{
+                        "type": "SEQ",
+                        "members": [
+                            {{
+                                "type": "FIELD",
+                                "name": "{field_name}",
+                                "content": {{"type": "SYMBOL", "name": "{symbol_name}"}}
+                            }},
+                            {{"type": "STRING", "value": ";"}}
+                        ]
+                    }},
+                    "{symbol_name}": {{"type": "PATTERN", "value": "[a-z]+"}}
+                }}
+            }}
+            "#
+        ))
+        .unwrap();
+        get_test_language(&parser_name, &parser_code, None)
+    };
+    let language = get_grammar_language("test_tree_serialization_a", "word", "name");
+    let renamed_symbol_language = get_grammar_language("test_tree_serialization_b", "term", "name");
+    let renamed_field_language = get_grammar_language("test_tree_serialization_c", "word", "label");
+    assert_eq!(
+        renamed_symbol_language.node_kind_count(),
+        language.node_kind_count()
+    );
+    assert_eq!(renamed_field_language.field_count(), language.field_count());
+
+    let mut parser = Parser::new();
+    parser.set_language(language).unwrap();
+    let tree = parser.parse("a; bc;", None).unwrap();
+    let data = tree.serialize();
+    assert!(Tree::deserialize(language, &data).is_some());
+    assert!(Tree::deserialize(renamed_symbol_language, &data).is_none());
+    assert!(Tree::deserialize(renamed_field_language, &data).is_none());
+}
+
+#[test]
+fn test_tree_memory_usage() {
+    let mut source_code = b"def a():\n    return [1, 2]\n\nclass B:\n    pass\n".to_vec();
+
+    let mut parser = Parser::new();
+    parser.set_language(get_language("python")).unwrap();
+    let mut tree = parser.parse(&source_code, None).unwrap();
+
+    let usage = tree.memory_usage();
+    assert!(usage.heap_node_count > 0);
+    assert!(usage.inline_leaf_count > 0);
+    assert_eq!(usage.shared_bytes, 0);
+    assert!(
+        usage.total_bytes
+            > usage.heap_node_bytes + usage.child_array_bytes + usage.external_scanner_state_bytes
+    );
+    assert!(tree_sitter::allocation_count() > 0);
+
+    // All of the nodes are shared with a copy of the tree.
+    let tree_copy = tree.clone();
+    let copy_usage = tree.memory_usage();
+    assert_eq!(
+        copy_usage.shared_bytes,
+        usage.heap_node_bytes + usage.child_array_bytes + usage.external_scanner_state_bytes
+    );
+    drop(tree_copy);
+    assert_eq!(tree.memory_usage(), usage);
+
+    // After an edit, the unchanged nodes are shared with the new tree.
+    let edit = Edit {
+        position: index_of(&source_code, "pass"),
+        deleted_length: 4,
+        inserted_text: b"b = 1".to_vec(),
+    };
+    perform_edit(&mut tree, &mut source_code, &edit);
+    let new_tree = parser.parse(&source_code, Some(&tree)).unwrap();
+    let new_usage = new_tree.memory_usage();
+    assert!(new_usage.shared_bytes > 0);
+    assert!(new_usage.shared_bytes < new_usage.total_bytes);
+}
+
+#[test]
+fn test_tree_delete_deferred() {
+    let source_code = "[".to_string() + &"{\"a\": [1, 2, 3]}, ".repeat(2000) + "null]";
+
+    let mut parser = Parser::new();
+    parser.set_language(get_language("json")).unwrap();
+    let tree = parser.parse(&source_code, None).unwrap();
+    let tree_copy = tree.clone();
+
+    // Deleting a tree whose nodes are shared with a copy leaves them intact.
+    let mut queue = DeletionQueue::new();
+    tree.delete_deferred(&mut queue);
+    assert!(queue.drain(0));
+    assert_eq!(tree_copy.root_node().named_child_count(), 2001);
+
+    // The nodes of an unshared tree are freed incrementally, and the queue can
+    // be drained on another thread.
+    tree_copy.delete_deferred(&mut queue);
+    let mut queue = std::thread::spawn(move || {
+        while !queue.drain(10) {}
+        queue
+    })
+    .join()
+    .unwrap();
+    assert!(queue.drain(0));
+}
+
 fn index_of(text: &Vec<u8>, substring: &str) -> usize {
     str::from_utf8(text.as_slice())
         .unwrap()
@@ -626,3 +1005,25 @@ fn get_changed_ranges(
     *tree = new_tree;
     result
 }
+
+fn get_changed_nodes(
+    parser: &mut Parser,
+    tree: &mut Tree,
+    source_code: &mut Vec<u8>,
+    edit: Edit,
+) -> Vec<(NodeChangeKind, Option<&'static str>, Option<&'static str>)> {
+    perform_edit(tree, source_code, &edit);
+    let new_tree = parser.parse(&source_code, Some(tree)).unwrap();
+    let result = tree
+        .changed_nodes(&new_tree)
+        .map(|change| {
+            (
+                change.kind,
+                change.old_node.map(|node| node.kind()),
+                change.new_node.map(|node| node.kind()),
+            )
+        })
+        .collect();
+    *tree = new_tree;
+    result
+}
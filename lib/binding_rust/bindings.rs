@@ -14,11 +14,26 @@ pub struct TSParser {
 }
 #[repr(C)]
 #[derive(Debug, Copy, Clone)]
+pub struct TSParserSnapshot {
+    _unused: [u8; 0],
+}
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct TSSubtreeCache {
+    _unused: [u8; 0],
+}
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
 pub struct TSTree {
     _unused: [u8; 0],
 }
 #[repr(C)]
 #[derive(Debug, Copy, Clone)]
+pub struct TSDeletionQueue {
+    _unused: [u8; 0],
+}
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
 pub struct TSQuery {
     _unused: [u8; 0],
 }
@@ -27,6 +42,11 @@ pub struct TSQuery {
 pub struct TSQueryCursor {
     _unused: [u8; 0],
 }
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct TSQuerySession {
+    _unused: [u8; 0],
+}
 pub const TSInputEncoding_TSInputEncodingUTF8: TSInputEncoding = 0;
 pub const TSInputEncoding_TSInputEncodingUTF16: TSInputEncoding = 1;
 pub type TSInputEncoding = ::std::os::raw::c_uint;
@@ -79,6 +99,30 @@ pub struct TSLogger {
 }
 #[repr(C)]
 #[derive(Debug, Copy, Clone)]
+pub struct TSAllocator {
+    pub payload: *mut ::std::os::raw::c_void,
+    pub allocate: ::std::option::Option<
+        unsafe extern "C" fn(
+            payload: *mut ::std::os::raw::c_void,
+            size: usize,
+        ) -> *mut ::std::os::raw::c_void,
+    >,
+    pub reallocate: ::std::option::Option<
+        unsafe extern "C" fn(
+            payload: *mut ::std::os::raw::c_void,
+            buffer: *mut ::std::os::raw::c_void,
+            size: usize,
+        ) -> *mut ::std::os::raw::c_void,
+    >,
+    pub deallocate: ::std::option::Option<
+        unsafe extern "C" fn(
+            payload: *mut ::std::os::raw::c_void,
+            buffer: *mut ::std::os::raw::c_void,
+        ),
+    >,
+}
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
 pub struct TSInputEdit {
     pub start_byte: u32,
     pub old_end_byte: u32,
@@ -96,11 +140,41 @@ pub struct TSNode {
 }
 #[repr(C)]
 #[derive(Debug, Copy, Clone)]
+pub struct TSStreamCallback {
+    pub payload: *mut ::std::os::raw::c_void,
+    pub node_completed: ::std::option::Option<
+        unsafe extern "C" fn(payload: *mut ::std::os::raw::c_void, node: TSNode),
+    >,
+}
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
 pub struct TSTreeCursor {
     pub tree: *const ::std::os::raw::c_void,
     pub id: *const ::std::os::raw::c_void,
     pub context: [u32; 2usize],
 }
+pub const TSNodeChangeType_TSNodeChangeTypeInserted: TSNodeChangeType = 0;
+pub const TSNodeChangeType_TSNodeChangeTypeRemoved: TSNodeChangeType = 1;
+pub const TSNodeChangeType_TSNodeChangeTypeModified: TSNodeChangeType = 2;
+pub type TSNodeChangeType = ::std::os::raw::c_uint;
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct TSNodeChange {
+    pub type_: TSNodeChangeType,
+    pub old_node: TSNode,
+    pub new_node: TSNode,
+}
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct TSTreeMemoryUsage {
+    pub heap_node_count: usize,
+    pub inline_leaf_count: usize,
+    pub heap_node_bytes: usize,
+    pub child_array_bytes: usize,
+    pub external_scanner_state_bytes: usize,
+    pub shared_bytes: usize,
+    pub total_bytes: usize,
+}
 #[repr(C)]
 #[derive(Debug, Copy, Clone)]
 pub struct TSQueryCapture {
@@ -121,6 +195,21 @@ pub struct TSQueryMatch {
     pub capture_count: u16,
     pub captures: *const TSQueryCapture,
 }
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct TSQuerySessionCapture {
+    pub range: TSRange,
+    pub symbol: TSSymbol,
+    pub index: u32,
+}
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct TSQuerySessionMatch {
+    pub id: u32,
+    pub pattern_index: u16,
+    pub capture_count: u16,
+    pub captures: *const TSQuerySessionCapture,
+}
 pub const TSQueryPredicateStepType_TSQueryPredicateStepTypeDone: TSQueryPredicateStepType = 0;
 pub const TSQueryPredicateStepType_TSQueryPredicateStepTypeCapture: TSQueryPredicateStepType = 1;
 pub const TSQueryPredicateStepType_TSQueryPredicateStepTypeString: TSQueryPredicateStepType = 2;
@@ -143,6 +232,10 @@ extern "C" {
     #[doc = " Create a new parser."]
     pub fn ts_parser_new() -> *mut TSParser;
 }
+extern "C" {
+    #[doc = " Create a new parser that allocates memory using the given allocator, instead\n of the functions passed to `ts_set_allocator`.\n\n The allocator is used for all of the parser's own memory, and for the trees\n that it produces, including their copies. The allocation functions must not\n return NULL, and are never passed a NULL buffer to deallocate. They are only\n called on the thread that is using the parser or tree.\n\n Because trees can only share nodes with trees that use the same allocator,\n an old tree that uses a different allocator is not reused when parsing, and\n a parser with its own allocator does not use a subtree cache."]
+    pub fn ts_parser_new_with_allocator(allocator: TSAllocator) -> *mut TSParser;
+}
 extern "C" {
     #[doc = " Delete the parser, freeing all of the memory that it used."]
     pub fn ts_parser_delete(parser: *mut TSParser);
@@ -168,7 +261,7 @@ extern "C" {
     pub fn ts_parser_included_ranges(self_: *const TSParser, length: *mut u32) -> *const TSRange;
 }
 extern "C" {
-    #[doc = " Use the parser to parse some source code and create a syntax tree.\n\n If you are parsing this document for the first time, pass `NULL` for the\n `old_tree` parameter. Otherwise, if you have already parsed an earlier\n version of this document and the document has since been edited, pass the\n previous syntax tree so that the unchanged parts of it can be reused.\n This will save time and memory. For this to work correctly, you must have\n already edited the old syntax tree using the `ts_tree_edit` function in a\n way that exactly matches the source code changes.\n\n The `TSInput` parameter lets you specify how to read the text. It has the\n following three fields:\n 1. `read`: A function to retrieve a chunk of text at a given byte offset\n    and (row, column) position. The function should return a pointer to the\n    text and write its length to the `bytes_read` pointer. The parser does\n    not take ownership of this buffer; it just borrows it until it has\n    finished reading it. The function should write a zero value to the\n    `bytes_read` pointer to indicate the end of the document.\n 2. `payload`: An arbitrary pointer that will be passed to each invocation\n    of the `read` function.\n 3. `encoding`: An indication of how the text is encoded. Either\n    `TSInputEncodingUTF8` or `TSInputEncodingUTF16`.\n\n This function returns a syntax tree on success, and `NULL` on failure. There\n are three possible reasons for failure:\n 1. The parser does not have a language assigned. Check for this using the\n`ts_parser_language` function.\n 2. Parsing was cancelled due to a timeout that was set by an earlier call to\n    the `ts_parser_set_timeout_micros` function. You can resume parsing from\n    where the parser left out by calling `ts_parser_parse` again with the\n    same arguments. Or you can start parsing from scratch by first calling\n    `ts_parser_reset`.\n 3. Parsing was cancelled using a cancellation flag that was set by an\n    earlier call to `ts_parser_set_cancellation_flag`. You can resume parsing\n    from where the parser left out by calling `ts_parser_parse` again with\n    the same arguments."]
+    #[doc = " Use the parser to parse some source code and create a syntax tree.\n\n If you are parsing this document for the first time, pass `NULL` for the\n `old_tree` parameter. Otherwise, if you have already parsed an earlier\n version of this document and the document has since been edited, pass the\n previous syntax tree so that the unchanged parts of it can be reused.\n This will save time and memory. For this to work correctly, you must have\n already edited the old syntax tree using the `ts_tree_edit` function in a\n way that exactly matches the source code changes.\n\n The `TSInput` parameter lets you specify how to read the text. It has the\n following three fields:\n 1. `read`: A function to retrieve a chunk of text at a given byte offset\n    and (row, column) position. The function should return a pointer to the\n    text and write its length to the `bytes_read` pointer. The parser does\n    not take ownership of this buffer; it just borrows it until it has\n    finished reading it. The function should write a zero value to the\n    `bytes_read` pointer to indicate the end of the document.\n 2. `payload`: An arbitrary pointer that will be passed to each invocation\n    of the `read` function.\n 3. `encoding`: An indication of how the text is encoded. Either\n    `TSInputEncodingUTF8` or `TSInputEncodingUTF16`.\n\n This function returns a syntax tree on success, and `NULL` on failure. There\n are four possible reasons for failure:\n 1. The parser does not have a language assigned. Check for this using the\n`ts_parser_language` function.\n 2. Parsing was cancelled due to a timeout that was set by an earlier call to\n    the `ts_parser_set_timeout_micros` function. You can resume parsing from\n    where the parser left out by calling `ts_parser_parse` again with the\n    same arguments. Or you can start parsing from scratch by first calling\n    `ts_parser_reset`.\n 3. Parsing was cancelled using a cancellation flag that was set by an\n    earlier call to `ts_parser_set_cancellation_flag`. You can resume parsing\n    from where the parser left out by calling `ts_parser_parse` again with\n    the same arguments.\n 4. Parsing exceeded the memory limit that was set by an earlier call to\n    the `ts_parser_set_memory_limit` function. Call `ts_parser_reset` to\n    free the memory used by the unfinished parse."]
     pub fn ts_parser_parse(
         self_: *mut TSParser,
         old_tree: *const TSTree,
@@ -194,10 +287,54 @@ extern "C" {
         encoding: TSInputEncoding,
     ) -> *mut TSTree;
 }
+extern "C" {
+    #[doc = " Use the parser to quickly produce a syntax tree for one range of a document,\n such as the part of a large file that is currently visible in an editor.\n\n Rather than parsing the document from its beginning, the parser starts at\n the beginning of the line that contains the start of the given range, and\n stops at the end of the range, so the time taken is independent of the size\n of the document. Any syntax errors caused by starting in the middle of a\n construct are handled by the parser's normal error recovery. If included\n ranges have been set on the parser, only the parts of them that overlap\n the given range are parsed.\n\n The resulting tree is marked as partial (see `ts_tree_is_partial`). To get\n a complete tree, parse the whole document separately, for example on a\n background thread, or in several steps using `ts_parser_set_timeout_micros`.\n A partial tree should not be passed as the old tree to `ts_parser_parse`.\n\n This function returns `NULL` if the parser has no language, if the range\n does not overlap the parser's included ranges, if the parse is halted by a\n timeout or cancellation, or if the parser has an outstanding parse that\n has not been completed or reset. A halted partial parse is not resumed."]
+    pub fn ts_parser_parse_partial(
+        self_: *mut TSParser,
+        input: TSInput,
+        range: TSRange,
+    ) -> *mut TSTree;
+}
+extern "C" {
+    #[doc = " Set the callback that the parser should use to report complete syntax nodes\n while parsing a stream of text with `ts_parser_feed`.\n\n The parser does not take ownership over the callback payload."]
+    pub fn ts_parser_set_stream_callback(self_: *mut TSParser, callback: TSStreamCallback);
+}
+extern "C" {
+    #[doc = " Get the parser's current stream callback."]
+    pub fn ts_parser_stream_callback(self_: *const TSParser) -> TSStreamCallback;
+}
+extern "C" {
+    #[doc = " Provide the parser with the next chunk of a stream of UTF8 text, and parse as\n much of the stream as possible.\n\n This can be used to parse a document that is too large to keep in memory,\n such as a log file or a stream of data from a network connection. Whenever\n the parser has completed some top-level nodes of the document, it passes\n them to the stream callback (see `ts_parser_set_stream_callback`), and then\n frees the memory that they used. A node passed to the callback is only valid\n until the callback returns. The parser only keeps the text that it may still\n need, so the memory used by a stream is bounded by the size of the largest\n top-level node, rather than the size of the whole document.\n\n Nodes are only reported when the top level of the grammar consists of a\n repetition of nodes, and while the parser is not considering more than one\n interpretation of the text. Otherwise, they remain in the tree returned by\n `ts_parser_finish`.\n\n This function returns `false` if the parser has no language, if it has\n included ranges that do not cover the entire stream, if the stream has\n already been finished, or if parsing was halted by a timeout or a\n cancellation. In the last case, the text is kept, and parsing can be resumed\n by calling `ts_parser_feed` again, with or without more text."]
+    pub fn ts_parser_feed(
+        self_: *mut TSParser,
+        bytes: *const ::std::os::raw::c_char,
+        length: u32,
+    ) -> bool;
+}
+extern "C" {
+    #[doc = " Mark the end of a stream of text that was provided using `ts_parser_feed`,\n and finish parsing it.\n\n The returned syntax tree contains the nodes that have not already been\n passed to the stream callback. Those nodes are replaced with a single hidden\n node, so the positions of all of the nodes in the tree are relative to the\n start of the stream. Afterwards, the parser is ready to parse a new stream.\n\n Like `ts_parser_parse`, this returns `NULL` if the parser has no language or\n if parsing was halted by a timeout or a cancellation, in which case it can be\n resumed by calling `ts_parser_finish` again."]
+    pub fn ts_parser_finish(self_: *mut TSParser) -> *mut TSTree;
+}
 extern "C" {
     #[doc = " Instruct the parser to start the next parse from the beginning.\n\n If the parser previously failed because of a timeout or a cancellation, then\n by default, it will resume where it left off on the next call to\n `ts_parser_parse` or other parsing functions. If you don't want to resume,\n and instead intend to use this parser to parse some other document, you must\n call `ts_parser_reset` first."]
     pub fn ts_parser_reset(self_: *mut TSParser);
 }
+extern "C" {
+    #[doc = " Capture the state of a parse that is in progress, so that it can later be\n resumed from the same point using `ts_parser_restore`.\n\n A parse is left in progress when it is halted by a timeout or a cancellation\n flag. Snapshots are cheap to create, because the syntax nodes that have\n already been produced are shared with the parser rather than copied. This can\n be used to checkpoint the parsing of a long document, so that after an edit,\n parsing can resume from the nearest checkpoint that precedes the edit,\n instead of from the beginning of the document.\n\n The snapshot must be freed with `ts_parser_snapshot_delete`."]
+    pub fn ts_parser_snapshot(self_: *mut TSParser) -> *mut TSParserSnapshot;
+}
+extern "C" {
+    #[doc = " Get the furthest byte offset that the parser had consumed when the snapshot\n was taken.\n\n Parsing can only be resumed from a snapshot if none of the text before this\n offset has changed. Because the lexer may have looked at some text beyond\n the tokens that it returned, it is safest to use a snapshot whose offset is\n some distance before the first change."]
+    pub fn ts_parser_snapshot_byte_offset(self_: *const TSParserSnapshot) -> u32;
+}
+extern "C" {
+    #[doc = " Restore the parser to the state captured in the given snapshot. The next call\n to `ts_parser_parse` will resume parsing from that point.\n\n If the snapshot was taken from a parser with a different language, the\n parser is left unchanged and this function returns `false`. Otherwise, it\n returns `true`. A snapshot can be restored any number of times."]
+    pub fn ts_parser_restore(self_: *mut TSParser, snapshot: *const TSParserSnapshot) -> bool;
+}
+extern "C" {
+    #[doc = " Delete a parser snapshot, freeing all of the memory that it used."]
+    pub fn ts_parser_snapshot_delete(self_: *mut TSParserSnapshot);
+}
 extern "C" {
     #[doc = " Set the maximum duration in microseconds that parsing should be allowed to\n take before halting.\n\n If parsing takes longer than this, it will halt early, returning NULL.\n See `ts_parser_parse` for more information."]
     pub fn ts_parser_set_timeout_micros(self_: *mut TSParser, timeout: u64);
@@ -206,6 +343,18 @@ extern "C" {
     #[doc = " Get the duration in microseconds that parsing is allowed to take."]
     pub fn ts_parser_timeout_micros(self_: *const TSParser) -> u64;
 }
+extern "C" {
+    #[doc = " Set the maximum number of bytes that parsing should be allowed to use\n before halting, or zero for no limit.\n\n This limits the memory that is measured by `ts_parser_memory_usage`.\n Ambiguous or erroneous input can cause this to grow far more quickly than\n the input itself. The limit is checked periodically, so it may be exceeded\n by a small amount. If it is exceeded, parsing will halt early, returning\n NULL. See `ts_parser_parse` for more information."]
+    pub fn ts_parser_set_memory_limit(self_: *mut TSParser, bytes: usize);
+}
+extern "C" {
+    #[doc = " Get the number of bytes that parsing is allowed to use."]
+    pub fn ts_parser_memory_limit(self_: *const TSParser) -> usize;
+}
+extern "C" {
+    #[doc = " Get the number of bytes used by the parser's current parse.\n\n This counts the parse stack, and the syntax nodes that the parse has\n created and not yet handed off to a finished tree or a snapshot. It\n returns to its original value once a parse has finished, or once the\n parser has been reset."]
+    pub fn ts_parser_memory_usage(self_: *const TSParser) -> usize;
+}
 extern "C" {
     #[doc = " Set the parser's current cancellation flag pointer.\n\n If a non-null pointer is assigned, then the parser will periodically read\n from this pointer during parsing. If it reads a non-zero value, it will\n halt early, returning NULL. See `ts_parser_parse` for more information."]
     pub fn ts_parser_set_cancellation_flag(self_: *mut TSParser, flag: *const usize);
@@ -214,6 +363,38 @@ extern "C" {
     #[doc = " Get the parser's current cancellation flag pointer."]
     pub fn ts_parser_cancellation_flag(self_: *const TSParser) -> *const usize;
 }
+extern "C" {
+    #[doc = " Create a new, empty subtree cache.\n\n A subtree cache allows syntax nodes to be shared between trees that contain\n identical regions of text, such as license headers, generated code, or\n vendored libraries. When a parser is given a cache, then after each parse,\n it adds the larger nodes of the new tree to the cache. When parsing later\n documents, it reuses those nodes wherever the same text appears in the same\n parse state, instead of parsing that text again. Reused nodes are shared\n rather than copied, so this also reduces the memory used by the trees.\n\n The cache keeps a copy of the text of each cached node, which is compared to\n the current text before the node is reused. When the memory used by the\n cache exceeds its limit (see `ts_subtree_cache_set_memory_limit`), the\n nodes that were least recently added or reused are removed.\n\n A cache can be shared by any number of parsers, but it must not be used by\n more than one parser at a time. It is only used when the parser's included\n ranges span the entire document, and it is not used when parsing a stream\n of text with `ts_parser_feed`.\n\n The cache must be freed with `ts_subtree_cache_delete`."]
+    pub fn ts_subtree_cache_new() -> *mut TSSubtreeCache;
+}
+extern "C" {
+    #[doc = " Set the maximum number of bytes that a subtree cache may use, or zero for no\n limit. The default limit is 64 MiB.\n\n This counts the copies of text that the cache keeps, and the syntax nodes\n that it keeps alive, even if they are also used by other trees. The limit is\n checked after each parse that adds nodes to the cache, so it may be exceeded\n until then."]
+    pub fn ts_subtree_cache_set_memory_limit(self_: *mut TSSubtreeCache, bytes: usize);
+}
+extern "C" {
+    #[doc = " Get the number of bytes that a subtree cache is allowed to use."]
+    pub fn ts_subtree_cache_memory_limit(self_: *const TSSubtreeCache) -> usize;
+}
+extern "C" {
+    #[doc = " Get the number of bytes that a subtree cache is currently using."]
+    pub fn ts_subtree_cache_memory_usage(self_: *const TSSubtreeCache) -> usize;
+}
+extern "C" {
+    #[doc = " Remove all of the nodes from a subtree cache."]
+    pub fn ts_subtree_cache_clear(self_: *mut TSSubtreeCache);
+}
+extern "C" {
+    #[doc = " Delete a subtree cache, freeing all of the memory that it used. Any trees\n that share nodes with the cache are unaffected."]
+    pub fn ts_subtree_cache_delete(self_: *mut TSSubtreeCache);
+}
+extern "C" {
+    #[doc = " Set the subtree cache that the parser should use, or pass NULL to stop\n using a cache. The parser does not take ownership of the cache."]
+    pub fn ts_parser_set_subtree_cache(self_: *mut TSParser, cache: *mut TSSubtreeCache);
+}
+extern "C" {
+    #[doc = " Get the parser's current subtree cache."]
+    pub fn ts_parser_subtree_cache(self_: *const TSParser) -> *mut TSSubtreeCache;
+}
 extern "C" {
     #[doc = " Set the logger that a parser should use during parsing.\n\n The parser does not take ownership over the logger payload. If a logger was\n previously assigned, the caller is responsible for releasing any memory\n owned by the previous logger."]
     pub fn ts_parser_set_logger(self_: *mut TSParser, logger: TSLogger);
@@ -234,6 +415,22 @@ extern "C" {
     #[doc = " Delete the syntax tree, freeing all of the memory that it used."]
     pub fn ts_tree_delete(self_: *mut TSTree);
 }
+extern "C" {
+    #[doc = " Delete the syntax tree without freeing the memory used by its nodes. Any\n nodes that are not shared with other trees are added to the given deletion\n queue, and are freed when the queue is drained. This takes constant time,\n so it can be used to avoid stalling a latency-sensitive thread when deleting\n a large tree."]
+    pub fn ts_tree_delete_deferred(self_: *mut TSTree, queue: *mut TSDeletionQueue);
+}
+extern "C" {
+    #[doc = " Create a queue for freeing the memory of deleted syntax trees incrementally.\n\n The queue is not thread safe, but it can be drained on a different thread\n from the one that adds trees to it, as long as the two threads do not use\n it at the same time."]
+    pub fn ts_deletion_queue_new() -> *mut TSDeletionQueue;
+}
+extern "C" {
+    #[doc = " Free the memory used by the trees in the deletion queue, stopping once the\n given number of microseconds have elapsed. Pass zero to free everything.\n\n Returns true if the queue is now empty."]
+    pub fn ts_deletion_queue_drain(self_: *mut TSDeletionQueue, timeout_micros: u64) -> bool;
+}
+extern "C" {
+    #[doc = " Delete a deletion queue, freeing all of the memory that remains in it."]
+    pub fn ts_deletion_queue_delete(self_: *mut TSDeletionQueue);
+}
 extern "C" {
     #[doc = " Get the root node of the syntax tree."]
     pub fn ts_tree_root_node(self_: *const TSTree) -> TSNode;
@@ -250,6 +447,10 @@ extern "C" {
     #[doc = " Get the language that was used to parse the syntax tree."]
     pub fn ts_tree_language(arg1: *const TSTree) -> *const TSLanguage;
 }
+extern "C" {
+    #[doc = " Check whether the syntax tree was produced by `ts_parser_parse_partial`,\n and therefore only describes part of the document."]
+    pub fn ts_tree_is_partial(self_: *const TSTree) -> bool;
+}
 extern "C" {
     #[doc = " Get the array of included ranges that was used to parse the syntax tree.\n\n The returned pointer must be freed by the caller."]
     pub fn ts_tree_included_ranges(arg1: *const TSTree, length: *mut u32) -> *mut TSRange;
@@ -258,6 +459,10 @@ extern "C" {
     #[doc = " Edit the syntax tree to keep it in sync with source code that has been\n edited.\n\n You must describe the edit both in terms of byte offsets and in terms of\n (row, column) coordinates."]
     pub fn ts_tree_edit(self_: *mut TSTree, edit: *const TSInputEdit);
 }
+extern "C" {
+    #[doc = " Edit the syntax tree to reflect several source code changes at once.\n\n Every edit must be described in terms of the document as it was *before*\n any of the edits in the batch were made, and the edits must not overlap.\n They do not need to be given in any particular order. The result is the\n same as calling `ts_tree_edit` for each edit, in order from the last edit\n in the document to the first, but the tree is only traversed once, and each\n affected node is only copied once.\n\n If the edits overlap, the tree is left unchanged and this function returns\n `false`. Otherwise, it returns `true`."]
+    pub fn ts_tree_edit_batch(self_: *mut TSTree, edits: *const TSInputEdit, count: u32) -> bool;
+}
 extern "C" {
     #[doc = " Compare an old edited syntax tree to a new syntax tree representing the same\n document, returning an array of ranges whose syntactic structure has changed.\n\n For this to work correctly, the old syntax tree must have been edited such\n that its ranges match up to the new tree. Generally, you'll want to call\n this function right after calling one of the `ts_parser_parse` functions.\n You need to pass the old tree that was passed to parse, as well as the new\n tree that was returned from that function.\n\n The returned array is allocated using `malloc` and the caller is responsible\n for freeing it using `free`. The length of the array will be written to the\n given `length` pointer."]
     pub fn ts_tree_get_changed_ranges(
@@ -266,6 +471,31 @@ extern "C" {
         length: *mut u32,
     ) -> *mut TSRange;
 }
+extern "C" {
+    #[doc = " Compare an old edited syntax tree to a new syntax tree representing the same\n document, returning an array of the nodes that have changed.\n\n The comparison is performed in the same way as for\n `ts_tree_get_changed_ranges`, and the same requirements apply to the old\n tree. Each change refers to the smallest visible nodes that differ:\n `TSNodeChangeTypeInserted` changes only have a `new_node`,\n `TSNodeChangeTypeRemoved` changes only have an `old_node`, and\n `TSNodeChangeTypeModified` changes have both nodes, which are of the same\n type, but whose contents may have changed. Nodes of one type that were\n replaced by nodes of another type are reported as removed and inserted.\n The absent node of each change is a null node.\n\n The returned array is allocated using `malloc` and the caller is responsible\n for freeing it using `free`. The length of the array will be written to the\n given `length` pointer. The returned nodes are only valid for as long as\n their respective trees are."]
+    pub fn ts_tree_get_changed_nodes(
+        old_tree: *const TSTree,
+        new_tree: *const TSTree,
+        length: *mut u32,
+    ) -> *mut TSNodeChange;
+}
+extern "C" {
+    #[doc = " Serialize a syntax tree into a compact binary format, so that it can be\n stored, for example in a cache that persists across runs of a program, and\n later restored using `ts_tree_deserialize`.\n\n The format does not depend on the memory layout of the tree, and contains\n everything that is needed to use the restored tree as the old tree when\n reparsing an edited document. It does not contain the document's text.\n\n The returned buffer is allocated using `malloc` and the caller is\n responsible for freeing it using `free`. The length of the buffer will be\n written to the given `length` pointer."]
+    pub fn ts_tree_serialize(self_: *const TSTree, length: *mut u32)
+        -> *mut ::std::os::raw::c_char;
+}
+extern "C" {
+    #[doc = " Restore a syntax tree that was serialized using `ts_tree_serialize`.\n\n The data is only read during this call, so it can be a temporary buffer or a\n memory-mapped file. The resulting tree is equivalent to the original one, and\n can be passed as the old tree to `ts_parser_parse` after being edited to\n match any changes that have been made to the document since it was\n serialized.\n\n This returns `NULL` if the data is not a valid serialized tree, if it was\n written by an incompatible version of the library, or if the tree was\n produced by a different language than the one given."]
+    pub fn ts_tree_deserialize(
+        language: *const TSLanguage,
+        data: *const ::std::os::raw::c_char,
+        length: u32,
+    ) -> *mut TSTree;
+}
+extern "C" {
+    #[doc = " Measure the memory used by a syntax tree, and write the results to the\n given `TSTreeMemoryUsage` struct.\n\n Small leaf nodes are stored inline within their parents, so they do not\n use any memory of their own. The remaining nodes are allocated on the heap,\n along with the arrays of their children and any external scanner state\n that is too large to be stored inline.\n\n Trees share nodes with each other, both when they are copied using\n `ts_tree_copy` and when they are produced by reparsing an old tree. The\n `shared_bytes` field counts the memory of the nodes that are also used\n elsewhere, which would not be freed by deleting this tree. The\n `total_bytes` field includes the memory of the tree itself."]
+    pub fn ts_tree_memory_usage(self_: *const TSTree, usage: *mut TSTreeMemoryUsage);
+}
 extern "C" {
     #[doc = " Write a DOT graph describing the syntax tree to the given file."]
     pub fn ts_tree_print_dot_graph(arg1: *const TSTree, file_descriptor: ::std::os::raw::c_int);
@@ -470,6 +700,38 @@ extern "C" {
     #[doc = " Delete a query, freeing all of the memory that it used."]
     pub fn ts_query_delete(arg1: *mut TSQuery);
 }
+extern "C" {
+    #[doc = " Serialize a query into a compact binary format, so that it can be stored,
+ for example in a cache that persists across runs of a program, and later
+ restored using `ts_query_deserialize`, without parsing and analyzing its
+ source again.
+
+ Any captures or patterns that have been disabled remain disabled in the
+ restored query.
+
+ The returned buffer is allocated using `malloc` and the caller is
+ responsible for freeing it using `free`. The length of the buffer will be
+ written to the given `length` pointer."]
+    pub fn ts_query_serialize(
+        self_: *const TSQuery,
+        length: *mut u32,
+    ) -> *mut ::std::os::raw::c_char;
+}
+extern "C" {
+    #[doc = " Restore a query that was serialized using `ts_query_serialize`.
+
+ The data is only read during this call, so it can be a temporary buffer or a
+ memory-mapped file.
+
+ This returns `NULL` if the data is not a valid serialized query, if it was
+ written by an incompatible version of the library, or if the query was
+ created for a different language than the one given."]
+    pub fn ts_query_deserialize(
+        language: *const TSLanguage,
+        data: *const ::std::os::raw::c_char,
+        length: u32,
+    ) -> *mut TSQuery;
+}
 extern "C" {
     #[doc = " Get the number of patterns, captures, or string literals in the query."]
     pub fn ts_query_pattern_count(arg1: *const TSQuery) -> u32;
@@ -540,6 +802,10 @@ extern "C" {
     #[doc = " Create a new cursor for executing a given query.\n\n The cursor stores the state that is needed to iteratively search\n for matches. To use the query cursor, first call `ts_query_cursor_exec`\n to start running a given query on a given syntax node. Then, there are\n two options for consuming the results of the query:\n 1. Repeatedly call `ts_query_cursor_next_match` to iterate over all of the\n    *matches* in the order that they were found. Each match contains the\n    index of the pattern that matched, and an array of captures. Because\n    multiple patterns can match the same set of nodes, one match may contain\n    captures that appear *before* some of the captures from a previous match.\n 2. Repeatedly call `ts_query_cursor_next_capture` to iterate over all of the\n    individual *captures* in the order that they appear. This is useful if\n    don't care about which pattern matched, and just want a single ordered\n    sequence of captures.\n\n If you don't care about consuming all of the results, you can stop calling\n `ts_query_cursor_next_match` or `ts_query_cursor_next_capture` at any point.\n  You can then start executing another query on another node by calling\n  `ts_query_cursor_exec` again."]
     pub fn ts_query_cursor_new() -> *mut TSQueryCursor;
 }
+extern "C" {
+    #[doc = " Create a new query cursor that allocates memory using the given allocator,\n instead of the functions passed to `ts_set_allocator`. See\n `ts_parser_new_with_allocator` for the requirements of the allocator."]
+    pub fn ts_query_cursor_new_with_allocator(allocator: TSAllocator) -> *mut TSQueryCursor;
+}
 extern "C" {
     #[doc = " Delete a query cursor, freeing all of the memory that it used."]
     pub fn ts_query_cursor_delete(arg1: *mut TSQueryCursor);
@@ -548,6 +814,19 @@ extern "C" {
     #[doc = " Start running a given query on a given node."]
     pub fn ts_query_cursor_exec(arg1: *mut TSQueryCursor, arg2: *const TSQuery, arg3: TSNode);
 }
+extern "C" {
+    #[doc = " Start running several queries on a given node, in a single walk of the tree.\n\n This is faster than running each query with its own cursor, because the\n tree is only traversed once. Matches and captures are returned in the same\n order as if the queries' patterns were all in one query, in the order of the\n given queries. Use `ts_query_cursor_next_query_match` or\n `ts_query_cursor_next_query_capture` to find out which query a match belongs\n to. A match's pattern index and capture indices refer to the patterns and\n captures of that query.\n\n The queries must not be modified or deleted while the cursor is running them.\n This returns `false` and leaves the cursor unchanged if the queries are for\n different languages, or if there are too many patterns altogether."]
+    pub fn ts_query_cursor_exec_queries(
+        arg1: *mut TSQueryCursor,
+        queries: *const *const TSQuery,
+        query_count: u32,
+        arg2: TSNode,
+    ) -> bool;
+}
+extern "C" {
+    #[doc = " Give a query cursor access to the source code of the tree that it is\n querying, so that it can evaluate the `#eq?`, `#not-eq?`, `#match?` and\n `#not-match?` predicates itself. Matches that fail these predicates are\n then discarded as soon as they finish, and are never returned.\n\n Regexes are searched for with a small built-in regex engine. Predicates with\n regexes that it does not support, or whose result depends on how `\\d`, `\\w`\n or `\\s` treat non-ASCII characters, are still left to the caller.\n\n The text is read using the given input, which must use the UTF-8 encoding.\n Pass an input whose `read` function is `NULL` to stop evaluating\n predicates. The input is kept across calls to `ts_query_cursor_exec`."]
+    pub fn ts_query_cursor_set_text_input(arg1: *mut TSQueryCursor, arg2: TSInput);
+}
 extern "C" {
     #[doc = " Manage the maximum number of in-progress matches allowed by this query\n cursor.\n\n Query cursors have an optional maximum capacity for storing lists of\n in-progress captures. If this capacity is exceeded, then the\n earliest-starting match will silently be dropped to make room for further\n matches. This maximum capacity is optional — by default, query cursors allow\n any number of pending matches, dynamically allocating new space for them as\n needed as the query is executed."]
     pub fn ts_query_cursor_did_exceed_match_limit(arg1: *const TSQueryCursor) -> bool;
@@ -558,6 +837,14 @@ extern "C" {
 extern "C" {
     pub fn ts_query_cursor_set_match_limit(arg1: *mut TSQueryCursor, arg2: u32);
 }
+extern "C" {
+    #[doc = " Set the maximum number of bytes that a query cursor may use for storing the\n captures of in-progress matches, or zero for no limit.\n\n The captures of all in-progress matches are stored together in one\n contiguous block of memory, which grows as needed. If this limit would be\n exceeded, then the earliest-starting match will be dropped to make room for\n further captures, just as when the match limit is exceeded, and\n `ts_query_cursor_did_exceed_match_limit` will return true."]
+    pub fn ts_query_cursor_set_capture_memory_limit(self_: *mut TSQueryCursor, bytes: usize);
+}
+extern "C" {
+    #[doc = " Get the number of bytes that a query cursor may use for storing captures."]
+    pub fn ts_query_cursor_capture_memory_limit(self_: *const TSQueryCursor) -> usize;
+}
 extern "C" {
     #[doc = " Set the range of bytes or (row, column) positions in which the query\n will be executed."]
     pub fn ts_query_cursor_set_byte_range(arg1: *mut TSQueryCursor, arg2: u32, arg3: u32);
@@ -565,6 +852,14 @@ extern "C" {
 extern "C" {
     pub fn ts_query_cursor_set_point_range(arg1: *mut TSQueryCursor, arg2: TSPoint, arg3: TSPoint);
 }
+extern "C" {
+    #[doc = " Set the range of bytes in which matches are allowed to start.\n\n A match starts where the node matched by the first step of its pattern\n starts. Unlike `ts_query_cursor_set_byte_range`, this doesn't cut off\n matches that start within the range but extend past its end, and it never\n returns a match that starts before the range. So running a query separately\n over several adjacent ranges finds each match exactly once, which makes it\n possible to split one large tree between several cursors, for example on\n different threads.\n\n An end byte of zero means that the range is unbounded."]
+    pub fn ts_query_cursor_set_match_start_byte_range(
+        arg1: *mut TSQueryCursor,
+        start_byte: u32,
+        end_byte: u32,
+    );
+}
 extern "C" {
     #[doc = " Advance to the next match of the currently running query.\n\n If there is a match, write it to `*match` and return `true`.\n Otherwise, return `false`."]
     pub fn ts_query_cursor_next_match(arg1: *mut TSQueryCursor, match_: *mut TSQueryMatch) -> bool;
@@ -572,6 +867,14 @@ extern "C" {
 extern "C" {
     pub fn ts_query_cursor_remove_match(arg1: *mut TSQueryCursor, id: u32);
 }
+extern "C" {
+    #[doc = " Advance to the next match, like `ts_query_cursor_next_match`, and write the\n index of the query that it belongs to to `*query_index`. This is only needed\n for cursors that were started with `ts_query_cursor_exec_queries`. For other\n cursors, the query index is always zero."]
+    pub fn ts_query_cursor_next_query_match(
+        arg1: *mut TSQueryCursor,
+        match_: *mut TSQueryMatch,
+        query_index: *mut u32,
+    ) -> bool;
+}
 extern "C" {
     #[doc = " Advance to the next capture of the currently running query.\n\n If there is a capture, write its match to `*match` and its index within\n the matche's capture list to `*capture_index`. Otherwise, return `false`."]
     pub fn ts_query_cursor_next_capture(
@@ -580,10 +883,59 @@ extern "C" {
         capture_index: *mut u32,
     ) -> bool;
 }
+extern "C" {
+    #[doc = " Advance to the next capture, like `ts_query_cursor_next_capture`, and write\n the index of the query that its match belongs to to `*query_index`."]
+    pub fn ts_query_cursor_next_query_capture(
+        arg1: *mut TSQueryCursor,
+        match_: *mut TSQueryMatch,
+        capture_index: *mut u32,
+        query_index: *mut u32,
+    ) -> bool;
+}
 extern "C" {
     #[doc = " Set the maximum start depth for a cursor.\n\n This prevents cursors from exploring children nodes at a certain depth.\n Note if a pattern includes many children, then they will still be checked.\n\n Set to `0` to remove the maximum start depth."]
     pub fn ts_query_cursor_set_max_start_depth(arg1: *mut TSQueryCursor, arg2: u32);
 }
+extern "C" {
+    #[doc = " Create a new query session, which keeps track of the matches of a query\n in a document as it is edited and reparsed.\n\n Rather than running the query over the whole tree after every change, a\n session only searches the ranges that were edited or whose syntactic\n structure changed, and reports which matches were added and removed.\n Matches that extend past those ranges, like the matches of non-local\n patterns, are found as well. Because a session outlives the trees that it is\n given, it describes each capture by its position and node type, not by its\n node. Matches without any captures are not tracked.\n\n The query must not be modified or deleted while the session is in use."]
+    pub fn ts_query_session_new(query: *const TSQuery) -> *mut TSQuerySession;
+}
+extern "C" {
+    #[doc = " Delete a query session, freeing all of the memory that it used."]
+    pub fn ts_query_session_delete(arg1: *mut TSQuerySession);
+}
+extern "C" {
+    #[doc = " Give a query session access to the source code of the document, so that it\n can evaluate text predicates like `ts_query_cursor_set_text_input`. The\n input must describe the text of the tree that is passed to the next call to\n `ts_query_session_update`. Any predicates that the session can't evaluate\n itself are ignored."]
+    pub fn ts_query_session_set_text_input(arg1: *mut TSQuerySession, arg2: TSInput);
+}
+extern "C" {
+    #[doc = " Keep a query session in sync with source code that has been edited.\n\n Every edit that is passed to `ts_tree_edit` for the tree that will be\n reparsed must also be passed to this function, before the session is\n updated with the new tree."]
+    pub fn ts_query_session_edit(arg1: *mut TSQuerySession, edit: *const TSInputEdit);
+}
+extern "C" {
+    #[doc = " Update a query session to reflect a new syntax tree.\n\n The first time that a session is updated, it runs its query over the whole\n tree, and every match is reported as added. After that, each tree must be\n the result of reparsing the previous one, after it was edited in the same\n way as the session."]
+    pub fn ts_query_session_update(arg1: *mut TSQuerySession, tree: *const TSTree);
+}
+extern "C" {
+    #[doc = " Get the matches of a query session's query in its current tree.\n\n The matches are ordered by the start of their first capture. Each match\n keeps the same id for as long as it exists in the session's trees.\n The returned array is owned by the session, and remains valid until the next\n call to `ts_query_session_edit` or `ts_query_session_update`. The length of\n the array will be written to the given `count` pointer."]
+    pub fn ts_query_session_matches(
+        arg1: *const TSQuerySession,
+        count: *mut u32,
+    ) -> *const TSQuerySessionMatch;
+}
+extern "C" {
+    #[doc = " Get the matches that were added or removed by the last call to\n `ts_query_session_update`.\n\n The positions of both kinds of matches refer to the document at the time of\n that update. The returned arrays are owned by the session, and remain valid\n until the next call to `ts_query_session_update`."]
+    pub fn ts_query_session_added_matches(
+        arg1: *const TSQuerySession,
+        count: *mut u32,
+    ) -> *const TSQuerySessionMatch;
+}
+extern "C" {
+    pub fn ts_query_session_removed_matches(
+        arg1: *const TSQuerySession,
+        count: *mut u32,
+    ) -> *const TSQuerySessionMatch;
+}
 extern "C" {
     #[doc = " Get the number of distinct node types in the language."]
     pub fn ts_language_symbol_count(arg1: *const TSLanguage) -> u32;
@@ -649,6 +1001,14 @@ extern "C" {
         new_free: ::std::option::Option<unsafe extern "C" fn(arg1: *mut ::std::os::raw::c_void)>,
     );
 }
+extern "C" {
+    #[doc = " Enable or disable counting the blocks of memory that the library allocates.\n\n Counting is disabled by default, because it adds an atomic operation to\n every allocation and deallocation. For the count to be exact, enable it\n before the library allocates any memory, and leave it enabled. Otherwise,\n blocks that are allocated and freed while counting is in different states\n make the count inaccurate."]
+    pub fn ts_set_allocation_counting(enabled: bool);
+}
+extern "C" {
+    #[doc = " Get the number of blocks of memory that the library has allocated and not\n yet freed, across all threads, while allocation counting was enabled (see\n `ts_set_allocation_counting`).\n\n Memory that is returned to the caller, such as the string returned by\n `ts_node_string`, is not included, because it is freed by the caller."]
+    pub fn ts_allocation_count() -> usize;
+}
 
 pub const TREE_SITTER_LANGUAGE_VERSION: usize = 14;
 pub const TREE_SITTER_MIN_COMPATIBLE_LANGUAGE_VERSION: usize = 13;
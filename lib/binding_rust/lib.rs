@@ -9,13 +9,13 @@ use std::{
     ffi::CStr,
     fmt, hash, iter,
     marker::PhantomData,
-    mem::MaybeUninit,
+    mem::{ManuallyDrop, MaybeUninit},
     ops,
     os::raw::{c_char, c_void},
     ptr::{self, NonNull},
     slice, str,
-    sync::atomic::AtomicUsize,
-    u16,
+    sync::atomic::{AtomicUsize, Ordering},
+    thread, u16,
 };
 
 /// The latest ABI version that is supported by the current version of the
@@ -35,6 +35,24 @@ pub const MIN_COMPATIBLE_LANGUAGE_VERSION: usize = ffi::TREE_SITTER_MIN_COMPATIB
 
 pub const PARSER_HEADER: &'static str = include_str!("../include/tree_sitter/parser.h");
 
+/// Enable or disable counting the blocks of memory that Tree-sitter allocates.
+///
+/// Counting is disabled by default, because it adds an atomic operation to every
+/// allocation and deallocation. For the count to be exact, enable it before
+/// Tree-sitter allocates any memory, and leave it enabled.
+#[doc(alias = "ts_set_allocation_counting")]
+pub fn set_allocation_counting(enabled: bool) {
+    unsafe { ffi::ts_set_allocation_counting(enabled) }
+}
+
+/// Get the number of blocks of memory that Tree-sitter has allocated and not yet
+/// freed, across all threads, while allocation counting was enabled (see
+/// [set_allocation_counting]).
+#[doc(alias = "ts_allocation_count")]
+pub fn allocation_count() -> usize {
+    unsafe { ffi::ts_allocation_count() }
+}
+
 /// An opaque object that defines how to parse a particular language. The code for each
 /// `Language` is generated by the Tree-sitter CLI.
 #[doc(alias = "TSLanguage")]
@@ -82,10 +100,60 @@ pub struct InputEdit {
 #[repr(transparent)]
 pub struct Node<'a>(ffi::TSNode, PhantomData<&'a ()>);
 
+/// A type of change between an old and a new syntax tree.
+#[derive(Debug, PartialEq, Eq, Clone, Copy)]
+pub enum NodeChangeKind {
+    Inserted,
+    Removed,
+    Modified,
+}
+
+/// A node that differs between an old and a new syntax tree.
+///
+/// Inserted nodes only have a `new_node`, removed nodes only have an `old_node`, and
+/// modified nodes have both.
+#[doc(alias = "TSNodeChange")]
+#[derive(Clone, Copy, Debug)]
+pub struct NodeChange<'tree> {
+    pub kind: NodeChangeKind,
+    pub old_node: Option<Node<'tree>>,
+    pub new_node: Option<Node<'tree>>,
+}
+
+/// A summary of the memory used by a syntax tree.
+///
+/// Nodes that are shared with other trees, such as copies of the tree or trees that
+/// were produced by reparsing it, are counted in `shared_bytes`. That memory would
+/// not be freed by dropping the tree.
+#[doc(alias = "TSTreeMemoryUsage")]
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub struct TreeMemoryUsage {
+    pub heap_node_count: usize,
+    pub inline_leaf_count: usize,
+    pub heap_node_bytes: usize,
+    pub child_array_bytes: usize,
+    pub external_scanner_state_bytes: usize,
+    pub shared_bytes: usize,
+    pub total_bytes: usize,
+}
+
 /// A stateful object that this is used to produce a `Tree` based on some source code.
 #[doc(alias = "TSParser")]
 pub struct Parser(NonNull<ffi::TSParser>);
 
+/// The saved state of a [Parser] whose parse has not yet finished.
+#[doc(alias = "TSParserSnapshot")]
+pub struct ParserSnapshot(NonNull<ffi::TSParserSnapshot>);
+
+/// A cache of syntax nodes that can be shared between the trees of documents
+/// that contain identical regions of text.
+#[doc(alias = "TSSubtreeCache")]
+pub struct SubtreeCache(NonNull<ffi::TSSubtreeCache>);
+
+/// A queue of deleted syntax trees whose memory has not yet been freed.
+#[doc(alias = "TSDeletionQueue")]
+pub struct DeletionQueue(NonNull<ffi::TSDeletionQueue>);
+
 /// A type of log message.
 #[derive(Debug, PartialEq, Eq)]
 pub enum LogType {
@@ -171,11 +239,46 @@ pub struct QueryMatch<'cursor, 'tree> {
     cursor: *mut ffi::TSQueryCursor,
 }
 
+/// A match of a `Query` that owns its list of captures, and so outlives the cursor that
+/// found it.
+#[derive(Clone, Debug)]
+pub struct OwnedQueryMatch<'tree> {
+    pub pattern_index: usize,
+    pub captures: Vec<QueryCapture<'tree>>,
+}
+
+/// A stateful object that keeps track of the matches of a `Query` in a document as it is
+/// edited and reparsed, searching only the parts of each new `Tree` that have changed.
+#[doc(alias = "TSQuerySession")]
+pub struct QuerySession<'query> {
+    ptr: NonNull<ffi::TSQuerySession>,
+    _query: PhantomData<&'query Query>,
+}
+
+/// A capture in a `QuerySessionMatch`. Because a session outlives the trees that it is
+/// given, captures are described by their position and node kind rather than by a `Node`.
+#[derive(Clone, Debug, PartialEq, Eq)]
+pub struct QuerySessionCapture {
+    pub range: Range,
+    pub kind_id: u16,
+    pub index: u32,
+}
+
+/// A match that is tracked by a `QuerySession`. Its id stays the same for as long as the
+/// match exists.
+#[derive(Clone, Debug, PartialEq, Eq)]
+pub struct QuerySessionMatch {
+    pub id: u32,
+    pub pattern_index: usize,
+    pub captures: Vec<QuerySessionCapture>,
+}
+
 /// A sequence of `QueryMatch`es associated with a given `QueryCursor`.
 pub struct QueryMatches<'a, 'tree: 'a, T: TextProvider<'a>> {
     ptr: *mut ffi::TSQueryCursor,
     query: &'a Query,
     text_provider: T,
+    _text: Option<Box<&'a [u8]>>,
     buffer1: Vec<u8>,
     buffer2: Vec<u8>,
     _tree: PhantomData<&'tree ()>,
@@ -186,6 +289,29 @@ pub struct QueryCaptures<'a, 'tree: 'a, T: TextProvider<'a>> {
     ptr: *mut ffi::TSQueryCursor,
     query: &'a Query,
     text_provider: T,
+    _text: Option<Box<&'a [u8]>>,
+    buffer1: Vec<u8>,
+    buffer2: Vec<u8>,
+    _tree: PhantomData<&'tree ()>,
+}
+
+/// A sequence of `QueryMatch`es from several queries, each paired with the index of its query.
+pub struct QueriesMatches<'a, 'tree: 'a, T: TextProvider<'a>> {
+    ptr: *mut ffi::TSQueryCursor,
+    queries: &'a [&'a Query],
+    text_provider: T,
+    _text: Option<Box<&'a [u8]>>,
+    buffer1: Vec<u8>,
+    buffer2: Vec<u8>,
+    _tree: PhantomData<&'tree ()>,
+}
+
+/// A sequence of `QueryCapture`s from several queries, each paired with the index of its query.
+pub struct QueriesCaptures<'a, 'tree: 'a, T: TextProvider<'a>> {
+    ptr: *mut ffi::TSQueryCursor,
+    queries: &'a [&'a Query],
+    text_provider: T,
+    _text: Option<Box<&'a [u8]>>,
     buffer1: Vec<u8>,
     buffer2: Vec<u8>,
     _tree: PhantomData<&'tree ()>,
@@ -194,6 +320,13 @@ pub struct QueryCaptures<'a, 'tree: 'a, T: TextProvider<'a>> {
 pub trait TextProvider<'a> {
     type I: Iterator<Item = &'a [u8]> + 'a;
     fn text(&mut self, node: Node) -> Self::I;
+
+    /// The entire source text, if it is available as a single slice. This allows the query
+    /// cursor to evaluate the `#eq?`, `#not-eq?` and most `#match?` predicates itself, and to
+    /// discard the matches that fail them before they are returned.
+    fn bytes(&self) -> Option<&'a [u8]> {
+        None
+    }
 }
 
 /// A particular `Node` that has been captured with a particular name within a `Query`.
@@ -214,6 +347,10 @@ pub struct LanguageError {
 #[derive(Debug, PartialEq, Eq)]
 pub struct IncludedRangesError(pub usize);
 
+/// An error that occurred in `Tree::edit_batch`.
+#[derive(Debug, PartialEq, Eq)]
+pub struct EditBatchError(pub usize);
+
 /// An error that occurred when trying to create a `Query`.
 #[derive(Debug, PartialEq, Eq)]
 pub struct QueryError {
@@ -345,6 +482,22 @@ impl Parser {
         }
     }
 
+    /// Create a new parser that allocates memory using the given allocator,
+    /// instead of the functions passed to [set_allocator].
+    ///
+    /// The allocator is also used for the trees that the parser produces. Trees
+    /// only share nodes with trees that use the same allocator.
+    ///
+    /// # Safety
+    ///
+    /// The allocator's functions must not return null, and its payload must
+    /// outlive the parser and all of the trees that it produces.
+    #[doc(alias = "ts_parser_new_with_allocator")]
+    pub unsafe fn new_with_allocator(allocator: ffi::TSAllocator) -> Parser {
+        let parser = ffi::ts_parser_new_with_allocator(allocator);
+        Parser(NonNull::new_unchecked(parser))
+    }
+
     /// Set the language that the parser should use for parsing.
     ///
     /// Returns a Result indicating whether or not the language was successfully
@@ -458,6 +611,8 @@ impl Parser {
     ///  * The parser has not yet had a language assigned with [Parser::set_language]
     ///  * The timeout set with [Parser::set_timeout_micros] expired
     ///  * The cancellation flag set with [Parser::set_cancellation_flag] was flipped
+    ///  * The memory limit set with [Parser::set_memory_limit] was exceeded
+    ///  * `old_tree` is a partial tree, produced by [Parser::parse_partial]
     #[doc(alias = "ts_parser_parse")]
     pub fn parse(&mut self, text: impl AsRef<[u8]>, old_tree: Option<&Tree>) -> Option<Tree> {
         let bytes = text.as_ref();
@@ -595,6 +750,120 @@ impl Parser {
         }
     }
 
+    /// Quickly parse one range of a slice of UTF8 text, such as the part of a large
+    /// document that is currently visible in an editor.
+    ///
+    /// Parsing starts at the beginning of the line that contains the start of the
+    /// range, and stops at the end of the range, so the time taken does not depend
+    /// on the size of the document. The resulting tree is marked as partial (see
+    /// [Tree::is_partial]), and can't be used as the old tree in a later parse.
+    ///
+    /// # Arguments:
+    /// * `text` The UTF8-encoded text of the whole document.
+    /// * `range` The range of the document that should be parsed.
+    ///
+    /// Returns `None` in the same situations as [Parser::parse], and also if the
+    /// range is inconsistent, if the range does not overlap the parser's included
+    /// ranges, or if a previous parse was halted and not completed or reset.
+    #[doc(alias = "ts_parser_parse_partial")]
+    pub fn parse_partial(&mut self, text: impl AsRef<[u8]>, range: Range) -> Option<Tree> {
+        unsafe extern "C" fn read(
+            payload: *mut c_void,
+            byte_offset: u32,
+            _: ffi::TSPoint,
+            bytes_read: *mut u32,
+        ) -> *const c_char {
+            let text = (payload as *const &[u8]).as_ref().unwrap();
+            let slice = text.get(byte_offset as usize..).unwrap_or(&[]);
+            *bytes_read = slice.len() as u32;
+            return slice.as_ptr() as *const c_char;
+        }
+
+        let mut bytes = text.as_ref();
+        let c_input = ffi::TSInput {
+            payload: &mut bytes as *mut &[u8] as *mut c_void,
+            read: Some(read),
+            encoding: ffi::TSInputEncoding_TSInputEncodingUTF8,
+        };
+
+        unsafe {
+            let c_new_tree = ffi::ts_parser_parse_partial(self.0.as_ptr(), c_input, range.into());
+            NonNull::new(c_new_tree).map(Tree)
+        }
+    }
+
+    /// Parse the next chunk of a stream of UTF8 text, such as a log file or data
+    /// arriving from a network connection, that may be too large to keep in memory.
+    ///
+    /// Whenever the parser has completed some top-level nodes of the document, it
+    /// passes them to the given callback, and then frees the memory that they
+    /// used. This only happens when the top level of the grammar is a repetition,
+    /// and the text is not ambiguous. Any nodes that are not passed to the callback
+    /// remain in the tree returned by [Parser::finish].
+    ///
+    /// # Arguments:
+    /// * `bytes` The next chunk of text.
+    /// * `callback` A function that is called with each completed top-level node.
+    ///   The node is only valid for the duration of the call.
+    ///
+    /// Returns `true` once the parser has consumed all of the text provided so far
+    /// and is waiting for more.
+    ///
+    /// Returns `false` if the parser has no language, if its included ranges do not
+    /// cover the entire stream, or if parsing was halted by a timeout or a
+    /// cancellation. In the last case, the text is kept, and parsing can be resumed
+    /// by calling `feed` again.
+    #[doc(alias = "ts_parser_feed")]
+    pub fn feed<F: FnMut(Node)>(&mut self, bytes: &[u8], mut callback: F) -> bool {
+        unsafe extern "C" fn node_completed<F: FnMut(Node)>(
+            payload: *mut c_void,
+            c_node: ffi::TSNode,
+        ) {
+            let callback = (payload as *mut F).as_mut().unwrap();
+            if let Some(node) = Node::new(c_node) {
+                callback(node);
+            }
+        }
+
+        unsafe {
+            ffi::ts_parser_set_stream_callback(
+                self.0.as_ptr(),
+                ffi::TSStreamCallback {
+                    payload: &mut callback as *mut F as *mut c_void,
+                    node_completed: Some(node_completed::<F>),
+                },
+            );
+            let result = ffi::ts_parser_feed(
+                self.0.as_ptr(),
+                bytes.as_ptr() as *const c_char,
+                bytes.len() as u32,
+            );
+            ffi::ts_parser_set_stream_callback(
+                self.0.as_ptr(),
+                ffi::TSStreamCallback {
+                    payload: ptr::null_mut(),
+                    node_completed: None,
+                },
+            );
+            result
+        }
+    }
+
+    /// Finish parsing a stream of text that was provided using [Parser::feed].
+    ///
+    /// The returned tree contains the nodes that were not already passed to the
+    /// callback. Those nodes are replaced with a single hidden node, so the
+    /// positions of all of the nodes are relative to the start of the stream.
+    ///
+    /// Returns `None` in the same situations as [Parser::parse].
+    #[doc(alias = "ts_parser_finish")]
+    pub fn finish(&mut self) -> Option<Tree> {
+        unsafe {
+            let c_tree = ffi::ts_parser_finish(self.0.as_ptr());
+            NonNull::new(c_tree).map(Tree)
+        }
+    }
+
     /// Instruct the parser to start the next parse from the beginning.
     ///
     /// If the parser previously failed because of a timeout or a cancellation, then
@@ -614,6 +883,56 @@ impl Parser {
         unsafe { ffi::ts_parser_timeout_micros(self.0.as_ptr()) }
     }
 
+    /// Get the number of bytes that parsing is allowed to use.
+    ///
+    /// This is set via [set_memory_limit](Parser::set_memory_limit).
+    #[doc(alias = "ts_parser_memory_limit")]
+    pub fn memory_limit(&self) -> usize {
+        unsafe { ffi::ts_parser_memory_limit(self.0.as_ptr()) }
+    }
+
+    /// Get the number of bytes used by the parser's current parse.
+    ///
+    /// This counts the parse stack, and the syntax nodes that the parse has
+    /// created and not yet handed off to a finished tree or a snapshot. It
+    /// returns to its original value once a parse has finished, or once the
+    /// parser has been reset.
+    #[doc(alias = "ts_parser_memory_usage")]
+    pub fn memory_usage(&self) -> usize {
+        unsafe { ffi::ts_parser_memory_usage(self.0.as_ptr()) }
+    }
+
+    /// Capture the state of a parse that is in progress, so that it can later be
+    /// resumed from the same point using [Parser::restore].
+    ///
+    /// A parse is left in progress when it is halted by a timeout or a cancellation
+    /// flag. This can be used to checkpoint the parsing of a long document, so that
+    /// after an edit, parsing can resume from the nearest checkpoint that precedes
+    /// the edit, instead of from the beginning of the document.
+    #[doc(alias = "ts_parser_snapshot")]
+    pub fn snapshot(&mut self) -> ParserSnapshot {
+        unsafe {
+            ParserSnapshot(NonNull::new_unchecked(ffi::ts_parser_snapshot(
+                self.0.as_ptr(),
+            )))
+        }
+    }
+
+    /// Restore the parser to the state captured in the given snapshot. The next
+    /// call to [Parser::parse] will resume parsing from that point.
+    ///
+    /// The old tree that the parser was reusing when the snapshot was taken is
+    /// not restored. To reuse nodes past the snapshot's offset, pass the old tree,
+    /// edited to match the document, to the next call to [Parser::parse].
+    ///
+    /// Returns `false` and leaves the parser unchanged if the snapshot was taken
+    /// from a parser with a different language, or if text has been streamed into
+    /// the parser since it was last reset.
+    #[doc(alias = "ts_parser_restore")]
+    pub fn restore(&mut self, snapshot: &ParserSnapshot) -> bool {
+        unsafe { ffi::ts_parser_restore(self.0.as_ptr(), snapshot.0.as_ptr()) }
+    }
+
     /// Set the maximum duration in microseconds that parsing should be allowed to
     /// take before halting.
     ///
@@ -624,6 +943,18 @@ impl Parser {
         unsafe { ffi::ts_parser_set_timeout_micros(self.0.as_ptr(), timeout_micros) }
     }
 
+    /// Set the maximum number of bytes that parsing should be allowed to use
+    /// before halting, or zero for no limit.
+    ///
+    /// This counts the memory used by the parse stack, and by the syntax nodes
+    /// that have been created since the parser was last reset. If parsing
+    /// exceeds this, it will halt early, returning `None`. Call [Parser::reset]
+    /// to free the memory used by the unfinished parse.
+    #[doc(alias = "ts_parser_set_memory_limit")]
+    pub fn set_memory_limit(&mut self, bytes: usize) {
+        unsafe { ffi::ts_parser_set_memory_limit(self.0.as_ptr(), bytes) }
+    }
+
     /// Set the ranges of text that the parser should include when parsing.
     ///
     /// By default, the parser will always include entire documents. This function
@@ -691,6 +1022,24 @@ impl Parser {
             ffi::ts_parser_set_cancellation_flag(self.0.as_ptr(), ptr::null());
         }
     }
+
+    /// Set the subtree cache that the parser should use.
+    ///
+    /// When a parser has a cache, it adds the larger nodes of each tree that it
+    /// produces to the cache, and reuses those nodes when it finds the same text
+    /// in later documents. See [SubtreeCache] for more information.
+    ///
+    /// # Safety
+    ///
+    /// The cache must outlive any parsing that is done with this parser, and it
+    /// must not be used by more than one parser at a time.
+    #[doc(alias = "ts_parser_set_subtree_cache")]
+    pub unsafe fn set_subtree_cache(&mut self, cache: Option<&SubtreeCache>) {
+        ffi::ts_parser_set_subtree_cache(
+            self.0.as_ptr(),
+            cache.map_or(ptr::null_mut(), |cache| cache.0.as_ptr()),
+        );
+    }
 }
 
 impl Drop for Parser {
@@ -701,6 +1050,115 @@ impl Drop for Parser {
     }
 }
 
+impl ParserSnapshot {
+    /// Get the furthest byte offset that the parser had consumed when the snapshot
+    /// was taken.
+    ///
+    /// Parsing can only be resumed from a snapshot if none of the text before this
+    /// offset has changed.
+    #[doc(alias = "ts_parser_snapshot_byte_offset")]
+    pub fn byte_offset(&self) -> usize {
+        unsafe { ffi::ts_parser_snapshot_byte_offset(self.0.as_ptr()) as usize }
+    }
+}
+
+impl Drop for ParserSnapshot {
+    fn drop(&mut self) {
+        unsafe { ffi::ts_parser_snapshot_delete(self.0.as_ptr()) }
+    }
+}
+
+impl SubtreeCache {
+    /// Create a new, empty subtree cache.
+    ///
+    /// A subtree cache allows syntax nodes to be shared between the trees of
+    /// documents that contain identical regions of text, such as license headers,
+    /// generated code, or vendored libraries. Parsers that use the cache reuse
+    /// its nodes wherever the same text appears in the same parse state, instead
+    /// of parsing that text again, and the trees share those nodes rather than
+    /// copying them.
+    #[doc(alias = "ts_subtree_cache_new")]
+    pub fn new() -> Self {
+        unsafe { SubtreeCache(NonNull::new_unchecked(ffi::ts_subtree_cache_new())) }
+    }
+
+    /// Remove all of the nodes from the cache.
+    #[doc(alias = "ts_subtree_cache_clear")]
+    pub fn clear(&mut self) {
+        unsafe { ffi::ts_subtree_cache_clear(self.0.as_ptr()) }
+    }
+
+    /// Set the maximum number of bytes that the cache may use, or zero for no
+    /// limit. The default limit is 64 MiB.
+    ///
+    /// This counts the copies of text that the cache keeps, and the syntax nodes
+    /// that it keeps alive. When the limit is exceeded, the nodes that were least
+    /// recently added or reused are removed from the cache.
+    #[doc(alias = "ts_subtree_cache_set_memory_limit")]
+    pub fn set_memory_limit(&mut self, bytes: usize) {
+        unsafe { ffi::ts_subtree_cache_set_memory_limit(self.0.as_ptr(), bytes) }
+    }
+
+    /// Get the number of bytes that the cache is allowed to use.
+    #[doc(alias = "ts_subtree_cache_memory_limit")]
+    pub fn memory_limit(&self) -> usize {
+        unsafe { ffi::ts_subtree_cache_memory_limit(self.0.as_ptr()) }
+    }
+
+    /// Get the number of bytes that the cache is currently using.
+    #[doc(alias = "ts_subtree_cache_memory_usage")]
+    pub fn memory_usage(&self) -> usize {
+        unsafe { ffi::ts_subtree_cache_memory_usage(self.0.as_ptr()) }
+    }
+}
+
+impl Default for SubtreeCache {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl Drop for SubtreeCache {
+    fn drop(&mut self) {
+        unsafe { ffi::ts_subtree_cache_delete(self.0.as_ptr()) }
+    }
+}
+
+impl DeletionQueue {
+    /// Create a new, empty deletion queue.
+    ///
+    /// Large trees can be handed to the queue with [Tree::delete_deferred],
+    /// and their memory can then be freed in small increments with [drain],
+    /// either when a latency-sensitive thread is idle, or on another thread.
+    ///
+    /// [drain]: DeletionQueue::drain
+    #[doc(alias = "ts_deletion_queue_new")]
+    pub fn new() -> Self {
+        unsafe { DeletionQueue(NonNull::new_unchecked(ffi::ts_deletion_queue_new())) }
+    }
+
+    /// Free the memory used by the trees in the queue, stopping once the given
+    /// number of microseconds have elapsed. Pass zero to free everything.
+    ///
+    /// Returns `true` if the queue is now empty.
+    #[doc(alias = "ts_deletion_queue_drain")]
+    pub fn drain(&mut self, timeout_micros: u64) -> bool {
+        unsafe { ffi::ts_deletion_queue_drain(self.0.as_ptr(), timeout_micros) }
+    }
+}
+
+impl Default for DeletionQueue {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl Drop for DeletionQueue {
+    fn drop(&mut self) {
+        unsafe { ffi::ts_deletion_queue_delete(self.0.as_ptr()) }
+    }
+}
+
 impl Tree {
     /// Get the root node of the syntax tree.
     #[doc(alias = "ts_tree_root_node")]
@@ -728,6 +1186,13 @@ impl Tree {
         Language(unsafe { ffi::ts_tree_language(self.0.as_ptr()) })
     }
 
+    /// Check whether the syntax tree was produced by [Parser::parse_partial], and
+    /// therefore only describes part of the document.
+    #[doc(alias = "ts_tree_is_partial")]
+    pub fn is_partial(&self) -> bool {
+        unsafe { ffi::ts_tree_is_partial(self.0.as_ptr()) }
+    }
+
     /// Edit the syntax tree to keep it in sync with source code that has been
     /// edited.
     ///
@@ -739,6 +1204,43 @@ impl Tree {
         unsafe { ffi::ts_tree_edit(self.0.as_ptr(), &edit) };
     }
 
+    /// Edit the syntax tree to reflect several source code changes at once.
+    ///
+    /// Every edit must be described in terms of the document as it was *before*
+    /// any of the edits were made, and the edits must not overlap. They can be
+    /// given in any order. This is equivalent to calling [Tree::edit] for each
+    /// edit, from the last one in the document to the first, but the tree is
+    /// only traversed once.
+    ///
+    /// If the edits overlap, the tree is left unchanged, and this method returns
+    /// an [EditBatchError] with the index of an overlapping edit.
+    #[doc(alias = "ts_tree_edit_batch")]
+    pub fn edit_batch(&mut self, edits: &[InputEdit]) -> Result<(), EditBatchError> {
+        let ts_edits: Vec<ffi::TSInputEdit> = edits.iter().map(|edit| edit.into()).collect();
+        let result = unsafe {
+            ffi::ts_tree_edit_batch(self.0.as_ptr(), ts_edits.as_ptr(), ts_edits.len() as u32)
+        };
+
+        if result {
+            Ok(())
+        } else {
+            let mut indices: Vec<usize> = (0..edits.len()).collect();
+            indices.sort_by_key(|i| edits[*i].start_byte);
+            let mut prev_end_byte = 0;
+            for i in indices {
+                let edit = &edits[i];
+                if edit.start_byte < prev_end_byte
+                    || edit.old_end_byte < edit.start_byte
+                    || edit.new_end_byte < edit.start_byte
+                {
+                    return Err(EditBatchError(i));
+                }
+                prev_end_byte = edit.old_end_byte;
+            }
+            Err(EditBatchError(0))
+        }
+    }
+
     /// Create a new [TreeCursor] starting from the root of the tree.
     pub fn walk(&self) -> TreeCursor {
         self.root_node().walk()
@@ -764,6 +1266,36 @@ impl Tree {
         }
     }
 
+    /// Compare this old edited syntax tree to a new syntax tree representing the same
+    /// document, returning the nodes that have changed.
+    ///
+    /// The same requirements apply as for [Tree::changed_ranges]. Each change refers to
+    /// the smallest nodes that differ between the two trees. Nodes that were replaced by
+    /// nodes of a different type are reported as a removal followed by an insertion.
+    #[doc(alias = "ts_tree_get_changed_nodes")]
+    pub fn changed_nodes<'tree>(
+        &'tree self,
+        other: &'tree Tree,
+    ) -> impl ExactSizeIterator<Item = NodeChange<'tree>> {
+        let mut count = 0u32;
+        unsafe {
+            let ptr = ffi::ts_tree_get_changed_nodes(
+                self.0.as_ptr(),
+                other.0.as_ptr(),
+                &mut count as *mut u32,
+            );
+            util::CBufferIter::new(ptr, count as usize).map(|change| NodeChange {
+                kind: match change.type_ {
+                    ffi::TSNodeChangeType_TSNodeChangeTypeInserted => NodeChangeKind::Inserted,
+                    ffi::TSNodeChangeType_TSNodeChangeTypeRemoved => NodeChangeKind::Removed,
+                    _ => NodeChangeKind::Modified,
+                },
+                old_node: Node::new(change.old_node),
+                new_node: Node::new(change.new_node),
+            })
+        }
+    }
+
     /// Get the included ranges that were used to parse the syntax tree.
     pub fn included_ranges(&self) -> Vec<Range> {
         let mut count = 0u32;
@@ -776,6 +1308,58 @@ impl Tree {
         }
     }
 
+    /// Serialize the syntax tree into a compact binary format, so that it can be
+    /// stored and later restored using [Tree::deserialize].
+    ///
+    /// The data contains everything that is needed to use the restored tree as the
+    /// old tree when reparsing an edited document, but not the document's text.
+    #[doc(alias = "ts_tree_serialize")]
+    pub fn serialize(&self) -> Vec<u8> {
+        let mut length = 0u32;
+        unsafe {
+            let ptr = ffi::ts_tree_serialize(self.0.as_ptr(), &mut length as *mut u32);
+            let result = slice::from_raw_parts(ptr as *const u8, length as usize).to_vec();
+            (FREE_FN)(ptr as *mut c_void);
+            result
+        }
+    }
+
+    /// Restore a syntax tree that was serialized using [Tree::serialize].
+    ///
+    /// Returns `None` if the data is not a valid serialized tree, if it was written
+    /// by an incompatible version of Tree-sitter, or if the tree was produced by a
+    /// different language.
+    #[doc(alias = "ts_tree_deserialize")]
+    pub fn deserialize(language: Language, data: &[u8]) -> Option<Tree> {
+        unsafe {
+            let ptr = ffi::ts_tree_deserialize(
+                language.0,
+                data.as_ptr() as *const c_char,
+                data.len() as u32,
+            );
+            NonNull::new(ptr).map(Tree)
+        }
+    }
+
+    /// Measure the memory used by the syntax tree.
+    #[doc(alias = "ts_tree_memory_usage")]
+    pub fn memory_usage(&self) -> TreeMemoryUsage {
+        let mut usage = MaybeUninit::<ffi::TSTreeMemoryUsage>::uninit();
+        let usage = unsafe {
+            ffi::ts_tree_memory_usage(self.0.as_ptr(), usage.as_mut_ptr());
+            usage.assume_init()
+        };
+        TreeMemoryUsage {
+            heap_node_count: usage.heap_node_count,
+            inline_leaf_count: usage.inline_leaf_count,
+            heap_node_bytes: usage.heap_node_bytes,
+            child_array_bytes: usage.child_array_bytes,
+            external_scanner_state_bytes: usage.external_scanner_state_bytes,
+            shared_bytes: usage.shared_bytes,
+            total_bytes: usage.total_bytes,
+        }
+    }
+
     /// Print a graph of the tree to the given file descriptor.
     /// The graph is formatted in the DOT language. You may want to pipe this graph
     /// directly to a `dot(1)` process in order to generate SVG output.
@@ -785,6 +1369,15 @@ impl Tree {
         let fd = file.as_raw_fd();
         unsafe { ffi::ts_tree_print_dot_graph(self.0.as_ptr(), fd) }
     }
+
+    /// Delete the syntax tree without freeing the memory used by its nodes,
+    /// adding them to the given queue instead. This takes constant time, no
+    /// matter how large the tree is.
+    #[doc(alias = "ts_tree_delete_deferred")]
+    pub fn delete_deferred(self, queue: &mut DeletionQueue) {
+        let tree = ManuallyDrop::new(self);
+        unsafe { ffi::ts_tree_delete_deferred(tree.0.as_ptr(), queue.0.as_ptr()) }
+    }
 }
 
 impl fmt::Debug for Tree {
@@ -1653,6 +2246,65 @@ impl Query {
         Ok(result)
     }
 
+    /// Serialize the query into a compact binary format, so that it can be
+    /// stored and later restored using [Query::deserialize], without parsing
+    /// and analyzing its source again.
+    #[doc(alias = "ts_query_serialize")]
+    pub fn serialize(&self) -> Vec<u8> {
+        let mut length = 0u32;
+        unsafe {
+            let ptr = ffi::ts_query_serialize(self.ptr.as_ptr(), &mut length as *mut u32);
+            let result = slice::from_raw_parts(ptr as *const u8, length as usize).to_vec();
+            (FREE_FN)(ptr as *mut c_void);
+            result
+        }
+    }
+
+    /// Restore a query that was serialized using [Query::serialize].
+    ///
+    /// Returns `None` if the data is not a valid serialized query, if it was
+    /// written by an incompatible version of Tree-sitter, or if the query was
+    /// created for a different language.
+    #[doc(alias = "ts_query_deserialize")]
+    pub fn deserialize(language: Language, data: &[u8]) -> Option<Query> {
+        let ptr = unsafe {
+            ffi::ts_query_deserialize(
+                language.0,
+                data.as_ptr() as *const c_char,
+                data.len() as u32,
+            )
+        };
+        if ptr.is_null() {
+            return None;
+        }
+
+        // The query's names and string values are converted to Rust strings
+        // without being checked, so they must be checked here.
+        let is_utf8 = |value: *const c_char, length: u32| unsafe {
+            str::from_utf8(slice::from_raw_parts(value as *const u8, length as usize)).is_ok()
+        };
+        let mut length = 0u32;
+        let is_valid = unsafe {
+            (0..ffi::ts_query_capture_count(ptr)).all(|i| {
+                is_utf8(
+                    ffi::ts_query_capture_name_for_id(ptr, i, &mut length),
+                    length,
+                )
+            }) && (0..ffi::ts_query_string_count(ptr)).all(|i| {
+                is_utf8(
+                    ffi::ts_query_string_value_for_id(ptr, i, &mut length),
+                    length,
+                )
+            })
+        };
+        if !is_valid {
+            unsafe { ffi::ts_query_delete(ptr) };
+            return None;
+        }
+
+        unsafe { Query::from_raw_parts(ptr, "") }.ok()
+    }
+
     /// Get the byte offset where the given pattern starts in the query's source.
     #[doc(alias = "ts_query_start_byte_for_pattern")]
     pub fn start_byte_for_pattern(&self, pattern_index: usize) -> usize {
@@ -1838,6 +2490,20 @@ impl QueryCursor {
         }
     }
 
+    /// Create a new cursor that allocates memory using the given allocator,
+    /// instead of the functions passed to [set_allocator].
+    ///
+    /// # Safety
+    ///
+    /// The allocator's functions must not return null, and its payload must
+    /// outlive the cursor.
+    #[doc(alias = "ts_query_cursor_new_with_allocator")]
+    pub unsafe fn new_with_allocator(allocator: ffi::TSAllocator) -> Self {
+        QueryCursor {
+            ptr: NonNull::new_unchecked(ffi::ts_query_cursor_new_with_allocator(allocator)),
+        }
+    }
+
     /// Return the maximum number of in-progress matches for this cursor.
     #[doc(alias = "ts_query_cursor_match_limit")]
     pub fn match_limit(&self) -> u32 {
@@ -1853,6 +2519,27 @@ impl QueryCursor {
         }
     }
 
+    /// Get the number of bytes that this cursor may use for storing captures.
+    ///
+    /// This is set via [set_capture_memory_limit](QueryCursor::set_capture_memory_limit).
+    #[doc(alias = "ts_query_cursor_capture_memory_limit")]
+    pub fn capture_memory_limit(&self) -> usize {
+        unsafe { ffi::ts_query_cursor_capture_memory_limit(self.ptr.as_ptr()) }
+    }
+
+    /// Set the maximum number of bytes that this cursor may use for storing the
+    /// captures of in-progress matches, or zero for no limit.
+    ///
+    /// If this limit would be exceeded, the earliest-starting match is dropped,
+    /// and [did_exceed_match_limit](QueryCursor::did_exceed_match_limit) will
+    /// return `true`.
+    #[doc(alias = "ts_query_cursor_set_capture_memory_limit")]
+    pub fn set_capture_memory_limit(&mut self, bytes: usize) {
+        unsafe {
+            ffi::ts_query_cursor_set_capture_memory_limit(self.ptr.as_ptr(), bytes);
+        }
+    }
+
     /// Check if, on its last execution, this cursor exceeded its maximum number of
     /// in-progress matches.
     #[doc(alias = "ts_query_cursor_did_exceed_match_limit")]
@@ -1873,11 +2560,13 @@ impl QueryCursor {
         text_provider: T,
     ) -> QueryMatches<'a, 'tree, T> {
         let ptr = self.ptr.as_ptr();
+        let text = self.set_text(text_provider.bytes());
         unsafe { ffi::ts_query_cursor_exec(ptr, query.ptr.as_ptr(), node.0) };
         QueryMatches {
             ptr,
             query,
             text_provider,
+            _text: text,
             buffer1: Default::default(),
             buffer2: Default::default(),
             _tree: PhantomData,
@@ -1896,15 +2585,196 @@ impl QueryCursor {
         text_provider: T,
     ) -> QueryCaptures<'a, 'tree, T> {
         let ptr = self.ptr.as_ptr();
+        let text = self.set_text(text_provider.bytes());
         unsafe { ffi::ts_query_cursor_exec(self.ptr.as_ptr(), query.ptr.as_ptr(), node.0) };
         QueryCaptures {
             ptr,
             query,
             text_provider,
+            _text: text,
+            buffer1: Default::default(),
+            buffer2: Default::default(),
+            _tree: PhantomData,
+        }
+    }
+
+    /// Iterate over the matches of several queries at once, walking the tree only once.
+    ///
+    /// Each match is paired with the index of its query in `queries`. Its pattern index and
+    /// captures refer to that query. Returns `None` if the queries are for different languages,
+    /// or if they have too many patterns altogether.
+    #[doc(alias = "ts_query_cursor_exec_queries")]
+    pub fn matches_for_queries<'a, 'tree: 'a, T: TextProvider<'a> + 'a>(
+        &'a mut self,
+        queries: &'a [&'a Query],
+        node: Node<'tree>,
+        text_provider: T,
+    ) -> Option<QueriesMatches<'a, 'tree, T>> {
+        let ptr = self.ptr.as_ptr();
+        let query_ptrs = queries
+            .iter()
+            .map(|query| query.ptr.as_ptr() as *const ffi::TSQuery)
+            .collect::<Vec<_>>();
+        let text = self.set_text(text_provider.bytes());
+        let ok = unsafe {
+            ffi::ts_query_cursor_exec_queries(
+                ptr,
+                query_ptrs.as_ptr(),
+                query_ptrs.len() as u32,
+                node.0,
+            )
+        };
+        if !ok {
+            return None;
+        }
+        Some(QueriesMatches {
+            ptr,
+            queries,
+            text_provider,
+            _text: text,
+            buffer1: Default::default(),
+            buffer2: Default::default(),
+            _tree: PhantomData,
+        })
+    }
+
+    /// Iterate over the captures of several queries at once, walking the tree only once.
+    ///
+    /// Each capture is paired with the index of its query in `queries`. Returns `None` if the
+    /// queries are for different languages, or if they have too many patterns altogether.
+    #[doc(alias = "ts_query_cursor_exec_queries")]
+    pub fn captures_for_queries<'a, 'tree: 'a, T: TextProvider<'a> + 'a>(
+        &'a mut self,
+        queries: &'a [&'a Query],
+        node: Node<'tree>,
+        text_provider: T,
+    ) -> Option<QueriesCaptures<'a, 'tree, T>> {
+        let ptr = self.ptr.as_ptr();
+        let query_ptrs = queries
+            .iter()
+            .map(|query| query.ptr.as_ptr() as *const ffi::TSQuery)
+            .collect::<Vec<_>>();
+        let text = self.set_text(text_provider.bytes());
+        let ok = unsafe {
+            ffi::ts_query_cursor_exec_queries(
+                ptr,
+                query_ptrs.as_ptr(),
+                query_ptrs.len() as u32,
+                node.0,
+            )
+        };
+        if !ok {
+            return None;
+        }
+        Some(QueriesCaptures {
+            ptr,
+            queries,
+            text_provider,
+            _text: text,
             buffer1: Default::default(),
             buffer2: Default::default(),
             _tree: PhantomData,
+        })
+    }
+
+    /// Find all of the matches of a query within a node, splitting the work between several
+    /// threads.
+    ///
+    /// The node's text is divided into more byte ranges than there are threads, and each
+    /// thread repeatedly claims the next unclaimed range and finds the matches that *start*
+    /// within it, using its own cursor with this cursor's match limit. Each match is found in
+    /// exactly one range, so the result contains the same matches as `matches` would return.
+    /// They are ordered by the range in which they start, and within each range, in the order
+    /// that `matches` returns them.
+    pub fn matches_in_parallel<'tree>(
+        &self,
+        query: &Query,
+        node: Node<'tree>,
+        text: &[u8],
+        thread_count: usize,
+    ) -> Vec<OwnedQueryMatch<'tree>> {
+        // Nodes and captures only refer to the tree, which can be read from several threads
+        // at once.
+        struct AssertSend<T>(T);
+        unsafe impl<T> Send for AssertSend<T> {}
+        unsafe impl<T> Sync for AssertSend<T> {}
+        impl<T: Copy> AssertSend<T> {
+            fn get(&self) -> T {
+                self.0
+            }
         }
+
+        let thread_count = thread_count.max(1);
+        let range = node.byte_range();
+        let chunk_count = (thread_count * 4).min(range.len()).max(1);
+        let chunk_size = (range.len() + chunk_count - 1) / chunk_count;
+
+        // The first and last ranges are left unbounded, so that zero-width nodes at the edges
+        // of the node are still covered.
+        let chunk_range = |i: usize| {
+            let start = if i == 0 {
+                0
+            } else {
+                range.start + i * chunk_size
+            };
+            let end = if i + 1 == chunk_count {
+                0
+            } else {
+                range.start + (i + 1) * chunk_size
+            };
+            start..end
+        };
+
+        let match_limit = self.match_limit();
+        let next_chunk = AtomicUsize::new(0);
+        let root = AssertSend(node.0);
+        let mut chunks = thread::scope(|scope| {
+            let workers = (0..thread_count)
+                .map(|_| {
+                    scope.spawn(|| {
+                        let node = Node::<'tree>(root.get(), PhantomData);
+                        let mut cursor = QueryCursor::new();
+                        cursor.set_match_limit(match_limit);
+                        let mut chunks = Vec::new();
+                        loop {
+                            let i = next_chunk.fetch_add(1, Ordering::Relaxed);
+                            if i >= chunk_count {
+                                break;
+                            }
+                            cursor.set_match_start_byte_range(chunk_range(i));
+                            let matches = cursor
+                                .matches(query, node, text)
+                                .map(|m| OwnedQueryMatch {
+                                    pattern_index: m.pattern_index,
+                                    captures: m.captures.to_vec(),
+                                })
+                                .collect::<Vec<_>>();
+                            chunks.push((i, matches));
+                        }
+                        AssertSend(chunks)
+                    })
+                })
+                .collect::<Vec<_>>();
+            workers
+                .into_iter()
+                .flat_map(|worker| worker.join().unwrap().0)
+                .collect::<Vec<_>>()
+        });
+        chunks.sort_unstable_by_key(|(i, _)| *i);
+        chunks
+            .into_iter()
+            .flat_map(|(_, matches)| matches)
+            .collect()
+    }
+
+    /// Give the cursor access to the source text, so that it can evaluate some predicates
+    /// itself. The returned box holds the slice that the cursor reads from, and must be kept
+    /// alive for as long as the cursor is used with this text.
+    fn set_text<'a>(&mut self, text: Option<&'a [u8]>) -> Option<Box<&'a [u8]>> {
+        let text = text.map(Box::new);
+        let c_input = text_input(text.as_deref());
+        unsafe { ffi::ts_query_cursor_set_text_input(self.ptr.as_ptr(), c_input) };
+        text
     }
 
     /// Set the range in which the query will be executed, in terms of byte offsets.
@@ -1933,6 +2803,24 @@ impl QueryCursor {
         self
     }
 
+    /// Set the range of bytes in which matches are allowed to start.
+    ///
+    /// Unlike `set_byte_range`, this doesn't cut off matches that start within the range but
+    /// extend past its end, and it never returns a match that starts before the range. So
+    /// running a query separately over several adjacent ranges finds each match exactly once.
+    /// An end of zero means that the range is unbounded.
+    #[doc(alias = "ts_query_cursor_set_match_start_byte_range")]
+    pub fn set_match_start_byte_range(&mut self, range: ops::Range<usize>) -> &mut Self {
+        unsafe {
+            ffi::ts_query_cursor_set_match_start_byte_range(
+                self.ptr.as_ptr(),
+                range.start as u32,
+                range.end as u32,
+            );
+        }
+        self
+    }
+
     #[doc(alias = "ts_query_cursor_set_max_start_depth")]
     pub fn set_max_start_depth(&mut self, max_start_depth: u32) -> &mut Self {
         unsafe {
@@ -2114,6 +3002,70 @@ impl<'a, 'tree, T: TextProvider<'a>> Iterator for QueryCaptures<'a, 'tree, T> {
     }
 }
 
+impl<'a, 'tree, T: TextProvider<'a>> Iterator for QueriesMatches<'a, 'tree, T> {
+    type Item = (usize, QueryMatch<'a, 'tree>);
+
+    fn next(&mut self) -> Option<Self::Item> {
+        unsafe {
+            loop {
+                let mut query_index = 0u32;
+                let mut m = MaybeUninit::<ffi::TSQueryMatch>::uninit();
+                if ffi::ts_query_cursor_next_query_match(
+                    self.ptr,
+                    m.as_mut_ptr(),
+                    &mut query_index as *mut u32,
+                ) {
+                    let result = QueryMatch::new(m.assume_init(), self.ptr);
+                    if result.satisfies_text_predicates(
+                        self.queries[query_index as usize],
+                        &mut self.buffer1,
+                        &mut self.buffer2,
+                        &mut self.text_provider,
+                    ) {
+                        return Some((query_index as usize, result));
+                    }
+                } else {
+                    return None;
+                }
+            }
+        }
+    }
+}
+
+impl<'a, 'tree, T: TextProvider<'a>> Iterator for QueriesCaptures<'a, 'tree, T> {
+    type Item = (usize, QueryMatch<'a, 'tree>, usize);
+
+    fn next(&mut self) -> Option<Self::Item> {
+        unsafe {
+            loop {
+                let mut capture_index = 0u32;
+                let mut query_index = 0u32;
+                let mut m = MaybeUninit::<ffi::TSQueryMatch>::uninit();
+                if ffi::ts_query_cursor_next_query_capture(
+                    self.ptr,
+                    m.as_mut_ptr(),
+                    &mut capture_index as *mut u32,
+                    &mut query_index as *mut u32,
+                ) {
+                    let result = QueryMatch::new(m.assume_init(), self.ptr);
+                    if result.satisfies_text_predicates(
+                        self.queries[query_index as usize],
+                        &mut self.buffer1,
+                        &mut self.buffer2,
+                        &mut self.text_provider,
+                    ) {
+                        return Some((query_index as usize, result, capture_index as usize));
+                    } else {
+                        result.remove();
+                    }
+                } else {
+                    return None;
+                }
+            }
+        }
+    }
+}
+
 impl<'a, 'tree, T: TextProvider<'a>> QueryMatches<'a, 'tree, T> {
     #[doc(alias = "ts_query_cursor_set_byte_range")]
     pub fn set_byte_range(&mut self, range: ops::Range<usize>) {
@@ -2174,6 +3126,10 @@ impl<'a> TextProvider<'a> for &'a [u8] {
     fn text(&mut self, node: Node) -> Self::I {
         iter::once(&self[node.byte_range()])
     }
+
+    fn bytes(&self) -> Option<&'a [u8]> {
+        Some(self)
+    }
 }
 
 impl PartialEq for Query {
@@ -2194,6 +3150,132 @@ impl Drop for QueryCursor {
     }
 }
 
+impl<'query> QuerySession<'query> {
+    /// Create a new session for the given query.
+    #[doc(alias = "ts_query_session_new")]
+    pub fn new(query: &'query Query) -> Self {
+        QuerySession {
+            ptr: unsafe { NonNull::new_unchecked(ffi::ts_query_session_new(query.ptr.as_ptr())) },
+            _query: PhantomData,
+        }
+    }
+
+    /// Keep the session in sync with source code that has been edited.
+    ///
+    /// Every edit that is applied to the tree with [`Tree::edit`] must also be applied to the
+    /// session, before the session is updated with the reparsed tree.
+    #[doc(alias = "ts_query_session_edit")]
+    pub fn edit(&mut self, edit: &InputEdit) {
+        let edit = edit.into();
+        unsafe { ffi::ts_query_session_edit(self.ptr.as_ptr(), &edit) };
+    }
+
+    /// Update the session to reflect a new syntax tree, whose source code is `text`.
+    ///
+    /// The first update searches the whole tree. After that, each tree must be the result of
+    /// reparsing the previous one, after it was edited in the same way as the session. Text
+    /// predicates are evaluated against `text`, and the other predicates are ignored.
+    #[doc(alias = "ts_query_session_update")]
+    pub fn update(&mut self, tree: &Tree, text: &[u8]) {
+        unsafe {
+            ffi::ts_query_session_set_text_input(self.ptr.as_ptr(), text_input(Some(&text)));
+            ffi::ts_query_session_update(self.ptr.as_ptr(), tree.0.as_ptr());
+            ffi::ts_query_session_set_text_input(self.ptr.as_ptr(), text_input(None));
+        }
+    }
+
+    /// Get all of the matches in the current tree, ordered by the start of their first
+    /// capture.
+    #[doc(alias = "ts_query_session_matches")]
+    pub fn matches(&self) -> Vec<QuerySessionMatch> {
+        let mut count = 0;
+        let matches = unsafe { ffi::ts_query_session_matches(self.ptr.as_ptr(), &mut count) };
+        Self::convert_matches(matches, count)
+    }
+
+    /// Get the matches that were added by the last call to [`update`](QuerySession::update).
+    #[doc(alias = "ts_query_session_added_matches")]
+    pub fn added_matches(&self) -> Vec<QuerySessionMatch> {
+        let mut count = 0;
+        let matches = unsafe { ffi::ts_query_session_added_matches(self.ptr.as_ptr(), &mut count) };
+        Self::convert_matches(matches, count)
+    }
+
+    /// Get the matches that were removed by the last call to
+    /// [`update`](QuerySession::update).
+    #[doc(alias = "ts_query_session_removed_matches")]
+    pub fn removed_matches(&self) -> Vec<QuerySessionMatch> {
+        let mut count = 0;
+        let matches =
+            unsafe { ffi::ts_query_session_removed_matches(self.ptr.as_ptr(), &mut count) };
+        Self::convert_matches(matches, count)
+    }
+
+    fn convert_matches(
+        matches: *const ffi::TSQuerySessionMatch,
+        count: u32,
+    ) -> Vec<QuerySessionMatch> {
+        if count == 0 {
+            return Vec::new();
+        }
+        let matches = unsafe { slice::from_raw_parts(matches, count as usize) };
+        matches
+            .iter()
+            .map(|m| {
+                let captures =
+                    unsafe { slice::from_raw_parts(m.captures, m.capture_count as usize) };
+                QuerySessionMatch {
+                    id: m.id,
+                    pattern_index: m.pattern_index as usize,
+                    captures: captures
+                        .iter()
+                        .map(|c| QuerySessionCapture {
+                            range: c.range.into(),
+                            kind_id: c.symbol,
+                            index: c.index,
+                        })
+                        .collect(),
+                }
+            })
+            .collect()
+    }
+}
+
+impl<'query> Drop for QuerySession<'query> {
+    fn drop(&mut self) {
+        unsafe { ffi::ts_query_session_delete(self.ptr.as_ptr()) }
+    }
+}
+
+/// Create an input that reads UTF-8 text from the slice that `text` points to. The slice
+/// reference must stay in place for as long as the input is used.
+fn text_input(text: Option<&&[u8]>) -> ffi::TSInput {
+    unsafe extern "C" fn read(
+        payload: *mut c_void,
+        byte_offset: u32,
+        _: ffi::TSPoint,
+        bytes_read: *mut u32,
+    ) -> *const c_char {
+        let text = *(payload as *const &[u8]);
+        let slice = text.get(byte_offset as usize..).unwrap_or(&[]);
+        *bytes_read = slice.len() as u32;
+        return slice.as_ptr() as *const c_char;
+    }
+
+    match text {
+        Some(text) => ffi::TSInput {
+            payload: text as *const &[u8] as *mut c_void,
+            read: Some(read),
+            encoding: ffi::TSInputEncoding_TSInputEncodingUTF8,
+        },
+        None => ffi::TSInput {
+            payload: ptr::null_mut(),
+            read: None,
+            encoding: ffi::TSInputEncoding_TSInputEncodingUTF8,
+        },
+    }
+}
+
 impl Point {
     pub fn new(row: usize, column: usize) -> Self {
         Point { row, column }
@@ -2321,6 +3403,12 @@ impl fmt::Display for IncludedRangesError {
     }
 }
 
+impl fmt::Display for EditBatchError {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        write!(f, "Overlapping edit by index: {}", self.0)
+    }
+}
+
 impl fmt::Display for LanguageError {
     fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
         write!(
@@ -2375,16 +3463,21 @@ pub unsafe fn set_allocator(
 }
 
 impl error::Error for IncludedRangesError {}
+impl error::Error for EditBatchError {}
 impl error::Error for LanguageError {}
 impl error::Error for QueryError {}
 
 unsafe impl Send for Language {}
 unsafe impl Send for Parser {}
+unsafe impl Send for ParserSnapshot {}
+unsafe impl Send for SubtreeCache {}
+unsafe impl Send for DeletionQueue {}
 unsafe impl Send for Query {}
 unsafe impl Send for QueryCursor {}
 unsafe impl Send for Tree {}
 unsafe impl Sync for Language {}
 unsafe impl Sync for Parser {}
+unsafe impl Sync for ParserSnapshot {}
 unsafe impl Sync for Query {}
 unsafe impl Sync for QueryCursor {}
 unsafe impl Sync for Tree {}
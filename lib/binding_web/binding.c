@@ -90,9 +90,8 @@ static void unmarshal_range(TSRange *range) {
   range->end_point.column = code_unit_to_byte(range->end_point.column);
 }
 
-static TSInputEdit unmarshal_edit() {
+static TSInputEdit unmarshal_edit(const void **address) {
   TSInputEdit edit;
-  const void **address = TRANSFER_BUFFER;
   edit.start_point = unmarshal_point(address); address += 2;
   edit.old_end_point = unmarshal_point(address); address += 2;
   edit.new_end_point = unmarshal_point(address); address += 2;
@@ -207,10 +206,21 @@ void ts_tree_root_node_wasm(const TSTree *tree) {
 }
 
 void ts_tree_edit_wasm(TSTree *tree) {
-  TSInputEdit edit = unmarshal_edit();
+  TSInputEdit edit = unmarshal_edit(TRANSFER_BUFFER);
   ts_tree_edit(tree, &edit);
 }
 
+bool ts_tree_edit_batch_wasm(TSTree *tree, const void **buffer, uint32_t count) {
+  TSInputEdit *edits = calloc(count, sizeof(TSInputEdit));
+  for (unsigned i = 0; i < count; i++) {
+    edits[i] = unmarshal_edit(&buffer[i * 9]);
+  }
+  bool result = ts_tree_edit_batch(tree, edits, count);
+  free(edits);
+  free(buffer);
+  return result;
+}
+
 void ts_tree_get_changed_ranges_wasm(TSTree *tree, TSTree *other) {
   unsigned range_count;
   TSRange *ranges = ts_tree_get_changed_ranges(tree, other, &range_count);
@@ -4,6 +4,7 @@ const SIZE_OF_INT = 4;
 const SIZE_OF_NODE = 5 * SIZE_OF_INT;
 const SIZE_OF_POINT = 2 * SIZE_OF_INT;
 const SIZE_OF_RANGE = 2 * SIZE_OF_INT + 2 * SIZE_OF_POINT;
+const SIZE_OF_EDIT = 3 * SIZE_OF_INT + 3 * SIZE_OF_POINT;
 const ZERO_POINT = {row: 0, column: 0};
 const QUERY_WORD_REGEX = /[\w-.]*/g;
 
@@ -159,10 +160,21 @@ class Tree {
   }
 
   edit(edit) {
-    marshalEdit(edit);
+    marshalEdit(TRANSFER_BUFFER, edit);
     C._ts_tree_edit_wasm(this[0]);
   }
 
+  editBatch(edits) {
+    if (edits.length === 0) return true;
+    const buffer = C._calloc(edits.length, SIZE_OF_EDIT);
+    let address = buffer;
+    for (let i = 0; i < edits.length; i++) {
+      marshalEdit(address, edits[i]);
+      address += SIZE_OF_EDIT;
+    }
+    return C._ts_tree_edit_batch_wasm(this[0], buffer, edits.length) !== 0;
+  }
+
   get rootNode() {
     C._ts_tree_root_node_wasm(this[0]);
     return unmarshalNode(this);
@@ -1186,8 +1198,7 @@ function unmarshalRange(address) {
   return result;
 }
 
-function marshalEdit(edit) {
-  let address = TRANSFER_BUFFER;
+function marshalEdit(address, edit) {
   marshalPoint(address, edit.startPosition); address += SIZE_OF_POINT;
   marshalPoint(address, edit.oldEndPosition); address += SIZE_OF_POINT;
   marshalPoint(address, edit.newEndPosition); address += SIZE_OF_POINT;
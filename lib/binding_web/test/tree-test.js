@@ -81,6 +81,40 @@ describe("Tree", () => {
     });
   });
 
+  describe('.editBatch', () => {
+    it('applies several edits that are expressed in terms of the original text', () => {
+      const input = 'abc + cde';
+      tree = parser.parse(input);
+
+      const [, insertion] = spliceInput(input, input.indexOf('bc'), 0, ' * ');
+      const [, replacement] = spliceInput(input, input.indexOf('cde'), 3, 'x');
+      assert.equal(tree.editBatch([replacement, insertion]), true);
+
+      const newInput = 'a * bc + x';
+      const sumNode = tree.rootNode.firstChild.firstChild;
+      assert.equal(sumNode.firstChild.startIndex, 0);
+      assert.equal(sumNode.firstChild.endIndex, 6);
+      assert.equal(sumNode.lastChild.startIndex, 9);
+      assert.equal(sumNode.lastChild.endIndex, 10);
+
+      tree = parser.parse(newInput, tree);
+      assert.equal(
+        tree.rootNode.toString(),
+        "(program (expression_statement (binary_expression left: (binary_expression left: (identifier) right: (identifier)) right: (identifier))))"
+      );
+    });
+
+    it('rejects overlapping edits', () => {
+      const input = 'abc + cde';
+      tree = parser.parse(input);
+
+      const [, edit1] = spliceInput(input, 0, 5, '');
+      const [, edit2] = spliceInput(input, 4, 3, '');
+      assert.equal(tree.editBatch([edit1, edit2]), false);
+      assert.equal(tree.rootNode.endIndex, 9);
+    });
+  });
+
   describe(".getChangedRanges(previous)", () => {
     it("reports the ranges of text whose syntactic meaning has changed", () => {
       let sourceCode = "abcdefg + hij";
@@ -130,6 +130,7 @@ declare module 'web-tree-sitter' {
       copy(): Tree;
       delete(): void;
       edit(delta: Edit): Tree;
+      editBatch(deltas: Edit[]): boolean;
       walk(): TreeCursor;
       getChangedRanges(other: Tree): Range[];
       getEditedRange(other: Tree): Range;
@@ -37,9 +37,13 @@ typedef uint16_t TSSymbol;
 typedef uint16_t TSFieldId;
 typedef struct TSLanguage TSLanguage;
 typedef struct TSParser TSParser;
+typedef struct TSParserSnapshot TSParserSnapshot;
+typedef struct TSSubtreeCache TSSubtreeCache;
 typedef struct TSTree TSTree;
+typedef struct TSDeletionQueue TSDeletionQueue;
 typedef struct TSQuery TSQuery;
 typedef struct TSQueryCursor TSQueryCursor;
+typedef struct TSQuerySession TSQuerySession;
 
 typedef enum {
   TSInputEncodingUTF8,
@@ -80,6 +84,13 @@ typedef struct {
   void (*log)(void *payload, TSLogType, const char *);
 } TSLogger;
 
+typedef struct {
+  void *payload;
+  void *(*allocate)(void *payload, size_t size);
+  void *(*reallocate)(void *payload, void *buffer, size_t size);
+  void (*deallocate)(void *payload, void *buffer);
+} TSAllocator;
+
 typedef struct {
   uint32_t start_byte;
   uint32_t old_end_byte;
@@ -95,12 +106,39 @@ typedef struct {
   const TSTree *tree;
 } TSNode;
 
+typedef struct {
+  void *payload;
+  void (*node_completed)(void *payload, TSNode node);
+} TSStreamCallback;
+
 typedef struct {
   const void *tree;
   const void *id;
   uint32_t context[2];
 } TSTreeCursor;
 
+typedef enum {
+  TSNodeChangeTypeInserted,
+  TSNodeChangeTypeRemoved,
+  TSNodeChangeTypeModified,
+} TSNodeChangeType;
+
+typedef struct {
+  TSNodeChangeType type;
+  TSNode old_node;
+  TSNode new_node;
+} TSNodeChange;
+
+typedef struct {
+  size_t heap_node_count;
+  size_t inline_leaf_count;
+  size_t heap_node_bytes;
+  size_t child_array_bytes;
+  size_t external_scanner_state_bytes;
+  size_t shared_bytes;
+  size_t total_bytes;
+} TSTreeMemoryUsage;
+
 typedef struct {
   TSNode node;
   uint32_t index;
@@ -121,6 +159,19 @@ typedef struct {
   const TSQueryCapture *captures;
 } TSQueryMatch;
 
+typedef struct {
+  TSRange range;
+  TSSymbol symbol;
+  uint32_t index;
+} TSQuerySessionCapture;
+
+typedef struct {
+  uint32_t id;
+  uint16_t pattern_index;
+  uint16_t capture_count;
+  const TSQuerySessionCapture *captures;
+} TSQuerySessionMatch;
+
 typedef enum {
   TSQueryPredicateStepTypeDone,
   TSQueryPredicateStepTypeCapture,
@@ -151,6 +202,21 @@ typedef enum {
  */
 TSParser *ts_parser_new(void);
 
+/**
+ * Create a new parser that allocates memory using the given allocator, instead
+ * of the functions passed to `ts_set_allocator`.
+ *
+ * The allocator is used for all of the parser's own memory, and for the trees
+ * that it produces, including their copies. The allocation functions must not
+ * return NULL, and are never passed a NULL buffer to deallocate. They are only
+ * called on the thread that is using the parser or tree.
+ *
+ * Because trees can only share nodes with trees that use the same allocator,
+ * an old tree that uses a different allocator is not reused when parsing, and
+ * a parser with its own allocator does not use a subtree cache.
+ */
+TSParser *ts_parser_new_with_allocator(TSAllocator allocator);
+
 /**
  * Delete the parser, freeing all of the memory that it used.
  */
@@ -237,7 +303,7 @@ const TSRange *ts_parser_included_ranges(
  *    `TSInputEncodingUTF8` or `TSInputEncodingUTF16`.
  *
  * This function returns a syntax tree on success, and `NULL` on failure. There
- * are three possible reasons for failure:
+ * are five possible reasons for failure:
  * 1. The parser does not have a language assigned. Check for this using the
       `ts_parser_language` function.
  * 2. Parsing was cancelled due to a timeout that was set by an earlier call to
@@ -249,6 +315,11 @@ const TSRange *ts_parser_included_ranges(
  *    earlier call to `ts_parser_set_cancellation_flag`. You can resume parsing
  *    from where the parser left out by calling `ts_parser_parse` again with
  *    the same arguments.
+ * 4. Parsing exceeded the memory limit that was set by an earlier call to
+ *    the `ts_parser_set_memory_limit` function. Call `ts_parser_reset` to
+ *    free the memory used by the unfinished parse.
+ * 5. The old tree is a partial tree that was produced by
+ *    `ts_parser_parse_partial`. Partial trees can't be reused.
  */
 TSTree *ts_parser_parse(
   TSParser *self,
@@ -283,6 +354,95 @@ TSTree *ts_parser_parse_string_encoding(
   TSInputEncoding encoding
 );
 
+/**
+ * Use the parser to quickly produce a syntax tree for one range of a document,
+ * such as the part of a large file that is currently visible in an editor.
+ *
+ * Rather than parsing the document from its beginning, the parser starts at
+ * the beginning of the line that contains the start of the given range, and
+ * stops at the end of the range, so the time taken is independent of the size
+ * of the document. Any syntax errors caused by starting in the middle of a
+ * construct are handled by the parser's normal error recovery. If included
+ * ranges have been set on the parser, only the parts of them that overlap
+ * the given range are parsed.
+ *
+ * The resulting tree is marked as partial (see `ts_tree_is_partial`). To get
+ * a complete tree, parse the whole document separately, for example on a
+ * background thread, or in several steps using `ts_parser_set_timeout_micros`.
+ * A partial tree can't be passed as the old tree to `ts_parser_parse`.
+ *
+ * This function returns `NULL` if the parser has no language, if the range
+ * is inconsistent (its start column is greater than its start byte, or it
+ * ends before it starts), if the range does not overlap the parser's included
+ * ranges, if the parse is halted by a timeout, a cancellation or the memory
+ * limit, or if the parser has an outstanding parse that has not been
+ * completed or reset. A halted partial parse is not resumed.
+ */
+TSTree *ts_parser_parse_partial(
+  TSParser *self,
+  TSInput input,
+  TSRange range
+);
+
+/**
+ * Set the callback that the parser should use to report complete syntax nodes
+ * while parsing a stream of text with `ts_parser_feed`.
+ *
+ * The parser does not take ownership over the callback payload.
+ */
+void ts_parser_set_stream_callback(TSParser *self, TSStreamCallback callback);
+
+/**
+ * Get the parser's current stream callback.
+ */
+TSStreamCallback ts_parser_stream_callback(const TSParser *self);
+
+/**
+ * Provide the parser with the next chunk of a stream of UTF8 text, and parse as
+ * much of the stream as possible.
+ *
+ * This can be used to parse a document that is too large to keep in memory,
+ * such as a log file or a stream of data from a network connection. Whenever
+ * the parser has completed some top-level nodes of the document, it passes
+ * them to the stream callback (see `ts_parser_set_stream_callback`), and then
+ * frees the memory that they used. A node passed to the callback is only valid
+ * until the callback returns. The parser only keeps the text that it may still
+ * need, so the memory used by a stream is bounded by the size of the largest
+ * top-level node, rather than the size of the whole document.
+ *
+ * Nodes are only reported when the top level of the grammar consists of a
+ * repetition of nodes, and while the parser is not considering more than one
+ * interpretation of the text. Otherwise, they remain in the tree returned by
+ * `ts_parser_finish`.
+ *
+ * This function returns `true` once the parser has consumed all of the text
+ * provided so far and is waiting for more. The parser remains in this state
+ * until the next call to `ts_parser_feed`, `ts_parser_finish`, or
+ * `ts_parser_reset`, each of which clears it before doing anything else.
+ *
+ * This function returns `false` if the parser has no language, if it has
+ * included ranges that do not cover the entire stream, if the stream has
+ * already been finished, or if parsing was halted by a timeout or a
+ * cancellation. In the last case, the text is kept, and parsing can be resumed
+ * by calling `ts_parser_feed` again, with or without more text.
+ */
+bool ts_parser_feed(TSParser *self, const char *bytes, uint32_t length);
+
+/**
+ * Mark the end of a stream of text that was provided using `ts_parser_feed`,
+ * and finish parsing it.
+ *
+ * The returned syntax tree contains the nodes that have not already been
+ * passed to the stream callback. Those nodes are replaced with a single hidden
+ * node, so the positions of all of the nodes in the tree are relative to the
+ * start of the stream. Afterwards, the parser is ready to parse a new stream.
+ *
+ * Like `ts_parser_parse`, this returns `NULL` if the parser has no language or
+ * if parsing was halted by a timeout or a cancellation, in which case it can be
+ * resumed by calling `ts_parser_finish` again.
+ */
+TSTree *ts_parser_finish(TSParser *self);
+
 /**
  * Instruct the parser to start the next parse from the beginning.
  *
@@ -294,6 +454,55 @@ TSTree *ts_parser_parse_string_encoding(
  */
 void ts_parser_reset(TSParser *self);
 
+/**
+ * Capture the state of a parse that is in progress, so that it can later be
+ * resumed from the same point using `ts_parser_restore`.
+ *
+ * A parse is left in progress when it is halted by a timeout or a cancellation
+ * flag. Snapshots are cheap to create, because the syntax nodes that have
+ * already been produced are shared with the parser rather than copied. This can
+ * be used to checkpoint the parsing of a long document, so that after an edit,
+ * parsing can resume from the nearest checkpoint that precedes the edit,
+ * instead of from the beginning of the document.
+ *
+ * Taking a snapshot modifies the parser, because the nodes that it shares with
+ * the snapshot no longer count toward the parser's memory usage.
+ *
+ * The snapshot must be freed with `ts_parser_snapshot_delete`.
+ */
+TSParserSnapshot *ts_parser_snapshot(TSParser *self);
+
+/**
+ * Get the furthest byte offset that the parser had consumed when the snapshot
+ * was taken.
+ *
+ * Parsing can only be resumed from a snapshot if none of the text before this
+ * offset has changed. Because the lexer may have looked at some text beyond
+ * the tokens that it returned, it is safest to use a snapshot whose offset is
+ * some distance before the first change.
+ */
+uint32_t ts_parser_snapshot_byte_offset(const TSParserSnapshot *self);
+
+/**
+ * Restore the parser to the state captured in the given snapshot. The next call
+ * to `ts_parser_parse` will resume parsing from that point.
+ *
+ * The old tree that the parser was reusing when the snapshot was taken is not
+ * restored. To reuse nodes past the snapshot's offset, pass the old tree, edited
+ * to match the document, to the next call to `ts_parser_parse`.
+ *
+ * If the snapshot was taken from a parser with a different language, or if text
+ * has been fed to the parser with `ts_parser_feed` since it was last reset, the
+ * parser is left unchanged and this function returns `false`. Otherwise, it
+ * returns `true`. A snapshot can be restored any number of times.
+ */
+bool ts_parser_restore(TSParser *self, const TSParserSnapshot *snapshot);
+
+/**
+ * Delete a parser snapshot, freeing all of the memory that it used.
+ */
+void ts_parser_snapshot_delete(TSParserSnapshot *self);
+
 /**
  * Set the maximum duration in microseconds that parsing should be allowed to
  * take before halting.
@@ -308,6 +517,33 @@ void ts_parser_set_timeout_micros(TSParser *self, uint64_t timeout);
  */
 uint64_t ts_parser_timeout_micros(const TSParser *self);
 
+/**
+ * Set the maximum number of bytes that parsing should be allowed to use
+ * before halting, or zero for no limit.
+ *
+ * This limits the memory that is measured by `ts_parser_memory_usage`.
+ * Ambiguous or erroneous input can cause this to grow far more quickly than
+ * the input itself. The limit is checked periodically, so it may be exceeded
+ * by a small amount. If it is exceeded, parsing will halt early, returning
+ * NULL. See `ts_parser_parse` for more information.
+ */
+void ts_parser_set_memory_limit(TSParser *self, size_t bytes);
+
+/**
+ * Get the number of bytes that parsing is allowed to use.
+ */
+size_t ts_parser_memory_limit(const TSParser *self);
+
+/**
+ * Get the number of bytes used by the parser's current parse.
+ *
+ * This counts the parse stack, and the syntax nodes that the parse has
+ * created and not yet handed off to a finished tree or a snapshot. It
+ * returns to its original value once a parse has finished, or once the
+ * parser has been reset.
+ */
+size_t ts_parser_memory_usage(const TSParser *self);
+
 /**
  * Set the parser's current cancellation flag pointer.
  *
@@ -322,6 +558,74 @@ void ts_parser_set_cancellation_flag(TSParser *self, const size_t *flag);
  */
 const size_t *ts_parser_cancellation_flag(const TSParser *self);
 
+/**
+ * Create a new, empty subtree cache.
+ *
+ * A subtree cache allows syntax nodes to be shared between trees that contain
+ * identical regions of text, such as license headers, generated code, or
+ * vendored libraries. When a parser is given a cache, then after each parse,
+ * it adds the larger nodes of the new tree to the cache. When parsing later
+ * documents, it reuses those nodes wherever the same text appears in the same
+ * parse state, instead of parsing that text again. Reused nodes are shared
+ * rather than copied, so this also reduces the memory used by the trees.
+ *
+ * The cache keeps a copy of the text of each cached node, which is compared to
+ * the current text before the node is reused. When the memory used by the
+ * cache exceeds its limit (see `ts_subtree_cache_set_memory_limit`), the
+ * nodes that were least recently added or reused are removed.
+ *
+ * A cache can be shared by any number of parsers, but it must not be used by
+ * more than one parser at a time. It is only used when the parser's included
+ * ranges span the entire document, and it is not used when parsing a stream
+ * of text with `ts_parser_feed`.
+ *
+ * The cache must be freed with `ts_subtree_cache_delete`.
+ */
+TSSubtreeCache *ts_subtree_cache_new(void);
+
+/**
+ * Set the maximum number of bytes that a subtree cache may use, or zero for no
+ * limit. The default limit is 64 MiB.
+ *
+ * This counts the copies of text that the cache keeps, and the syntax nodes
+ * that it keeps alive, even if they are also used by other trees. The limit is
+ * checked after each parse that adds nodes to the cache, so it may be exceeded
+ * until then.
+ */
+void ts_subtree_cache_set_memory_limit(TSSubtreeCache *self, size_t bytes);
+
+/**
+ * Get the number of bytes that a subtree cache is allowed to use.
+ */
+size_t ts_subtree_cache_memory_limit(const TSSubtreeCache *self);
+
+/**
+ * Get the number of bytes that a subtree cache is currently using.
+ */
+size_t ts_subtree_cache_memory_usage(const TSSubtreeCache *self);
+
+/**
+ * Remove all of the nodes from a subtree cache.
+ */
+void ts_subtree_cache_clear(TSSubtreeCache *self);
+
+/**
+ * Delete a subtree cache, freeing all of the memory that it used. Any trees
+ * that share nodes with the cache are unaffected.
+ */
+void ts_subtree_cache_delete(TSSubtreeCache *self);
+
+/**
+ * Set the subtree cache that the parser should use, or pass NULL to stop
+ * using a cache. The parser does not take ownership of the cache.
+ */
+void ts_parser_set_subtree_cache(TSParser *self, TSSubtreeCache *cache);
+
+/**
+ * Get the parser's current subtree cache.
+ */
+TSSubtreeCache *ts_parser_subtree_cache(const TSParser *self);
+
 /**
  * Set the logger that a parser should use during parsing.
  *
@@ -352,7 +656,9 @@ void ts_parser_print_dot_graphs(TSParser *self, int file);
  * Create a shallow copy of the syntax tree. This is very fast.
  *
  * You need to copy a syntax tree in order to use it on more than one thread at
- * a time, as syntax trees are not thread safe.
+ * a time, as syntax trees are not thread safe. If the library was compiled with
+ * `TS_NON_ATOMIC_REFCOUNTS`, trees cannot be used on more than one thread, even
+ * when they are copied.
  */
 TSTree *ts_tree_copy(const TSTree *self);
 
@@ -361,6 +667,37 @@ TSTree *ts_tree_copy(const TSTree *self);
  */
 void ts_tree_delete(TSTree *self);
 
+/**
+ * Delete the syntax tree without freeing the memory used by its nodes. Any
+ * nodes that are not shared with other trees are added to the given deletion
+ * queue, and are freed when the queue is drained. This takes constant time,
+ * so it can be used to avoid stalling a latency-sensitive thread when deleting
+ * a large tree.
+ */
+void ts_tree_delete_deferred(TSTree *self, TSDeletionQueue *queue);
+
+/**
+ * Create a queue for freeing the memory of deleted syntax trees incrementally.
+ *
+ * The queue is not thread safe, but it can be drained on a different thread
+ * from the one that adds trees to it, as long as the two threads do not use
+ * it at the same time.
+ */
+TSDeletionQueue *ts_deletion_queue_new(void);
+
+/**
+ * Free the memory used by the trees in the deletion queue, stopping once the
+ * given number of microseconds have elapsed. Pass zero to free everything.
+ *
+ * Returns true if the queue is now empty.
+ */
+bool ts_deletion_queue_drain(TSDeletionQueue *self, uint64_t timeout_micros);
+
+/**
+ * Delete a deletion queue, freeing all of the memory that remains in it.
+ */
+void ts_deletion_queue_delete(TSDeletionQueue *self);
+
 /**
  * Get the root node of the syntax tree.
  */
@@ -381,6 +718,12 @@ TSNode ts_tree_root_node_with_offset(
  */
 const TSLanguage *ts_tree_language(const TSTree *);
 
+/**
+ * Check whether the syntax tree was produced by `ts_parser_parse_partial`,
+ * and therefore only describes part of the document.
+ */
+bool ts_tree_is_partial(const TSTree *self);
+
 /**
  * Get the array of included ranges that was used to parse the syntax tree.
  *
@@ -397,6 +740,21 @@ TSRange *ts_tree_included_ranges(const TSTree *, uint32_t *length);
  */
 void ts_tree_edit(TSTree *self, const TSInputEdit *edit);
 
+/**
+ * Edit the syntax tree to reflect several source code changes at once.
+ *
+ * Every edit must be described in terms of the document as it was *before*
+ * any of the edits in the batch were made, and the edits must not overlap.
+ * They do not need to be given in any particular order. The result is the
+ * same as calling `ts_tree_edit` for each edit, in order from the last edit
+ * in the document to the first, but the tree is only traversed once, and each
+ * affected node is only copied once.
+ *
+ * If the edits overlap, the tree is left unchanged and this function returns
+ * `false`. Otherwise, it returns `true`.
+ */
+bool ts_tree_edit_batch(TSTree *self, const TSInputEdit *edits, uint32_t count);
+
 /**
  * Compare an old edited syntax tree to a new syntax tree representing the same
  * document, returning an array of ranges whose syntactic structure has changed.
@@ -417,6 +775,78 @@ TSRange *ts_tree_get_changed_ranges(
   uint32_t *length
 );
 
+/**
+ * Compare an old edited syntax tree to a new syntax tree representing the same
+ * document, returning an array of the nodes that have changed.
+ *
+ * The comparison is performed in the same way as for
+ * `ts_tree_get_changed_ranges`, and the same requirements apply to the old
+ * tree. Each change refers to the smallest visible nodes that differ:
+ * `TSNodeChangeTypeInserted` changes only have a `new_node`,
+ * `TSNodeChangeTypeRemoved` changes only have an `old_node`, and
+ * `TSNodeChangeTypeModified` changes have both nodes, which are of the same
+ * type, but whose contents may have changed. Nodes of one type that were
+ * replaced by nodes of another type are reported as removed and inserted.
+ * The absent node of each change is a null node.
+ *
+ * The returned array is allocated using `malloc` and the caller is responsible
+ * for freeing it using `free`. The length of the array will be written to the
+ * given `length` pointer. The returned nodes are only valid for as long as
+ * their respective trees are.
+ */
+TSNodeChange *ts_tree_get_changed_nodes(
+  const TSTree *old_tree,
+  const TSTree *new_tree,
+  uint32_t *length
+);
+
+/**
+ * Serialize a syntax tree into a compact binary format, so that it can be
+ * stored, for example in a cache that persists across runs of a program, and
+ * later restored using `ts_tree_deserialize`.
+ *
+ * The format does not depend on the memory layout of the tree, and contains
+ * everything that is needed to use the restored tree as the old tree when
+ * reparsing an edited document. It does not contain the document's text.
+ *
+ * The returned buffer is allocated using `malloc` and the caller is
+ * responsible for freeing it using `free`. The length of the buffer will be
+ * written to the given `length` pointer.
+ */
+char *ts_tree_serialize(const TSTree *self, uint32_t *length);
+
+/**
+ * Restore a syntax tree that was serialized using `ts_tree_serialize`.
+ *
+ * The data is only read during this call, so it can be a temporary buffer or a
+ * memory-mapped file. The resulting tree is equivalent to the original one, and
+ * can be passed as the old tree to `ts_parser_parse` after being edited to
+ * match any changes that have been made to the document since it was
+ * serialized.
+ *
+ * This returns `NULL` if the data is not a valid serialized tree, if it was
+ * written by an incompatible version of the library, or if the tree was
+ * produced by a different language than the one given.
+ */
+TSTree *ts_tree_deserialize(const TSLanguage *language, const char *data, uint32_t length);
+
+/**
+ * Measure the memory used by a syntax tree, and write the results to the
+ * given `TSTreeMemoryUsage` struct.
+ *
+ * Small leaf nodes are stored inline within their parents, so they do not
+ * use any memory of their own. The remaining nodes are allocated on the heap,
+ * along with the arrays of their children and any external scanner state
+ * that is too large to be stored inline.
+ *
+ * Trees share nodes with each other, both when they are copied using
+ * `ts_tree_copy` and when they are produced by reparsing an old tree. The
+ * `shared_bytes` field counts the memory of the nodes that are also used
+ * elsewhere, which would not be freed by deleting this tree. The
+ * `total_bytes` field includes the memory of the tree itself.
+ */
+void ts_tree_memory_usage(const TSTree *self, TSTreeMemoryUsage *usage);
+
 /**
  * Write a DOT graph describing the syntax tree to the given file.
  */
@@ -713,6 +1143,33 @@ TSQuery *ts_query_new(
  */
 void ts_query_delete(TSQuery *);
 
+/**
+ * Serialize a query into a compact binary format, so that it can be stored,
+ * for example in a cache that persists across runs of a program, and later
+ * restored using `ts_query_deserialize`, without parsing and analyzing its
+ * source again.
+ *
+ * Any captures or patterns that have been disabled remain disabled in the
+ * restored query.
+ *
+ * The returned buffer is allocated using `malloc` and the caller is
+ * responsible for freeing it using `free`. The length of the buffer will be
+ * written to the given `length` pointer.
+ */
+char *ts_query_serialize(const TSQuery *self, uint32_t *length);
+
+/**
+ * Restore a query that was serialized using `ts_query_serialize`.
+ *
+ * The data is only read during this call, so it can be a temporary buffer or a
+ * memory-mapped file.
+ *
+ * This returns `NULL` if the data is not a valid serialized query, if it was
+ * written by an incompatible version of the library, or if the query was
+ * created for a different language than the one given.
+ */
+TSQuery *ts_query_deserialize(const TSLanguage *language, const char *data, uint32_t length);
+
 /**
  * Get the number of patterns, captures, or string literals in the query.
  */
@@ -839,6 +1296,13 @@ void ts_query_disable_pattern(TSQuery *, uint32_t);
  */
 TSQueryCursor *ts_query_cursor_new(void);
 
+/**
+ * Create a new query cursor that allocates memory using the given allocator,
+ * instead of the functions passed to `ts_set_allocator`. See
+ * `ts_parser_new_with_allocator` for the requirements of the allocator.
+ */
+TSQueryCursor *ts_query_cursor_new_with_allocator(TSAllocator allocator);
+
 /**
  * Delete a query cursor, freeing all of the memory that it used.
  */
@@ -849,6 +1313,44 @@ void ts_query_cursor_delete(TSQueryCursor *);
  */
 void ts_query_cursor_exec(TSQueryCursor *, const TSQuery *, TSNode);
 
+/**
+ * Start running several queries on a given node, in a single walk of the tree.
+ *
+ * This is faster than running each query with its own cursor, because the
+ * tree is only traversed once. Matches and captures are returned in the same
+ * order as if the queries' patterns were all in one query, in the order of the
+ * given queries. Use `ts_query_cursor_next_query_match` or
+ * `ts_query_cursor_next_query_capture` to find out which query a match belongs
+ * to. A match's pattern index and capture indices refer to the patterns and
+ * captures of that query.
+ *
+ * The queries must not be modified or deleted while the cursor is running them.
+ * This returns `false` and leaves the cursor unchanged if the queries are for
+ * different languages, or if there are too many patterns altogether.
+ */
+bool ts_query_cursor_exec_queries(
+  TSQueryCursor *,
+  const TSQuery *const *queries,
+  uint32_t query_count,
+  TSNode
+);
+
+/**
+ * Give a query cursor access to the source code of the tree that it is
+ * querying, so that it can evaluate the `#eq?`, `#not-eq?`, `#match?` and
+ * `#not-match?` predicates itself. Matches that fail these predicates are
+ * then discarded as soon as they finish, and are never returned.
+ *
+ * Regexes are searched for with a small built-in regex engine. Predicates with
+ * regexes that it does not support, or whose result depends on how `\d`, `\w`
+ * or `\s` treat non-ASCII characters, are still left to the caller.
+ *
+ * The text is read using the given input, which must use the UTF-8 encoding.
+ * Pass an input whose `read` function is `NULL` to stop evaluating
+ * predicates. The input is kept across calls to `ts_query_cursor_exec`.
+ */
+void ts_query_cursor_set_text_input(TSQueryCursor *, TSInput);
+
 /**
  * Manage the maximum number of in-progress matches allowed by this query
  * cursor.
@@ -864,6 +1366,23 @@ bool ts_query_cursor_did_exceed_match_limit(const TSQueryCursor *);
 uint32_t ts_query_cursor_match_limit(const TSQueryCursor *);
 void ts_query_cursor_set_match_limit(TSQueryCursor *, uint32_t);
 
+/**
+ * Set the maximum number of bytes that a query cursor may use for storing the
+ * captures of in-progress matches, or zero for no limit.
+ *
+ * The captures of all in-progress matches are stored together in one
+ * contiguous block of memory, which grows as needed. If this limit would be
+ * exceeded, then the earliest-starting match will be dropped to make room for
+ * further captures, just as when the match limit is exceeded, and
+ * `ts_query_cursor_did_exceed_match_limit` will return true.
+ */
+void ts_query_cursor_set_capture_memory_limit(TSQueryCursor *self, size_t bytes);
+
+/**
+ * Get the number of bytes that a query cursor may use for storing captures.
+ */
+size_t ts_query_cursor_capture_memory_limit(const TSQueryCursor *self);
+
 /**
  * Set the range of bytes or (row, column) positions in which the query
  * will be executed.
@@ -871,6 +1390,25 @@ void ts_query_cursor_set_match_limit(TSQueryCursor *, uint32_t);
 void ts_query_cursor_set_byte_range(TSQueryCursor *, uint32_t, uint32_t);
 void ts_query_cursor_set_point_range(TSQueryCursor *, TSPoint, TSPoint);
 
+/**
+ * Set the range of bytes in which matches are allowed to start.
+ *
+ * A match starts where the node matched by the first step of its pattern
+ * starts. Unlike `ts_query_cursor_set_byte_range`, this doesn't cut off
+ * matches that start within the range but extend past its end, and it never
+ * returns a match that starts before the range. So running a query separately
+ * over several adjacent ranges finds each match exactly once, which makes it
+ * possible to split one large tree between several cursors, for example on
+ * different threads.
+ *
+ * An end byte of zero means that the range is unbounded.
+ */
+void ts_query_cursor_set_match_start_byte_range(
+  TSQueryCursor *,
+  uint32_t start_byte,
+  uint32_t end_byte
+);
+
 /**
  * Advance to the next match of the currently running query.
  *
@@ -880,6 +1418,18 @@ void ts_query_cursor_set_point_range(TSQueryCursor *, TSPoint, TSPoint);
 bool ts_query_cursor_next_match(TSQueryCursor *, TSQueryMatch *match);
 void ts_query_cursor_remove_match(TSQueryCursor *, uint32_t id);
 
+/**
+ * Advance to the next match, like `ts_query_cursor_next_match`, and write the
+ * index of the query that it belongs to to `*query_index`. This is only needed
+ * for cursors that were started with `ts_query_cursor_exec_queries`. For other
+ * cursors, the query index is always zero.
+ */
+bool ts_query_cursor_next_query_match(
+  TSQueryCursor *,
+  TSQueryMatch *match,
+  uint32_t *query_index
+);
+
 /**
  * Advance to the next capture of the currently running query.
  *
@@ -892,6 +1442,17 @@ bool ts_query_cursor_next_capture(
   uint32_t *capture_index
 );
 
+/**
+ * Advance to the next capture, like `ts_query_cursor_next_capture`, and write
+ * the index of the query that its match belongs to to `*query_index`.
+ */
+bool ts_query_cursor_next_query_capture(
+  TSQueryCursor *,
+  TSQueryMatch *match,
+  uint32_t *capture_index,
+  uint32_t *query_index
+);
+
 /**
  * Set the maximum start depth for a cursor.
  *
@@ -902,6 +1463,86 @@ bool ts_query_cursor_next_capture(
  */
 void ts_query_cursor_set_max_start_depth(TSQueryCursor *, uint32_t);
 
+/**
+ * Create a new query session, which keeps track of the matches of a query
+ * in a document as it is edited and reparsed.
+ *
+ * Rather than running the query over the whole tree after every change, a
+ * session only searches the ranges that were edited or whose syntactic
+ * structure changed, and reports which matches were added and removed.
+ * Matches that extend past those ranges, like the matches of non-local
+ * patterns, are found as well. Because a session outlives the trees that it is
+ * given, it describes each capture by its position and node type, not by its
+ * node. Matches without any captures are not tracked.
+ *
+ * The query must not be modified or deleted while the session is in use.
+ */
+TSQuerySession *ts_query_session_new(const TSQuery *query);
+
+/**
+ * Delete a query session, freeing all of the memory that it used.
+ */
+void ts_query_session_delete(TSQuerySession *);
+
+/**
+ * Give a query session access to the source code of the document, so that it
+ * can evaluate text predicates like `ts_query_cursor_set_text_input`. The
+ * input must describe the text of the tree that is passed to the next call to
+ * `ts_query_session_update`. Any predicates that the session can't evaluate
+ * itself are ignored.
+ */
+void ts_query_session_set_text_input(TSQuerySession *, TSInput);
+
+/**
+ * Keep a query session in sync with source code that has been edited.
+ *
+ * Every edit that is passed to `ts_tree_edit` for the tree that will be
+ * reparsed must also be passed to this function, before the session is
+ * updated with the new tree.
+ */
+void ts_query_session_edit(TSQuerySession *, const TSInputEdit *edit);
+
+/**
+ * Update a query session to reflect a new syntax tree.
+ *
+ * The first time that a session is updated, it runs its query over the whole
+ * tree, and every match is reported as added. After that, each tree must be
+ * the result of reparsing the previous one, after it was edited in the same
+ * way as the session.
+ */
+void ts_query_session_update(TSQuerySession *, const TSTree *tree);
+
+/**
+ * Get the matches of a query session's query in its current tree.
+ *
+ * The matches are ordered by the start of their first capture. Each match
+ * keeps the same id for as long as it exists in the session's trees.
+ * The returned array is owned by the session, and remains valid until the next
+ * call to `ts_query_session_edit` or `ts_query_session_update`. The length of
+ * the array will be written to the given `count` pointer.
+ */
+const TSQuerySessionMatch *ts_query_session_matches(
+  const TSQuerySession *,
+  uint32_t *count
+);
+
+/**
+ * Get the matches that were added or removed by the last call to
+ * `ts_query_session_update`.
+ *
+ * The positions of both kinds of matches refer to the document at the time of
+ * that update. The returned arrays are owned by the session, and remain valid
+ * until the next call to `ts_query_session_update`.
+ */
+const TSQuerySessionMatch *ts_query_session_added_matches(
+  const TSQuerySession *,
+  uint32_t *count
+);
+const TSQuerySessionMatch *ts_query_session_removed_matches(
+  const TSQuerySession *,
+  uint32_t *count
+);
+
 /**********************/
 /* Section - Language */
 /**********************/
@@ -977,6 +1618,9 @@ uint32_t ts_language_version(const TSLanguage *);
  *  1. All the existing objects have been freed.
  *  2. The new allocator shares its state with the old one, so it is capable
  *     of freeing memory that was allocated by the old allocator.
+ *
+ * To use a separate allocator for a particular parser and the trees that it
+ * produces, see `ts_parser_new_with_allocator`.
  */
 void ts_set_allocator(
   void *(*new_malloc)(size_t),
@@ -985,6 +1629,27 @@ void ts_set_allocator(
 	void (*new_free)(void *)
 );
 
+/**
+ * Enable or disable counting the blocks of memory that the library allocates.
+ *
+ * Counting is disabled by default, because it adds an atomic operation to
+ * every allocation and deallocation. For the count to be exact, enable it
+ * before the library allocates any memory, and leave it enabled. Otherwise,
+ * blocks that are allocated and freed while counting is in different states
+ * make the count inaccurate.
+ */
+void ts_set_allocation_counting(bool enabled);
+
+/**
+ * Get the number of blocks of memory that the library has allocated and not
+ * yet freed, across all threads, while allocation counting was enabled (see
+ * `ts_set_allocation_counting`).
+ *
+ * Memory that is returned to the caller, such as the string returned by
+ * `ts_node_string`, is not included, because it is freed by the caller.
+ */
+size_t ts_allocation_count(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,5 +1,9 @@
 #include "alloc.h"
+#include "atomic.h"
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 static void *ts_malloc_default(size_t size) {
   void *result = malloc(size);
@@ -46,3 +50,111 @@ void ts_set_allocator(
   ts_current_free = new_free ? new_free : free;
 }
 
+
+#if defined(_MSC_VER)
+#define TS_THREAD_LOCAL __declspec(thread)
+#elif defined(__TINYC__)
+#define TS_THREAD_LOCAL
+#else
+#define TS_THREAD_LOCAL __thread
+#endif
+
+// The allocator of the parser, tree, or query cursor that the library is
+// currently operating on, or NULL if the global allocation functions should
+// be used.
+static TS_THREAD_LOCAL const TSAllocator *ts_scoped_allocator = NULL;
+
+const TSAllocator *ts_allocator_enter(const TSAllocator *allocator) {
+  const TSAllocator *previous = ts_scoped_allocator;
+  ts_scoped_allocator = allocator && allocator->allocate ? allocator : NULL;
+  return previous;
+}
+
+void ts_allocator_leave(const TSAllocator *previous) {
+  ts_scoped_allocator = previous;
+}
+
+TSAllocator ts_allocator_current(void) {
+  if (ts_scoped_allocator) return *ts_scoped_allocator;
+  TSAllocator result = {NULL, NULL, NULL, NULL};
+  return result;
+}
+
+bool ts_allocator_eq(const TSAllocator *self, const TSAllocator *other) {
+  return
+    self->payload == other->payload &&
+    self->allocate == other->allocate &&
+    self->reallocate == other->reallocate &&
+    self->deallocate == other->deallocate;
+}
+
+// Count the blocks that are allocated through the current allocation
+// functions, so that clients can monitor the library's memory usage. Counting
+// is opt-in, because it adds an atomic operation to every allocation. Blocks
+// that were allocated before counting was enabled may be freed afterwards, so
+// the count is interpreted as a signed value.
+static volatile bool ts_allocation_counting = false;
+static volatile size_t ts_allocation_count_value = 0;
+
+static inline void ts_allocation_count_add(size_t delta) {
+  if (ts_allocation_counting) atomic_size_add(&ts_allocation_count_value, delta);
+}
+
+void *ts_counted_malloc(size_t size) {
+  const TSAllocator *allocator = ts_scoped_allocator;
+  void *result = allocator
+    ? allocator->allocate(allocator->payload, size)
+    : ts_current_malloc(size);
+  if (result) ts_allocation_count_add(1);
+  return result;
+}
+
+void *ts_counted_calloc(size_t count, size_t size) {
+  const TSAllocator *allocator = ts_scoped_allocator;
+  void *result;
+  if (allocator) {
+    // Like `calloc`, reject sizes whose product overflows.
+    if (size != 0 && count > SIZE_MAX / size) return NULL;
+    result = allocator->allocate(allocator->payload, count * size);
+    if (result) memset(result, 0, count * size);
+  } else {
+    result = ts_current_calloc(count, size);
+  }
+  if (result) ts_allocation_count_add(1);
+  return result;
+}
+
+void *ts_counted_realloc(void *buffer, size_t size) {
+  const TSAllocator *allocator = ts_scoped_allocator;
+  void *result = allocator
+    ? allocator->reallocate(allocator->payload, buffer, size)
+    : ts_current_realloc(buffer, size);
+  if (!buffer && result) ts_allocation_count_add(1);
+  return result;
+}
+
+void ts_counted_free(void *buffer) {
+  const TSAllocator *allocator = ts_scoped_allocator;
+  if (!buffer) return;
+  ts_allocation_count_add((size_t)-1);
+  if (allocator) {
+    allocator->deallocate(allocator->payload, buffer);
+  } else {
+    ts_current_free(buffer);
+  }
+}
+
+// Stop counting a block of memory that is returned to the caller, who will
+// free it using `free`.
+void ts_disown(const void *buffer) {
+  if (buffer) ts_allocation_count_add((size_t)-1);
+}
+
+void ts_set_allocation_counting(bool enabled) {
+  ts_allocation_counting = enabled;
+}
+
+size_t ts_allocation_count(void) {
+  ptrdiff_t count = (ptrdiff_t)atomic_load(&ts_allocation_count_value);
+  return count > 0 ? (size_t)count : 0;
+}
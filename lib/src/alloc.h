@@ -16,18 +16,35 @@ extern void *(*ts_current_calloc)(size_t, size_t);
 extern void *(*ts_current_realloc)(void *, size_t);
 extern void (*ts_current_free)(void *);
 
+// Wrappers around the current allocation functions, which keep count of the
+// number of blocks that are allocated.
+void *ts_counted_malloc(size_t);
+void *ts_counted_calloc(size_t, size_t);
+void *ts_counted_realloc(void *, size_t);
+void ts_counted_free(void *);
+void ts_disown(const void *);
+
+// While the library operates on an object that has its own allocator, that
+// allocator is installed for the current thread, and is used by all of the
+// functions above. `ts_allocator_enter` returns the previously installed
+// allocator, which must be passed to `ts_allocator_leave` afterwards.
+const TSAllocator *ts_allocator_enter(const TSAllocator *);
+void ts_allocator_leave(const TSAllocator *);
+TSAllocator ts_allocator_current(void);
+bool ts_allocator_eq(const TSAllocator *, const TSAllocator *);
+
 // Allow clients to override allocation functions
 #ifndef ts_malloc
-#define ts_malloc  ts_current_malloc
+#define ts_malloc  ts_counted_malloc
 #endif
 #ifndef ts_calloc
-#define ts_calloc  ts_current_calloc
+#define ts_calloc  ts_counted_calloc
 #endif
 #ifndef ts_realloc
-#define ts_realloc ts_current_realloc
+#define ts_realloc ts_counted_realloc
 #endif
 #ifndef ts_free
-#define ts_free    ts_current_free
+#define ts_free    ts_counted_free
 #endif
 
 #ifdef __cplusplus
@@ -1,6 +1,7 @@
 #ifndef TREE_SITTER_ATOMIC_H_
 #define TREE_SITTER_ATOMIC_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __TINYC__
@@ -19,6 +20,11 @@ static inline uint32_t atomic_dec(volatile uint32_t *p) {
   return *p;
 }
 
+static inline size_t atomic_size_add(volatile size_t *p, size_t delta) {
+  *p += delta;
+  return *p;
+}
+
 #elif defined(_WIN32)
 
 #include <windows.h>
@@ -35,6 +41,14 @@ static inline uint32_t atomic_dec(volatile uint32_t *p) {
   return InterlockedDecrement((long volatile *)p);
 }
 
+static inline size_t atomic_size_add(volatile size_t *p, size_t delta) {
+#ifdef _WIN64
+  return InterlockedExchangeAdd64((LONG64 volatile *)p, (LONG64)delta) + delta;
+#else
+  return InterlockedExchangeAdd((long volatile *)p, (long)delta) + delta;
+#endif
+}
+
 #else
 
 static inline size_t atomic_load(const volatile size_t *p) {
@@ -53,6 +67,10 @@ static inline uint32_t atomic_dec(volatile uint32_t *p) {
   return __sync_sub_and_fetch(p, 1u);
 }
 
+static inline size_t atomic_size_add(volatile size_t *p, size_t delta) {
+  return __sync_add_and_fetch(p, delta);
+}
+
 #endif
 
 #endif  // TREE_SITTER_ATOMIC_H_
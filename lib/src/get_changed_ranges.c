@@ -3,6 +3,7 @@
 #include "./language.h"
 #include "./error_costs.h"
 #include "./tree_cursor.h"
+#include "./tree.h"
 #include <assert.h>
 
 // #define DEBUG_GET_CHANGED_RANGES
@@ -103,6 +104,72 @@ void ts_range_array_get_changed_ranges(
   }
 }
 
+#define NULL_NODE ((TSNode) {{0, 0, 0, 0}, NULL, NULL})
+
+static bool ts_node_change_array_contains(
+  const TSNodeChangeArray *self,
+  TSNode old_node,
+  TSNode new_node
+) {
+  for (unsigned i = self->size - 1; i + 1 > 0; i--) {
+    const TSNodeChange *change = &self->contents[i];
+    if (old_node.id && change->old_node.id) {
+      return ts_node_eq(change->old_node, old_node);
+    }
+    if (new_node.id && change->new_node.id) {
+      return ts_node_eq(change->new_node, new_node);
+    }
+  }
+  return false;
+}
+
+static void ts_node_change_array_add(
+  TSNodeChangeArray *self,
+  TSNode old_node,
+  TSNode new_node
+) {
+  if (!self || (!old_node.id && !new_node.id)) return;
+
+  if (!old_node.id || !new_node.id) {
+    // When nodes of different types overlap, the same node can be compared
+    // against several nodes from the other tree. Only report it once.
+    if (ts_node_change_array_contains(self, old_node, new_node)) return;
+
+    // A node that was removed and a node of the same type that was inserted
+    // in its place are reported as a single modification.
+    if (self->size > 0) {
+      TSNodeChange *last_change = array_back(self);
+      if (
+        last_change->type == TSNodeChangeTypeInserted && old_node.id &&
+        ts_node_symbol(last_change->new_node) == ts_node_symbol(old_node)
+      ) {
+        last_change->type = TSNodeChangeTypeModified;
+        last_change->old_node = old_node;
+        return;
+      }
+      if (
+        last_change->type == TSNodeChangeTypeRemoved && new_node.id &&
+        ts_node_symbol(last_change->old_node) == ts_node_symbol(new_node)
+      ) {
+        last_change->type = TSNodeChangeTypeModified;
+        last_change->new_node = new_node;
+        return;
+      }
+    }
+  }
+
+  TSNodeChange change = {
+    .type = !old_node.id
+      ? TSNodeChangeTypeInserted
+      : !new_node.id
+        ? TSNodeChangeTypeRemoved
+        : TSNodeChangeTypeModified,
+    .old_node = old_node,
+    .new_node = new_node,
+  };
+  array_push(self, change);
+}
+
 typedef struct {
   TreeCursor cursor;
   const TSLanguage *language;
@@ -134,7 +201,7 @@ static bool iterator_done(Iterator *self) {
   return self->cursor.stack.size == 0;
 }
 
-static Length iterator_start_position(Iterator *self) {
+static Length iterator_start_position(const Iterator *self) {
   TreeCursorEntry entry = *array_back(&self->cursor.stack);
   if (self->in_padding) {
     return entry.position;
@@ -143,7 +210,7 @@ static Length iterator_start_position(Iterator *self) {
   }
 }
 
-static Length iterator_end_position(Iterator *self) {
+static Length iterator_end_position(const Iterator *self) {
   TreeCursorEntry entry = *array_back(&self->cursor.stack);
   Length result = length_add(entry.position, ts_subtree_padding(*entry.subtree));
   if (self->in_padding) {
@@ -338,6 +405,130 @@ static IteratorComparison iterator_compare(
   return IteratorDiffers;
 }
 
+static TSSymbol iterator_alias_at(const Iterator *self, uint32_t depth) {
+  if (depth == 0) return 0;
+  const Subtree *parent = self->cursor.stack.contents[depth - 1].subtree;
+  return ts_language_alias_at(
+    self->language,
+    parent->ptr->production_id,
+    self->cursor.stack.contents[depth].structural_child_index
+  );
+}
+
+static TSNode iterator_visible_node(const Iterator *self) {
+  uint32_t i = self->cursor.stack.size - 1;
+
+  if (self->in_padding) {
+    if (i == 0) return NULL_NODE;
+    i--;
+  }
+
+  for (; i + 1 > 0; i--) {
+    TreeCursorEntry entry = self->cursor.stack.contents[i];
+    TSSymbol alias_symbol = ts_subtree_extra(*entry.subtree) ? 0 : iterator_alias_at(self, i);
+    if (ts_subtree_visible(*entry.subtree) || alias_symbol) {
+      return ts_node_new(
+        self->cursor.tree,
+        entry.subtree,
+        length_add(entry.position, ts_subtree_padding(*entry.subtree)),
+        alias_symbol
+      );
+    }
+  }
+
+  return NULL_NODE;
+}
+
+// Get the visible node that the iterator is currently within, if it starts
+// at or after the given position. Any node that starts before the position
+// has already been partially compared to the other tree.
+static TSNode iterator_node_since(const Iterator *self, Length position) {
+  if (self->in_padding) return NULL_NODE;
+  TSNode node = iterator_visible_node(self);
+  if (!node.id || ts_node_start_byte(node) < position.bytes) return NULL_NODE;
+  return node;
+}
+
+static TSNode iterator_skipped_node(const Iterator *self, Length position) {
+  if (!iterator_tree_is_visible(self)) return NULL_NODE;
+  return iterator_node_since(self, position);
+}
+
+static bool subtree_is_identical(Subtree self, Subtree other) {
+  if (self.data.is_inline != other.data.is_inline) return false;
+  if (self.data.is_inline) return memcmp(&self.data, &other.data, sizeof(self.data)) == 0;
+  return self.ptr == other.ptr;
+}
+
+// Find the largest subtree that starts at the iterators' current position
+// and that is shared by the old and new trees. When the parser reuses a node
+// from the old tree, the new tree points to the very same heap-allocated
+// subtree, so if that subtree has not been edited and it occurs at the same
+// depth in both trees, nothing within it can have changed, regardless of how
+// many nodes it contains.
+//
+// If the iterators are both within a shared subtree, then the parts of their
+// stacks below that subtree are identical too, so the stacks only need to be
+// compared from the bottom up, for as long as their entries are identical.
+// This usually stops at the very first entry. And the visible nodes below
+// the shared subtree are the same in both stacks, so the subtree is at the
+// same visible depth in both trees exactly when the iterators are.
+//
+// If such a subtree is found, move both iterators up to it, so that the
+// caller can skip over it in a single step.
+static bool iterator_ascend_to_shared_subtree(
+  Iterator *old_iter,
+  Iterator *new_iter,
+  const TSRangeArray *included_range_differences,
+  unsigned included_range_difference_index
+) {
+  if (old_iter->in_padding || new_iter->in_padding) return false;
+  if (old_iter->visible_depth != new_iter->visible_depth) return false;
+  uint32_t start_byte = iterator_start_position(old_iter).bytes;
+  if (iterator_start_position(new_iter).bytes != start_byte) return false;
+
+  uint32_t old_index = UINT32_MAX;
+  uint32_t new_index = UINT32_MAX;
+  for (
+    uint32_t i = old_iter->cursor.stack.size, j = new_iter->cursor.stack.size;
+    i > 0 && j > 0;
+    i--, j--
+  ) {
+    TreeCursorEntry old_entry = old_iter->cursor.stack.contents[i - 1];
+    TreeCursorEntry new_entry = new_iter->cursor.stack.contents[j - 1];
+    Subtree old_tree = *old_entry.subtree;
+    if (
+      !subtree_is_identical(old_tree, *new_entry.subtree) ||
+      new_entry.position.bytes != old_entry.position.bytes
+    ) break;
+    Length old_start = length_add(old_entry.position, ts_subtree_padding(old_tree));
+    if (old_start.bytes != start_byte) break;
+    if (
+      !old_tree.data.is_inline &&
+      !ts_subtree_has_changes(old_tree) &&
+      iterator_alias_at(new_iter, j - 1) == iterator_alias_at(old_iter, i - 1)
+    ) {
+      old_index = i - 1;
+      new_index = j - 1;
+    }
+  }
+  if (old_index == UINT32_MAX) return false;
+
+  // Even a shared subtree could differ internally if it contains a range of
+  // text that was previously excluded from the parse, or vice-versa.
+  Subtree shared_tree = *old_iter->cursor.stack.contents[old_index].subtree;
+  if (ts_range_array_intersects(
+    included_range_differences,
+    included_range_difference_index,
+    start_byte,
+    start_byte + ts_subtree_size(shared_tree).bytes
+  )) return false;
+
+  while (old_iter->cursor.stack.size > old_index + 1) iterator_ascend(old_iter);
+  while (new_iter->cursor.stack.size > new_index + 1) iterator_ascend(new_iter);
+  return true;
+}
+
 #ifdef DEBUG_GET_CHANGED_RANGES
 static inline void iterator_print_state(Iterator *self) {
   TreeCursorEntry entry = *array_back(&self->cursor.stack);
@@ -359,7 +550,8 @@ unsigned ts_subtree_get_changed_ranges(
   TreeCursor *cursor1, TreeCursor *cursor2,
   const TSLanguage *language,
   const TSRangeArray *included_range_differences,
-  TSRange **ranges
+  TSRange **ranges,
+  TSNodeChangeArray *changes
 ) {
   TSRangeArray results = array_new();
 
@@ -387,8 +579,14 @@ unsigned ts_subtree_get_changed_ranges(
     puts("");
     #endif
 
-    // Compare the old and new subtrees.
-    IteratorComparison comparison = iterator_compare(&old_iter, &new_iter);
+    // Compare the old and new subtrees. Subtrees that are shared between
+    // the two trees are known to match without any further comparison.
+    IteratorComparison comparison = iterator_ascend_to_shared_subtree(
+      &old_iter,
+      &new_iter,
+      included_range_differences,
+      included_range_difference_index
+    ) ? IteratorMatches : iterator_compare(&old_iter, &new_iter);
 
     // Even if the two subtrees appear to be identical, they could differ
     // internally if they contain a range of text that was previously
@@ -417,15 +615,31 @@ unsigned ts_subtree_get_changed_ranges(
           if (!iterator_descend(&new_iter, position.bytes)) {
             is_changed = true;
             next_position = iterator_end_position(&old_iter);
+            if (changes) {
+              ts_node_change_array_add(changes, iterator_node_since(&old_iter, position), NULL_NODE);
+            }
           }
         } else if (iterator_descend(&new_iter, position.bytes)) {
           is_changed = true;
           next_position = iterator_end_position(&new_iter);
+          if (changes) {
+            ts_node_change_array_add(changes, NULL_NODE, iterator_node_since(&new_iter, position));
+          }
         } else {
           next_position = length_min(
             iterator_end_position(&old_iter),
             iterator_end_position(&new_iter)
           );
+
+          // Neither subtree has any children at this position, so if they
+          // start here, they are the smallest nodes that may have changed.
+          if (changes) {
+            TSNode old_node = iterator_node_since(&old_iter, position);
+            TSNode new_node = iterator_node_since(&new_iter, position);
+            if (old_node.id && new_node.id) {
+              ts_node_change_array_add(changes, old_node, new_node);
+            }
+          }
         }
         break;
 
@@ -437,18 +651,34 @@ unsigned ts_subtree_get_changed_ranges(
           iterator_end_position(&old_iter),
           iterator_end_position(&new_iter)
         );
+        if (changes) {
+          ts_node_change_array_add(changes, iterator_node_since(&old_iter, position), NULL_NODE);
+          ts_node_change_array_add(changes, NULL_NODE, iterator_node_since(&new_iter, position));
+        }
         break;
     }
 
     // Ensure that both iterators are caught up to the current position.
+    // Unless the subtrees matched, any nodes that are skipped over in the
+    // process have no counterpart in the other tree.
     while (
       !iterator_done(&old_iter) &&
       iterator_end_position(&old_iter).bytes <= next_position.bytes
-    ) iterator_advance(&old_iter);
+    ) {
+      if (changes && comparison != IteratorMatches) {
+        ts_node_change_array_add(changes, iterator_skipped_node(&old_iter, position), NULL_NODE);
+      }
+      iterator_advance(&old_iter);
+    }
     while (
       !iterator_done(&new_iter) &&
       iterator_end_position(&new_iter).bytes <= next_position.bytes
-    ) iterator_advance(&new_iter);
+    ) {
+      if (changes && comparison != IteratorMatches) {
+        ts_node_change_array_add(changes, NULL_NODE, iterator_skipped_node(&new_iter, position));
+      }
+      iterator_advance(&new_iter);
+    }
 
     // Ensure that both iterators are at the same depth in the tree.
     while (old_iter.visible_depth > new_iter.visible_depth) {
@@ -486,6 +716,19 @@ unsigned ts_subtree_get_changed_ranges(
     }
   } while (!iterator_done(&old_iter) && !iterator_done(&new_iter));
 
+  // Any nodes that remain in one of the trees after the other tree has
+  // ended have no counterpart in the other tree.
+  if (changes) {
+    while (!iterator_done(&old_iter)) {
+      ts_node_change_array_add(changes, iterator_skipped_node(&old_iter, position), NULL_NODE);
+      iterator_advance(&old_iter);
+    }
+    while (!iterator_done(&new_iter)) {
+      ts_node_change_array_add(changes, NULL_NODE, iterator_skipped_node(&new_iter, position));
+      iterator_advance(&new_iter);
+    }
+  }
+
   Length old_size = ts_subtree_total_size(*old_tree);
   Length new_size = ts_subtree_total_size(*new_tree);
   if (old_size.bytes < new_size.bytes) {
@@ -9,6 +9,7 @@ extern "C" {
 #include "./subtree.h"
 
 typedef Array(TSRange) TSRangeArray;
+typedef Array(TSNodeChange) TSNodeChangeArray;
 
 void ts_range_array_get_changed_ranges(
   const TSRange *old_ranges, unsigned old_range_count,
@@ -26,7 +27,18 @@ unsigned ts_subtree_get_changed_ranges(
   TreeCursor *cursor1, TreeCursor *cursor2,
   const TSLanguage *language,
   const TSRangeArray *included_range_differences,
-  TSRange **ranges
+  TSRange **ranges,
+  TSNodeChangeArray *changes
+);
+
+// Compare two trees like `ts_tree_get_changed_ranges`, also collecting the
+// changed nodes if `changes` is not NULL. The returned array is still owned
+// by the library's allocator, so it must be freed with `ts_free`.
+TSRange *ts_tree__get_changed_ranges(
+  const TSTree *self,
+  const TSTree *other,
+  uint32_t *count,
+  TSNodeChangeArray *changes
 );
 
 #ifdef __cplusplus
@@ -135,3 +135,26 @@ TSFieldId ts_language_field_id_for_name(
   }
   return 0;
 }
+
+// Add a null-terminated string to an FNV-1a hash, including its terminator,
+// so that the boundaries between consecutive strings affect the hash.
+static uint32_t ts_language__hash_string(uint32_t hash, const char *string) {
+  for (;;) {
+    hash = (hash ^ (uint8_t)*string) * 16777619u;
+    if (!*string++) return hash;
+  }
+}
+
+// Hash the names of the language's symbols and fields, which distinguishes
+// grammars whose tables happen to have the same sizes.
+uint32_t ts_language_name_hash(const TSLanguage *self) {
+  uint32_t hash = 2166136261u;
+  uint32_t symbol_count = ts_language_symbol_count(self);
+  for (TSSymbol symbol = 0; symbol < symbol_count; symbol++) {
+    hash = ts_language__hash_string(hash, ts_language_symbol_name(self, symbol));
+  }
+  for (TSFieldId field_id = 1; field_id <= self->field_count; field_id++) {
+    hash = ts_language__hash_string(hash, ts_language_field_name_for_id(self, field_id));
+  }
+  return hash;
+}
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 #include "./lexer.h"
 #include "./subtree.h"
 #include "./length.h"
@@ -414,4 +415,193 @@ TSRange *ts_lexer_included_ranges(const Lexer *self, uint32_t *count) {
   return self->included_ranges;
 }
 
+// Advance the given position past a sequence of bytes in the input's encoding.
+static void ts_lexer__advance_position(
+  const Lexer *self,
+  Length *position,
+  const char *text,
+  uint32_t length
+) {
+  bool is_utf16 = self->input.encoding == TSInputEncodingUTF16;
+  for (uint32_t i = 0; i < length; i++) {
+    if (text[i] == '\n' && (!is_utf16 || (
+      ((position->bytes + i) & 1) == 0 &&
+      i + 1 < length &&
+      text[i + 1] == 0
+    ))) {
+      if (is_utf16) i++;
+      position->extent.row++;
+      position->extent.column = 0;
+    } else {
+      position->extent.column++;
+    }
+  }
+  position->bytes += length;
+}
+
+// A hash of a sequence of bytes, which is computed eight bytes at a time, and
+// which does not depend on how the bytes are divided into chunks.
+typedef struct {
+  uint64_t state;
+  uint64_t word;
+  uint32_t word_size;
+} TextHash;
+
+static inline void text_hash__mix(TextHash *self, uint64_t word) {
+  uint64_t state = (self->state ^ word) * 0x9e3779b97f4a7c15ull;
+  self->state = state ^ (state >> 29);
+}
+
+static inline void text_hash__push_byte(TextHash *self, uint8_t byte) {
+  self->word |= (uint64_t)byte << (8 * self->word_size);
+  if (++self->word_size == 8) {
+    text_hash__mix(self, self->word);
+    self->word = 0;
+    self->word_size = 0;
+  }
+}
+
+static inline void text_hash__push_word(TextHash *self, const uint8_t *bytes) {
+  text_hash__mix(self,
+    (uint64_t)bytes[0] | (uint64_t)bytes[1] << 8 |
+    (uint64_t)bytes[2] << 16 | (uint64_t)bytes[3] << 24 |
+    (uint64_t)bytes[4] << 32 | (uint64_t)bytes[5] << 40 |
+    (uint64_t)bytes[6] << 48 | (uint64_t)bytes[7] << 56
+  );
+}
+
+static inline uint64_t text_hash__value(const TextHash *self) {
+  uint64_t result = self->state ^ self->word ^ ((uint64_t)self->word_size << 56);
+  result *= 0xff51afd7ed558ccdull;
+  return result ^ (result >> 32);
+}
+
+// Compute hashes of the text that starts at the given position, for each of
+// the given lengths, which must be in ascending order. The text is read using
+// a single pass over the input. Returns the number of lengths for which enough
+// text was available.
+//
+// Because the input's callback may reuse its buffer, the lexer's current chunk
+// is discarded if any new text had to be read.
+uint32_t ts_lexer_hash_text(
+  Lexer *self,
+  Length start,
+  const uint32_t *lengths,
+  uint64_t *hashes,
+  uint32_t count
+) {
+  TextHash hash = {0x6a09e667f3bcc908ull, 0, 0};
+  uint32_t index = 0;
+  while (index < count && lengths[index] == 0) {
+    hashes[index++] = text_hash__value(&hash);
+  }
+
+  Length position = start;
+  bool did_read = false;
+  while (index < count) {
+    const uint8_t *chunk;
+    uint32_t chunk_size;
+    if (
+      !did_read && self->chunk &&
+      position.bytes >= self->chunk_start &&
+      position.bytes < self->chunk_start + self->chunk_size
+    ) {
+      chunk = (const uint8_t *)self->chunk + (position.bytes - self->chunk_start);
+      chunk_size = self->chunk_start + self->chunk_size - position.bytes;
+    } else {
+      chunk = (const uint8_t *)self->input.read(
+        self->input.payload,
+        position.bytes,
+        position.extent,
+        &chunk_size
+      );
+      did_read = true;
+      if (!chunk_size) break;
+    }
+
+    uint32_t offset = position.bytes - start.bytes;
+    uint32_t i = 0;
+    while (i < chunk_size && index < count) {
+      uint32_t end = lengths[index] - offset;
+      if (end > chunk_size) end = chunk_size;
+      while (i < end && hash.word_size > 0) text_hash__push_byte(&hash, chunk[i++]);
+      for (; i + 8 <= end; i += 8) text_hash__push_word(&hash, &chunk[i]);
+      while (i < end) text_hash__push_byte(&hash, chunk[i++]);
+      while (index < count && lengths[index] == offset + i) {
+        hashes[index++] = text_hash__value(&hash);
+      }
+    }
+
+    // The position is only needed in order to read the next chunk.
+    if (index < count) {
+      ts_lexer__advance_position(self, &position, (const char *)chunk, chunk_size);
+    }
+  }
+
+  if (did_read) ts_lexer__clear_chunk(self);
+  return index;
+}
+
+// Read the given number of bytes of text, starting at the given position, and
+// either copy them into a buffer or compare them to some existing text. Returns
+// the number of bytes that were available, or that matched.
+static uint32_t ts_lexer__visit_text(
+  Lexer *self,
+  Length start,
+  uint32_t length,
+  char *copy,
+  const char *compare
+) {
+  Length position = start;
+  bool did_read = false;
+  uint32_t offset = 0;
+  while (offset < length) {
+    const char *chunk;
+    uint32_t chunk_size;
+    if (
+      !did_read && self->chunk &&
+      position.bytes >= self->chunk_start &&
+      position.bytes < self->chunk_start + self->chunk_size
+    ) {
+      chunk = self->chunk + (position.bytes - self->chunk_start);
+      chunk_size = self->chunk_start + self->chunk_size - position.bytes;
+    } else {
+      chunk = self->input.read(
+        self->input.payload,
+        position.bytes,
+        position.extent,
+        &chunk_size
+      );
+      did_read = true;
+      if (!chunk_size) break;
+    }
+
+    uint32_t size = chunk_size;
+    if (size > length - offset) size = length - offset;
+    if (copy) {
+      memcpy(&copy[offset], chunk, size);
+    } else if (memcmp(&compare[offset], chunk, size) != 0) {
+      break;
+    }
+    offset += size;
+    if (offset < length) {
+      ts_lexer__advance_position(self, &position, chunk, chunk_size);
+    }
+  }
+
+  if (did_read) ts_lexer__clear_chunk(self);
+  return offset;
+}
+
+// Copy the given number of bytes of text, starting at the given position, into
+// a buffer. Returns the number of bytes that were available.
+uint32_t ts_lexer_copy_text(Lexer *self, Length start, char *buffer, uint32_t length) {
+  return ts_lexer__visit_text(self, start, length, buffer, NULL);
+}
+
+// Check if the text starting at the given position is equal to the given text.
+bool ts_lexer_text_eq(Lexer *self, Length start, const char *text, uint32_t length) {
+  return ts_lexer__visit_text(self, start, length, NULL, text) == length;
+}
+
 #undef LOG
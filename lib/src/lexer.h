@@ -41,6 +41,9 @@ void ts_lexer_advance_to_end(Lexer *);
 void ts_lexer_mark_end(Lexer *);
 bool ts_lexer_set_included_ranges(Lexer *self, const TSRange *ranges, uint32_t count);
 TSRange *ts_lexer_included_ranges(const Lexer *self, uint32_t *count);
+uint32_t ts_lexer_hash_text(Lexer *, Length, const uint32_t *, uint64_t *, uint32_t);
+uint32_t ts_lexer_copy_text(Lexer *, Length, char *, uint32_t);
+bool ts_lexer_text_eq(Lexer *, Length, const char *, uint32_t);
 
 #ifdef __cplusplus
 }
@@ -12,7 +12,10 @@
 #include "./node.c"
 #include "./parser.c"
 #include "./query.c"
+#include "./query_session.c"
+#include "./regex.c"
 #include "./stack.c"
 #include "./subtree.c"
+#include "./subtree_cache.c"
 #include "./tree_cursor.c"
 #include "./tree.c"
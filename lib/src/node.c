@@ -424,7 +424,9 @@ const char *ts_node_type(TSNode self) {
 }
 
 char *ts_node_string(TSNode self) {
-  return ts_subtree_string(ts_node__subtree(self), self.tree->language, false);
+  char *result = ts_subtree_string(ts_node__subtree(self), self.tree->language, false);
+  ts_disown(result);
+  return result;
 }
 
 bool ts_node_eq(TSNode self, TSNode other) {
@@ -17,6 +17,7 @@
 #include "./reusable_node.h"
 #include "./stack.h"
 #include "./subtree.h"
+#include "./subtree_cache.h"
 #include "./tree.h"
 
 #define LOG(...)                                                                            \
@@ -76,6 +77,9 @@ static const unsigned MAX_VERSION_COUNT_OVERFLOW = 4;
 static const unsigned MAX_SUMMARY_DEPTH = 16;
 static const unsigned MAX_COST_DIFFERENCE = 16 * ERROR_COST_PER_SKIPPED_TREE;
 static const unsigned OP_COUNT_PER_TIMEOUT_CHECK = 100;
+static const uint32_t SUBTREE_CACHE_MIN_BYTES = 256;
+static const uint32_t SUBTREE_CACHE_PREFIX_BYTES = 32;
+#define SUBTREE_CACHE_MAX_CANDIDATES 8
 
 typedef struct {
   Subtree token;
@@ -83,6 +87,23 @@ typedef struct {
   uint32_t byte_index;
 } TokenCache;
 
+typedef struct {
+  Subtree tree;
+  Length position;
+  Subtree last_external_token;
+  uint32_t child_index;
+  SubtreeCacheText *text;
+  uint32_t text_start;
+} SubtreeCacheFrame;
+
+typedef struct {
+  Array(char) buffer;
+  uint32_t buffer_offset;
+  TSStreamCallback callback;
+  bool is_finished;
+  bool is_starved;
+} InputStream;
+
 struct TSParser {
   Lexer lexer;
   Stack *stack;
@@ -99,12 +120,25 @@ struct TSParser {
   FILE *dot_graph_file;
   TSClock end_clock;
   TSDuration timeout_duration;
+  size_t memory_limit;
   unsigned accept_count;
   unsigned operation_count;
   const volatile size_t *cancellation_flag;
   Subtree old_tree;
   TSRangeArray included_range_differences;
   unsigned included_range_difference_index;
+  InputStream stream;
+  TSSubtreeCache *subtree_cache;
+  TSAllocator allocator;
+};
+
+struct TSParserSnapshot {
+  const TSLanguage *language;
+  SubtreePool tree_pool;
+  Stack *stack;
+  Subtree finished_tree;
+  unsigned accept_count;
+  TSAllocator allocator;
 };
 
 typedef struct {
@@ -223,17 +257,27 @@ static void ts_parser__breakdown_lookahead(
 ) {
   bool did_descend = false;
   Subtree tree = reusable_node_tree(reusable_node);
+
+  // A lookahead subtree that was taken from the subtree cache is not part of
+  // the old tree, so it is broken down by descending into its first children.
+  bool is_from_old_tree = tree.ptr == lookahead->ptr;
+  if (!is_from_old_tree) tree = *lookahead;
+
   while (ts_subtree_child_count(tree) > 0 && ts_subtree_parse_state(tree) != state) {
     LOG("state_mismatch sym:%s", TREE_NAME(tree));
-    reusable_node_descend(reusable_node);
-    tree = reusable_node_tree(reusable_node);
+    if (is_from_old_tree) {
+      reusable_node_descend(reusable_node);
+      tree = reusable_node_tree(reusable_node);
+    } else {
+      tree = ts_subtree_children(tree)[0];
+    }
     did_descend = true;
   }
 
   if (did_descend) {
+    ts_subtree_retain(tree);
     ts_subtree_release(&self->tree_pool, *lookahead);
     *lookahead = tree;
-    ts_subtree_retain(*lookahead);
   }
 }
 
@@ -568,8 +612,9 @@ static Subtree ts_parser__lex(
 
     if (found_external_token) {
       MutableSubtree mut_result = ts_subtree_to_mut_unsafe(result);
-      ts_external_scanner_state_init(
-        &mut_result.ptr->external_scanner_state,
+      ts_subtree_set_external_scanner_state(
+        &self->tree_pool,
+        mut_result,
         self->lexer.debug_buffer,
         external_scanner_state_len
       );
@@ -713,6 +758,227 @@ static Subtree ts_parser__reuse_node(
   return NULL_SUBTREE;
 }
 
+// The subtree cache is only used when the lexer can read the entire document,
+// so that the text of any cached subtree can be compared to the current text.
+// Because the cache can be shared by many parsers, it can only hold subtrees
+// that were allocated by the default allocator.
+static bool ts_parser__can_use_subtree_cache(TSParser *self) {
+  if (!self->subtree_cache || self->lexer.input.payload == &self->stream) return false;
+  if (self->allocator.allocate) return false;
+  uint32_t range_count;
+  const TSRange *ranges = ts_lexer_included_ranges(&self->lexer, &range_count);
+  return range_count == 1 && ranges[0].start_byte == 0 && ranges[0].end_byte == UINT32_MAX;
+}
+
+// Find the largest subtree in the subtree cache that was parsed starting in the
+// given state, with the same external scanner state, and whose text (including
+// the text that the lexer looked at beyond its end) matches the current text.
+// Candidates are found by comparing hashes, and then their text is compared.
+static Subtree ts_parser__get_cached_subtree(
+  TSParser *self,
+  TSStateId state,
+  Length position,
+  Subtree last_external_token,
+  TableEntry *table_entry
+) {
+  TSSubtreeCache *cache = self->subtree_cache;
+  if (
+    state == ERROR_STATE ||
+    !ts_parser__can_use_subtree_cache(self) ||
+    !ts_subtree_cache_has_state(cache, self->language, state)
+  ) return NULL_SUBTREE;
+
+  uint64_t prefix_hash;
+  if (!ts_lexer_hash_text(
+    &self->lexer, position, &SUBTREE_CACHE_PREFIX_BYTES, &prefix_hash, 1
+  )) return NULL_SUBTREE;
+
+  // The entries are ordered from the longest to the shortest, but the text
+  // is hashed in a single pass, from the shortest length to the longest.
+  const SubtreeCacheEntry *candidates[SUBTREE_CACHE_MAX_CANDIDATES];
+  uint32_t lengths[SUBTREE_CACHE_MAX_CANDIDATES];
+  uint64_t hashes[SUBTREE_CACHE_MAX_CANDIDATES];
+  uint32_t candidate_count = 0;
+  for (
+    const SubtreeCacheEntry *entry = ts_subtree_cache_find(cache, self->language, state, prefix_hash);
+    entry && candidate_count < SUBTREE_CACHE_MAX_CANDIDATES;
+    entry = ts_subtree_cache_find_next(cache, entry)
+  ) {
+    if (
+      entry->is_at_start != (position.bytes == 0) ||
+      !ts_subtree_external_scanner_state_eq(entry->last_external_token, last_external_token)
+    ) continue;
+    uint32_t i = SUBTREE_CACHE_MAX_CANDIDATES - ++candidate_count;
+    candidates[i] = entry;
+    lengths[i] = entry->hashed_bytes;
+  }
+  if (candidate_count == 0) return NULL_SUBTREE;
+
+  uint32_t first = SUBTREE_CACHE_MAX_CANDIDATES - candidate_count;
+  uint32_t hash_count = ts_lexer_hash_text(
+    &self->lexer, position, &lengths[first], &hashes[first], candidate_count
+  );
+  for (uint32_t i = first + hash_count; i > first; i--) {
+    const SubtreeCacheEntry *entry = candidates[i - 1];
+    if (hashes[i - 1] != entry->hash) continue;
+    Subtree result = entry->tree;
+    ts_language_table_entry(self->language, state, ts_subtree_leaf_symbol(result), table_entry);
+    if (!ts_parser__can_reuse_first_leaf(self, state, result, table_entry)) continue;
+    if (!ts_lexer_text_eq(
+      &self->lexer, position, &entry->text->contents[entry->text_offset], entry->hashed_bytes
+    )) continue;
+    ts_subtree_cache_touch(cache, entry);
+    LOG("reuse_cached_subtree symbol:%s", TREE_NAME(result));
+    ts_subtree_retain(result);
+    return result;
+  }
+
+  return NULL_SUBTREE;
+}
+
+// Describe a subtree of a finished tree as a subtree cache entry, if it can
+// be reused when the same text is parsed again.
+static bool ts_parser__subtree_cache_entry(
+  TSParser *self,
+  Subtree tree,
+  Length position,
+  Subtree last_external_token,
+  uint32_t end_byte,
+  SubtreeCacheEntry *entry
+) {
+  TSStateId state = ts_subtree_leaf_parse_state(tree);
+  if (
+    ts_subtree_has_changes(tree) ||
+    ts_subtree_error_cost(tree) > 0 ||
+    ts_subtree_is_fragile(tree) ||
+    ts_subtree_depends_on_column(tree) ||
+    ts_subtree_is_eof(tree) ||
+    ts_subtree_parse_state(tree) == TS_TREE_STATE_NONE ||
+    state == TS_TREE_STATE_NONE ||
+    state == ERROR_STATE
+  ) return false;
+
+  // Subtrees whose lookahead reached the end of the document can't be
+  // reused in a longer document.
+  uint32_t hashed_bytes = ts_subtree_total_bytes(tree) + ts_subtree_lookahead_bytes(tree);
+  if (hashed_bytes > end_byte - position.bytes) return false;
+
+  uint32_t lengths[2] = {SUBTREE_CACHE_PREFIX_BYTES, hashed_bytes};
+  uint64_t hashes[2];
+  if (ts_lexer_hash_text(&self->lexer, position, lengths, hashes, 2) < 2) return false;
+
+  *entry = (SubtreeCacheEntry) {
+    .language = self->language,
+    .prefix_hash = hashes[0],
+    .hash = hashes[1],
+    .hashed_bytes = hashed_bytes,
+    .parse_state = state,
+    .is_at_start = position.bytes == 0,
+    .tree = tree,
+    .last_external_token = last_external_token,
+  };
+  return true;
+}
+
+// Copy the text of a subtree for a new subtree cache entry. The memory used by
+// the subtree's nodes is charged to the cache along with the text.
+static SubtreeCacheText *ts_parser__new_subtree_cache_text(
+  TSParser *self,
+  Subtree tree,
+  Length position,
+  uint32_t length
+) {
+  TSTreeMemoryUsage usage = {0};
+  ts_subtree_memory_usage(tree, &usage);
+  SubtreeCacheText *text = ts_subtree_cache_text_new(
+    self->subtree_cache,
+    length,
+    usage.heap_node_bytes + usage.child_array_bytes + usage.external_scanner_state_bytes
+  );
+  if (ts_lexer_copy_text(&self->lexer, position, text->contents, length) < length) {
+    ts_subtree_cache_text_release(self->subtree_cache, text);
+    return NULL;
+  }
+  return text;
+}
+
+// Add the larger subtrees of a finished tree to the subtree cache. When a
+// subtree is already cached, its descendants have been cached along with it.
+// The entries for a new subtree's descendants share the copy of its text.
+static void ts_parser__add_to_subtree_cache(TSParser *self, Subtree root) {
+  TSSubtreeCache *cache = self->subtree_cache;
+  uint32_t end_byte = ts_subtree_total_bytes(root);
+  Array(SubtreeCacheFrame) frames = array_new();
+  array_push(&frames, ((SubtreeCacheFrame) {
+    .tree = root,
+    .position = length_zero(),
+    .last_external_token = NULL_SUBTREE,
+    .child_index = 0,
+    .text = NULL,
+    .text_start = 0,
+  }));
+
+  while (frames.size > 0) {
+    SubtreeCacheFrame *frame = array_back(&frames);
+    if (frame->child_index == ts_subtree_child_count(frame->tree)) {
+      if (frame->text) ts_subtree_cache_text_release(cache, frame->text);
+      frames.size--;
+      continue;
+    }
+
+    Subtree child = ts_subtree_children(frame->tree)[frame->child_index++];
+    Length position = frame->position;
+    Subtree last_external_token = frame->last_external_token;
+    frame->position = length_add(frame->position, ts_subtree_total_size(child));
+    if (ts_subtree_has_external_tokens(child)) {
+      frame->last_external_token = ts_subtree_last_external_token(child);
+    }
+    if (ts_subtree_total_bytes(child) < SUBTREE_CACHE_MIN_BYTES) continue;
+
+    SubtreeCacheText *text = frame->text;
+    uint32_t text_start = frame->text_start;
+    if (text) text->ref_count++;
+
+    // A node that spans the same text as its parent would have the same
+    // cache key, so only the parent is cached.
+    SubtreeCacheEntry entry;
+    if (
+      ts_subtree_total_bytes(child) < ts_subtree_total_bytes(frame->tree) &&
+      ts_parser__subtree_cache_entry(self, child, position, last_external_token, end_byte, &entry)
+    ) {
+      if (!text || position.bytes + entry.hashed_bytes > text_start + text->length) {
+        if (text) ts_subtree_cache_text_release(cache, text);
+        text = ts_parser__new_subtree_cache_text(self, child, position, entry.hashed_bytes);
+        text_start = position.bytes;
+      }
+      if (text) {
+        entry.text = text;
+        entry.text_offset = position.bytes - text_start;
+        if (!ts_subtree_cache_insert(cache, &entry)) {
+          ts_subtree_cache_text_release(cache, text);
+          continue;
+        }
+      }
+    }
+
+    if (ts_subtree_child_count(child) > 0) {
+      array_push(&frames, ((SubtreeCacheFrame) {
+        .tree = child,
+        .position = position,
+        .last_external_token = last_external_token,
+        .child_index = 0,
+        .text = text,
+        .text_start = text_start,
+      }));
+    } else if (text) {
+      ts_subtree_cache_text_release(cache, text);
+    }
+  }
+
+  array_delete(&frames);
+  ts_subtree_cache_trim(cache);
+}
+
 // Determine if a given tree should be replaced by an alternative tree.
 //
 // The decision is based on the trees' error costs (if any), their dynamic precedence,
@@ -776,6 +1042,7 @@ static bool ts_parser__select_children(
   // room for its own heap data. The scratch tree is never explicitly released,
   // so the same 'scratch trees' array can be reused again later.
   MutableSubtree scratch_tree = ts_subtree_new_node(
+    NULL,
     ts_subtree_symbol(left),
     &self->scratch_trees,
     0,
@@ -859,7 +1126,7 @@ static StackVersion ts_parser__reduce(
     ts_subtree_array_remove_trailing_extras(&children, &self->trailing_extras);
 
     MutableSubtree parent = ts_subtree_new_node(
-      symbol, &children, production_id, self->language
+      &self->tree_pool, symbol, &children, production_id, self->language
     );
 
     // This pop operation may have caused multiple stack versions to collapse
@@ -883,7 +1150,7 @@ static StackVersion ts_parser__reduce(
         ts_subtree_release(&self->tree_pool, ts_subtree_from_mut(parent));
         array_swap(&self->trailing_extras, &self->trailing_extras2);
         parent = ts_subtree_new_node(
-          symbol, &children, production_id, self->language
+          &self->tree_pool, symbol, &children, production_id, self->language
         );
       } else {
         array_clear(&self->trailing_extras2);
@@ -951,6 +1218,7 @@ static void ts_parser__accept(
         }
         array_splice(&trees, j, 1, child_count, children);
         root = ts_subtree_from_mut(ts_subtree_new_node(
+          &self->tree_pool,
           ts_subtree_symbol(tree),
           &trees,
           tree.ptr->production_id,
@@ -1112,7 +1380,7 @@ static bool ts_parser__recover_to_state(
     ts_subtree_array_remove_trailing_extras(&slice.subtrees, &self->trailing_extras);
 
     if (slice.subtrees.size > 0) {
-      Subtree error = ts_subtree_new_error_node(&slice.subtrees, true, self->language);
+      Subtree error = ts_subtree_new_error_node(&self->tree_pool, &slice.subtrees, true, self->language);
       ts_stack_push(self->stack, slice.version, error, false, goal_state);
     } else {
       array_delete(&slice.subtrees);
@@ -1229,7 +1497,7 @@ static void ts_parser__recover(
   if (ts_subtree_is_eof(lookahead)) {
     LOG("recover_eof");
     SubtreeArray children = array_new();
-    Subtree parent = ts_subtree_new_error_node(&children, false, self->language);
+    Subtree parent = ts_subtree_new_error_node(&self->tree_pool, &children, false, self->language);
     ts_stack_push(self->stack, version, parent, false, 1);
     ts_parser__accept(self, version, lookahead);
     return;
@@ -1262,6 +1530,7 @@ static void ts_parser__recover(
   array_reserve(&children, 1);
   array_push(&children, lookahead);
   MutableSubtree error_repeat = ts_subtree_new_node(
+    &self->tree_pool,
     ts_builtin_sym_error_repeat,
     &children,
     0,
@@ -1290,6 +1559,7 @@ static void ts_parser__recover(
     ts_stack_renumber_version(self->stack, pop.contents[0].version, version);
     array_push(&pop.contents[0].subtrees, ts_subtree_from_mut(error_repeat));
     error_repeat = ts_subtree_new_node(
+      &self->tree_pool,
       ts_builtin_sym_error_repeat,
       &pop.contents[0].subtrees,
       0,
@@ -1404,6 +1674,11 @@ static void ts_parser__handle_error(
   LOG_STACK();
 }
 
+static bool ts_parser__has_exceeded_memory_limit(TSParser *self) {
+  if (!self->memory_limit) return false;
+  return ts_parser_memory_usage(self) > self->memory_limit;
+}
+
 static bool ts_parser__advance(
   TSParser *self,
   StackVersion version,
@@ -1425,9 +1700,19 @@ static bool ts_parser__advance(
   }
 
   // If no node from the previous syntax tree could be reused, then try to
-  // reuse the token previously returned by the lexer.
+  // reuse a node from another tree with identical text, using the subtree cache.
   if (!lookahead.ptr) {
     did_reuse = false;
+    if (allow_node_reuse) {
+      lookahead = ts_parser__get_cached_subtree(
+        self, state, ts_stack_position(self->stack, version),
+        last_external_token, &table_entry
+      );
+    }
+  }
+
+  // Otherwise, try to reuse the token previously returned by the lexer.
+  if (!lookahead.ptr) {
     lookahead = ts_parser__get_cached_token(
       self, state, position, last_external_token, &table_entry
     );
@@ -1440,6 +1725,16 @@ static bool ts_parser__advance(
       needs_lex = false;
       lookahead = ts_parser__lex(self, version, state);
 
+      // When parsing a stream, the lexer may reach the end of the text that
+      // has been provided so far. The token might continue in text that has
+      // not been provided yet, so halt until more text is available.
+      if (self->stream.is_starved) {
+        if (lookahead.ptr) {
+          ts_subtree_release(&self->tree_pool, lookahead);
+        }
+        return false;
+      }
+
       if (lookahead.ptr) {
         ts_parser__set_cached_token(self, position, last_external_token, lookahead);
         ts_language_table_entry(self->language, state, ts_subtree_symbol(lookahead), &table_entry);
@@ -1453,15 +1748,16 @@ static bool ts_parser__advance(
       }
     }
 
-    // If a cancellation flag or a timeout was provided, then check every
-    // time a fixed number of parse actions has been processed.
+    // If a cancellation flag, a timeout, or a memory limit was provided, then
+    // check every time a fixed number of parse actions has been processed.
     if (++self->operation_count == OP_COUNT_PER_TIMEOUT_CHECK) {
       self->operation_count = 0;
     }
     if (
       self->operation_count == 0 &&
       ((self->cancellation_flag && atomic_load(self->cancellation_flag)) ||
-       (!clock_is_null(self->end_clock) && clock_is_gt(clock_now(), self->end_clock)))
+       (!clock_is_null(self->end_clock) && clock_is_gt(clock_now(), self->end_clock)) ||
+       ts_parser__has_exceeded_memory_limit(self))
     ) {
       if (lookahead.ptr) {
         ts_subtree_release(&self->tree_pool, lookahead);
@@ -1584,7 +1880,12 @@ static bool ts_parser__advance(
         );
 
         MutableSubtree mutable_lookahead = ts_subtree_make_mut(&self->tree_pool, lookahead);
-        ts_subtree_set_symbol(&mutable_lookahead, self->language->keyword_capture_token, self->language);
+        ts_subtree_set_symbol(
+          &self->tree_pool,
+          &mutable_lookahead,
+          self->language->keyword_capture_token,
+          self->language
+        );
         lookahead = ts_subtree_from_mut(mutable_lookahead);
         continue;
       }
@@ -1728,32 +2029,174 @@ static bool ts_parser_has_outstanding_parse(TSParser *self) {
   );
 }
 
+// Parser - Streaming
+
+// Whether any text has been fed to the parser since it was last reset.
+static bool ts_parser__is_streaming(const TSParser *self) {
+  return (
+    self->stream.buffer.size > 0 ||
+    self->stream.buffer_offset > 0 ||
+    self->stream.is_finished
+  );
+}
+
+static const char *ts_parser__stream_read(
+  void *payload,
+  uint32_t byte,
+  TSPoint position,
+  uint32_t *bytes_read
+) {
+  (void)position;
+  InputStream *self = payload;
+  uint32_t end = self->buffer_offset + self->buffer.size;
+  if (byte >= end) {
+    if (!self->is_finished) self->is_starved = true;
+    *bytes_read = 0;
+    return "";
+  }
+
+  // The lexer may briefly revisit a position whose text has already been
+  // discarded, before being moved to the position of the next token.
+  if (byte < self->buffer_offset) {
+    *bytes_read = 0;
+    return "";
+  }
+
+  *bytes_read = end - byte;
+  return &self->buffer.contents[byte - self->buffer_offset];
+}
+
+// If the bottom of the parse stack holds a repetition of complete top-level
+// nodes, pass each of those nodes to the stream callback, and then replace
+// the repetition with an empty placeholder that spans the same text, so that
+// the memory used by the nodes can be freed.
+static void ts_parser__stream_emit_nodes(TSParser *self) {
+  if (!self->stream.callback.node_completed) return;
+  if (ts_stack_version_count(self->stack) != 1) return;
+
+  Subtree bottom = ts_stack_bottom_subtree(self->stack, 0);
+  if (!bottom.ptr || ts_subtree_child_count(bottom) == 0) return;
+  TSSymbol symbol = ts_subtree_symbol(bottom);
+  if (symbol == ts_builtin_sym_error_repeat) return;
+  TSSymbolMetadata metadata = ts_language_symbol_metadata(self->language, symbol);
+  if (metadata.visible || metadata.named) return;
+
+  // The placeholder must have the same error cost as the nodes that it
+  // replaces, which is only possible if it is not stored inline.
+  Subtree placeholder = ts_subtree_new_leaf(
+    &self->tree_pool,
+    symbol,
+    ts_subtree_total_size(bottom),
+    length_zero(),
+    0,
+    ts_subtree_parse_state(bottom),
+    false,
+    false,
+    false,
+    self->language
+  );
+  uint32_t error_cost = ts_subtree_error_cost(bottom);
+  if (error_cost > 0) {
+    if (placeholder.data.is_inline) return;
+    ts_subtree_set_error_cost(&self->tree_pool, ts_subtree_to_mut_unsafe(placeholder), error_cost);
+  }
+
+  TSTree tree = {
+    .root = bottom,
+    .language = self->language,
+    .included_ranges = NULL,
+    .included_range_count = 0,
+    .is_partial = false,
+  };
+  TSTreeCursor cursor = ts_tree_cursor_new(ts_tree_root_node(&tree));
+  if (ts_tree_cursor_goto_first_child(&cursor)) {
+    // Anything that the callback allocates belongs to the caller, so it must
+    // use the default allocator.
+    do {
+      const TSAllocator *previous_allocator = ts_allocator_enter(NULL);
+      self->stream.callback.node_completed(
+        self->stream.callback.payload,
+        ts_tree_cursor_current_node(&cursor)
+      );
+      ts_allocator_leave(previous_allocator);
+    } while (ts_tree_cursor_goto_next_sibling(&cursor));
+  }
+  ts_tree_cursor_delete(&cursor);
+
+  LOG("emit_stream_nodes symbol:%s", SYM_NAME(symbol));
+  ts_stack_replace_bottom_subtree(self->stack, 0, placeholder);
+}
+
+// Discard the buffered text that precedes every version of the parse stack.
+static void ts_parser__stream_discard_text(TSParser *self) {
+  uint32_t position = UINT32_MAX;
+  for (StackVersion i = 0; i < ts_stack_version_count(self->stack); i++) {
+    uint32_t version_position = ts_stack_position(self->stack, i).bytes;
+    if (version_position < position) position = version_position;
+  }
+  if (position <= self->stream.buffer_offset) return;
+
+  uint32_t count = position - self->stream.buffer_offset;
+  if (count > self->stream.buffer.size) count = self->stream.buffer.size;
+  array_splice(&self->stream.buffer, 0, count, 0, NULL);
+  self->stream.buffer_offset += count;
+}
+
+static TSTree *ts_parser__stream_parse(TSParser *self) {
+  self->stream.is_starved = false;
+  return ts_parser_parse(self, NULL, (TSInput) {
+    .payload = &self->stream,
+    .read = ts_parser__stream_read,
+    .encoding = TSInputEncodingUTF8,
+  });
+}
+
 // Parser - Public
 
 TSParser *ts_parser_new(void) {
+  return ts_parser_new_with_allocator((TSAllocator) {NULL, NULL, NULL, NULL});
+}
+
+TSParser *ts_parser_new_with_allocator(TSAllocator allocator) {
+  const TSAllocator *previous_allocator = ts_allocator_enter(&allocator);
   TSParser *self = ts_calloc(1, sizeof(TSParser));
+  self->allocator = allocator;
   ts_lexer_init(&self->lexer);
   array_init(&self->reduce_actions);
   array_reserve(&self->reduce_actions, 4);
   self->tree_pool = ts_subtree_pool_new(32);
+  self->tree_pool.is_counting = true;
   self->stack = ts_stack_new(&self->tree_pool);
   self->finished_tree = NULL_SUBTREE;
   self->reusable_node = reusable_node_new();
   self->dot_graph_file = NULL;
   self->cancellation_flag = NULL;
   self->timeout_duration = 0;
+  self->memory_limit = 0;
   self->end_clock = clock_null();
   self->operation_count = 0;
   self->old_tree = NULL_SUBTREE;
   self->included_range_differences = (TSRangeArray) array_new();
   self->included_range_difference_index = 0;
+  self->stream = (InputStream) {
+    .buffer = array_new(),
+    .buffer_offset = 0,
+    .callback = {NULL, NULL},
+    .is_finished = false,
+    .is_starved = false,
+  };
+  self->subtree_cache = NULL;
   ts_parser__set_cached_token(self, 0, NULL_SUBTREE, NULL_SUBTREE);
+  ts_allocator_leave(previous_allocator);
   return self;
 }
 
 void ts_parser_delete(TSParser *self) {
   if (!self) return;
 
+  // The parser's allocator must outlive the parser itself.
+  TSAllocator allocator = self->allocator;
+  const TSAllocator *previous_allocator = ts_allocator_enter(&allocator);
   ts_parser_set_language(self, NULL);
   ts_stack_delete(self->stack);
   if (self->reduce_actions.contents) {
@@ -1762,6 +2205,7 @@ void ts_parser_delete(TSParser *self) {
   if (self->included_range_differences.contents) {
     array_delete(&self->included_range_differences);
   }
+  array_delete(&self->stream.buffer);
   if (self->old_tree.ptr) {
     ts_subtree_release(&self->tree_pool, self->old_tree);
     self->old_tree = NULL_SUBTREE;
@@ -1774,6 +2218,7 @@ void ts_parser_delete(TSParser *self) {
   array_delete(&self->trailing_extras2);
   array_delete(&self->scratch_trees);
   ts_free(self);
+  ts_allocator_leave(previous_allocator);
 }
 
 const TSLanguage *ts_parser_language(const TSParser *self) {
@@ -1829,6 +2274,14 @@ void ts_parser_set_cancellation_flag(TSParser *self, const size_t *flag) {
   self->cancellation_flag = (const volatile size_t *)flag;
 }
 
+TSSubtreeCache *ts_parser_subtree_cache(const TSParser *self) {
+  return self->subtree_cache;
+}
+
+void ts_parser_set_subtree_cache(TSParser *self, TSSubtreeCache *cache) {
+  self->subtree_cache = cache;
+}
+
 uint64_t ts_parser_timeout_micros(const TSParser *self) {
   return duration_to_micros(self->timeout_duration);
 }
@@ -1837,12 +2290,27 @@ void ts_parser_set_timeout_micros(TSParser *self, uint64_t timeout_micros) {
   self->timeout_duration = duration_from_micros(timeout_micros);
 }
 
+size_t ts_parser_memory_limit(const TSParser *self) {
+  return self->memory_limit;
+}
+
+size_t ts_parser_memory_usage(const TSParser *self) {
+  return self->tree_pool.allocated_bytes + ts_stack_allocated_bytes(self->stack);
+}
+
+void ts_parser_set_memory_limit(TSParser *self, size_t bytes) {
+  self->memory_limit = bytes;
+}
+
 bool ts_parser_set_included_ranges(
   TSParser *self,
   const TSRange *ranges,
   uint32_t count
 ) {
-  return ts_lexer_set_included_ranges(&self->lexer, ranges, count);
+  const TSAllocator *previous_allocator = ts_allocator_enter(&self->allocator);
+  bool result = ts_lexer_set_included_ranges(&self->lexer, ranges, count);
+  ts_allocator_leave(previous_allocator);
+  return result;
 }
 
 const TSRange *ts_parser_included_ranges(const TSParser *self, uint32_t *count) {
@@ -1854,6 +2322,7 @@ void ts_parser_reset(TSParser *self) {
     self->language->external_scanner.deserialize(self->external_scanner_payload, NULL, 0);
   }
 
+  const TSAllocator *previous_allocator = ts_allocator_enter(&self->allocator);
   if (self->old_tree.ptr) {
     ts_subtree_release(&self->tree_pool, self->old_tree);
     self->old_tree = NULL_SUBTREE;
@@ -1868,21 +2337,92 @@ void ts_parser_reset(TSParser *self) {
     self->finished_tree = NULL_SUBTREE;
   }
   self->accept_count = 0;
+  array_clear(&self->stream.buffer);
+  self->stream.buffer_offset = 0;
+  self->stream.is_finished = false;
+  self->stream.is_starved = false;
+  ts_allocator_leave(previous_allocator);
 }
 
-TSTree *ts_parser_parse(
+TSParserSnapshot *ts_parser_snapshot(TSParser *self) {
+  const TSAllocator *previous_allocator = ts_allocator_enter(&self->allocator);
+  TSParserSnapshot *result = ts_malloc(sizeof(TSParserSnapshot));
+  result->allocator = self->allocator;
+  result->language = self->language;
+  result->tree_pool = ts_subtree_pool_new(0);
+  result->stack = ts_stack_new(&result->tree_pool);
+  ts_stack_assign(result->stack, self->stack);
+  result->finished_tree = self->finished_tree;
+  if (result->finished_tree.ptr) {
+    // The tree is now shared with the snapshot, so it no longer counts toward
+    // the memory used by the parse.
+    ts_subtree_retain(result->finished_tree);
+    ts_subtree_uncount(&self->tree_pool, result->finished_tree);
+  }
+  result->accept_count = self->accept_count;
+  ts_allocator_leave(previous_allocator);
+  return result;
+}
+
+uint32_t ts_parser_snapshot_byte_offset(const TSParserSnapshot *self) {
+  uint32_t result = 0;
+  for (StackVersion i = 0, n = ts_stack_version_count(self->stack); i < n; i++) {
+    uint32_t position = ts_stack_position(self->stack, i).bytes;
+    if (position > result) result = position;
+  }
+  return result;
+}
+
+bool ts_parser_restore(TSParser *self, const TSParserSnapshot *snapshot) {
+  if (snapshot->language != self->language) return false;
+  if (!ts_allocator_eq(&snapshot->allocator, &self->allocator)) return false;
+  if (ts_parser__is_streaming(self)) return false;
+
+  // The old tree that the parser was reusing nodes from when the snapshot was
+  // taken may not reflect edits that were made since then, so it is not
+  // restored. The next call to `ts_parser_parse` can supply an edited tree.
+  ts_parser_reset(self);
+  const TSAllocator *previous_allocator = ts_allocator_enter(&self->allocator);
+  ts_stack_assign(self->stack, snapshot->stack);
+  self->finished_tree = snapshot->finished_tree;
+  if (self->finished_tree.ptr) ts_subtree_retain(self->finished_tree);
+  self->accept_count = snapshot->accept_count;
+  ts_allocator_leave(previous_allocator);
+  return true;
+}
+
+void ts_parser_snapshot_delete(TSParserSnapshot *self) {
+  if (!self) return;
+  TSAllocator allocator = self->allocator;
+  const TSAllocator *previous_allocator = ts_allocator_enter(&allocator);
+  ts_stack_delete(self->stack);
+  if (self->finished_tree.ptr) ts_subtree_release(&self->tree_pool, self->finished_tree);
+  ts_subtree_pool_delete(&self->tree_pool);
+  ts_free(self);
+  ts_allocator_leave(previous_allocator);
+}
+
+static TSTree *ts_parser__parse(
   TSParser *self,
   const TSTree *old_tree,
   TSInput input
 ) {
-  if (!self->language || !input.read) return NULL;
 
   ts_lexer_set_input(&self->lexer, input);
 
   array_clear(&self->included_range_differences);
   self->included_range_difference_index = 0;
 
-  if (ts_parser_has_outstanding_parse(self)) {
+  // Trees can only share nodes with trees that use the same allocator.
+  if (old_tree && !ts_allocator_eq(&old_tree->allocator, &self->allocator)) {
+    old_tree = NULL;
+  }
+
+  // When resuming a parse that was restored from a snapshot, the parser has no
+  // old tree, so it can start reusing nodes from the given one, which must have
+  // been edited to match any changes since the snapshot was taken.
+  bool is_resuming = ts_parser_has_outstanding_parse(self);
+  if (is_resuming && (self->old_tree.ptr || !old_tree)) {
     LOG("resume_parsing");
   } else if (old_tree) {
     ts_subtree_retain(old_tree->root);
@@ -1893,7 +2433,11 @@ TSTree *ts_parser_parse(
       &self->included_range_differences
     );
     reusable_node_reset(&self->reusable_node, old_tree->root);
-    LOG("parse_after_edit");
+    if (is_resuming) {
+      LOG("resume_parsing_after_edit");
+    } else {
+      LOG("parse_after_edit");
+    }
     LOG_TREE(self->old_tree);
     for (unsigned i = 0; i < self->included_range_differences.size; i++) {
       TSRange *range = &self->included_range_differences.contents[i];
@@ -1966,6 +2510,10 @@ TSTree *ts_parser_parse(
 
   assert(self->finished_tree.ptr);
   ts_subtree_balance(self->finished_tree, &self->tree_pool, self->language);
+  ts_subtree_uncount(&self->tree_pool, self->finished_tree);
+  if (ts_parser__can_use_subtree_cache(self)) {
+    ts_parser__add_to_subtree_cache(self, self->finished_tree);
+  }
   LOG("done");
   LOG_TREE(self->finished_tree);
 
@@ -1980,6 +2528,119 @@ TSTree *ts_parser_parse(
   return result;
 }
 
+TSTree *ts_parser_parse(
+  TSParser *self,
+  const TSTree *old_tree,
+  TSInput input
+) {
+  if (!self->language || !input.read) return NULL;
+  if (old_tree && old_tree->is_partial) return NULL;
+
+  const TSAllocator *previous_allocator = ts_allocator_enter(&self->allocator);
+  TSTree *result = ts_parser__parse(self, old_tree, input);
+  ts_allocator_leave(previous_allocator);
+  return result;
+}
+
+TSTree *ts_parser_parse_partial(
+  TSParser *self,
+  TSInput input,
+  TSRange range
+) {
+  if (!self->language || !input.read) return NULL;
+  if (ts_parser_has_outstanding_parse(self)) return NULL;
+  if (
+    range.start_point.column > range.start_byte ||
+    range.end_byte < range.start_byte ||
+    point_lt(range.end_point, range.start_point)
+  ) return NULL;
+
+  // Start parsing at the beginning of the line that contains the start of
+  // the range. If the line starts in the middle of some larger construct, the
+  // parser will recover from the resulting errors before it reaches the range.
+  Length start = {range.start_byte - range.start_point.column, {range.start_point.row, 0}};
+  Length end = {range.end_byte, range.end_point};
+
+  // Restrict the existing included ranges to the span that will be parsed.
+  const TSAllocator *previous_allocator = ts_allocator_enter(&self->allocator);
+  uint32_t old_range_count;
+  const TSRange *old_ranges = ts_lexer_included_ranges(&self->lexer, &old_range_count);
+  TSRange *saved_ranges = ts_malloc(old_range_count * sizeof(TSRange));
+  memcpy(saved_ranges, old_ranges, old_range_count * sizeof(TSRange));
+
+  Array(TSRange) ranges = array_new();
+  for (unsigned i = 0; i < old_range_count; i++) {
+    TSRange clipped = saved_ranges[i];
+    if (clipped.start_byte < start.bytes) {
+      clipped.start_byte = start.bytes;
+      clipped.start_point = start.extent;
+    }
+    if (clipped.end_byte > end.bytes) {
+      clipped.end_byte = end.bytes;
+      clipped.end_point = end.extent;
+    }
+    if (clipped.start_byte < clipped.end_byte) array_push(&ranges, clipped);
+  }
+
+  TSTree *result = NULL;
+  if (ranges.size > 0) {
+    ts_lexer_set_included_ranges(&self->lexer, ranges.contents, ranges.size);
+    result = ts_parser_parse(self, NULL, input);
+    if (result) {
+      result->is_partial = true;
+    } else {
+      ts_parser_reset(self);
+    }
+    ts_lexer_set_included_ranges(&self->lexer, saved_ranges, old_range_count);
+  }
+
+  array_delete(&ranges);
+  ts_free(saved_ranges);
+  ts_allocator_leave(previous_allocator);
+  return result;
+}
+
+TSStreamCallback ts_parser_stream_callback(const TSParser *self) {
+  return self->stream.callback;
+}
+
+void ts_parser_set_stream_callback(TSParser *self, TSStreamCallback callback) {
+  self->stream.callback = callback;
+}
+
+bool ts_parser_feed(TSParser *self, const char *bytes, uint32_t length) {
+  if (!self->language || self->stream.is_finished) return false;
+
+  // The stream must be parsed in its entirety, so that the parse cannot
+  // finish before all of the text has been provided.
+  uint32_t range_count;
+  const TSRange *ranges = ts_lexer_included_ranges(&self->lexer, &range_count);
+  if (range_count != 1 || ranges[0].start_byte != 0 || ranges[0].end_byte != UINT32_MAX) {
+    return false;
+  }
+
+  const TSAllocator *previous_allocator = ts_allocator_enter(&self->allocator);
+  array_extend(&self->stream.buffer, length, bytes);
+  // Until the stream is finished, the parser halts whenever it reaches the
+  // end of the text that has been provided, so it can't produce a tree.
+  TSTree *tree = ts_parser__stream_parse(self);
+  assert(!tree);
+  if (tree) ts_tree_delete(tree);
+  bool result = self->stream.is_starved;
+  if (result) {
+    ts_parser__stream_emit_nodes(self);
+    ts_parser__stream_discard_text(self);
+  }
+  ts_allocator_leave(previous_allocator);
+  return result;
+}
+
+TSTree *ts_parser_finish(TSParser *self) {
+  if (!self->language) return NULL;
+  self->stream.is_finished = true;
+  return ts_parser__stream_parse(self);
+}
+
 TSTree *ts_parser_parse_string(
   TSParser *self,
   const TSTree *old_tree,
@@ -3,6 +3,9 @@
 #include "./array.h"
 #include "./language.h"
 #include "./point.h"
+#include "./query.h"
+#include "./regex.h"
+#include "./serialization.h"
 #include "./tree_cursor.h"
 #include "./unicode.h"
 #include <wctype.h>
@@ -15,6 +18,9 @@
 #define MAX_STATE_PREDECESSOR_COUNT 256
 #define MAX_ANALYSIS_STATE_DEPTH 8
 #define MAX_ANALYSIS_ITERATION_COUNT 256
+#define CAPTURE_SEGMENT_MIN_CAPACITY 4
+#define CAPTURE_SEGMENT_CLASS_COUNT 28
+#define MIN_SUMMARIZED_NODE_COUNT 16
 
 /*
  * Stream - A sequence of unicode characters derived from a UTF8 string.
@@ -135,16 +141,44 @@ typedef Array(uint8_t) CaptureQuantifiers;
  * - `is_rooted` - whether or not the pattern has a single root node. This property
  *   affects decisions about whether or not to start the pattern for nodes outside
  *   of a QueryCursor's range restriction.
+ * - `spans_siblings` - whether or not the pattern can match more than one node at
+ *   the depth of its first step, because of a repetition or a sequence of nodes.
+ *   Such a pattern's states can outlive the node where they started. This is not
+ *   serialized, because it is recomputed when indexing the pattern map.
  */
 typedef struct {
   uint16_t step_index;
   uint16_t pattern_index;
   bool is_rooted;
+  bool spans_siblings;
 } PatternEntry;
 
+/*
+ * TextPredicate - A built-in predicate that the query cursor can evaluate
+ * itself, when it has access to the source text. It compares the text of a
+ * capture with a string value (`#eq? @a "b"`), with the text of another
+ * capture (`#eq? @a @b`), or with a regex (`#match? @a "b"`), and is negated
+ * for `#not-eq?` and `#not-match?`. The `value_id` is either an id in the
+ * query's `predicate_values` table, or a capture id.
+ */
+typedef enum {
+  TextPredicateTypeEqString,
+  TextPredicateTypeEqCapture,
+  TextPredicateTypeMatchString,
+} TextPredicateType;
+
+typedef struct {
+  TextPredicateType type;
+  uint16_t capture_id;
+  uint16_t value_id;
+  bool is_positive;
+  Regex *regex;
+} TextPredicate;
+
 typedef struct {
   Slice steps;
   Slice predicate_steps;
+  Slice text_predicates;
   uint32_t start_byte;
   bool is_non_local;
 } QueryPattern;
@@ -177,6 +211,10 @@ typedef struct {
  *    different steps in their pattern. This means that in order to obey the
  *    'longest-match' rule, this state should not be returned as a match until
  *    it is clear that there can be no other alternative match with more captures.
+ * - `is_outside_match_range` - A flag that indicates that this state started
+ *    outside of the cursor's range of match start positions. Such a state is
+ *    never returned as a match, but it is still tracked, because it can prevent
+ *    other states from being returned by the longest-match rule.
  */
 typedef struct {
   uint32_t id;
@@ -189,28 +227,50 @@ typedef struct {
   bool has_in_progress_alternatives: 1;
   bool dead: 1;
   bool needs_parent: 1;
+  bool is_outside_match_range: 1;
 } QueryState;
 
-typedef Array(TSQueryCapture) CaptureList;
+/*
+ * CaptureList - A view of one query state's captures. The captures themselves
+ * are stored in a segment of the `CaptureListPool`'s arena, starting at
+ * `offset`, which has room for `capacity` captures.
+ */
+typedef struct {
+  TSQueryCapture *contents;
+  uint32_t size;
+  uint32_t capacity;
+  uint32_t offset;
+} CaptureList;
 
 /*
  * CaptureListPool - A collection of *lists* of captures. Each query state needs
- * to maintain its own list of captures. To avoid repeated allocations, this struct
- * maintains a fixed set of capture lists, and keeps track of which ones are
- * currently in use by a query state.
+ * to maintain its own list of captures. To avoid allocating each of these lists
+ * separately, this struct stores all of their captures in a single arena,
+ * divided into segments whose capacities are powers of two. When a list is
+ * released, its segment is kept in a free list for its size class, so that it
+ * can be reused by another list before the arena needs to grow.
  */
 typedef struct {
   Array(CaptureList) list;
   CaptureList empty_list;
-  // The maximum number of capture lists that we are allowed to allocate. We
-  // never allow `list` to allocate more entries than this, dropping pending
-  // matches if needed to stay under the limit.
+  // The ids of the lists in `list` that are not currently in use. We reuse
+  // those existing-but-unused lists before adding any new ones. We use an
+  // invalid value (UINT32_MAX) for a capture list's size to indicate that it's
+  // not in use.
+  Array(uint32_t) free_list_ids;
+  // The storage for all of the lists' captures.
+  Array(TSQueryCapture) arena;
+  // The offsets of the arena segments that are not owned by any list, indexed
+  // by size class, along with the total capacity of those segments.
+  Array(uint32_t) free_segments[CAPTURE_SEGMENT_CLASS_COUNT];
+  uint32_t free_segment_capture_count;
+  // The maximum number of capture lists that may be in use at once. We never
+  // allow more lists than this to be acquired, dropping pending matches if
+  // needed to stay under the limit.
   uint32_t max_capture_list_count;
-  // The number of capture lists allocated in `list` that are not currently in
-  // use. We reuse those existing-but-unused capture lists before trying to
-  // allocate any new ones. We use an invalid value (UINT32_MAX) for a capture
-  // list's length to indicate that it's not in use.
-  uint32_t free_capture_list_count;
+  // The maximum number of bytes that the arena may occupy, or zero for no
+  // limit. Likewise, pending matches are dropped if needed to stay under it.
+  size_t max_capture_memory;
 } CaptureListPool;
 
 /*
@@ -234,6 +294,21 @@ typedef struct {
 
 typedef Array(AnalysisState *) AnalysisStateSet;
 
+/*
+ * AnalysisResult - The outcome of analyzing a sequence of steps. In a large
+ * query, many patterns have the same structure, differing only in their
+ * captures and predicates, which don't affect the analysis. So each outcome
+ * is stored along with a `key` that describes the structure of the steps it
+ * depends on, and is reused for any other steps with the same key. The final
+ * step indices are stored relative to the first step that was analyzed.
+ */
+typedef struct {
+  Array(uint32_t) key;
+  Array(uint16_t) final_step_indices;
+  Array(TSSymbol) finished_parent_symbols;
+  bool did_abort;
+} AnalysisResult;
+
 typedef struct {
   AnalysisStateSet states;
   AnalysisStateSet next_states;
@@ -241,6 +316,8 @@ typedef struct {
   AnalysisStateSet state_pool;
   Array(uint16_t) final_step_indices;
   Array(TSSymbol) finished_parent_symbols;
+  Array(AnalysisResult) results;
+  AnalysisResult result;
   bool did_abort;
 } QueryAnalysis;
 
@@ -285,7 +362,12 @@ struct TSQuery {
   Array(CaptureQuantifiers) capture_quantifiers;
   Array(QueryStep) steps;
   Array(PatternEntry) pattern_map;
+  Array(uint32_t) pattern_map_offsets;
+  Array(uint32_t) pattern_start_symbols;
+  uint64_t pattern_start_symbol_summary;
+  bool has_unanalyzed_sibling_patterns;
   Array(TSQueryPredicateStep) predicate_steps;
+  Array(TextPredicate) text_predicates;
   Array(QueryPattern) patterns;
   Array(StepOffset) step_offsets;
   Array(TSFieldId) negated_fields;
@@ -295,6 +377,33 @@ struct TSQuery {
   uint16_t wildcard_root_pattern_count;
 };
 
+/*
+ * SymbolSummaryTable - A map from subtrees to summaries of the symbols of
+ * their visible descendants. Each summary is a 64-bit mask with one bit for
+ * each symbol modulo 64, and takes aliases into account. The summaries are
+ * computed by the query cursor when it first needs them, rather than being
+ * stored in every subtree, and are discarded when the cursor is executed
+ * again.
+ */
+typedef struct {
+  const SubtreeHeapData *subtree;
+  uint64_t symbols;
+} SymbolSummary;
+
+typedef struct {
+  Subtree subtree;
+  uint32_t child_index;
+  uint32_t structural_index;
+  uint64_t symbols;
+} SymbolSummaryFrame;
+
+typedef struct {
+  SymbolSummary *entries;
+  uint32_t capacity;
+  uint32_t size;
+  Array(SymbolSummaryFrame) stack;
+} SymbolSummaryTable;
+
 /*
  * TSQueryCursor - A stateful struct used to execute a query on a tree.
  */
@@ -310,11 +419,19 @@ struct TSQueryCursor {
   uint32_t end_byte;
   TSPoint start_point;
   TSPoint end_point;
+  uint32_t min_match_start_byte;
+  uint32_t max_match_start_byte;
   uint32_t next_state_id;
   bool on_visible_node;
   bool ascending;
   bool halted;
   bool did_exceed_match_limit;
+  TSAllocator allocator;
+  TSInput text_input;
+  Array(char) text_buffer;
+  TSQuery *combined_query;
+  Array(uint32_t) query_pattern_offsets;
+  SymbolSummaryTable symbol_summaries;
 };
 
 static const TSQueryError PARENT_DONE = -1;
@@ -407,73 +524,416 @@ static uint32_t stream_offset(Stream *self) {
  ******************/
 
 static CaptureListPool capture_list_pool_new(void) {
-  return (CaptureListPool) {
+  CaptureListPool result = {
     .list = array_new(),
-    .empty_list = array_new(),
+    .empty_list = {NULL, 0, 0, 0},
+    .free_list_ids = array_new(),
+    .arena = array_new(),
+    .free_segment_capture_count = 0,
     .max_capture_list_count = UINT32_MAX,
-    .free_capture_list_count = 0,
+    .max_capture_memory = 0,
   };
+  for (unsigned i = 0; i < CAPTURE_SEGMENT_CLASS_COUNT; i++) {
+    array_init(&result.free_segments[i]);
+  }
+  return result;
 }
 
 static void capture_list_pool_reset(CaptureListPool *self) {
-  for (uint16_t i = 0; i < self->list.size; i++) {
-    // This invalid size means that the list is not in use.
-    self->list.contents[i].size = UINT32_MAX;
+  array_clear(&self->list);
+  array_clear(&self->free_list_ids);
+  array_clear(&self->arena);
+  for (unsigned i = 0; i < CAPTURE_SEGMENT_CLASS_COUNT; i++) {
+    array_clear(&self->free_segments[i]);
   }
-  self->free_capture_list_count = self->list.size;
+  self->free_segment_capture_count = 0;
 }
 
 static void capture_list_pool_delete(CaptureListPool *self) {
-  for (uint16_t i = 0; i < self->list.size; i++) {
-    array_delete(&self->list.contents[i]);
-  }
   array_delete(&self->list);
+  array_delete(&self->free_list_ids);
+  array_delete(&self->arena);
+  for (unsigned i = 0; i < CAPTURE_SEGMENT_CLASS_COUNT; i++) {
+    array_delete(&self->free_segments[i]);
+  }
 }
 
-static const CaptureList *capture_list_pool_get(const CaptureListPool *self, uint16_t id) {
+static const CaptureList *capture_list_pool_get(const CaptureListPool *self, uint32_t id) {
   if (id >= self->list.size) return &self->empty_list;
   return &self->list.contents[id];
 }
 
-static CaptureList *capture_list_pool_get_mut(CaptureListPool *self, uint16_t id) {
-  assert(id < self->list.size);
-  return &self->list.contents[id];
+static uint32_t capture_list_pool__in_use_count(const CaptureListPool *self) {
+  return self->list.size - self->free_list_ids.size;
+}
+
+// The maximum number of captures that the arena may hold without exceeding
+// the pool's memory limit.
+static uint32_t capture_list_pool__max_arena_size(const CaptureListPool *self) {
+  if (self->max_capture_memory == 0) return UINT32_MAX;
+  size_t result = self->max_capture_memory / sizeof(TSQueryCapture);
+  return result > UINT32_MAX ? UINT32_MAX : (uint32_t)result;
+}
+
+static unsigned capture_list_pool__segment_class(uint32_t capacity) {
+  unsigned result = 0;
+  while ((uint32_t)CAPTURE_SEGMENT_MIN_CAPACITY << result < capacity) result++;
+  return result;
 }
 
 static bool capture_list_pool_is_empty(const CaptureListPool *self) {
-  // The capture list pool is empty if all allocated lists are in use, and we
-  // have reached the maximum allowed number of allocated lists.
-  return self->free_capture_list_count == 0 && self->list.size >= self->max_capture_list_count;
+  // The capture list pool is empty if the maximum number of lists are already
+  // in use, or if there is no room left in the arena for any more captures.
+  if (capture_list_pool__in_use_count(self) >= self->max_capture_list_count) return true;
+  return
+    self->free_segment_capture_count == 0 &&
+    self->arena.size + CAPTURE_SEGMENT_MIN_CAPACITY > capture_list_pool__max_arena_size(self);
 }
 
-static uint16_t capture_list_pool_acquire(CaptureListPool *self) {
+static uint32_t capture_list_pool_acquire(CaptureListPool *self) {
+  if (capture_list_pool__in_use_count(self) >= self->max_capture_list_count) {
+    return NONE;
+  }
+
+  // A list doesn't own a segment of the arena until its first capture is added.
+  CaptureList list = {NULL, 0, 0, 0};
+
   // First see if any already allocated capture list is currently unused.
-  if (self->free_capture_list_count > 0) {
-    for (uint16_t i = 0; i < self->list.size; i++) {
-      if (self->list.contents[i].size == UINT32_MAX) {
-        array_clear(&self->list.contents[i]);
-        self->free_capture_list_count--;
-        return i;
-      }
+  if (self->free_list_ids.size > 0) {
+    uint32_t id = array_pop(&self->free_list_ids);
+    self->list.contents[id] = list;
+    return id;
+  }
+
+  uint32_t id = self->list.size;
+  if (id >= NONE) return NONE;
+  array_push(&self->list, list);
+  return id;
+}
+
+// Point every list at its segment of the arena, after the arena has been
+// reallocated or compacted.
+static void capture_list_pool__update_contents(CaptureListPool *self) {
+  for (uint32_t i = 0; i < self->list.size; i++) {
+    CaptureList *list = &self->list.contents[i];
+    if (list->capacity > 0) list->contents = &self->arena.contents[list->offset];
+  }
+}
+
+static void capture_list_pool__free_segment(
+  CaptureListPool *self,
+  uint32_t offset,
+  uint32_t capacity
+) {
+  // A segment at the end of the arena can simply be removed from it.
+  if (offset + capacity == self->arena.size) {
+    self->arena.size = offset;
+    return;
+  }
+  array_push(&self->free_segments[capture_list_pool__segment_class(capacity)], offset);
+  self->free_segment_capture_count += capacity;
+}
+
+static int capture_list_pool__compare_segments(const void *left, const void *right) {
+  uint64_t left_segment = *(const uint64_t *)left;
+  uint64_t right_segment = *(const uint64_t *)right;
+  return left_segment < right_segment ? -1 : left_segment > right_segment ? 1 : 0;
+}
+
+// Move all of the lists' segments to the start of the arena, so that the free
+// segments between them become a single free region at the end of the arena.
+static void capture_list_pool__compact(CaptureListPool *self) {
+  // Sort the segments by their offsets, each packed together with the id of
+  // the list that owns it.
+  Array(uint64_t) segments = array_new();
+  for (uint32_t i = 0; i < self->list.size; i++) {
+    const CaptureList *list = &self->list.contents[i];
+    if (list->capacity > 0) {
+      array_push(&segments, (uint64_t)list->offset << 32 | i);
+    }
+  }
+  qsort(
+    segments.contents,
+    segments.size,
+    sizeof(uint64_t),
+    capture_list_pool__compare_segments
+  );
+
+  uint32_t offset = 0;
+  for (uint32_t i = 0; i < segments.size; i++) {
+    CaptureList *list = &self->list.contents[(uint32_t)segments.contents[i]];
+    if (list->offset != offset) {
+      memmove(
+        &self->arena.contents[offset],
+        &self->arena.contents[list->offset],
+        list->size * sizeof(TSQueryCapture)
+      );
+      list->offset = offset;
     }
+    offset += list->capacity;
   }
+  self->arena.size = offset;
+  array_delete(&segments);
 
-  // Otherwise allocate and initialize a new capture list, as long as that
-  // doesn't put us over the requested maximum.
-  uint32_t i = self->list.size;
-  if (i >= self->max_capture_list_count) {
-    return NONE;
+  for (unsigned i = 0; i < CAPTURE_SEGMENT_CLASS_COUNT; i++) {
+    array_clear(&self->free_segments[i]);
   }
-  CaptureList list;
-  array_init(&list);
-  array_push(&self->list, list);
-  return i;
+  self->free_segment_capture_count = 0;
+  capture_list_pool__update_contents(self);
+}
+
+// Make room for the given number of captures at the end of the arena, without
+// exceeding the pool's memory limit.
+static bool capture_list_pool__reserve(CaptureListPool *self, uint32_t count) {
+  uint32_t max_size = capture_list_pool__max_arena_size(self);
+  if (self->arena.size > max_size || count > max_size - self->arena.size) {
+    return false;
+  }
+
+  uint32_t required_size = self->arena.size + count;
+  if (required_size <= self->arena.capacity) return true;
+  uint32_t new_capacity = self->arena.capacity < max_size / 2
+    ? self->arena.capacity * 2
+    : max_size;
+  if (new_capacity < 8 * CAPTURE_SEGMENT_MIN_CAPACITY) {
+    new_capacity = 8 * CAPTURE_SEGMENT_MIN_CAPACITY;
+  }
+  if (new_capacity > max_size) new_capacity = max_size;
+  if (new_capacity < required_size) new_capacity = required_size;
+  array_reserve(&self->arena, new_capacity);
+  capture_list_pool__update_contents(self);
+  return true;
+}
+
+// Allocate a segment of the arena in the given size class, preferably by
+// reusing a free segment.
+static bool capture_list_pool__allocate_segment(
+  CaptureListPool *self,
+  unsigned segment_class,
+  uint32_t *offset
+) {
+  uint32_t capacity = (uint32_t)CAPTURE_SEGMENT_MIN_CAPACITY << segment_class;
+  if (self->free_segments[segment_class].size > 0) {
+    *offset = array_pop(&self->free_segments[segment_class]);
+    self->free_segment_capture_count -= capacity;
+    return true;
+  }
+
+  // If the arena has reached its memory limit, but it has free segments of
+  // other sizes, then compact it to reclaim their space.
+  if (!capture_list_pool__reserve(self, capacity)) {
+    if (self->free_segment_capture_count == 0) return false;
+    capture_list_pool__compact(self);
+    if (!capture_list_pool__reserve(self, capacity)) return false;
+  }
+  *offset = self->arena.size;
+  self->arena.size += capacity;
+  return true;
+}
+
+// Move the given list to a segment of the arena with room for at least the
+// given number of captures.
+static bool capture_list_pool__grow(
+  CaptureListPool *self,
+  uint32_t id,
+  uint32_t min_capacity
+) {
+  unsigned segment_class = capture_list_pool__segment_class(min_capacity);
+  if (segment_class >= CAPTURE_SEGMENT_CLASS_COUNT) return false;
+  uint32_t offset;
+  if (!capture_list_pool__allocate_segment(self, segment_class, &offset)) return false;
+
+  CaptureList *list = &self->list.contents[id];
+  if (list->size > 0) {
+    memcpy(
+      &self->arena.contents[offset],
+      list->contents,
+      list->size * sizeof(TSQueryCapture)
+    );
+  }
+  if (list->capacity > 0) {
+    capture_list_pool__free_segment(self, list->offset, list->capacity);
+  }
+  list->offset = offset;
+  list->capacity = (uint32_t)CAPTURE_SEGMENT_MIN_CAPACITY << segment_class;
+  list->contents = &self->arena.contents[offset];
+  return true;
+}
+
+static bool capture_list_pool_push(
+  CaptureListPool *self,
+  uint32_t id,
+  TSQueryCapture capture
+) {
+  CaptureList *list = &self->list.contents[id];
+  if (list->size == list->capacity) {
+    if (!capture_list_pool__grow(self, id, list->size + 1)) return false;
+    list = &self->list.contents[id];
+  }
+  list->contents[list->size++] = capture;
+  return true;
+}
+
+// Replace the captures in one list with the captures from another list.
+static bool capture_list_pool_copy(
+  CaptureListPool *self,
+  uint32_t id,
+  uint32_t source_id
+) {
+  uint32_t size = self->list.contents[source_id].size;
+  if (size > self->list.contents[id].capacity) {
+    self->list.contents[id].size = 0;
+    if (!capture_list_pool__grow(self, id, size)) return false;
+  }
+
+  // Growing the list may have moved the source list within the arena.
+  CaptureList *list = &self->list.contents[id];
+  const CaptureList *source = &self->list.contents[source_id];
+  if (size > 0) {
+    memcpy(list->contents, source->contents, size * sizeof(TSQueryCapture));
+  }
+  list->size = size;
+  return true;
 }
 
-static void capture_list_pool_release(CaptureListPool *self, uint16_t id) {
+static void capture_list_pool_release(CaptureListPool *self, uint32_t id) {
   if (id >= self->list.size) return;
-  self->list.contents[id].size = UINT32_MAX;
-  self->free_capture_list_count++;
+  CaptureList *list = &self->list.contents[id];
+  if (list->size == UINT32_MAX) return;
+
+  // The list's captures are left intact, because they can still be referenced
+  // by the most recently returned match.
+  if (list->capacity > 0) {
+    capture_list_pool__free_segment(self, list->offset, list->capacity);
+  }
+  list->size = UINT32_MAX;
+  list->capacity = 0;
+  array_push(&self->free_list_ids, id);
+}
+
+/*********************
+ * SymbolSummaryTable
+ *********************/
+
+static inline uint64_t symbol_summary_bit(TSSymbol symbol) {
+  return (uint64_t)1 << (symbol % 64);
+}
+
+static void symbol_summary_table_clear(SymbolSummaryTable *self) {
+  if (self->size == 0) return;
+  memset(self->entries, 0, self->capacity * sizeof(SymbolSummary));
+  self->size = 0;
+}
+
+static void symbol_summary_table_delete(SymbolSummaryTable *self) {
+  ts_free(self->entries);
+  array_delete(&self->stack);
+}
+
+static inline uint32_t symbol_summary_table__bucket(
+  const SymbolSummaryTable *self,
+  const SubtreeHeapData *subtree
+) {
+  uint64_t hash = (uintptr_t)subtree * 0x9e3779b97f4a7c15ull;
+  return (uint32_t)(hash >> 32) & (self->capacity - 1);
+}
+
+static bool symbol_summary_table_get(
+  const SymbolSummaryTable *self,
+  const SubtreeHeapData *subtree,
+  uint64_t *symbols
+) {
+  if (self->size == 0) return false;
+  for (uint32_t i = symbol_summary_table__bucket(self, subtree);; i = (i + 1) & (self->capacity - 1)) {
+    const SymbolSummary *entry = &self->entries[i];
+    if (!entry->subtree) return false;
+    if (entry->subtree == subtree) {
+      *symbols = entry->symbols;
+      return true;
+    }
+  }
+}
+
+static void symbol_summary_table_insert(
+  SymbolSummaryTable *self,
+  const SubtreeHeapData *subtree,
+  uint64_t symbols
+) {
+  // Keep the table at most half full, so that probe sequences stay short.
+  if (2 * (self->size + 1) > self->capacity) {
+    uint32_t old_capacity = self->capacity;
+    SymbolSummary *old_entries = self->entries;
+    self->capacity = old_capacity ? old_capacity * 2 : 64;
+    self->entries = ts_calloc(self->capacity, sizeof(SymbolSummary));
+    self->size = 0;
+    for (uint32_t i = 0; i < old_capacity; i++) {
+      if (old_entries[i].subtree) {
+        symbol_summary_table_insert(self, old_entries[i].subtree, old_entries[i].symbols);
+      }
+    }
+    ts_free(old_entries);
+  }
+
+  uint32_t i = symbol_summary_table__bucket(self, subtree);
+  while (self->entries[i].subtree) i = (i + 1) & (self->capacity - 1);
+  self->entries[i] = (SymbolSummary) {subtree, symbols};
+  self->size++;
+}
+
+// Get the summary of the symbols of a subtree's visible descendants. The
+// subtree is traversed without recursion, and the summaries of the large
+// subtrees within it are stored, so that they are only computed once. Small
+// subtrees are not worth skipping, so their summaries are not stored.
+static uint64_t symbol_summary_table_summarize(
+  SymbolSummaryTable *self,
+  Subtree subtree,
+  const TSLanguage *language
+) {
+  uint64_t result;
+  if (ts_subtree_child_count(subtree) == 0) return 0;
+  if (symbol_summary_table_get(self, subtree.ptr, &result)) return result;
+
+  array_clear(&self->stack);
+  array_push(&self->stack, ((SymbolSummaryFrame) {subtree, 0, 0, 0}));
+  for (;;) {
+    SymbolSummaryFrame *frame = array_back(&self->stack);
+    Subtree tree = frame->subtree;
+
+    // Once all of a subtree's children have been visited, add its summary
+    // to its parent's.
+    if (frame->child_index == tree.ptr->child_count) {
+      uint64_t symbols = frame->symbols;
+      if (ts_subtree_node_count(tree) >= MIN_SUMMARIZED_NODE_COUNT) {
+        symbol_summary_table_insert(self, tree.ptr, symbols);
+      }
+      self->stack.size--;
+      if (self->stack.size == 0) return symbols;
+      array_back(&self->stack)->symbols |= symbols;
+      continue;
+    }
+
+    Subtree child = ts_subtree_children(tree)[frame->child_index++];
+    TSSymbol alias_symbol = 0;
+    if (!ts_subtree_extra(child)) {
+      const TSSymbol *alias_sequence = ts_language_alias_sequence(language, tree.ptr->production_id);
+      if (alias_sequence) alias_symbol = alias_sequence[frame->structural_index];
+      frame->structural_index++;
+    }
+    if (alias_symbol) {
+      frame->symbols |= symbol_summary_bit(alias_symbol);
+    } else if (ts_subtree_visible(child)) {
+      frame->symbols |= symbol_summary_bit(ts_subtree_symbol(child));
+    }
+
+    if (ts_subtree_child_count(child) > 0) {
+      uint64_t child_symbols;
+      if (symbol_summary_table_get(self, child.ptr, &child_symbols)) {
+        frame->symbols |= child_symbols;
+      } else {
+        array_push(&self->stack, ((SymbolSummaryFrame) {child, 0, 0, 0}));
+      }
+    }
+  }
 }
 
 /**************
@@ -792,6 +1252,45 @@ static uint16_t symbol_table_insert_name(
   return self->slices.size - 1;
 }
 
+static void symbol_table_serialize(const SymbolTable *self, SerializationBuffer *buffer) {
+  ts_serialization_write_uint(buffer, self->characters.size);
+  if (self->characters.size > 0) {
+    ts_serialization_write_bytes(buffer, self->characters.contents, self->characters.size);
+  }
+  ts_serialization_write_uint(buffer, self->slices.size);
+  for (unsigned i = 0; i < self->slices.size; i++) {
+    ts_serialization_write_uint(buffer, self->slices.contents[i].offset);
+    ts_serialization_write_uint(buffer, self->slices.contents[i].length);
+  }
+}
+
+// Each name must be followed by a null character within the table, because
+// the names are returned to callers as C strings.
+static bool symbol_table_deserialize(SymbolTable *self, SerializationReader *reader) {
+  uint32_t character_count, slice_count;
+  const char *characters;
+  if (
+    !ts_serialization_read_uint(reader, &character_count) ||
+    !ts_serialization_read_bytes(reader, character_count, &characters) ||
+    !ts_serialization_read_uint(reader, &slice_count) ||
+    slice_count >= UINT16_MAX ||
+    slice_count > ts_serialization_remaining(reader)
+  ) return false;
+  if (character_count > 0) array_extend(&self->characters, character_count, characters);
+  for (unsigned i = 0; i < slice_count; i++) {
+    Slice slice;
+    if (
+      !ts_serialization_read_uint(reader, &slice.offset) ||
+      !ts_serialization_read_uint(reader, &slice.length) ||
+      slice.offset >= character_count ||
+      slice.length >= character_count - slice.offset ||
+      characters[slice.offset + slice.length] != 0
+    ) return false;
+    array_push(&self->slices, slice);
+  }
+  return true;
+}
+
 /************
  * QueryStep
  ************/
@@ -1038,10 +1537,65 @@ static inline QueryAnalysis query_analysis__new() {
     .state_pool = array_new(),
     .final_step_indices = array_new(),
     .finished_parent_symbols = array_new(),
+    .results = array_new(),
+    .result = {
+      .key = array_new(),
+      .final_step_indices = array_new(),
+      .finished_parent_symbols = array_new(),
+      .did_abort = false,
+    },
     .did_abort = false,
   };
 }
 
+static inline void analysis_result__delete(AnalysisResult *self) {
+  array_delete(&self->key);
+  array_delete(&self->final_step_indices);
+  array_delete(&self->finished_parent_symbols);
+}
+
+static inline int analysis_result__compare(const AnalysisResult *self, const AnalysisResult *other) {
+  if (self->key.size < other->key.size) return -1;
+  if (self->key.size > other->key.size) return 1;
+  if (self->key.size == 0) return 0;
+  return memcmp(self->key.contents, other->key.contents, self->key.size * sizeof(uint32_t));
+}
+
+// Look for a stored result whose key matches the key in `self->result`. If there
+// is one, then load it as the outcome of the current analysis, whose first step
+// is at the given index.
+static bool query_analysis__load_result(QueryAnalysis *self, uint16_t start_step_index) {
+  unsigned index, exists;
+  array_search_sorted_with(&self->results, analysis_result__compare, &self->result, &index, &exists);
+  if (!exists) return false;
+  const AnalysisResult *result = &self->results.contents[index];
+  array_clear(&self->final_step_indices);
+  for (unsigned i = 0; i < result->final_step_indices.size; i++) {
+    array_push(&self->final_step_indices, start_step_index + result->final_step_indices.contents[i]);
+  }
+  array_clear(&self->finished_parent_symbols);
+  array_push_all(&self->finished_parent_symbols, &result->finished_parent_symbols);
+  self->did_abort = result->did_abort;
+  return true;
+}
+
+// Store the outcome of the current analysis, whose first step is at the given
+// index, under the key in `self->result`.
+static void query_analysis__store_result(QueryAnalysis *self, uint16_t start_step_index) {
+  AnalysisResult result = {
+    .key = array_new(),
+    .final_step_indices = array_new(),
+    .finished_parent_symbols = array_new(),
+    .did_abort = self->did_abort,
+  };
+  array_push_all(&result.key, &self->result.key);
+  for (unsigned i = 0; i < self->final_step_indices.size; i++) {
+    array_push(&result.final_step_indices, self->final_step_indices.contents[i] - start_step_index);
+  }
+  array_push_all(&result.finished_parent_symbols, &self->finished_parent_symbols);
+  array_insert_sorted_with(&self->results, analysis_result__compare, result);
+}
+
 static inline void query_analysis__delete(QueryAnalysis *self) {
   analysis_state_set__delete(&self->states);
   analysis_state_set__delete(&self->next_states);
@@ -1049,6 +1603,11 @@ static inline void query_analysis__delete(QueryAnalysis *self) {
   analysis_state_set__delete(&self->state_pool);
   array_delete(&self->final_step_indices);
   array_delete(&self->finished_parent_symbols);
+  for (unsigned i = 0; i < self->results.size; i++) {
+    analysis_result__delete(&self->results.contents[i]);
+  }
+  array_delete(&self->results);
+  analysis_result__delete(&self->result);
 }
 
 /***********************
@@ -1078,9 +1637,10 @@ static inline int analysis_subgraph_node__compare(const AnalysisSubgraphNode *se
 // of the patterns in the query, and a `step_index`, which indicates the start
 // offset of that pattern's steps within the `steps` array.
 //
-// The entries are sorted by the patterns' root symbols, and lookups use a
-// binary search. This ensures that the cost of this initial lookup step
-// scales logarithmically with the number of patterns in the query.
+// The entries are sorted by the patterns' root symbols. While the query is
+// being constructed, lookups use a binary search. After that, the query
+// cursor uses the index built by `ts_query__index_pattern_map`, so the cost
+// of this initial lookup step doesn't depend on the number of patterns.
 //
 // This returns `true` if the symbol is present and `false` otherwise.
 // If the symbol is not present `*result` is set to the index where the
@@ -1152,6 +1712,170 @@ static inline void ts_query__pattern_map_insert(
   array_insert(&self->pattern_map, index, new_entry);
 }
 
+// Once all of the patterns have been added, the `pattern_map` is indexed by
+// symbol, so that the query cursor doesn't need to search it for every node.
+// Symbol values are dense, so `pattern_map_offsets` simply stores, for each
+// symbol, the index of the first non-wildcard pattern entry whose root has
+// that symbol or a larger one. The built-in symbols that are larger than the
+// language's symbol count, like `ERROR`, share one extra slot at the end.
+//
+// Most symbols don't start any pattern, so there is also a bitset of the
+// symbols that do, which lets the cursor reject the other symbols without
+// touching the offsets.
+//
+// The query cursor summarizes the symbols of subtrees' visible descendants in
+// 64-bit masks, so the same symbols are also stored in that form, which lets
+// the cursor skip over subtrees in which no pattern can start. Subtrees use
+// the symbols before they are mapped to public symbols, so every symbol that
+// maps to one of the patterns' root symbols is included.
+static inline uint32_t ts_query__pattern_map_slot(const TSQuery *self, TSSymbol symbol) {
+  uint32_t symbol_count = self->language->symbol_count;
+  return symbol < symbol_count ? symbol : symbol_count;
+}
+
+static inline bool ts_query__slot_starts_pattern(const TSQuery *self, uint32_t slot) {
+  return self->pattern_start_symbols.contents[slot / 32] & (1u << (slot % 32));
+}
+
+// Determine whether a pattern that starts at the given step has any other steps
+// at the same depth, or at a lower depth, or whether it can return to its first
+// step. If so, then its states can continue past the node where they started.
+static bool ts_query__pattern_spans_siblings(const TSQuery *self, uint16_t step_index) {
+  const QueryStep *first_step = &self->steps.contents[step_index];
+  for (
+    const QueryStep *step = first_step + 1;
+    step->depth != PATTERN_DONE_MARKER;
+    step++
+  ) {
+    if (
+      step->depth <= first_step->depth ||
+      (step->alternative_index != NONE && step->alternative_index <= step_index)
+    ) return true;
+  }
+  return false;
+}
+
+// Find the range of entries in the `pattern_map` for patterns whose root node
+// has the given symbol. This returns `false` if there are no such patterns.
+// Entries in the last slot may have a different symbol, and must be checked
+// by the caller.
+static inline bool ts_query__pattern_map_range(
+  const TSQuery *self,
+  TSSymbol symbol,
+  uint32_t *start,
+  uint32_t *end
+) {
+  uint32_t slot = ts_query__pattern_map_slot(self, symbol);
+  if (!ts_query__slot_starts_pattern(self, slot)) return false;
+  *start = self->pattern_map_offsets.contents[slot];
+  *end = self->pattern_map_offsets.contents[slot + 1];
+  return true;
+}
+
+// Add the given symbol bits to the query's summary of the symbols that can
+// start a pattern, if there are any patterns for the given symbol.
+static void ts_query__summarize_pattern_starts(
+  TSQuery *self,
+  TSSymbol symbol,
+  uint64_t symbol_bits
+) {
+  uint32_t start_index, end_index;
+  if (!ts_query__pattern_map_range(self, symbol, &start_index, &end_index)) return;
+  self->pattern_start_symbol_summary |= symbol_bits;
+}
+
+static void ts_query__index_pattern_map(TSQuery *self) {
+  uint32_t slot_count = self->language->symbol_count + 1;
+  array_clear(&self->pattern_map_offsets);
+  array_clear(&self->pattern_start_symbols);
+  array_reserve(&self->pattern_map_offsets, slot_count + 1);
+  array_grow_by(&self->pattern_start_symbols, (slot_count + 31) / 32);
+
+  uint32_t index = self->wildcard_root_pattern_count;
+  for (uint32_t slot = 0; slot < slot_count; slot++) {
+    array_push(&self->pattern_map_offsets, index);
+    while (index < self->pattern_map.size) {
+      PatternEntry *entry = &self->pattern_map.contents[index];
+      TSSymbol symbol = self->steps.contents[entry->step_index].symbol;
+      if (ts_query__pattern_map_slot(self, symbol) != slot) break;
+      self->pattern_start_symbols.contents[slot / 32] |= 1u << (slot % 32);
+      index++;
+    }
+  }
+  array_push(&self->pattern_map_offsets, index);
+
+  // The analysis only finds the repetitions that can contain the patterns
+  // that aren't rooted and don't start with a wildcard. Patterns that match
+  // several siblings because of alternatives or repetitions at their root
+  // can also be rooted.
+  self->has_unanalyzed_sibling_patterns = false;
+  for (uint32_t i = 0; i < self->pattern_map.size; i++) {
+    PatternEntry *entry = &self->pattern_map.contents[i];
+    entry->spans_siblings = ts_query__pattern_spans_siblings(self, entry->step_index);
+    if (
+      entry->spans_siblings &&
+      (entry->is_rooted || self->steps.contents[entry->step_index].symbol == WILDCARD_SYMBOL)
+    ) {
+      self->has_unanalyzed_sibling_patterns = true;
+    }
+  }
+
+  self->pattern_start_symbol_summary = 0;
+  for (TSSymbol symbol = 0; symbol < self->language->symbol_count; symbol++) {
+    TSSymbol public_symbol = ts_language_public_symbol(self->language, symbol);
+    ts_query__summarize_pattern_starts(self, public_symbol, symbol_summary_bit(symbol));
+  }
+  ts_query__summarize_pattern_starts(
+    self,
+    self->language->symbol_count,
+    symbol_summary_bit(ts_builtin_sym_error) |
+    symbol_summary_bit(ts_builtin_sym_error_repeat)
+  );
+}
+
+// Describe the structure of the steps that an analysis starting at the given
+// step depends on, so that its outcome can be reused for other steps with the
+// same structure. Those are the steps up to the end of the parent pattern, as
+// well as any steps that can be reached from them via alternatives or
+// pass-through steps. Depths and step indices are stored relative to the
+// first step.
+static void ts_query__analysis_key(
+  const TSQuery *self,
+  QueryAnalysis *analysis,
+  TSSymbol root_symbol,
+  uint16_t start_step_index
+) {
+  const QueryStep *steps = self->steps.contents;
+  uint16_t start_depth = steps[start_step_index].depth;
+  uint32_t end_step_index = start_step_index;
+  while (
+    steps[end_step_index].depth != PATTERN_DONE_MARKER &&
+    steps[end_step_index].depth >= start_depth
+  ) end_step_index++;
+
+  array_clear(&analysis->result.key);
+  array_push(&analysis->result.key, root_symbol);
+  for (uint32_t i = start_step_index; i <= end_step_index; i++) {
+    const QueryStep *step = &steps[i];
+    if (step->alternative_index != NONE && step->alternative_index > end_step_index) {
+      end_step_index = step->alternative_index;
+    }
+    if (step->is_pass_through && i == end_step_index && i + 1 < self->steps.size) {
+      end_step_index++;
+    }
+    array_push(&analysis->result.key, step->symbol);
+    array_push(&analysis->result.key, step->supertype_symbol);
+    array_push(&analysis->result.key, step->field);
+    array_push(&analysis->result.key, step->depth == PATTERN_DONE_MARKER
+      ? UINT32_MAX
+      : (uint32_t)step->depth + PATTERN_DONE_MARKER - start_depth);
+    array_push(&analysis->result.key, step->alternative_index == NONE
+      ? UINT32_MAX
+      : (uint32_t)step->alternative_index + NONE - start_step_index);
+    array_push(&analysis->result.key, step->is_named | step->is_pass_through << 1 | step->is_dead_end << 2);
+  }
+}
+
 // Walk the subgraph for this non-terminal, tracking all of the possible
 // sequences of progress within the pattern.
 static void ts_query__perform_analysis(
@@ -1695,38 +2419,43 @@ static bool ts_query__analyze_patterns(TSQuery *self, unsigned *error_offset) {
       break;
     }
 
-    // Initialize an analysis state at every parse state in the table where
-    // this parent symbol can occur.
-    AnalysisSubgraph *subgraph = &subgraphs.contents[subgraph_index];
-    analysis_state_set__clear(&analysis.states, &analysis.state_pool);
-    analysis_state_set__clear(&analysis.deeper_states, &analysis.state_pool);
-    for (unsigned j = 0; j < subgraph->start_states.size; j++) {
-      TSStateId parse_state = subgraph->start_states.contents[j];
-      analysis_state_set__push(&analysis.states, &analysis.state_pool, &((AnalysisState) {
-        .step_index = parent_step_index + 1,
-        .stack = {
-          [0] = {
-            .parse_state = parse_state,
-            .parent_symbol = parent_symbol,
-            .child_index = 0,
-            .field_id = 0,
-            .done = false,
+    // Reuse the outcome of analyzing any earlier pattern with the same structure.
+    ts_query__analysis_key(self, &analysis, parent_symbol, parent_step_index + 1);
+    if (!query_analysis__load_result(&analysis, parent_step_index + 1)) {
+      // Initialize an analysis state at every parse state in the table where
+      // this parent symbol can occur.
+      AnalysisSubgraph *subgraph = &subgraphs.contents[subgraph_index];
+      analysis_state_set__clear(&analysis.states, &analysis.state_pool);
+      analysis_state_set__clear(&analysis.deeper_states, &analysis.state_pool);
+      for (unsigned j = 0; j < subgraph->start_states.size; j++) {
+        TSStateId parse_state = subgraph->start_states.contents[j];
+        analysis_state_set__push(&analysis.states, &analysis.state_pool, &((AnalysisState) {
+          .step_index = parent_step_index + 1,
+          .stack = {
+            [0] = {
+              .parse_state = parse_state,
+              .parent_symbol = parent_symbol,
+              .child_index = 0,
+              .field_id = 0,
+              .done = false,
+            },
           },
-        },
-        .depth = 1,
-        .root_symbol = parent_symbol,
-      }));
-    }
+          .depth = 1,
+          .root_symbol = parent_symbol,
+        }));
+      }
 
-    #ifdef DEBUG_ANALYZE_QUERY
-      printf(
-        "\nWalk states for %s:\n",
-        ts_language_symbol_name(self->language, analysis.states.contents[0]->stack[0].parent_symbol)
-      );
-    #endif
+      #ifdef DEBUG_ANALYZE_QUERY
+        printf(
+          "\nWalk states for %s:\n",
+          ts_language_symbol_name(self->language, analysis.states.contents[0]->stack[0].parent_symbol)
+        );
+      #endif
 
-    analysis.did_abort = false;
-    ts_query__perform_analysis(self, &subgraphs, &analysis);
+      analysis.did_abort = false;
+      ts_query__perform_analysis(self, &subgraphs, &analysis);
+      query_analysis__store_result(&analysis, parent_step_index + 1);
+    }
 
     // If this pattern could not be fully analyzed, then every step should
     // be considered fallible.
@@ -1879,41 +2608,47 @@ static bool ts_query__analyze_patterns(TSQuery *self, unsigned *error_offset) {
     uint16_t pattern_entry_index = non_rooted_pattern_start_steps.contents[i];
     PatternEntry *pattern_entry = &self->pattern_map.contents[pattern_entry_index];
 
-    analysis_state_set__clear(&analysis.states, &analysis.state_pool);
-    analysis_state_set__clear(&analysis.deeper_states, &analysis.state_pool);
-    for (unsigned j = 0; j < subgraphs.size; j++) {
-      AnalysisSubgraph *subgraph = &subgraphs.contents[j];
-      TSSymbolMetadata metadata = ts_language_symbol_metadata(self->language, subgraph->symbol);
-      if (metadata.visible || metadata.named) continue;
-
-      for (uint32_t k = 0; k < subgraph->start_states.size; k++) {
-        TSStateId parse_state = subgraph->start_states.contents[k];
-        analysis_state_set__push(&analysis.states, &analysis.state_pool, &((AnalysisState) {
-          .step_index = pattern_entry->step_index,
-          .stack = {
-            [0] = {
-              .parse_state = parse_state,
-              .parent_symbol = subgraph->symbol,
-              .child_index = 0,
-              .field_id = 0,
-              .done = false,
+    // Rootless patterns are analyzed without a root symbol, so they are stored
+    // under a key that doesn't have one.
+    ts_query__analysis_key(self, &analysis, 0, pattern_entry->step_index);
+    if (!query_analysis__load_result(&analysis, pattern_entry->step_index)) {
+      analysis_state_set__clear(&analysis.states, &analysis.state_pool);
+      analysis_state_set__clear(&analysis.deeper_states, &analysis.state_pool);
+      for (unsigned j = 0; j < subgraphs.size; j++) {
+        AnalysisSubgraph *subgraph = &subgraphs.contents[j];
+        TSSymbolMetadata metadata = ts_language_symbol_metadata(self->language, subgraph->symbol);
+        if (metadata.visible || metadata.named) continue;
+
+        for (uint32_t k = 0; k < subgraph->start_states.size; k++) {
+          TSStateId parse_state = subgraph->start_states.contents[k];
+          analysis_state_set__push(&analysis.states, &analysis.state_pool, &((AnalysisState) {
+            .step_index = pattern_entry->step_index,
+            .stack = {
+              [0] = {
+                .parse_state = parse_state,
+                .parent_symbol = subgraph->symbol,
+                .child_index = 0,
+                .field_id = 0,
+                .done = false,
+              },
             },
-          },
-          .root_symbol = subgraph->symbol,
-          .depth = 1,
-        }));
+            .root_symbol = subgraph->symbol,
+            .depth = 1,
+          }));
+        }
       }
-    }
 
-    #ifdef DEBUG_ANALYZE_QUERY
-      printf("\nWalk states for rootless pattern step %u:\n", step_index);
-    #endif
+      #ifdef DEBUG_ANALYZE_QUERY
+        printf("\nWalk states for rootless pattern step %u:\n", step_index);
+      #endif
 
-    ts_query__perform_analysis(
-      self,
-      &subgraphs,
-      &analysis
-    );
+      ts_query__perform_analysis(
+        self,
+        &subgraphs,
+        &analysis
+      );
+      query_analysis__store_result(&analysis, pattern_entry->step_index);
+    }
 
     if (analysis.finished_parent_symbols.size > 0) {
       self->patterns.contents[pattern_entry->pattern_index].is_non_local = true;
@@ -2162,9 +2897,61 @@ static TSQueryError ts_query__parse_predicate(
   return 0;
 }
 
-// Read one S-expression pattern from the stream, and incorporate it into
-// the query's internal state machine representation. For nested patterns,
-// this function calls itself recursively.
+// Find the predicates of the given pattern that the query cursor can evaluate
+// itself, and add them to the query's internal `text_predicates` array. Any
+// predicates with the wrong number or type of arguments are left for the
+// caller to report, and any regexes that use unsupported syntax are left for
+// the caller to evaluate.
+static void ts_query__add_text_predicates(TSQuery *self, QueryPattern *pattern) {
+  pattern->text_predicates.offset = self->text_predicates.size;
+  const TSQueryPredicateStep *steps = &self->predicate_steps.contents[pattern->predicate_steps.offset];
+  uint32_t step_count = pattern->predicate_steps.length;
+  for (uint32_t start = 0, end = 0; start < step_count; start = end + 1) {
+    end = start;
+    while (end < step_count && steps[end].type != TSQueryPredicateStepTypeDone) end++;
+    if (
+      end - start != 3 ||
+      steps[start].type != TSQueryPredicateStepTypeString ||
+      steps[start + 1].type != TSQueryPredicateStepTypeCapture
+    ) continue;
+
+    uint32_t length;
+    const char *name = symbol_table_name_for_id(&self->predicate_values, steps[start].value_id, &length);
+    bool is_value_capture = steps[start + 2].type == TSQueryPredicateStepTypeCapture;
+    TextPredicate predicate = {
+      .type = is_value_capture ? TextPredicateTypeEqCapture : TextPredicateTypeEqString,
+      .capture_id = steps[start + 1].value_id,
+      .value_id = steps[start + 2].value_id,
+      .is_positive = true,
+      .regex = NULL,
+    };
+    if (length == 3 && !strncmp(name, "eq?", 3)) {
+      predicate.is_positive = true;
+    } else if (length == 7 && !strncmp(name, "not-eq?", 7)) {
+      predicate.is_positive = false;
+    } else if (
+      !is_value_capture &&
+      ((length == 6 && !strncmp(name, "match?", 6)) ||
+       (length == 10 && !strncmp(name, "not-match?", 10)))
+    ) {
+      uint32_t pattern_length;
+      const char *pattern = symbol_table_name_for_id(&self->predicate_values, predicate.value_id, &pattern_length);
+      predicate.type = TextPredicateTypeMatchString;
+      predicate.is_positive = length == 6;
+      predicate.regex = ts_regex_new(pattern, pattern_length);
+      if (!predicate.regex) continue;
+    } else {
+      continue;
+    }
+
+    array_push(&self->text_predicates, predicate);
+  }
+  pattern->text_predicates.length = self->text_predicates.size - pattern->text_predicates.offset;
+}
+
+// Read one S-expression pattern from the stream, and incorporate it into
+// the query's internal state machine representation. For nested patterns,
+// this function calls itself recursively.
 //
 // The caller is responsible for passing in a dedicated CaptureQuantifiers.
 // These should not be shared between different calls to ts_query__parse_pattern!
@@ -2684,10 +3471,13 @@ TSQuery *ts_query_new(
   *self = (TSQuery) {
     .steps = array_new(),
     .pattern_map = array_new(),
+    .pattern_map_offsets = array_new(),
+    .pattern_start_symbols = array_new(),
     .captures = symbol_table_new(),
     .capture_quantifiers = array_new(),
     .predicate_values = symbol_table_new(),
     .predicate_steps = array_new(),
+    .text_predicates = array_new(),
     .patterns = array_new(),
     .step_offsets = array_new(),
     .string_buffer = array_new(),
@@ -2732,6 +3522,7 @@ TSQuery *ts_query_new(
 
     // Maintain a list of capture quantifiers for each pattern
     array_push(&self->capture_quantifiers, capture_quantifiers);
+    ts_query__add_text_predicates(self, pattern);
 
     // Maintain a map that can look up patterns for a given root symbol.
     uint16_t wildcard_root_alternative_index = NONE;
@@ -2759,7 +3550,13 @@ TSQuery *ts_query_new(
       bool is_rooted = start_depth == 0;
       for (uint32_t step_index = start_step_index + 1; step_index < self->steps.size; step_index++) {
         QueryStep *step = &self->steps.contents[step_index];
-        if (step->is_dead_end) break;
+
+        // Skip over the remaining branches of an alternation. The steps that
+        // follow the alternation are still part of the pattern.
+        if (step->is_dead_end) {
+          step_index = step->alternative_index - 1;
+          continue;
+        }
         if (step->depth == start_depth) {
           is_rooted = false;
           break;
@@ -2795,6 +3592,7 @@ TSQuery *ts_query_new(
     return NULL;
   }
 
+  ts_query__index_pattern_map(self);
   array_delete(&self->string_buffer);
   return self;
 }
@@ -2803,7 +3601,13 @@ void ts_query_delete(TSQuery *self) {
   if (self) {
     array_delete(&self->steps);
     array_delete(&self->pattern_map);
+    array_delete(&self->pattern_map_offsets);
+    array_delete(&self->pattern_start_symbols);
     array_delete(&self->predicate_steps);
+    for (uint32_t i = 0; i < self->text_predicates.size; i++) {
+      ts_regex_delete(self->text_predicates.contents[i].regex);
+    }
+    array_delete(&self->text_predicates);
     array_delete(&self->patterns);
     array_delete(&self->step_offsets);
     array_delete(&self->string_buffer);
@@ -2890,6 +3694,26 @@ bool ts_query_is_pattern_rooted(
   return true;
 }
 
+uint16_t ts_query_capture_depth(
+  const TSQuery *self,
+  uint32_t pattern_index,
+  uint32_t capture_index
+) {
+  uint16_t result = 0;
+  Slice steps = self->patterns.contents[pattern_index].steps;
+  for (uint32_t i = steps.offset; i < steps.offset + steps.length; i++) {
+    const QueryStep *step = &self->steps.contents[i];
+    if (step->depth == PATTERN_DONE_MARKER) continue;
+    for (unsigned j = 0; j < MAX_STEP_CAPTURE_COUNT; j++) {
+      if (step->capture_ids[j] == NONE) break;
+      if (step->capture_ids[j] == capture_index && step->depth > result) {
+        result = step->depth;
+      }
+    }
+  }
+  return result;
+}
+
 bool ts_query_is_pattern_non_local(
   const TSQuery *self,
   uint32_t pattern_index
@@ -2961,6 +3785,578 @@ void ts_query_disable_pattern(
       i--;
     }
   }
+  ts_query__index_pattern_map(self);
+}
+
+// The serialized format starts with a magic number and a version, followed by
+// a description of the language, which is used to reject queries that were
+// compiled for a different grammar, and then the query's internal tables, as
+// they are after the patterns have been analyzed. Every index within the
+// tables is checked when the query is read back in.
+static const char QUERY_SERIALIZATION_MAGIC[4] = {'T', 'S', 'Q', 'Y'};
+static const uint32_t QUERY_SERIALIZATION_VERSION = 2;
+
+static inline bool slice_is_within(Slice slice, uint32_t size) {
+  return slice.offset <= size && slice.length <= size - slice.offset;
+}
+
+// Get the steps that the query cursor moves to from the given step without
+// matching a node.
+static uint16_t query_step__jump(const QueryStep *self, uint16_t index, unsigned jump_index) {
+  if (self->alternative_index == NONE) return NONE;
+  if (jump_index == 0) return self->alternative_index;
+  if (jump_index == 1 && self->is_pass_through && !self->is_dead_end) return index + 1;
+  return NONE;
+}
+
+static bool ts_query__deserialize_steps(TSQuery *self, SerializationReader *reader) {
+  uint32_t count;
+  if (
+    !ts_serialization_read_uint(reader, &count) ||
+    count == 0 || count >= UINT16_MAX ||
+    count > ts_serialization_remaining(reader)
+  ) return false;
+  uint32_t capture_count = self->captures.slices.size;
+  for (unsigned i = 0; i < count; i++) {
+    QueryStep step = {.symbol = 0};
+    uint32_t flags = 0;
+    if (
+      !ts_serialization_read_uint16(reader, &step.symbol) ||
+      !ts_serialization_read_uint16(reader, &step.supertype_symbol) ||
+      !ts_serialization_read_uint16(reader, &step.field) ||
+      !ts_serialization_read_uint16(reader, &step.depth) ||
+      !ts_serialization_read_uint16(reader, &step.alternative_index) ||
+      !ts_serialization_read_uint16(reader, &step.negated_field_list_id) ||
+      !ts_serialization_read_uint(reader, &flags)
+    ) return false;
+    for (unsigned j = 0; j < MAX_STEP_CAPTURE_COUNT; j++) {
+      if (!ts_serialization_read_uint16(reader, &step.capture_ids[j])) return false;
+      if (step.capture_ids[j] != NONE && step.capture_ids[j] >= capture_count) return false;
+    }
+    if (
+      step.symbol >= self->language->symbol_count &&
+      step.symbol != ts_builtin_sym_error &&
+      step.symbol != ts_builtin_sym_error_repeat
+    ) return false;
+    if (
+      step.supertype_symbol >= self->language->symbol_count ||
+      step.field > self->language->field_count ||
+      step.negated_field_list_id >= self->negated_fields.size ||
+      (step.alternative_index != NONE && step.alternative_index >= count)
+    ) return false;
+    step.is_named = flags & (1 << 0);
+    step.is_immediate = flags & (1 << 1);
+    step.is_last_child = flags & (1 << 2);
+    step.is_pass_through = flags & (1 << 3);
+    step.is_dead_end = flags & (1 << 4);
+    step.alternative_is_immediate = flags & (1 << 5);
+    step.contains_captures = flags & (1 << 6);
+    step.root_pattern_guaranteed = flags & (1 << 7);
+    step.parent_pattern_guaranteed = flags & (1 << 8);
+    array_push(&self->steps, step);
+  }
+
+  // The query cursor advances through the steps until it reaches the end of
+  // a pattern, so the last step must end a pattern.
+  if (array_back(&self->steps)->depth != PATTERN_DONE_MARKER) return false;
+
+  // Before matching the next node, the query cursor follows the jumps from each
+  // step to its alternative, and past any pass-through steps, so those jumps
+  // must not form a cycle. Search for one, marking each step on the stack with
+  // one more than the number of its two jumps that have been followed.
+  const uint8_t DONE = 4;
+  uint8_t *marks = ts_calloc(count, sizeof(uint8_t));
+  Array(uint16_t) stack = array_new();
+  bool has_cycle = false;
+  for (uint16_t i = 0; i < count && !has_cycle; i++) {
+    if (marks[i]) continue;
+    marks[i] = 1;
+    array_push(&stack, i);
+    while (stack.size > 0) {
+      uint16_t step_index = *array_back(&stack);
+      if (marks[step_index] == DONE - 1) {
+        marks[step_index] = DONE;
+        stack.size--;
+        continue;
+      }
+      uint16_t next_index = query_step__jump(&self->steps.contents[step_index], step_index, marks[step_index] - 1);
+      marks[step_index]++;
+      if (next_index == NONE) continue;
+      if (next_index >= count || (marks[next_index] && marks[next_index] != DONE)) {
+        has_cycle = true;
+        break;
+      }
+      if (!marks[next_index]) {
+        marks[next_index] = 1;
+        array_push(&stack, next_index);
+      }
+    }
+  }
+  array_delete(&stack);
+  ts_free(marks);
+  return !has_cycle;
+}
+
+static bool ts_query__deserialize_predicates(TSQuery *self, SerializationReader *reader) {
+  uint32_t step_count, text_predicate_count;
+  uint32_t capture_count = self->captures.slices.size;
+  uint32_t value_count = self->predicate_values.slices.size;
+  if (
+    !ts_serialization_read_uint(reader, &step_count) ||
+    step_count > ts_serialization_remaining(reader)
+  ) return false;
+  for (unsigned i = 0; i < step_count; i++) {
+    uint32_t type = 0, value_id = 0;
+    if (
+      !ts_serialization_read_uint(reader, &type) ||
+      !ts_serialization_read_uint(reader, &value_id) ||
+      type > TSQueryPredicateStepTypeString ||
+      (type == TSQueryPredicateStepTypeCapture && value_id >= capture_count) ||
+      (type == TSQueryPredicateStepTypeString && value_id >= value_count)
+    ) return false;
+    array_push(&self->predicate_steps, ((TSQueryPredicateStep) {
+      .type = type,
+      .value_id = value_id,
+    }));
+  }
+
+  if (
+    !ts_serialization_read_uint(reader, &text_predicate_count) ||
+    text_predicate_count > ts_serialization_remaining(reader)
+  ) return false;
+  for (unsigned i = 0; i < text_predicate_count; i++) {
+    uint32_t type = 0, is_positive = 0;
+    TextPredicate predicate = {.regex = NULL};
+    if (
+      !ts_serialization_read_uint(reader, &type) ||
+      !ts_serialization_read_uint16(reader, &predicate.capture_id) ||
+      !ts_serialization_read_uint16(reader, &predicate.value_id) ||
+      !ts_serialization_read_uint(reader, &is_positive) ||
+      type > TextPredicateTypeMatchString ||
+      predicate.capture_id >= capture_count ||
+      predicate.value_id >= (type == TextPredicateTypeEqCapture ? capture_count : value_count)
+    ) return false;
+    predicate.type = type;
+    predicate.is_positive = is_positive;
+    if (type == TextPredicateTypeMatchString) {
+      predicate.regex = ts_regex_deserialize(reader);
+      if (!predicate.regex) return false;
+    }
+    array_push(&self->text_predicates, predicate);
+  }
+  return true;
+}
+
+static bool ts_query__deserialize_patterns(TSQuery *self, SerializationReader *reader) {
+  uint32_t pattern_count;
+  if (
+    !ts_serialization_read_uint(reader, &pattern_count) ||
+    pattern_count >= UINT16_MAX ||
+    pattern_count > ts_serialization_remaining(reader)
+  ) return false;
+  for (unsigned i = 0; i < pattern_count; i++) {
+    QueryPattern pattern = {.is_non_local = false};
+    uint32_t is_non_local = 0;
+    if (
+      !ts_serialization_read_uint(reader, &pattern.steps.offset) ||
+      !ts_serialization_read_uint(reader, &pattern.steps.length) ||
+      !ts_serialization_read_uint(reader, &pattern.predicate_steps.offset) ||
+      !ts_serialization_read_uint(reader, &pattern.predicate_steps.length) ||
+      !ts_serialization_read_uint(reader, &pattern.text_predicates.offset) ||
+      !ts_serialization_read_uint(reader, &pattern.text_predicates.length) ||
+      !ts_serialization_read_uint(reader, &pattern.start_byte) ||
+      !ts_serialization_read_uint(reader, &is_non_local) ||
+      !slice_is_within(pattern.steps, self->steps.size) ||
+      !slice_is_within(pattern.predicate_steps, self->predicate_steps.size) ||
+      !slice_is_within(pattern.text_predicates, self->text_predicates.size)
+    ) return false;
+    pattern.is_non_local = is_non_local;
+    array_push(&self->patterns, pattern);
+
+    uint32_t quantifier_count;
+    const char *quantifiers;
+    if (
+      !ts_serialization_read_uint(reader, &quantifier_count) ||
+      quantifier_count > self->captures.slices.size ||
+      !ts_serialization_read_bytes(reader, quantifier_count, &quantifiers)
+    ) return false;
+    CaptureQuantifiers capture_quantifiers = capture_quantifiers_new();
+    array_push(&self->capture_quantifiers, capture_quantifiers);
+    for (unsigned j = 0; j < quantifier_count; j++) {
+      if ((uint8_t)quantifiers[j] > TSQuantifierOneOrMore) return false;
+      array_push(array_back(&self->capture_quantifiers), quantifiers[j]);
+    }
+  }
+
+  uint32_t entry_count;
+  if (
+    !ts_serialization_read_uint(reader, &entry_count) ||
+    entry_count > ts_serialization_remaining(reader)
+  ) return false;
+  for (unsigned i = 0; i < entry_count; i++) {
+    PatternEntry entry = {.step_index = 0};
+    uint32_t is_rooted = 0;
+    if (
+      !ts_serialization_read_uint16(reader, &entry.step_index) ||
+      !ts_serialization_read_uint16(reader, &entry.pattern_index) ||
+      !ts_serialization_read_uint(reader, &is_rooted) ||
+      entry.step_index >= self->steps.size ||
+      entry.pattern_index >= self->patterns.size
+    ) return false;
+
+    // The pattern map is searched by the symbol of each pattern's first step.
+    const QueryStep *step = &self->steps.contents[entry.step_index];
+    if (step->depth == PATTERN_DONE_MARKER) return false;
+    if (
+      self->pattern_map.size > 0 &&
+      self->steps.contents[array_back(&self->pattern_map)->step_index].symbol > step->symbol
+    ) return false;
+    entry.is_rooted = is_rooted;
+    array_push(&self->pattern_map, entry);
+  }
+  return true;
+}
+
+// Write the query into a binary format from which it can be restored using
+// `ts_query_deserialize`, without parsing or analyzing its source again.
+char *ts_query_serialize(const TSQuery *self, uint32_t *length) {
+  SerializationBuffer buffer = array_new();
+  ts_serialization_write_bytes(&buffer, QUERY_SERIALIZATION_MAGIC, sizeof(QUERY_SERIALIZATION_MAGIC));
+  ts_serialization_write_uint(&buffer, QUERY_SERIALIZATION_VERSION);
+  ts_serialization_write_uint(&buffer, self->language->version);
+  ts_serialization_write_uint(&buffer, self->language->symbol_count);
+  ts_serialization_write_uint(&buffer, self->language->field_count);
+  ts_serialization_write_uint(&buffer, self->language->state_count);
+  ts_serialization_write_uint(&buffer, ts_language_name_hash(self->language));
+  symbol_table_serialize(&self->captures, &buffer);
+  symbol_table_serialize(&self->predicate_values, &buffer);
+
+  ts_serialization_write_uint(&buffer, self->negated_fields.size);
+  for (unsigned i = 0; i < self->negated_fields.size; i++) {
+    ts_serialization_write_uint(&buffer, self->negated_fields.contents[i]);
+  }
+
+  ts_serialization_write_uint(&buffer, self->steps.size);
+  for (unsigned i = 0; i < self->steps.size; i++) {
+    const QueryStep *step = &self->steps.contents[i];
+    ts_serialization_write_uint(&buffer, step->symbol);
+    ts_serialization_write_uint(&buffer, step->supertype_symbol);
+    ts_serialization_write_uint(&buffer, step->field);
+    ts_serialization_write_uint(&buffer, step->depth);
+    ts_serialization_write_uint(&buffer, step->alternative_index);
+    ts_serialization_write_uint(&buffer, step->negated_field_list_id);
+    ts_serialization_write_uint(&buffer,
+      step->is_named << 0 |
+      step->is_immediate << 1 |
+      step->is_last_child << 2 |
+      step->is_pass_through << 3 |
+      step->is_dead_end << 4 |
+      step->alternative_is_immediate << 5 |
+      step->contains_captures << 6 |
+      step->root_pattern_guaranteed << 7 |
+      step->parent_pattern_guaranteed << 8
+    );
+    for (unsigned j = 0; j < MAX_STEP_CAPTURE_COUNT; j++) {
+      ts_serialization_write_uint(&buffer, step->capture_ids[j]);
+    }
+  }
+
+  ts_serialization_write_uint(&buffer, self->predicate_steps.size);
+  for (unsigned i = 0; i < self->predicate_steps.size; i++) {
+    ts_serialization_write_uint(&buffer, self->predicate_steps.contents[i].type);
+    ts_serialization_write_uint(&buffer, self->predicate_steps.contents[i].value_id);
+  }
+
+  ts_serialization_write_uint(&buffer, self->text_predicates.size);
+  for (unsigned i = 0; i < self->text_predicates.size; i++) {
+    const TextPredicate *predicate = &self->text_predicates.contents[i];
+    ts_serialization_write_uint(&buffer, predicate->type);
+    ts_serialization_write_uint(&buffer, predicate->capture_id);
+    ts_serialization_write_uint(&buffer, predicate->value_id);
+    ts_serialization_write_uint(&buffer, predicate->is_positive);
+    if (predicate->type == TextPredicateTypeMatchString) {
+      ts_regex_serialize(predicate->regex, &buffer);
+    }
+  }
+
+  ts_serialization_write_uint(&buffer, self->patterns.size);
+  for (unsigned i = 0; i < self->patterns.size; i++) {
+    const QueryPattern *pattern = &self->patterns.contents[i];
+    const CaptureQuantifiers *capture_quantifiers = &self->capture_quantifiers.contents[i];
+    ts_serialization_write_uint(&buffer, pattern->steps.offset);
+    ts_serialization_write_uint(&buffer, pattern->steps.length);
+    ts_serialization_write_uint(&buffer, pattern->predicate_steps.offset);
+    ts_serialization_write_uint(&buffer, pattern->predicate_steps.length);
+    ts_serialization_write_uint(&buffer, pattern->text_predicates.offset);
+    ts_serialization_write_uint(&buffer, pattern->text_predicates.length);
+    ts_serialization_write_uint(&buffer, pattern->start_byte);
+    ts_serialization_write_uint(&buffer, pattern->is_non_local);
+    ts_serialization_write_uint(&buffer, capture_quantifiers->size);
+    if (capture_quantifiers->size > 0) {
+      ts_serialization_write_bytes(&buffer, (const char *)capture_quantifiers->contents, capture_quantifiers->size);
+    }
+  }
+
+  ts_serialization_write_uint(&buffer, self->pattern_map.size);
+  for (unsigned i = 0; i < self->pattern_map.size; i++) {
+    const PatternEntry *entry = &self->pattern_map.contents[i];
+    ts_serialization_write_uint(&buffer, entry->step_index);
+    ts_serialization_write_uint(&buffer, entry->pattern_index);
+    ts_serialization_write_uint(&buffer, entry->is_rooted);
+  }
+  ts_serialization_write_uint(&buffer, self->wildcard_root_pattern_count);
+
+  ts_serialization_write_uint(&buffer, self->step_offsets.size);
+  for (unsigned i = 0; i < self->step_offsets.size; i++) {
+    ts_serialization_write_uint(&buffer, self->step_offsets.contents[i].byte_offset);
+    ts_serialization_write_uint(&buffer, self->step_offsets.contents[i].step_index);
+  }
+
+  ts_serialization_write_uint(&buffer, self->repeat_symbols_with_rootless_patterns.size);
+  for (unsigned i = 0; i < self->repeat_symbols_with_rootless_patterns.size; i++) {
+    ts_serialization_write_uint(&buffer, self->repeat_symbols_with_rootless_patterns.contents[i]);
+  }
+
+  *length = buffer.size;
+  ts_disown(buffer.contents);
+  return buffer.contents;
+}
+
+TSQuery *ts_query_deserialize(const TSLanguage *language, const char *data, uint32_t length) {
+  SerializationReader reader = ts_serialization_reader_new(data, length);
+  const char *magic;
+  uint32_t version, language_version, symbol_count, field_count, state_count, language_hash;
+  if (
+    !language ||
+    !ts_serialization_read_bytes(&reader, sizeof(QUERY_SERIALIZATION_MAGIC), &magic) ||
+    memcmp(magic, QUERY_SERIALIZATION_MAGIC, sizeof(QUERY_SERIALIZATION_MAGIC)) != 0 ||
+    !ts_serialization_read_uint(&reader, &version) ||
+    version != QUERY_SERIALIZATION_VERSION ||
+    !ts_serialization_read_uint(&reader, &language_version) ||
+    !ts_serialization_read_uint(&reader, &symbol_count) ||
+    !ts_serialization_read_uint(&reader, &field_count) ||
+    !ts_serialization_read_uint(&reader, &state_count) ||
+    !ts_serialization_read_uint(&reader, &language_hash) ||
+    language_version != language->version ||
+    symbol_count != language->symbol_count ||
+    field_count != language->field_count ||
+    state_count != language->state_count ||
+    language_hash != ts_language_name_hash(language)
+  ) return NULL;
+
+  TSQuery *self = ts_malloc(sizeof(TSQuery));
+  *self = (TSQuery) {
+    .steps = array_new(),
+    .pattern_map = array_new(),
+    .pattern_map_offsets = array_new(),
+    .pattern_start_symbols = array_new(),
+    .captures = symbol_table_new(),
+    .capture_quantifiers = array_new(),
+    .predicate_values = symbol_table_new(),
+    .predicate_steps = array_new(),
+    .text_predicates = array_new(),
+    .patterns = array_new(),
+    .step_offsets = array_new(),
+    .string_buffer = array_new(),
+    .negated_fields = array_new(),
+    .repeat_symbols_with_rootless_patterns = array_new(),
+    .wildcard_root_pattern_count = 0,
+    .language = language,
+  };
+
+  // Each list of negated fields ends with a zero.
+  uint32_t negated_field_count;
+  bool is_valid =
+    symbol_table_deserialize(&self->captures, &reader) &&
+    symbol_table_deserialize(&self->predicate_values, &reader) &&
+    ts_serialization_read_uint(&reader, &negated_field_count) &&
+    negated_field_count > 0 &&
+    negated_field_count <= ts_serialization_remaining(&reader);
+  for (unsigned i = 0; is_valid && i < negated_field_count; i++) {
+    TSFieldId field_id = 0;
+    is_valid =
+      ts_serialization_read_uint16(&reader, &field_id) &&
+      field_id <= language->field_count &&
+      (field_id == 0 || i + 1 < negated_field_count);
+    array_push(&self->negated_fields, field_id);
+  }
+
+  is_valid =
+    is_valid &&
+    ts_query__deserialize_steps(self, &reader) &&
+    ts_query__deserialize_predicates(self, &reader) &&
+    ts_query__deserialize_patterns(self, &reader) &&
+    ts_serialization_read_uint16(&reader, &self->wildcard_root_pattern_count) &&
+    self->wildcard_root_pattern_count <= self->pattern_map.size;
+
+  uint32_t step_offset_count = 0, repeat_symbol_count = 0;
+  is_valid =
+    is_valid &&
+    ts_serialization_read_uint(&reader, &step_offset_count) &&
+    step_offset_count <= ts_serialization_remaining(&reader);
+  for (unsigned i = 0; is_valid && i < step_offset_count; i++) {
+    StepOffset step_offset = {.byte_offset = 0};
+    is_valid =
+      ts_serialization_read_uint(&reader, &step_offset.byte_offset) &&
+      ts_serialization_read_uint16(&reader, &step_offset.step_index) &&
+      step_offset.step_index < self->steps.size;
+    array_push(&self->step_offsets, step_offset);
+  }
+
+  is_valid =
+    is_valid &&
+    ts_serialization_read_uint(&reader, &repeat_symbol_count) &&
+    repeat_symbol_count <= ts_serialization_remaining(&reader);
+  for (unsigned i = 0; is_valid && i < repeat_symbol_count; i++) {
+    TSSymbol symbol = 0;
+    is_valid = ts_serialization_read_uint16(&reader, &symbol);
+    array_push(&self->repeat_symbols_with_rootless_patterns, symbol);
+  }
+
+  if (!is_valid || ts_serialization_remaining(&reader) != 0) {
+    ts_query_delete(self);
+    return NULL;
+  }
+
+  ts_query__index_pattern_map(self);
+  return self;
+}
+
+// Combine several queries into one, so that a query cursor can run all of
+// them in a single walk of the tree. The combined query only contains the
+// data that the cursor needs: it has no capture names, predicate steps, or
+// step offsets, and it shares the regexes of the original queries. Capture
+// ids are not remapped, so the captures of each match refer to the captures
+// of the query that the match's pattern came from. The index of the first
+// pattern of each query is written to `pattern_offsets`.
+//
+// The given query is reused, so that its arrays don't need to be reallocated
+// every time the same cursor runs the queries. It is left unchanged if the
+// queries can't be combined.
+static bool ts_query__combine(
+  TSQuery *self,
+  const TSQuery *const *queries,
+  uint32_t query_count,
+  uint32_t *pattern_offsets
+) {
+  if (query_count == 0) return false;
+  uint32_t step_count = 0, pattern_count = 0;
+  for (uint32_t i = 0; i < query_count; i++) {
+    if (queries[i]->language != queries[0]->language) return false;
+    step_count += queries[i]->steps.size;
+    pattern_count += queries[i]->patterns.size;
+  }
+  if (step_count >= NONE || pattern_count >= NONE) return false;
+
+  array_clear(&self->steps);
+  array_clear(&self->pattern_map);
+  array_clear(&self->patterns);
+  array_clear(&self->text_predicates);
+  array_clear(&self->negated_fields);
+  array_clear(&self->repeat_symbols_with_rootless_patterns);
+  array_clear(&self->predicate_values.characters);
+  array_clear(&self->predicate_values.slices);
+  self->wildcard_root_pattern_count = 0;
+  self->language = queries[0]->language;
+
+  // Each list of negated fields ends with a zero, and the list at index zero
+  // is empty.
+  array_push(&self->negated_fields, 0);
+
+  Array(PatternEntry) pattern_map = array_new();
+  for (uint32_t i = 0; i < query_count; i++) {
+    const TSQuery *query = queries[i];
+    uint32_t step_base = self->steps.size;
+    uint32_t pattern_base = self->patterns.size;
+    uint32_t text_predicate_base = self->text_predicates.size;
+    uint32_t value_base = self->predicate_values.slices.size;
+    uint32_t character_base = self->predicate_values.characters.size;
+    uint32_t negated_field_base = self->negated_fields.size;
+    pattern_offsets[i] = pattern_base;
+
+    for (uint32_t j = 1; j < query->negated_fields.size; j++) {
+      array_push(&self->negated_fields, query->negated_fields.contents[j]);
+    }
+
+    for (uint32_t j = 0; j < query->steps.size; j++) {
+      QueryStep step = query->steps.contents[j];
+      if (step.alternative_index != NONE) step.alternative_index += step_base;
+      if (step.negated_field_list_id != 0) {
+        step.negated_field_list_id += negated_field_base - 1;
+      }
+      array_push(&self->steps, step);
+    }
+
+    array_push_all(&self->predicate_values.characters, &query->predicate_values.characters);
+    for (uint32_t j = 0; j < query->predicate_values.slices.size; j++) {
+      Slice slice = query->predicate_values.slices.contents[j];
+      slice.offset += character_base;
+      array_push(&self->predicate_values.slices, slice);
+    }
+
+    for (uint32_t j = 0; j < query->text_predicates.size; j++) {
+      TextPredicate predicate = query->text_predicates.contents[j];
+      if (predicate.type == TextPredicateTypeEqString) predicate.value_id += value_base;
+      array_push(&self->text_predicates, predicate);
+    }
+
+    for (uint32_t j = 0; j < query->patterns.size; j++) {
+      QueryPattern pattern = query->patterns.contents[j];
+      pattern.steps.offset += step_base;
+      pattern.text_predicates.offset += text_predicate_base;
+      pattern.predicate_steps = (Slice) {.offset = 0, .length = 0};
+      array_push(&self->patterns, pattern);
+    }
+
+    for (uint32_t j = 0; j < query->repeat_symbols_with_rootless_patterns.size; j++) {
+      TSSymbol symbol = query->repeat_symbols_with_rootless_patterns.contents[j];
+      unsigned index, exists;
+      array_search_sorted_by(&self->repeat_symbols_with_rootless_patterns, , symbol, &index, &exists);
+      if (!exists) array_insert(&self->repeat_symbols_with_rootless_patterns, index, symbol);
+    }
+
+    // Both pattern maps are sorted by symbol and then by pattern index, with
+    // the wildcard symbol first, so they can be merged in one pass.
+    array_clear(&pattern_map);
+    uint32_t k = 0;
+    for (uint32_t j = 0; j < query->pattern_map.size; j++) {
+      PatternEntry entry = query->pattern_map.contents[j];
+      entry.step_index += step_base;
+      entry.pattern_index += pattern_base;
+      TSSymbol symbol = self->steps.contents[entry.step_index].symbol;
+      while (
+        k < self->pattern_map.size &&
+        self->steps.contents[self->pattern_map.contents[k].step_index].symbol <= symbol
+      ) {
+        array_push(&pattern_map, self->pattern_map.contents[k++]);
+      }
+      array_push(&pattern_map, entry);
+    }
+    while (k < self->pattern_map.size) {
+      array_push(&pattern_map, self->pattern_map.contents[k++]);
+    }
+    array_swap(&self->pattern_map, &pattern_map);
+  }
+  array_delete(&pattern_map);
+
+  while (
+    self->wildcard_root_pattern_count < self->pattern_map.size &&
+    self->steps.contents[
+      self->pattern_map.contents[self->wildcard_root_pattern_count].step_index
+    ].symbol == WILDCARD_SYMBOL
+  ) self->wildcard_root_pattern_count++;
+
+  ts_query__index_pattern_map(self);
+  return true;
+}
+
+// Delete a query that was created by `ts_query__combine`, without deleting the
+// regexes that it shares with the original queries.
+static void ts_query__delete_combined(TSQuery *self) {
+  if (self) {
+    array_clear(&self->text_predicates);
+    ts_query_delete(self);
+  }
 }
 
 /***************
@@ -2968,6 +4364,11 @@ void ts_query_disable_pattern(
  ***************/
 
 TSQueryCursor *ts_query_cursor_new(void) {
+  return ts_query_cursor_new_with_allocator((TSAllocator) {NULL, NULL, NULL, NULL});
+}
+
+TSQueryCursor *ts_query_cursor_new_with_allocator(TSAllocator allocator) {
+  const TSAllocator *previous_allocator = ts_allocator_enter(&allocator);
   TSQueryCursor *self = ts_malloc(sizeof(TSQueryCursor));
   *self = (TSQueryCursor) {
     .did_exceed_match_limit = false,
@@ -2980,19 +4381,35 @@ TSQueryCursor *ts_query_cursor_new(void) {
     .end_byte = UINT32_MAX,
     .start_point = {0, 0},
     .end_point = POINT_MAX,
+    .min_match_start_byte = 0,
+    .max_match_start_byte = UINT32_MAX,
     .max_start_depth = UINT32_MAX,
+    .allocator = allocator,
+    .text_input = {NULL, NULL, TSInputEncodingUTF8},
+    .text_buffer = array_new(),
+    .combined_query = NULL,
+    .query_pattern_offsets = array_new(),
+    .symbol_summaries = {NULL, 0, 0, array_new()},
   };
   array_reserve(&self->states, 8);
   array_reserve(&self->finished_states, 8);
+  ts_allocator_leave(previous_allocator);
   return self;
 }
 
 void ts_query_cursor_delete(TSQueryCursor *self) {
+  TSAllocator allocator = self->allocator;
+  const TSAllocator *previous_allocator = ts_allocator_enter(&allocator);
   array_delete(&self->states);
   array_delete(&self->finished_states);
+  array_delete(&self->text_buffer);
+  array_delete(&self->query_pattern_offsets);
+  ts_query__delete_combined(self->combined_query);
+  symbol_summary_table_delete(&self->symbol_summaries);
   ts_tree_cursor_delete(&self->cursor);
   capture_list_pool_delete(&self->capture_list_pool);
   ts_free(self);
+  ts_allocator_leave(previous_allocator);
 }
 
 bool ts_query_cursor_did_exceed_match_limit(const TSQueryCursor *self) {
@@ -3007,6 +4424,14 @@ void ts_query_cursor_set_match_limit(TSQueryCursor *self, uint32_t limit) {
   self->capture_list_pool.max_capture_list_count = limit;
 }
 
+size_t ts_query_cursor_capture_memory_limit(const TSQueryCursor *self) {
+  return self->capture_list_pool.max_capture_memory;
+}
+
+void ts_query_cursor_set_capture_memory_limit(TSQueryCursor *self, size_t bytes) {
+  self->capture_list_pool.max_capture_memory = bytes;
+}
+
 void ts_query_cursor_exec(
   TSQueryCursor *self,
   const TSQuery *query,
@@ -3014,8 +4439,11 @@ void ts_query_cursor_exec(
 ) {
   array_clear(&self->states);
   array_clear(&self->finished_states);
+  const TSAllocator *previous_allocator = ts_allocator_enter(&self->allocator);
   ts_tree_cursor_reset(&self->cursor, node);
+  ts_allocator_leave(previous_allocator);
   capture_list_pool_reset(&self->capture_list_pool);
+  symbol_summary_table_clear(&self->symbol_summaries);
   self->on_visible_node = true;
   self->next_state_id = 0;
   self->depth = 0;
@@ -3025,6 +4453,54 @@ void ts_query_cursor_exec(
   self->did_exceed_match_limit = false;
 }
 
+bool ts_query_cursor_exec_queries(
+  TSQueryCursor *self,
+  const TSQuery *const *queries,
+  uint32_t query_count,
+  TSNode node
+) {
+  const TSAllocator *previous_allocator = ts_allocator_enter(&self->allocator);
+  if (!self->combined_query) {
+    self->combined_query = ts_malloc(sizeof(TSQuery));
+    *self->combined_query = (TSQuery) {
+      .steps = array_new(),
+      .pattern_map = array_new(),
+      .pattern_map_offsets = array_new(),
+      .pattern_start_symbols = array_new(),
+      .captures = symbol_table_new(),
+      .capture_quantifiers = array_new(),
+      .predicate_values = symbol_table_new(),
+      .predicate_steps = array_new(),
+      .text_predicates = array_new(),
+      .patterns = array_new(),
+      .step_offsets = array_new(),
+      .string_buffer = array_new(),
+      .negated_fields = array_new(),
+      .repeat_symbols_with_rootless_patterns = array_new(),
+      .wildcard_root_pattern_count = 0,
+      .language = NULL,
+    };
+  }
+  array_reserve(&self->query_pattern_offsets, query_count);
+  bool result = ts_query__combine(
+    self->combined_query,
+    queries,
+    query_count,
+    self->query_pattern_offsets.contents
+  );
+  ts_allocator_leave(previous_allocator);
+  if (!result) return false;
+
+  self->query_pattern_offsets.size = query_count;
+
+  ts_query_cursor_exec(self, self->combined_query, node);
+  return true;
+}
+
+void ts_query_cursor_set_text_input(TSQueryCursor *self, TSInput input) {
+  self->text_input = input;
+}
+
 void ts_query_cursor_set_byte_range(
   TSQueryCursor *self,
   uint32_t start_byte,
@@ -3037,6 +4513,18 @@ void ts_query_cursor_set_byte_range(
   self->end_byte = end_byte;
 }
 
+void ts_query_cursor_set_match_start_byte_range(
+  TSQueryCursor *self,
+  uint32_t start_byte,
+  uint32_t end_byte
+) {
+  if (end_byte == 0) {
+    end_byte = UINT32_MAX;
+  }
+  self->min_match_start_byte = start_byte;
+  self->max_match_start_byte = end_byte;
+}
+
 void ts_query_cursor_set_point_range(
   TSQueryCursor *self,
   TSPoint start_point,
@@ -3091,9 +4579,18 @@ static bool ts_query_cursor__first_in_progress_capture(
       (node_start_byte == *byte_offset && state->pattern_index < *pattern_index)
     ) {
       QueryStep *step = &self->query->steps.contents[state->step_index];
+      bool is_guaranteed = step->root_pattern_guaranteed;
+
+      // If the cursor evaluates this pattern's text predicates, then its
+      // captures can't be returned until the pattern has finished.
+      if (
+        self->text_input.read &&
+        self->query->patterns.contents[state->pattern_index].text_predicates.length > 0
+      ) is_guaranteed = false;
+
       if (root_pattern_guaranteed) {
-        *root_pattern_guaranteed = step->root_pattern_guaranteed;
-      } else if (step->root_pattern_guaranteed) {
+        *root_pattern_guaranteed = is_guaranteed;
+      } else if (is_guaranteed) {
         continue;
       }
 
@@ -3187,7 +4684,8 @@ void ts_query_cursor__compare_captures(
 
 static void ts_query_cursor__add_state(
   TSQueryCursor *self,
-  const PatternEntry *pattern
+  const PatternEntry *pattern,
+  bool is_outside_match_range
 ) {
   QueryStep *step = &self->query->steps.contents[pattern->step_index];
   uint32_t start_depth = self->depth - step->depth;
@@ -3243,57 +4741,59 @@ static void ts_query_cursor__add_state(
     .has_in_progress_alternatives = false,
     .needs_parent = step->depth == 1,
     .dead = false,
+    .is_outside_match_range = is_outside_match_range,
   }));
 }
 
+// Terminate whichever in-progress state has captured the earliest node in the
+// document, and return its capture list to the pool, in order to make room for
+// the captures of other states.
+static bool ts_query_cursor__abandon_earliest_state(
+  TSQueryCursor *self,
+  unsigned state_index_to_preserve
+) {
+  self->did_exceed_match_limit = true;
+  uint32_t state_index, byte_offset, pattern_index;
+  if (
+    ts_query_cursor__first_in_progress_capture(
+      self,
+      &state_index,
+      &byte_offset,
+      &pattern_index,
+      NULL
+    ) &&
+    state_index != state_index_to_preserve
+  ) {
+    LOG(
+      "  abandon state. index:%u, pattern:%u, offset:%u.\n",
+      state_index, pattern_index, byte_offset
+    );
+    QueryState *other_state = &self->states.contents[state_index];
+    capture_list_pool_release(&self->capture_list_pool, other_state->capture_list_id);
+    other_state->capture_list_id = NONE;
+    other_state->dead = true;
+    return true;
+  } else {
+    LOG("  ran out of capture lists");
+    return false;
+  }
+}
+
 // Acquire a capture list for this state. If there are no capture lists left in the
-// pool, this will steal the capture list from another existing state, and mark that
-// other state as 'dead'.
-static CaptureList *ts_query_cursor__prepare_to_capture(
+// pool, this will terminate another existing state in order to reuse its capture list.
+static bool ts_query_cursor__prepare_to_capture(
   TSQueryCursor *self,
   QueryState *state,
   unsigned state_index_to_preserve
 ) {
-  if (state->capture_list_id == NONE) {
+  while (state->capture_list_id == NONE) {
     state->capture_list_id = capture_list_pool_acquire(&self->capture_list_pool);
-
-    // If there are no capture lists left in the pool, then terminate whichever
-    // state has captured the earliest node in the document, and steal its
-    // capture list.
-    if (state->capture_list_id == NONE) {
-      self->did_exceed_match_limit = true;
-      uint32_t state_index, byte_offset, pattern_index;
-      if (
-        ts_query_cursor__first_in_progress_capture(
-          self,
-          &state_index,
-          &byte_offset,
-          &pattern_index,
-          NULL
-        ) &&
-        state_index != state_index_to_preserve
-      ) {
-        LOG(
-          "  abandon state. index:%u, pattern:%u, offset:%u.\n",
-          state_index, pattern_index, byte_offset
-        );
-        QueryState *other_state = &self->states.contents[state_index];
-        state->capture_list_id = other_state->capture_list_id;
-        other_state->capture_list_id = NONE;
-        other_state->dead = true;
-        CaptureList *list = capture_list_pool_get_mut(
-          &self->capture_list_pool,
-          state->capture_list_id
-        );
-        array_clear(list);
-        return list;
-      } else {
-        LOG("  ran out of capture lists");
-        return NULL;
-      }
-    }
+    if (
+      state->capture_list_id == NONE &&
+      !ts_query_cursor__abandon_earliest_state(self, state_index_to_preserve)
+    ) return false;
   }
-  return capture_list_pool_get_mut(&self->capture_list_pool, state->capture_list_id);
+  return true;
 }
 
 static void ts_query_cursor__capture(
@@ -3303,8 +4803,8 @@ static void ts_query_cursor__capture(
   TSNode node
 ) {
   if (state->dead) return;
-  CaptureList *capture_list = ts_query_cursor__prepare_to_capture(self, state, UINT32_MAX);
-  if (!capture_list) {
+  unsigned state_index = (unsigned)(state - self->states.contents);
+  if (!ts_query_cursor__prepare_to_capture(self, state, state_index)) {
     state->dead = true;
     return;
   }
@@ -3312,13 +4812,25 @@ static void ts_query_cursor__capture(
   for (unsigned j = 0; j < MAX_STEP_CAPTURE_COUNT; j++) {
     uint16_t capture_id = step->capture_ids[j];
     if (step->capture_ids[j] == NONE) break;
-    array_push(capture_list, ((TSQueryCapture) { node, capture_id }));
+
+    // If there is no room left in the pool's arena for this capture, then
+    // terminate other states to make room for it.
+    while (!capture_list_pool_push(
+      &self->capture_list_pool,
+      state->capture_list_id,
+      (TSQueryCapture) { node, capture_id }
+    )) {
+      if (!ts_query_cursor__abandon_earliest_state(self, state_index)) {
+        state->dead = true;
+        return;
+      }
+    }
     LOG(
       "  capture node. type:%s, pattern:%u, capture_id:%u, capture_count:%u\n",
       ts_node_type(node),
       state->pattern_index,
       capture_id,
-      capture_list->size
+      capture_list_pool_get(&self->capture_list_pool, state->capture_list_id)->size
     );
   }
 }
@@ -3337,13 +4849,17 @@ static QueryState *ts_query_cursor__copy_state(
 
   // If the state has captures, copy its capture list.
   if (state->capture_list_id != NONE) {
-    CaptureList *new_captures = ts_query_cursor__prepare_to_capture(self, &copy, state_index);
-    if (!new_captures) return NULL;
-    const CaptureList *old_captures = capture_list_pool_get(
+    if (!ts_query_cursor__prepare_to_capture(self, &copy, state_index)) return NULL;
+    while (!capture_list_pool_copy(
       &self->capture_list_pool,
+      copy.capture_list_id,
       state->capture_list_id
-    );
-    array_push_all(new_captures, old_captures);
+    )) {
+      if (!ts_query_cursor__abandon_earliest_state(self, state_index)) {
+        capture_list_pool_release(&self->capture_list_pool, copy.capture_list_id);
+        return NULL;
+      }
+    }
   }
 
   array_insert(&self->states, state_index + 1, copy);
@@ -3351,12 +4867,91 @@ static QueryState *ts_query_cursor__copy_state(
   return &self->states.contents[state_index + 1];
 }
 
+// Matches are only returned if they start within the cursor's range of match
+// start positions. But the longest-match rule can make states that start
+// outside of that range prevent the states within it from being returned, as
+// well as the other way around. This can only happen between states for the
+// same pattern that start at the same depth, and that can outlive the node
+// where they started, because their patterns can match several siblings.
+// So states for those patterns are also started outside of the range: at the
+// visited nodes before it, and at the nodes after it while there are states
+// from within the range that they could interact with.
+static inline bool ts_query_cursor__can_start_state(
+  const TSQueryCursor *self,
+  const PatternEntry *pattern,
+  bool node_precedes_match_range,
+  bool node_follows_match_range
+) {
+  if (!node_precedes_match_range && !node_follows_match_range) return true;
+  if (!pattern->spans_siblings) return false;
+  if (node_precedes_match_range) return true;
+  const QueryStep *step = &self->query->steps.contents[pattern->step_index];
+  uint32_t start_depth = self->depth - step->depth;
+  for (unsigned i = 0; i < self->states.size; i++) {
+    const QueryState *state = &self->states.contents[i];
+    if (
+      state->start_depth == start_depth &&
+      state->pattern_index == pattern->pattern_index &&
+      !state->is_outside_match_range
+    ) return true;
+  }
+  return false;
+}
+
 static inline bool ts_query_cursor__should_descend(
   TSQueryCursor *self,
   bool node_intersects_range
 ) {
+  TSNode node = ts_tree_cursor_current_node(&self->cursor);
+  bool can_start_matches = true;
+
+  // No new matches can start within this node if it starts after the range of
+  // allowed match start positions. If it ends before that range, then only
+  // states that can't be returned as matches would start within it. Those are
+  // only needed if the node is hidden, and if they are for patterns that can
+  // continue into the node's later siblings.
+  bool node_precedes_match_range = false;
+  if (self->min_match_start_byte > 0 || self->max_match_start_byte < UINT32_MAX) {
+    if (ts_node_start_byte(node) >= self->max_match_start_byte) {
+      can_start_matches = false;
+    } else if (ts_node_end_byte(node) < self->min_match_start_byte) {
+      node_precedes_match_range = true;
+      can_start_matches = !self->on_visible_node;
+    }
+  }
+
+  // New matches can only start within this node if some of its descendants
+  // might have the symbol of one of the patterns' root nodes. Summarizing a
+  // node's descendants means visiting all of them, so this is only checked
+  // for large nodes that the cursor would otherwise visit in full.
+  Subtree subtree = ts_tree_cursor_current_subtree(&self->cursor);
+  if (
+    can_start_matches &&
+    !node_precedes_match_range &&
+    self->query->wildcard_root_pattern_count == 0 &&
+    self->max_start_depth == UINT32_MAX &&
+    ts_subtree_node_count(subtree) >= MIN_SUMMARIZED_NODE_COUNT &&
+    ts_node_start_byte(node) >= self->start_byte &&
+    ts_node_end_byte(node) <= self->end_byte &&
+    point_lte(self->start_point, ts_node_start_point(node)) &&
+    point_lte(ts_node_end_point(node), self->end_point) &&
+    ts_node_start_byte(node) >= self->min_match_start_byte &&
+    ts_node_end_byte(node) <= self->max_match_start_byte
+  ) {
+    uint64_t symbols = symbol_summary_table_summarize(
+      &self->symbol_summaries,
+      subtree,
+      self->query->language
+    );
+    can_start_matches = symbols & self->query->pattern_start_symbol_summary;
+  }
 
-  if (node_intersects_range && self->depth < self->max_start_depth) {
+  if (
+    node_intersects_range &&
+    !node_precedes_match_range &&
+    self->depth < self->max_start_depth &&
+    can_start_matches
+  ) {
     return true;
   }
 
@@ -3373,7 +4968,7 @@ static inline bool ts_query_cursor__should_descend(
     }
   }
 
-  if (self->depth >= self->max_start_depth) {
+  if (self->depth >= self->max_start_depth || !can_start_matches) {
     return false;
   }
 
@@ -3386,8 +4981,10 @@ static inline bool ts_query_cursor__should_descend(
     // Avoid descending into repetition nodes unless we have already
     // determined that this query can match rootless patterns inside
     // of this type of repetition node.
-    Subtree subtree = ts_tree_cursor_current_subtree(&self->cursor);
-    if (ts_subtree_is_repetition(subtree)) {
+    if (
+      ts_subtree_is_repetition(subtree) &&
+      !(node_precedes_match_range && self->query->has_unanalyzed_sibling_patterns)
+    ) {
       bool exists;
       uint32_t index;
       array_search_sorted_by(
@@ -3405,6 +5002,144 @@ static inline bool ts_query_cursor__should_descend(
   return false;
 }
 
+// Read the next chunk of text from the cursor's text input, stopping at the
+// given end byte, and advance the position and point past it.
+static const char *ts_query_cursor__read_text_chunk(
+  TSQueryCursor *self,
+  uint32_t *position,
+  TSPoint *point,
+  uint32_t end_byte,
+  uint32_t *length
+) {
+  *length = 0;
+  const char *chunk = self->text_input.read(self->text_input.payload, *position, *point, length);
+  if (*length > end_byte - *position) *length = end_byte - *position;
+  *position += *length;
+
+  // The point is only needed if there are more chunks to read.
+  if (*position < end_byte) {
+    for (uint32_t i = 0; i < *length; i++) {
+      if (chunk[i] == '\n') {
+        point->row++;
+        point->column = 0;
+      } else {
+        point->column++;
+      }
+    }
+  }
+  return chunk;
+}
+
+// Append the text of the given node to the cursor's text buffer.
+static void ts_query_cursor__read_node_text(TSQueryCursor *self, TSNode node) {
+  uint32_t position = ts_node_start_byte(node);
+  uint32_t end_byte = ts_node_end_byte(node);
+  TSPoint point = ts_node_start_point(node);
+  while (position < end_byte) {
+    uint32_t length;
+    const char *chunk = ts_query_cursor__read_text_chunk(self, &position, &point, end_byte, &length);
+    if (length == 0) break;
+    array_extend(&self->text_buffer, length, chunk);
+  }
+}
+
+// Search the text of the given node for a regex, passing the chunks of text
+// directly from the cursor's text input to the regex.
+static RegexResult ts_query_cursor__match_node_text(
+  TSQueryCursor *self,
+  const Regex *regex,
+  TSNode node
+) {
+  uint32_t state = ts_regex_start(regex);
+  uint32_t position = ts_node_start_byte(node);
+  uint32_t end_byte = ts_node_end_byte(node);
+  TSPoint point = ts_node_start_point(node);
+  while (position < end_byte) {
+    uint32_t length;
+    const char *chunk = ts_query_cursor__read_text_chunk(self, &position, &point, end_byte, &length);
+    if (length == 0 || !ts_regex_advance(regex, &state, chunk, length)) break;
+  }
+  return ts_regex_finish(regex, state);
+}
+
+static TSNode ts_query_cursor__first_node_for_capture(
+  const CaptureList *captures,
+  uint16_t capture_id
+) {
+  for (uint32_t i = 0; i < captures->size; i++) {
+    if (captures->contents[i].index == capture_id) return captures->contents[i].node;
+  }
+  return (TSNode) {{0, 0, 0, 0}, NULL, NULL};
+}
+
+// Check whether a state's captures satisfy its pattern's text predicates. As
+// in the language bindings, each predicate uses the first node of each of
+// its captures, and is satisfied if any of them have no nodes.
+static bool ts_query_cursor__satisfies_text_predicates(
+  TSQueryCursor *self,
+  const QueryState *state
+) {
+  if (!self->text_input.read) return true;
+  Slice slice = self->query->patterns.contents[state->pattern_index].text_predicates;
+  if (slice.length == 0) return true;
+
+  const CaptureList *captures = capture_list_pool_get(
+    &self->capture_list_pool,
+    state->capture_list_id
+  );
+  for (uint32_t i = slice.offset; i < slice.offset + slice.length; i++) {
+    const TextPredicate *predicate = &self->query->text_predicates.contents[i];
+    TSNode node = ts_query_cursor__first_node_for_capture(captures, predicate->capture_id);
+    if (ts_node_is_null(node)) continue;
+
+    // If a regex can't decide whether the text matches, then leave the
+    // predicate for the caller to evaluate.
+    if (predicate->type == TextPredicateTypeMatchString) {
+      RegexResult result = ts_query_cursor__match_node_text(self, predicate->regex, node);
+      if (result == RegexResultUnknown) continue;
+      if ((result == RegexResultMatch) != predicate->is_positive) {
+        LOG("  fail text predicate. pattern:%u\n", state->pattern_index);
+        return false;
+      }
+      continue;
+    }
+
+    uint32_t length = ts_node_end_byte(node) - ts_node_start_byte(node);
+
+    const char *value = NULL;
+    uint32_t value_length;
+    TSNode value_node = {{0, 0, 0, 0}, NULL, NULL};
+    if (predicate->type == TextPredicateTypeEqString) {
+      value = symbol_table_name_for_id(&self->query->predicate_values, predicate->value_id, &value_length);
+    } else {
+      value_node = ts_query_cursor__first_node_for_capture(captures, predicate->value_id);
+      if (ts_node_is_null(value_node)) continue;
+      value_length = ts_node_end_byte(value_node) - ts_node_start_byte(value_node);
+    }
+
+    // Only read the text if the lengths match.
+    bool is_equal = length == value_length;
+    if (is_equal && length > 0) {
+      array_clear(&self->text_buffer);
+      ts_query_cursor__read_node_text(self, node);
+      if (!ts_node_is_null(value_node)) ts_query_cursor__read_node_text(self, value_node);
+      if (self->text_buffer.size < length + (ts_node_is_null(value_node) ? 0 : value_length)) {
+        is_equal = false;
+      } else if (ts_node_is_null(value_node)) {
+        is_equal = !memcmp(self->text_buffer.contents, value, length);
+      } else {
+        is_equal = !memcmp(self->text_buffer.contents, self->text_buffer.contents + length, length);
+      }
+    }
+
+    if (is_equal != predicate->is_positive) {
+      LOG("  fail text predicate. pattern:%u\n", state->pattern_index);
+      return false;
+    }
+  }
+  return true;
+}
+
 // Walk the tree, processing patterns until at least one pattern finishes,
 // If one or more patterns finish, return `true` and store their states in the
 // `finished_states` array. Multiple patterns can finish on the same node. If
@@ -3454,8 +5189,14 @@ static inline bool ts_query_cursor__advance(
           self->ascending = false;
           break;
         default:
+          // The depth of a hidden node is already the depth of its visible
+          // parent, so it only changes when leaving a visible node.
           if (ts_tree_cursor_goto_parent(&self->cursor)) {
-            self->depth--;
+            if (self->on_visible_node) {
+              self->depth--;
+            } else {
+              self->on_visible_node = true;
+            }
           } else {
             LOG("halt at root\n");
             self->halted = true;
@@ -3473,9 +5214,19 @@ static inline bool ts_query_cursor__advance(
           // in order to search for longer matches, mark it as finished.
           if (step->depth == PATTERN_DONE_MARKER) {
             if (state->start_depth > self->depth || self->halted) {
-              LOG("  finish pattern %u\n", state->pattern_index);
-              array_push(&self->finished_states, *state);
-              did_match = true;
+              if (
+                !state->is_outside_match_range &&
+                ts_query_cursor__satisfies_text_predicates(self, state)
+              ) {
+                LOG("  finish pattern %u\n", state->pattern_index);
+                array_push(&self->finished_states, *state);
+                did_match = true;
+              } else {
+                capture_list_pool_release(
+                  &self->capture_list_pool,
+                  state->capture_list_id
+                );
+              }
               deleted_count++;
               continue;
             }
@@ -3528,6 +5279,8 @@ static inline bool ts_query_cursor__advance(
       );
       bool parent_intersects_range = !parent_precedes_range && !parent_follows_range;
       bool node_intersects_range = !node_precedes_range && !node_follows_range;
+      bool node_precedes_match_range = ts_node_start_byte(node) < self->min_match_start_byte;
+      bool node_follows_match_range = ts_node_start_byte(node) >= self->max_match_start_byte;
 
       if (self->on_visible_node) {
         TSSymbol symbol = ts_node_symbol(node);
@@ -3572,6 +5325,12 @@ static inline bool ts_query_cursor__advance(
             QueryStep *step = &self->query->steps.contents[pattern->step_index];
             uint32_t start_depth = self->depth - step->depth;
             if (
+              ts_query_cursor__can_start_state(
+                self,
+                pattern,
+                node_precedes_match_range,
+                node_follows_match_range
+              ) &&
               (pattern->is_rooted ?
                 node_intersects_range :
                 (parent_intersects_range && !parent_is_error)) &&
@@ -3579,37 +5338,46 @@ static inline bool ts_query_cursor__advance(
               (!step->supertype_symbol || supertype_count > 0) &&
               (start_depth <= self->max_start_depth)
             ) {
-              ts_query_cursor__add_state(self, pattern);
+              ts_query_cursor__add_state(
+                self,
+                pattern,
+                node_precedes_match_range || node_follows_match_range
+              );
             }
           }
         }
 
         // Add new states for any patterns whose root node matches this node.
-        unsigned i;
-        if (ts_query__pattern_map_search(self->query, symbol, &i)) {
-          PatternEntry *pattern = &self->query->pattern_map.contents[i];
+        uint32_t start_index, end_index;
+        if (ts_query__pattern_map_range(self->query, symbol, &start_index, &end_index)) {
+          for (uint32_t i = start_index; i < end_index; i++) {
+            PatternEntry *pattern = &self->query->pattern_map.contents[i];
+            QueryStep *step = &self->query->steps.contents[pattern->step_index];
+            if (step->symbol != symbol) continue;
 
-          QueryStep *step = &self->query->steps.contents[pattern->step_index];
-          uint32_t start_depth = self->depth - step->depth;
-          do {
             // If this node matches the first step of the pattern, then add a new
             // state at the start of this pattern.
+            uint32_t start_depth = self->depth - step->depth;
             if (
+              ts_query_cursor__can_start_state(
+                self,
+                pattern,
+                node_precedes_match_range,
+                node_follows_match_range
+              ) &&
               (pattern->is_rooted ?
                 node_intersects_range :
                 (parent_intersects_range && !parent_is_error)) &&
               (!step->field || field_id == step->field) &&
               (start_depth <= self->max_start_depth)
             ) {
-              ts_query_cursor__add_state(self, pattern);
+              ts_query_cursor__add_state(
+                self,
+                pattern,
+                node_precedes_match_range || node_follows_match_range
+              );
             }
-
-            // Advance to the next pattern whose root node matches this node.
-            i++;
-            if (i == self->query->pattern_map.size) break;
-            pattern = &self->query->pattern_map.contents[i];
-            step = &self->query->steps.contents[pattern->step_index];
-          } while (step->symbol == symbol);
+          }
         }
 
         // Update all of the in-progress states with current node.
@@ -3888,6 +5656,16 @@ static inline bool ts_query_cursor__advance(
             if (next_step->depth == PATTERN_DONE_MARKER) {
               if (state->has_in_progress_alternatives) {
                 LOG("  defer finishing pattern %u\n", state->pattern_index);
+              } else if (
+                state->is_outside_match_range ||
+                !ts_query_cursor__satisfies_text_predicates(self, state)
+              ) {
+                capture_list_pool_release(
+                  &self->capture_list_pool,
+                  state->capture_list_id
+                );
+                array_erase(&self->states, i);
+                i--;
               } else {
                 LOG("  finish pattern %u\n", state->pattern_index);
                 array_push(&self->finished_states, *state);
@@ -3919,20 +5697,52 @@ static inline bool ts_query_cursor__advance(
   }
 }
 
+// When the cursor is running several queries, find the query that the given
+// pattern belongs to, and convert the pattern index to an index within that
+// query.
+static uint32_t ts_query_cursor__query_for_pattern(
+  const TSQueryCursor *self,
+  uint16_t *pattern_index
+) {
+  if (self->query != self->combined_query) return 0;
+  uint32_t query_index = 0;
+  uint32_t size = self->query_pattern_offsets.size;
+  while (size > 1) {
+    uint32_t half_size = size / 2;
+    uint32_t mid_index = query_index + half_size;
+    if (self->query_pattern_offsets.contents[mid_index] <= *pattern_index) {
+      query_index = mid_index;
+    }
+    size -= half_size;
+  }
+  *pattern_index -= self->query_pattern_offsets.contents[query_index];
+  return query_index;
+}
+
 bool ts_query_cursor_next_match(
   TSQueryCursor *self,
   TSQueryMatch *match
 ) {
-  if (self->finished_states.size == 0) {
-    if (!ts_query_cursor__advance(self, false)) {
-      return false;
-    }
+  uint32_t query_index;
+  return ts_query_cursor_next_query_match(self, match, &query_index);
+}
+
+bool ts_query_cursor_next_query_match(
+  TSQueryCursor *self,
+  TSQueryMatch *match,
+  uint32_t *query_index
+) {
+  const TSAllocator *previous_allocator = ts_allocator_enter(&self->allocator);
+  if (self->finished_states.size == 0 && !ts_query_cursor__advance(self, false)) {
+    ts_allocator_leave(previous_allocator);
+    return false;
   }
 
   QueryState *state = &self->finished_states.contents[0];
   if (state->id == UINT32_MAX) state->id = self->next_state_id++;
   match->id = state->id;
   match->pattern_index = state->pattern_index;
+  *query_index = ts_query_cursor__query_for_pattern(self, &match->pattern_index);
   const CaptureList *captures = capture_list_pool_get(
     &self->capture_list_pool,
     state->capture_list_id
@@ -3941,10 +5751,11 @@ bool ts_query_cursor_next_match(
   match->capture_count = captures->size;
   capture_list_pool_release(&self->capture_list_pool, state->capture_list_id);
   array_erase(&self->finished_states, 0);
+  ts_allocator_leave(previous_allocator);
   return true;
 }
 
-void ts_query_cursor_remove_match(
+static void ts_query_cursor__remove_match(
   TSQueryCursor *self,
   uint32_t match_id
 ) {
@@ -3975,10 +5786,29 @@ void ts_query_cursor_remove_match(
   }
 }
 
+void ts_query_cursor_remove_match(
+  TSQueryCursor *self,
+  uint32_t match_id
+) {
+  const TSAllocator *previous_allocator = ts_allocator_enter(&self->allocator);
+  ts_query_cursor__remove_match(self, match_id);
+  ts_allocator_leave(previous_allocator);
+}
+
 bool ts_query_cursor_next_capture(
   TSQueryCursor *self,
   TSQueryMatch *match,
   uint32_t *capture_index
+) {
+  uint32_t query_index;
+  return ts_query_cursor_next_query_capture(self, match, capture_index, &query_index);
+}
+
+static bool ts_query_cursor__next_query_capture(
+  TSQueryCursor *self,
+  TSQueryMatch *match,
+  uint32_t *capture_index,
+  uint32_t *query_index
 ) {
   // The goal here is to return captures in order, even though they may not
   // be discovered in order, because patterns can overlap. Search for matches
@@ -4053,10 +5883,19 @@ bool ts_query_cursor_next_capture(
       state = NULL;
     }
 
+    // States from outside of the cursor's range of match start positions
+    // still take part in ordering the captures, but their own captures are
+    // skipped.
+    if (state && state->is_outside_match_range) {
+      state->consumed_capture_count++;
+      continue;
+    }
+
     if (state) {
       if (state->id == UINT32_MAX) state->id = self->next_state_id++;
       match->id = state->id;
       match->pattern_index = state->pattern_index;
+      *query_index = ts_query_cursor__query_for_pattern(self, &match->pattern_index);
       const CaptureList *captures = capture_list_pool_get(
         &self->capture_list_pool,
         state->capture_list_id
@@ -4068,13 +5907,17 @@ bool ts_query_cursor_next_capture(
       return true;
     }
 
-    if (capture_list_pool_is_empty(&self->capture_list_pool)) {
+    if (
+      first_unfinished_state_index != UINT32_MAX &&
+      capture_list_pool_is_empty(&self->capture_list_pool)
+    ) {
       LOG(
         "  abandon state. index:%u, pattern:%u, offset:%u.\n",
         first_unfinished_state_index,
         first_unfinished_pattern_index,
         first_unfinished_capture_byte
       );
+      self->did_exceed_match_limit = true;
       capture_list_pool_release(
         &self->capture_list_pool,
         self->states.contents[first_unfinished_state_index].capture_list_id
@@ -4084,13 +5927,23 @@ bool ts_query_cursor_next_capture(
 
     // If there are no finished matches that are ready to be returned, then
     // continue finding more matches.
-    if (
-      !ts_query_cursor__advance(self, true) &&
-      self->finished_states.size == 0
-    ) return false;
+    bool did_advance = ts_query_cursor__advance(self, true);
+    if (!did_advance && self->finished_states.size == 0) return false;
   }
 }
 
+bool ts_query_cursor_next_query_capture(
+  TSQueryCursor *self,
+  TSQueryMatch *match,
+  uint32_t *capture_index,
+  uint32_t *query_index
+) {
+  const TSAllocator *previous_allocator = ts_allocator_enter(&self->allocator);
+  bool result = ts_query_cursor__next_query_capture(self, match, capture_index, query_index);
+  ts_allocator_leave(previous_allocator);
+  return result;
+}
+
 void ts_query_cursor_set_max_start_depth(
   TSQueryCursor *self,
   uint32_t max_start_depth
@@ -0,0 +1,24 @@
+#ifndef TREE_SITTER_QUERY_H_
+#define TREE_SITTER_QUERY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "tree_sitter/api.h"
+
+// Get the depth, relative to the top level of its pattern, at which a capture
+// occurs. If the capture occurs at several depths within the pattern, then
+// the greatest one is returned.
+uint16_t ts_query_capture_depth(
+  const TSQuery *self,
+  uint32_t pattern_index,
+  uint32_t capture_index
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // TREE_SITTER_QUERY_H_
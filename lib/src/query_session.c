@@ -0,0 +1,551 @@
+#include <stdlib.h>
+#include "tree_sitter/api.h"
+#include "./alloc.h"
+#include "./array.h"
+#include "./get_changed_ranges.h"
+#include "./point.h"
+#include "./query.h"
+
+// A list of matches whose captures are stored contiguously, in the same order
+// as the matches. Each match's captures are followed by one more entry, which
+// is not part of the match, and which records the match's extent: the range
+// of text that the match depends on. While a list is being built, its matches'
+// `captures` pointers are left null, because the capture array may still be
+// reallocated. They are filled in by `session_match_list_finish`.
+typedef struct {
+  Array(TSQuerySessionMatch) matches;
+  Array(TSQuerySessionCapture) captures;
+} SessionMatchList;
+
+typedef struct {
+  uint32_t start_byte;
+  uint32_t end_byte;
+} ByteRange;
+
+typedef Array(ByteRange) ByteRangeArray;
+
+/*
+ * TSQuerySession - A cache of the matches of a query in a tree, which is kept
+ * up to date as the tree is edited and reparsed. Fields:
+ * - `tree` - A copy of the tree that the matches were found in. It is edited
+ *    along with the caller's tree, so that it can be compared to the next tree.
+ * - `edited_ranges` - The ranges of text that have been edited since the last
+ *    update, in terms of the current document. Text predicates may give
+ *    different results in these ranges, even if their syntax is unchanged.
+ */
+struct TSQuerySession {
+  const TSQuery *query;
+  TSQueryCursor *cursor;
+  TSTree *tree;
+  TSInput text_input;
+  ByteRangeArray edited_ranges;
+  SessionMatchList matches;
+  SessionMatchList added_matches;
+  SessionMatchList removed_matches;
+  uint32_t next_match_id;
+};
+
+/******************
+ * SessionMatchList
+ ******************/
+
+static inline void session_match_list_clear(SessionMatchList *self) {
+  array_clear(&self->matches);
+  array_clear(&self->captures);
+}
+
+static inline void session_match_list_delete(SessionMatchList *self) {
+  array_delete(&self->matches);
+  array_delete(&self->captures);
+}
+
+static inline void session_match_list_push_match(
+  SessionMatchList *self,
+  const TSQuerySessionMatch *match,
+  uint32_t id
+) {
+  array_push(&self->matches, ((TSQuerySessionMatch) {
+    .id = id,
+    .pattern_index = match->pattern_index,
+    .capture_count = match->capture_count,
+    .captures = NULL,
+  }));
+  array_extend(&self->captures, match->capture_count + 1, match->captures);
+}
+
+static void session_match_list_finish(SessionMatchList *self) {
+  uint32_t offset = 0;
+  for (uint32_t i = 0; i < self->matches.size; i++) {
+    TSQuerySessionMatch *match = &self->matches.contents[i];
+    match->captures = &self->captures.contents[offset];
+    offset += match->capture_count + 1;
+  }
+}
+
+static inline const TSRange *session_match__extent(const TSQuerySessionMatch *self) {
+  return &self->captures[self->capture_count].range;
+}
+
+// Matches are ordered by the position of their first capture, and then by all
+// of their other properties except for their id, so that two matches compare
+// as equal if they have the same pattern and the same captures.
+static int session_match__compare(const void *left, const void *right) {
+  const TSQuerySessionMatch *a = left;
+  const TSQuerySessionMatch *b = right;
+  if (a->captures[0].range.start_byte < b->captures[0].range.start_byte) return -1;
+  if (a->captures[0].range.start_byte > b->captures[0].range.start_byte) return 1;
+  if (a->pattern_index < b->pattern_index) return -1;
+  if (a->pattern_index > b->pattern_index) return 1;
+  if (a->capture_count < b->capture_count) return -1;
+  if (a->capture_count > b->capture_count) return 1;
+  for (unsigned i = 0; i < a->capture_count; i++) {
+    const TSQuerySessionCapture *left_capture = &a->captures[i];
+    const TSQuerySessionCapture *right_capture = &b->captures[i];
+    if (left_capture->range.start_byte < right_capture->range.start_byte) return -1;
+    if (left_capture->range.start_byte > right_capture->range.start_byte) return 1;
+    if (left_capture->range.end_byte < right_capture->range.end_byte) return -1;
+    if (left_capture->range.end_byte > right_capture->range.end_byte) return 1;
+    if (left_capture->index < right_capture->index) return -1;
+    if (left_capture->index > right_capture->index) return 1;
+    if (left_capture->symbol < right_capture->symbol) return -1;
+    if (left_capture->symbol > right_capture->symbol) return 1;
+  }
+  return 0;
+}
+
+// Sort a finished list of matches and remove any duplicates from it.
+static void session_match_list_sort(SessionMatchList *self) {
+  if (self->matches.size == 0) return;
+  qsort(
+    self->matches.contents,
+    self->matches.size,
+    sizeof(TSQuerySessionMatch),
+    session_match__compare
+  );
+  uint32_t size = 1;
+  for (uint32_t i = 1; i < self->matches.size; i++) {
+    if (session_match__compare(
+      &self->matches.contents[size - 1],
+      &self->matches.contents[i]
+    ) != 0) {
+      self->matches.contents[size++] = self->matches.contents[i];
+    }
+  }
+  self->matches.size = size;
+}
+
+/****************
+ * ByteRangeArray
+ ****************/
+
+// Sort the given ranges by their start byte, and merge the ranges that
+// overlap or touch.
+static void byte_range_array_merge(ByteRangeArray *self) {
+  // There are usually only a few ranges, so an insertion sort is used.
+  for (uint32_t i = 1; i < self->size; i++) {
+    ByteRange range = self->contents[i];
+    uint32_t j = i;
+    while (j > 0 && self->contents[j - 1].start_byte > range.start_byte) {
+      self->contents[j] = self->contents[j - 1];
+      j--;
+    }
+    self->contents[j] = range;
+  }
+
+  uint32_t size = 0;
+  for (uint32_t i = 0; i < self->size; i++) {
+    ByteRange range = self->contents[i];
+    if (size > 0 && range.start_byte <= self->contents[size - 1].end_byte) {
+      ByteRange *previous = &self->contents[size - 1];
+      if (range.end_byte > previous->end_byte) previous->end_byte = range.end_byte;
+    } else {
+      self->contents[size++] = range;
+    }
+  }
+  self->size = size;
+}
+
+static bool byte_range_array_intersects(const ByteRangeArray *self, const TSRange *range) {
+  for (uint32_t i = 0; i < self->size; i++) {
+    const ByteRange *other = &self->contents[i];
+    if (range->start_byte <= other->end_byte && range->end_byte >= other->start_byte) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool byte_range_array_contains(const ByteRangeArray *self, const TSRange *range) {
+  for (uint32_t i = 0; i < self->size; i++) {
+    const ByteRange *other = &self->contents[i];
+    if (range->start_byte >= other->start_byte && range->end_byte <= other->end_byte) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*****************
+ * TSQuerySession
+ *****************/
+
+// Adjust a position to account for an edit, in the same way that
+// `ts_node_edit` adjusts the start of a node.
+static void ts_query_session__edit_position(
+  uint32_t *byte,
+  TSPoint *point,
+  const TSInputEdit *edit
+) {
+  if (*byte >= edit->old_end_byte) {
+    *byte = edit->new_end_byte + (*byte - edit->old_end_byte);
+    *point = point_add(edit->new_end_point, point_sub(*point, edit->old_end_point));
+  } else if (*byte > edit->start_byte) {
+    *byte = edit->new_end_byte;
+    *point = edit->new_end_point;
+  }
+}
+
+// Find the range of text that a match depends on. For a rooted pattern, this
+// is the range of the pattern's root node, which contains all of the other
+// nodes in the match. Other patterns match a sequence of sibling nodes, some
+// of which may not be captured, so the range of their parent is used.
+static TSRange ts_query_session__match_extent(
+  const TSQuerySession *self,
+  const TSQueryMatch *match
+) {
+  bool is_rooted = ts_query_is_pattern_rooted(self->query, match->pattern_index);
+  TSRange result = {
+    .start_point = {UINT32_MAX, UINT32_MAX},
+    .end_point = {0, 0},
+    .start_byte = UINT32_MAX,
+    .end_byte = 0,
+  };
+  for (uint16_t i = 0; i < match->capture_count; i++) {
+    TSNode node = match->captures[i].node;
+    uint16_t depth = ts_query_capture_depth(
+      self->query,
+      match->pattern_index,
+      match->captures[i].index
+    );
+    if (!is_rooted) depth++;
+    for (uint16_t j = 0; j < depth; j++) {
+      TSNode parent = ts_node_parent(node);
+      if (ts_node_is_null(parent)) break;
+      node = parent;
+    }
+    uint32_t start_byte = ts_node_start_byte(node);
+    uint32_t end_byte = ts_node_end_byte(node);
+    if (start_byte < result.start_byte) {
+      result.start_byte = start_byte;
+      result.start_point = ts_node_start_point(node);
+    }
+    if (end_byte > result.end_byte) {
+      result.end_byte = end_byte;
+      result.end_point = ts_node_end_point(node);
+    }
+  }
+  return result;
+}
+
+// Run the query over the given range of a tree, and add the resulting matches
+// to the given list. Matches without any captures are not recorded, because
+// there is nothing that would distinguish them from each other.
+//
+// The session treats a node as intersecting a range if it touches it, while
+// the query cursor does not. So the cursor's range is widened by one byte on
+// each side, to include zero-width nodes at the edges of the range.
+static void ts_query_session__find_matches(
+  TSQuerySession *self,
+  const TSTree *tree,
+  ByteRange range,
+  SessionMatchList *result
+) {
+  if (range.start_byte > 0) range.start_byte--;
+  if (range.end_byte < UINT32_MAX) range.end_byte++;
+  ts_query_cursor_set_text_input(self->cursor, self->text_input);
+  ts_query_cursor_set_byte_range(self->cursor, range.start_byte, range.end_byte);
+  ts_query_cursor_exec(self->cursor, self->query, ts_tree_root_node(tree));
+
+  TSQueryMatch match;
+  while (ts_query_cursor_next_match(self->cursor, &match)) {
+    if (match.capture_count == 0) continue;
+    array_push(&result->matches, ((TSQuerySessionMatch) {
+      .id = 0,
+      .pattern_index = match.pattern_index,
+      .capture_count = match.capture_count,
+      .captures = NULL,
+    }));
+    for (uint16_t i = 0; i < match.capture_count; i++) {
+      TSNode node = match.captures[i].node;
+      array_push(&result->captures, ((TSQuerySessionCapture) {
+        .range = {
+          .start_point = ts_node_start_point(node),
+          .end_point = ts_node_end_point(node),
+          .start_byte = ts_node_start_byte(node),
+          .end_byte = ts_node_end_byte(node),
+        },
+        .symbol = ts_node_symbol(node),
+        .index = match.captures[i].index,
+      }));
+    }
+    array_push(&result->captures, ((TSQuerySessionCapture) {
+      .range = ts_query_session__match_extent(self, &match),
+      .symbol = 0,
+      .index = UINT32_MAX,
+    }));
+  }
+}
+
+// Compute the byte ranges that need to be searched again: the ranges whose
+// syntactic structure has changed, together with the ranges that were edited.
+// Each range is widened by one byte in each direction, so that the nodes that
+// border on a change are considered to intersect it, and overlapping ranges
+// are merged.
+static void ts_query_session__get_invalidated_ranges(
+  TSQuerySession *self,
+  const TSTree *tree,
+  ByteRangeArray *result
+) {
+  uint32_t changed_range_count;
+  TSRange *changed_ranges = ts_tree__get_changed_ranges(self->tree, tree, &changed_range_count, NULL);
+  for (uint32_t i = 0; i < changed_range_count; i++) {
+    array_push(result, ((ByteRange) {
+      changed_ranges[i].start_byte,
+      changed_ranges[i].end_byte,
+    }));
+  }
+  ts_free(changed_ranges);
+  array_extend(result, self->edited_ranges.size, self->edited_ranges.contents);
+
+  for (uint32_t i = 0; i < result->size; i++) {
+    ByteRange *range = &result->contents[i];
+    if (range->start_byte > 0) range->start_byte--;
+    if (range->end_byte < UINT32_MAX) range->end_byte++;
+  }
+  byte_range_array_merge(result);
+}
+
+// Extend the given ranges so that they contain the extent of every match in
+// the given list that intersects them. Returns true if any of the ranges were
+// extended.
+static bool ts_query_session__cover_matches(
+  ByteRangeArray *ranges,
+  const SessionMatchList *matches
+) {
+  bool did_extend = false;
+  for (uint32_t i = 0; i < matches->matches.size; i++) {
+    const TSRange *extent = session_match__extent(&matches->matches.contents[i]);
+    if (
+      byte_range_array_intersects(ranges, extent) &&
+      !byte_range_array_contains(ranges, extent)
+    ) {
+      array_push(ranges, ((ByteRange) {extent->start_byte, extent->end_byte}));
+      did_extend = true;
+    }
+  }
+  if (did_extend) byte_range_array_merge(ranges);
+  return did_extend;
+}
+
+TSQuerySession *ts_query_session_new(const TSQuery *query) {
+  TSQuerySession *self = ts_malloc(sizeof(TSQuerySession));
+  *self = (TSQuerySession) {
+    .query = query,
+    .cursor = ts_query_cursor_new(),
+    .tree = NULL,
+    .text_input = {NULL, NULL, TSInputEncodingUTF8},
+    .edited_ranges = array_new(),
+    .matches = {array_new(), array_new()},
+    .added_matches = {array_new(), array_new()},
+    .removed_matches = {array_new(), array_new()},
+    .next_match_id = 0,
+  };
+  return self;
+}
+
+void ts_query_session_delete(TSQuerySession *self) {
+  ts_query_cursor_delete(self->cursor);
+  if (self->tree) ts_tree_delete(self->tree);
+  array_delete(&self->edited_ranges);
+  session_match_list_delete(&self->matches);
+  session_match_list_delete(&self->added_matches);
+  session_match_list_delete(&self->removed_matches);
+  ts_free(self);
+}
+
+void ts_query_session_set_text_input(TSQuerySession *self, TSInput input) {
+  self->text_input = input;
+}
+
+void ts_query_session_edit(TSQuerySession *self, const TSInputEdit *edit) {
+  if (!self->tree) return;
+  ts_tree_edit(self->tree, edit);
+
+  for (uint32_t i = 0; i < self->edited_ranges.size; i++) {
+    ByteRange *range = &self->edited_ranges.contents[i];
+    TSPoint point = {0, 0};
+    ts_query_session__edit_position(&range->start_byte, &point, edit);
+    if (range->end_byte > edit->start_byte) {
+      ts_query_session__edit_position(&range->end_byte, &point, edit);
+    }
+  }
+  array_push(&self->edited_ranges, ((ByteRange) {edit->start_byte, edit->new_end_byte}));
+
+  // The matches that overlap the edit will be checked again on the next
+  // update, so their positions only need to be roughly correct.
+  for (uint32_t i = 0; i < self->matches.captures.size; i++) {
+    TSRange *range = &self->matches.captures.contents[i].range;
+    ts_query_session__edit_position(&range->start_byte, &range->start_point, edit);
+    if (range->end_byte > edit->start_byte) {
+      ts_query_session__edit_position(&range->end_byte, &range->end_point, edit);
+    }
+  }
+}
+
+void ts_query_session_update(TSQuerySession *self, const TSTree *tree) {
+  session_match_list_clear(&self->added_matches);
+  session_match_list_clear(&self->removed_matches);
+
+  // The first time that the session is updated, the whole tree is searched.
+  if (!self->tree) {
+    ts_query_session__find_matches(
+      self, tree, (ByteRange) {0, UINT32_MAX}, &self->added_matches
+    );
+    session_match_list_finish(&self->added_matches);
+    session_match_list_sort(&self->added_matches);
+    session_match_list_clear(&self->matches);
+    for (uint32_t i = 0; i < self->added_matches.matches.size; i++) {
+      TSQuerySessionMatch *match = &self->added_matches.matches.contents[i];
+      match->id = self->next_match_id++;
+      session_match_list_push_match(&self->matches, match, match->id);
+    }
+    session_match_list_finish(&self->matches);
+    self->tree = ts_tree_copy(tree);
+    return;
+  }
+
+  // Find the matches in the new tree that intersect the invalidated ranges.
+  // Outside of these ranges, the old and new trees are the same. But a match
+  // that extends beyond the ranges may still depend on something inside of
+  // them, and a search that is restricted to the ranges can miss a match whose
+  // first node lies outside of them. So the ranges are extended until they
+  // contain every cached or new match that intersects them.
+  ByteRangeArray ranges = array_new();
+  ts_query_session__get_invalidated_ranges(self, tree, &ranges);
+  SessionMatchList new_matches = {array_new(), array_new()};
+  for (;;) {
+    session_match_list_clear(&new_matches);
+    for (uint32_t i = 0; i < ranges.size; i++) {
+      ts_query_session__find_matches(self, tree, ranges.contents[i], &new_matches);
+    }
+    session_match_list_finish(&new_matches);
+    bool did_extend = ts_query_session__cover_matches(&ranges, &new_matches);
+    if (ts_query_session__cover_matches(&ranges, &self->matches)) did_extend = true;
+    if (!did_extend) break;
+  }
+  session_match_list_sort(&new_matches);
+
+  // Set aside the cached matches that intersect the ranges. They remain only
+  // if they were found again. The rest of the cached matches are still in
+  // sorted order, because they were not affected by any of the edits.
+  SessionMatchList stale_matches = {array_new(), array_new()};
+  uint32_t clean_count = 0;
+  for (uint32_t i = 0; i < self->matches.matches.size; i++) {
+    TSQuerySessionMatch *match = &self->matches.matches.contents[i];
+    if (byte_range_array_intersects(&ranges, session_match__extent(match))) {
+      session_match_list_push_match(&stale_matches, match, match->id);
+    } else {
+      self->matches.matches.contents[clean_count++] = *match;
+    }
+  }
+  self->matches.matches.size = clean_count;
+  session_match_list_finish(&stale_matches);
+  if (stale_matches.matches.size > 0) qsort(
+    stale_matches.matches.contents,
+    stale_matches.matches.size,
+    sizeof(TSQuerySessionMatch),
+    session_match__compare
+  );
+
+  // Merge the clean cached matches with the new matches. A new match that is
+  // the same as one of the stale matches keeps that match's id. The other new
+  // matches are added, and the other stale matches are removed.
+  SessionMatchList matches = {array_new(), array_new()};
+  uint32_t old_index = 0, new_index = 0, stale_index = 0;
+  while (old_index < self->matches.matches.size || new_index < new_matches.matches.size) {
+    const TSQuerySessionMatch *old_match = old_index < self->matches.matches.size
+      ? &self->matches.matches.contents[old_index]
+      : NULL;
+    const TSQuerySessionMatch *new_match = new_index < new_matches.matches.size
+      ? &new_matches.matches.contents[new_index]
+      : NULL;
+    int comparison = !new_match ? -1 : !old_match ? 1 : session_match__compare(old_match, new_match);
+
+    if (comparison <= 0) {
+      session_match_list_push_match(&matches, old_match, old_match->id);
+      old_index++;
+      if (comparison == 0) new_index++;
+    } else {
+      while (
+        stale_index < stale_matches.matches.size &&
+        session_match__compare(&stale_matches.matches.contents[stale_index], new_match) < 0
+      ) {
+        TSQuerySessionMatch *stale_match = &stale_matches.matches.contents[stale_index++];
+        session_match_list_push_match(&self->removed_matches, stale_match, stale_match->id);
+      }
+      if (
+        stale_index < stale_matches.matches.size &&
+        session_match__compare(&stale_matches.matches.contents[stale_index], new_match) == 0
+      ) {
+        uint32_t id = stale_matches.matches.contents[stale_index++].id;
+        session_match_list_push_match(&matches, new_match, id);
+      } else {
+        uint32_t id = self->next_match_id++;
+        session_match_list_push_match(&matches, new_match, id);
+        session_match_list_push_match(&self->added_matches, new_match, id);
+      }
+      new_index++;
+    }
+  }
+  while (stale_index < stale_matches.matches.size) {
+    TSQuerySessionMatch *stale_match = &stale_matches.matches.contents[stale_index++];
+    session_match_list_push_match(&self->removed_matches, stale_match, stale_match->id);
+  }
+
+  session_match_list_finish(&matches);
+  session_match_list_finish(&self->added_matches);
+  session_match_list_finish(&self->removed_matches);
+  session_match_list_delete(&self->matches);
+  self->matches = matches;
+
+  session_match_list_delete(&new_matches);
+  session_match_list_delete(&stale_matches);
+  array_delete(&ranges);
+  array_clear(&self->edited_ranges);
+  ts_tree_delete(self->tree);
+  self->tree = ts_tree_copy(tree);
+}
+
+const TSQuerySessionMatch *ts_query_session_matches(
+  const TSQuerySession *self,
+  uint32_t *count
+) {
+  *count = self->matches.matches.size;
+  return self->matches.matches.contents;
+}
+
+const TSQuerySessionMatch *ts_query_session_added_matches(
+  const TSQuerySession *self,
+  uint32_t *count
+) {
+  *count = self->added_matches.matches.size;
+  return self->added_matches.matches.contents;
+}
+
+const TSQuerySessionMatch *ts_query_session_removed_matches(
+  const TSQuerySession *self,
+  uint32_t *count
+) {
+  *count = self->removed_matches.matches.size;
+  return self->removed_matches.matches.contents;
+}
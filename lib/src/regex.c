@@ -0,0 +1,1181 @@
+#include "./regex.h"
+#include "./alloc.h"
+#include "./array.h"
+#include "./unicode.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define NONE UINT16_MAX
+#define NO_NODE UINT32_MAX
+#define UNBOUNDED UINT32_MAX
+#define MAX_CODE_POINT 0x10FFFF
+#define MAX_NESTING_DEPTH 64
+#define MAX_REPETITION_COUNT 256
+#define MAX_INSTRUCTION_COUNT 4096
+#define MAX_STATE_COUNT 1024
+#define MAX_PREFIX_LENGTH 16
+#define DEAD_STATE 0
+
+typedef struct {
+  uint32_t min;
+  uint32_t max;
+} RegexRange;
+
+typedef Array(RegexRange) RegexRangeArray;
+
+// A set of code points, which is stored as two sorted lists of disjoint
+// ranges: the code points that are definitely in the set, and those that may
+// or may not be in the set.
+typedef struct {
+  RegexRangeArray matched;
+  RegexRangeArray unknown;
+} RegexClass;
+
+typedef enum {
+  RegexNodeTypeEmpty,
+  RegexNodeTypeClass,
+  RegexNodeTypeConcatenation,
+  RegexNodeTypeAlternation,
+  RegexNodeTypeRepetition,
+  RegexNodeTypeStart,
+  RegexNodeTypeEnd,
+} RegexNodeType;
+
+// A node in a regex's syntax tree. The children of each node are linked
+// through their `next_sibling` indices. The ranges of a class node are stored
+// in the builder's `ranges` array, with its matched ranges first.
+typedef struct {
+  RegexNodeType type;
+  uint32_t first_child;
+  uint32_t next_sibling;
+  uint32_t min_count;
+  uint32_t max_count;
+  uint32_t range_offset;
+  uint32_t matched_range_count;
+  uint32_t unknown_range_count;
+} RegexNode;
+
+typedef enum {
+  RegexInstructionTypeByte,
+  RegexInstructionTypeSplit,
+  RegexInstructionTypeStart,
+  RegexInstructionTypeEnd,
+  RegexInstructionTypeMatch,
+  RegexInstructionTypeUnknown,
+} RegexInstructionType;
+
+// An instruction in a regex's NFA. Byte instructions consume one byte in the
+// range from `min` to `max`. Split, start and end instructions don't consume
+// any input. Unknown instructions consume any input, and mark the search as
+// undecidable.
+typedef struct {
+  uint8_t type;
+  uint8_t min;
+  uint8_t max;
+  uint16_t out;
+  uint16_t out1;
+} RegexInstruction;
+
+typedef struct {
+  uint32_t offset;
+  uint32_t length;
+} RegexStateMembers;
+
+typedef struct {
+  const char *input;
+  const char *end;
+  unsigned depth;
+  bool did_overflow;
+  Array(RegexNode) nodes;
+  RegexRangeArray ranges;
+  Array(RegexInstruction) instructions;
+  Array(RegexStateMembers) states;
+  Array(uint16_t) members;
+  Array(uint16_t) set;
+  Array(uint16_t) stack;
+  Array(uint16_t) transitions;
+  Array(uint8_t) state_flags;
+  uint32_t *marks;
+  uint32_t mark;
+  uint32_t *state_table;
+} RegexBuilder;
+
+typedef enum {
+  RegexStateFlagMatch = 1,
+  RegexStateFlagMatchAtEnd = 2,
+  RegexStateFlagUnknown = 4,
+} RegexStateFlag;
+
+struct Regex {
+  uint8_t byte_classes[256];
+  uint32_t class_count;
+  uint32_t state_count;
+  uint16_t *transitions;
+  uint8_t *state_flags;
+  uint32_t start_state;
+  uint32_t idle_state;
+  uint32_t prefix_length;
+  uint8_t prefix[MAX_PREFIX_LENGTH];
+};
+
+static const RegexRange SCALAR_VALUE_RANGES[] = {
+  {0, 0xD7FF},
+  {0xE000, MAX_CODE_POINT},
+};
+
+/*************
+ * RangeArray
+ *************/
+
+static int regex_range__compare(const void *a, const void *b) {
+  const RegexRange *left = a, *right = b;
+  if (left->min < right->min) return -1;
+  if (left->min > right->min) return 1;
+  return 0;
+}
+
+static void range_array__normalize(RegexRangeArray *self) {
+  if (self->size == 0) return;
+  qsort(self->contents, self->size, sizeof(RegexRange), regex_range__compare);
+  uint32_t size = 1;
+  for (uint32_t i = 1; i < self->size; i++) {
+    RegexRange range = self->contents[i];
+    RegexRange *previous = &self->contents[size - 1];
+    if (range.min <= previous->max + 1) {
+      if (range.max > previous->max) previous->max = range.max;
+    } else {
+      self->contents[size++] = range;
+    }
+  }
+  self->size = size;
+}
+
+// Remove the code points in one normalized array of ranges from another.
+static void range_array__subtract(RegexRangeArray *self, const RegexRange *other, uint32_t other_count) {
+  RegexRangeArray result = array_new();
+  uint32_t j = 0;
+  for (uint32_t i = 0; i < self->size; i++) {
+    RegexRange range = self->contents[i];
+    while (j < other_count && other[j].max < range.min) j++;
+    bool is_empty = false;
+    for (uint32_t k = j; k < other_count && other[k].min <= range.max; k++) {
+      if (other[k].min > range.min) {
+        array_push(&result, ((RegexRange) {range.min, other[k].min - 1}));
+      }
+      if (other[k].max >= range.max) {
+        is_empty = true;
+        break;
+      }
+      range.min = other[k].max + 1;
+    }
+    if (!is_empty) array_push(&result, range);
+  }
+  array_delete(self);
+  *self = result;
+}
+
+/*************
+ * RegexClass
+ *************/
+
+static RegexClass regex_class__new(void) {
+  return (RegexClass) {array_new(), array_new()};
+}
+
+static void regex_class__delete(RegexClass *self) {
+  array_delete(&self->matched);
+  array_delete(&self->unknown);
+}
+
+static void regex_class__add_class(RegexClass *self, const RegexClass *other) {
+  array_extend(&self->matched, other->matched.size, other->matched.contents);
+  array_extend(&self->unknown, other->unknown.size, other->unknown.contents);
+}
+
+// Sort and merge the class's ranges, and remove any code points that are not
+// unicode scalar values, or that are known to be matched from its unknown
+// ranges.
+static void regex_class__normalize(RegexClass *self) {
+  static const RegexRange SURROGATES = {0xD800, 0xDFFF};
+  range_array__normalize(&self->matched);
+  range_array__normalize(&self->unknown);
+  range_array__subtract(&self->matched, &SURROGATES, 1);
+  range_array__subtract(&self->unknown, &SURROGATES, 1);
+  range_array__subtract(&self->unknown, self->matched.contents, self->matched.size);
+}
+
+static void regex_class__negate(RegexClass *self) {
+  regex_class__normalize(self);
+  RegexRangeArray excluded = array_new();
+  array_extend(&excluded, self->matched.size, self->matched.contents);
+  array_extend(&excluded, self->unknown.size, self->unknown.contents);
+  range_array__normalize(&excluded);
+  array_clear(&self->matched);
+  array_extend(&self->matched, 2, SCALAR_VALUE_RANGES);
+  range_array__subtract(&self->matched, excluded.contents, excluded.size);
+  array_delete(&excluded);
+}
+
+// Add one of the `\d`, `\w` or `\s` classes, or their negations. These classes
+// include non-ASCII characters in some bindings, so they are only known to
+// match ASCII characters.
+static void regex_class__add_perl_class(RegexClass *self, char name) {
+  static const RegexRange DIGIT_RANGES[] = {{'0', '9'}};
+  static const RegexRange WORD_RANGES[] = {{'0', '9'}, {'A', 'Z'}, {'_', '_'}, {'a', 'z'}};
+  static const RegexRange SPACE_RANGES[] = {{'\t', '\r'}, {' ', ' '}};
+
+  RegexClass class = regex_class__new();
+  switch (name | 0x20) {
+    case 'd':
+      array_extend(&class.matched, 1, DIGIT_RANGES);
+      break;
+    case 'w':
+      array_extend(&class.matched, 4, WORD_RANGES);
+      break;
+    default:
+      array_extend(&class.matched, 2, SPACE_RANGES);
+      break;
+  }
+  array_push(&class.unknown, ((RegexRange) {0x80, MAX_CODE_POINT}));
+  if (name >= 'A' && name <= 'Z') regex_class__negate(&class);
+  regex_class__add_class(self, &class);
+  regex_class__delete(&class);
+}
+
+/**********
+ * Parsing
+ **********/
+
+static uint32_t regex_builder__add_node(RegexBuilder *self, RegexNode node) {
+  array_push(&self->nodes, node);
+  return self->nodes.size - 1;
+}
+
+static uint32_t regex_builder__add_simple_node(RegexBuilder *self, RegexNodeType type) {
+  return regex_builder__add_node(self, (RegexNode) {
+    .type = type,
+    .first_child = NO_NODE,
+    .next_sibling = NO_NODE,
+  });
+}
+
+static uint32_t regex_builder__add_class_node(RegexBuilder *self, RegexClass *class) {
+  regex_class__normalize(class);
+  RegexNode node = {
+    .type = RegexNodeTypeClass,
+    .first_child = NO_NODE,
+    .next_sibling = NO_NODE,
+    .range_offset = self->ranges.size,
+    .matched_range_count = class->matched.size,
+    .unknown_range_count = class->unknown.size,
+  };
+  array_extend(&self->ranges, class->matched.size, class->matched.contents);
+  array_extend(&self->ranges, class->unknown.size, class->unknown.contents);
+  return regex_builder__add_node(self, node);
+}
+
+static bool regex_builder__parse_code_point(RegexBuilder *self, int32_t *code_point) {
+  uint32_t size = ts_decode_utf8(
+    (const uint8_t *)self->input,
+    (uint32_t)(self->end - self->input),
+    code_point
+  );
+  self->input += size;
+  return *code_point >= 0;
+}
+
+static bool regex_builder__parse_hex(RegexBuilder *self, int32_t *code_point) {
+  const char *end = self->end;
+  bool is_braced = self->input < self->end && *self->input == '{';
+  if (is_braced) {
+    self->input++;
+  } else if (self->end - self->input >= 2) {
+    end = self->input + 2;
+  } else {
+    return false;
+  }
+
+  uint32_t value = 0, digit_count = 0;
+  while (self->input < end) {
+    char c = *self->input;
+    if (is_braced && c == '}') break;
+    uint32_t digit;
+    if (c >= '0' && c <= '9') digit = c - '0';
+    else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+    else return false;
+    if (++digit_count > 6) return false;
+    value = value * 16 + digit;
+    self->input++;
+  }
+  if (is_braced) {
+    if (self->input == self->end) return false;
+    self->input++;
+  }
+  if (digit_count == 0 || value > MAX_CODE_POINT || (value >= 0xD800 && value <= 0xDFFF)) {
+    return false;
+  }
+  *code_point = value;
+  return true;
+}
+
+// Parse an escape sequence, following a backslash. Escapes that denote a
+// single character are returned as a code point. Escapes that denote classes
+// are added to the given class, and return a code point of -1.
+static bool regex_builder__parse_escape(RegexBuilder *self, int32_t *code_point, RegexClass *class) {
+  if (self->input == self->end) return false;
+  char c = *self->input++;
+  switch (c) {
+    case 'd': case 'D': case 'w': case 'W': case 's': case 'S':
+      regex_class__add_perl_class(class, c);
+      *code_point = -1;
+      return true;
+    case 'a': *code_point = '\a'; return true;
+    case 'f': *code_point = '\f'; return true;
+    case 'n': *code_point = '\n'; return true;
+    case 'r': *code_point = '\r'; return true;
+    case 't': *code_point = '\t'; return true;
+    case 'v': *code_point = '\v'; return true;
+    case 'x': return regex_builder__parse_hex(self, code_point);
+    default:
+      if (
+        (c >= '0' && c <= '9') ||
+        (c >= 'a' && c <= 'z') ||
+        (c >= 'A' && c <= 'Z') ||
+        (c & 0x80)
+      ) return false;
+      *code_point = c;
+      return true;
+  }
+}
+
+static bool regex_builder__parse_class_item(RegexBuilder *self, int32_t *code_point, RegexClass *class) {
+  if (*self->input == '\\') {
+    self->input++;
+    return regex_builder__parse_escape(self, code_point, class);
+  }
+  return regex_builder__parse_code_point(self, code_point);
+}
+
+// Parse a bracketed character class. Nested classes, POSIX classes and set
+// operations are not supported.
+static bool regex_builder__parse_class(RegexBuilder *self, uint32_t *result) {
+  RegexClass class = regex_class__new();
+  bool is_negated = false;
+  if (self->input < self->end && *self->input == '^') {
+    is_negated = true;
+    self->input++;
+  }
+
+  for (bool is_first = true;; is_first = false) {
+    if (self->input == self->end) goto fail;
+    char c = *self->input;
+    if (c == ']' && !is_first) {
+      self->input++;
+      break;
+    }
+    if (c == '[') goto fail;
+    if (
+      (c == '&' || c == '-' || c == '~') &&
+      self->end - self->input > 1 &&
+      self->input[1] == c
+    ) goto fail;
+
+    int32_t min;
+    if (!regex_builder__parse_class_item(self, &min, &class)) goto fail;
+    if (min < 0) continue;
+    if (
+      self->end - self->input > 1 &&
+      self->input[0] == '-' &&
+      self->input[1] != ']'
+    ) {
+      self->input++;
+      int32_t max;
+      if (!regex_builder__parse_class_item(self, &max, &class)) goto fail;
+      if (max < min) goto fail;
+      array_push(&class.matched, ((RegexRange) {min, max}));
+    } else {
+      array_push(&class.matched, ((RegexRange) {min, min}));
+    }
+  }
+
+  if (is_negated) regex_class__negate(&class);
+  *result = regex_builder__add_class_node(self, &class);
+  regex_class__delete(&class);
+  return true;
+
+fail:
+  regex_class__delete(&class);
+  return false;
+}
+
+static bool regex_builder__parse_alternation(RegexBuilder *self, uint32_t *result);
+
+static bool regex_builder__parse_atom(RegexBuilder *self, uint32_t *result) {
+  char c = *self->input;
+  switch (c) {
+    case '(': {
+      self->input++;
+      if (self->end - self->input >= 2 && self->input[0] == '?') {
+        if (self->input[1] == ':') {
+          self->input += 2;
+        } else if (self->input[1] == '<' || self->input[1] == 'P') {
+          // Named groups are treated like any other group.
+          self->input += self->input[1] == 'P' ? 3 : 2;
+          if (self->input > self->end || self->input[-1] != '<') return false;
+          const char *name_end = memchr(self->input, '>', self->end - self->input);
+          if (!name_end || name_end == self->input) return false;
+          self->input = name_end + 1;
+        } else {
+          return false;
+        }
+      }
+      if (!regex_builder__parse_alternation(self, result)) return false;
+      if (self->input == self->end || *self->input != ')') return false;
+      self->input++;
+      return true;
+    }
+    case '^':
+      self->input++;
+      *result = regex_builder__add_simple_node(self, RegexNodeTypeStart);
+      return true;
+    case '$':
+      self->input++;
+      *result = regex_builder__add_simple_node(self, RegexNodeTypeEnd);
+      return true;
+    case '*': case '+': case '?': case '{':
+      return false;
+    default:
+      break;
+  }
+
+  RegexClass class = regex_class__new();
+  int32_t code_point;
+  bool is_valid = true;
+  if (c == '.') {
+    self->input++;
+    array_push(&class.matched, ((RegexRange) {0, '\n' - 1}));
+    array_push(&class.matched, ((RegexRange) {'\n' + 1, MAX_CODE_POINT}));
+  } else if (c == '[') {
+    self->input++;
+    regex_class__delete(&class);
+    return regex_builder__parse_class(self, result);
+  } else if (c == '\\') {
+    self->input++;
+    if (self->input < self->end && (*self->input == 'A' || *self->input == 'z')) {
+      RegexNodeType type = *self->input == 'A' ? RegexNodeTypeStart : RegexNodeTypeEnd;
+      self->input++;
+      regex_class__delete(&class);
+      *result = regex_builder__add_simple_node(self, type);
+      return true;
+    }
+    is_valid = regex_builder__parse_escape(self, &code_point, &class);
+    if (is_valid && code_point >= 0) {
+      array_push(&class.matched, ((RegexRange) {code_point, code_point}));
+    }
+  } else {
+    is_valid = regex_builder__parse_code_point(self, &code_point);
+    if (is_valid) array_push(&class.matched, ((RegexRange) {code_point, code_point}));
+  }
+
+  if (is_valid) *result = regex_builder__add_class_node(self, &class);
+  regex_class__delete(&class);
+  return is_valid;
+}
+
+static bool regex_builder__parse_count(RegexBuilder *self, uint32_t *count) {
+  uint32_t digit_count = 0;
+  *count = 0;
+  while (self->input < self->end && *self->input >= '0' && *self->input <= '9') {
+    if (++digit_count > 4) return false;
+    *count = *count * 10 + (*self->input - '0');
+    self->input++;
+  }
+  return digit_count > 0;
+}
+
+static bool regex_builder__parse_repetition(RegexBuilder *self, uint32_t *result) {
+  uint32_t atom;
+  if (!regex_builder__parse_atom(self, &atom)) return false;
+  for (bool is_repeated = false; self->input < self->end; is_repeated = true) {
+    uint32_t min_count, max_count;
+    switch (*self->input) {
+      case '*':
+        min_count = 0;
+        max_count = UNBOUNDED;
+        self->input++;
+        break;
+      case '+':
+        min_count = 1;
+        max_count = UNBOUNDED;
+        self->input++;
+        break;
+      case '?':
+        min_count = 0;
+        max_count = 1;
+        self->input++;
+        break;
+      case '{':
+        self->input++;
+        if (!regex_builder__parse_count(self, &min_count)) return false;
+        max_count = min_count;
+        if (self->input < self->end && *self->input == ',') {
+          self->input++;
+          max_count = UNBOUNDED;
+          if (self->input < self->end && *self->input != '}') {
+            if (!regex_builder__parse_count(self, &max_count)) return false;
+            if (max_count < min_count) return false;
+          }
+        }
+        if (self->input == self->end || *self->input != '}') return false;
+        self->input++;
+        break;
+      default:
+        *result = atom;
+        return true;
+    }
+
+    // Laziness doesn't affect whether a regex matches.
+    if (self->input < self->end && *self->input == '?') self->input++;
+
+    RegexNodeType type = self->nodes.contents[atom].type;
+    if (
+      is_repeated ||
+      type == RegexNodeTypeStart ||
+      type == RegexNodeTypeEnd ||
+      min_count > MAX_REPETITION_COUNT ||
+      (max_count != UNBOUNDED && max_count > MAX_REPETITION_COUNT)
+    ) return false;
+
+    atom = regex_builder__add_node(self, (RegexNode) {
+      .type = RegexNodeTypeRepetition,
+      .first_child = atom,
+      .next_sibling = NO_NODE,
+      .min_count = min_count,
+      .max_count = max_count,
+    });
+  }
+  *result = atom;
+  return true;
+}
+
+static bool regex_builder__parse_concatenation(RegexBuilder *self, uint32_t *result) {
+  uint32_t first_child = NO_NODE, previous_child = NO_NODE, child_count = 0;
+  while (self->input < self->end && *self->input != '|' && *self->input != ')') {
+    uint32_t child;
+    if (!regex_builder__parse_repetition(self, &child)) return false;
+    if (previous_child == NO_NODE) {
+      first_child = child;
+    } else {
+      self->nodes.contents[previous_child].next_sibling = child;
+    }
+    previous_child = child;
+    child_count++;
+  }
+
+  if (child_count == 0) {
+    *result = regex_builder__add_simple_node(self, RegexNodeTypeEmpty);
+  } else if (child_count == 1) {
+    *result = first_child;
+  } else {
+    *result = regex_builder__add_node(self, (RegexNode) {
+      .type = RegexNodeTypeConcatenation,
+      .first_child = first_child,
+      .next_sibling = NO_NODE,
+    });
+  }
+  return true;
+}
+
+static bool regex_builder__parse_alternation(RegexBuilder *self, uint32_t *result) {
+  if (++self->depth > MAX_NESTING_DEPTH) return false;
+  uint32_t first_child;
+  if (!regex_builder__parse_concatenation(self, &first_child)) return false;
+  if (self->input == self->end || *self->input != '|') {
+    *result = first_child;
+    self->depth--;
+    return true;
+  }
+
+  uint32_t previous_child = first_child;
+  while (self->input < self->end && *self->input == '|') {
+    self->input++;
+    uint32_t child;
+    if (!regex_builder__parse_concatenation(self, &child)) return false;
+    self->nodes.contents[previous_child].next_sibling = child;
+    previous_child = child;
+  }
+  *result = regex_builder__add_node(self, (RegexNode) {
+    .type = RegexNodeTypeAlternation,
+    .first_child = first_child,
+    .next_sibling = NO_NODE,
+  });
+  self->depth--;
+  return true;
+}
+
+/************
+ * Compiling
+ ************/
+
+static uint16_t regex_builder__emit(RegexBuilder *self, RegexInstruction instruction) {
+  if (self->instructions.size >= MAX_INSTRUCTION_COUNT) {
+    self->did_overflow = true;
+    return NONE;
+  }
+  array_push(&self->instructions, instruction);
+  return self->instructions.size - 1;
+}
+
+static uint16_t regex_builder__emit_split(RegexBuilder *self, uint16_t out, uint16_t out1) {
+  if (out == NONE) return out1;
+  if (out1 == NONE) return out;
+  return regex_builder__emit(self, (RegexInstruction) {RegexInstructionTypeSplit, 0, 0, out, out1});
+}
+
+static unsigned regex__encode_utf8(uint32_t code_point, uint8_t *bytes) {
+  if (code_point < 0x80) {
+    bytes[0] = code_point;
+    return 1;
+  } else if (code_point < 0x800) {
+    bytes[0] = 0xC0 | (code_point >> 6);
+    bytes[1] = 0x80 | (code_point & 0x3F);
+    return 2;
+  } else if (code_point < 0x10000) {
+    bytes[0] = 0xE0 | (code_point >> 12);
+    bytes[1] = 0x80 | ((code_point >> 6) & 0x3F);
+    bytes[2] = 0x80 | (code_point & 0x3F);
+    return 3;
+  } else {
+    bytes[0] = 0xF0 | (code_point >> 18);
+    bytes[1] = 0x80 | ((code_point >> 12) & 0x3F);
+    bytes[2] = 0x80 | ((code_point >> 6) & 0x3F);
+    bytes[3] = 0x80 | (code_point & 0x3F);
+    return 4;
+  }
+}
+
+// Emit instructions that match the UTF-8 encoding of any code point in the
+// given range, and then continue to `next`. The range is split until each
+// part can be matched by a single sequence of byte ranges.
+static uint16_t regex_builder__compile_range(RegexBuilder *self, uint32_t min, uint32_t max, uint16_t next) {
+  static const uint32_t ENCODED_LENGTH_LIMITS[] = {0x7F, 0x7FF, 0xFFFF};
+  for (unsigned i = 0; i < 3; i++) {
+    uint32_t limit = ENCODED_LENGTH_LIMITS[i];
+    if (min <= limit && limit < max) {
+      return regex_builder__emit_split(
+        self,
+        regex_builder__compile_range(self, min, limit, next),
+        regex_builder__compile_range(self, limit + 1, max, next)
+      );
+    }
+  }
+
+  for (unsigned i = 1; i < 4; i++) {
+    uint32_t mask = (1u << (6 * i)) - 1;
+    if ((min & ~mask) != (max & ~mask)) {
+      if ((min & mask) != 0) {
+        return regex_builder__emit_split(
+          self,
+          regex_builder__compile_range(self, min, min | mask, next),
+          regex_builder__compile_range(self, (min | mask) + 1, max, next)
+        );
+      }
+      if ((max & mask) != mask) {
+        return regex_builder__emit_split(
+          self,
+          regex_builder__compile_range(self, min, (max & ~mask) - 1, next),
+          regex_builder__compile_range(self, max & ~mask, max, next)
+        );
+      }
+    }
+  }
+
+  uint8_t min_bytes[4], max_bytes[4];
+  unsigned length = regex__encode_utf8(min, min_bytes);
+  regex__encode_utf8(max, max_bytes);
+  uint16_t entry = next;
+  for (unsigned i = length; i > 0; i--) {
+    entry = regex_builder__emit(self, (RegexInstruction) {
+      RegexInstructionTypeByte, min_bytes[i - 1], max_bytes[i - 1], entry, NONE
+    });
+  }
+  return entry;
+}
+
+static uint16_t regex_builder__compile(RegexBuilder *self, uint32_t node_index, uint16_t next, unsigned depth);
+
+static uint16_t regex_builder__compile_sequence(RegexBuilder *self, uint32_t node_index, uint16_t next, unsigned depth) {
+  if (node_index == NO_NODE) return next;
+  uint32_t next_sibling = self->nodes.contents[node_index].next_sibling;
+  next = regex_builder__compile_sequence(self, next_sibling, next, depth);
+  return regex_builder__compile(self, node_index, next, depth);
+}
+
+// Emit the instructions for a node of the syntax tree, which continue to the
+// given instruction, and return the index of the first one. Nodes are compiled
+// from the end of the regex to the beginning, so that each instruction's
+// successor already exists.
+static uint16_t regex_builder__compile(RegexBuilder *self, uint32_t node_index, uint16_t next, unsigned depth) {
+  if (depth > MAX_NESTING_DEPTH * 2) self->did_overflow = true;
+  if (self->did_overflow) return NONE;
+
+  RegexNode node = self->nodes.contents[node_index];
+  switch (node.type) {
+    case RegexNodeTypeEmpty:
+      return next;
+    case RegexNodeTypeStart:
+      return regex_builder__emit(self, (RegexInstruction) {RegexInstructionTypeStart, 0, 0, next, NONE});
+    case RegexNodeTypeEnd:
+      return regex_builder__emit(self, (RegexInstruction) {RegexInstructionTypeEnd, 0, 0, next, NONE});
+    case RegexNodeTypeConcatenation:
+      return regex_builder__compile_sequence(self, node.first_child, next, depth + 1);
+    case RegexNodeTypeAlternation: {
+      uint16_t entry = NONE;
+      for (uint32_t i = node.first_child; i != NO_NODE; i = self->nodes.contents[i].next_sibling) {
+        entry = regex_builder__emit_split(self, entry, regex_builder__compile(self, i, next, depth + 1));
+      }
+      return entry;
+    }
+    case RegexNodeTypeClass: {
+      // The instruction at index zero is the unknown instruction.
+      uint16_t entry = NONE;
+      const RegexRange *ranges = &self->ranges.contents[node.range_offset];
+      uint32_t range_count = node.matched_range_count + node.unknown_range_count;
+      for (uint32_t i = 0; i < range_count; i++) {
+        uint16_t range_entry = regex_builder__compile_range(
+          self,
+          ranges[i].min,
+          ranges[i].max,
+          i < node.matched_range_count ? next : 0
+        );
+        entry = regex_builder__emit_split(self, entry, range_entry);
+      }
+      return entry;
+    }
+    case RegexNodeTypeRepetition: {
+      uint16_t entry;
+      if (node.max_count == UNBOUNDED) {
+        entry = regex_builder__emit(self, (RegexInstruction) {RegexInstructionTypeSplit, 0, 0, NONE, next});
+        uint16_t body = regex_builder__compile(self, node.first_child, entry, depth + 1);
+        if (self->did_overflow) return NONE;
+        self->instructions.contents[entry].out = body;
+      } else {
+        entry = next;
+        for (uint32_t i = node.min_count; i < node.max_count; i++) {
+          entry = regex_builder__emit_split(
+            self,
+            regex_builder__compile(self, node.first_child, entry, depth + 1),
+            next
+          );
+        }
+      }
+      for (uint32_t i = 0; i < node.min_count; i++) {
+        entry = regex_builder__compile(self, node.first_child, entry, depth + 1);
+      }
+      return entry;
+    }
+  }
+  return NONE;
+}
+
+/*****************
+ * Determinizing
+ *****************/
+
+// Add the instructions that are reachable from the given instruction without
+// consuming any input to the builder's current set.
+static void regex_builder__add_closure(RegexBuilder *self, uint16_t index, bool is_at_start) {
+  array_push(&self->stack, index);
+  while (self->stack.size > 0) {
+    index = array_pop(&self->stack);
+    if (index == NONE || self->marks[index] == self->mark) continue;
+    self->marks[index] = self->mark;
+    RegexInstruction instruction = self->instructions.contents[index];
+    switch (instruction.type) {
+      case RegexInstructionTypeSplit:
+        array_push(&self->stack, instruction.out1);
+        array_push(&self->stack, instruction.out);
+        break;
+      case RegexInstructionTypeStart:
+        if (is_at_start) array_push(&self->stack, instruction.out);
+        break;
+      default:
+        array_push(&self->set, index);
+        break;
+    }
+  }
+}
+
+static int regex__compare_indices(const void *a, const void *b) {
+  return (int)*(const uint16_t *)a - (int)*(const uint16_t *)b;
+}
+
+// Determine whether the regex matches when the text ends in a state that
+// contains the given instruction.
+static bool regex_builder__matches_at_end(RegexBuilder *self, uint16_t index) {
+  self->mark++;
+  array_push(&self->stack, index);
+  bool result = false;
+  while (self->stack.size > 0) {
+    index = array_pop(&self->stack);
+    if (index == NONE || self->marks[index] == self->mark) continue;
+    self->marks[index] = self->mark;
+    RegexInstruction instruction = self->instructions.contents[index];
+    switch (instruction.type) {
+      case RegexInstructionTypeMatch:
+        result = true;
+        break;
+      case RegexInstructionTypeSplit:
+        array_push(&self->stack, instruction.out1);
+        array_push(&self->stack, instruction.out);
+        break;
+      case RegexInstructionTypeEnd:
+        array_push(&self->stack, instruction.out);
+        break;
+      default:
+        break;
+    }
+  }
+  return result;
+}
+
+// Find the DFA state whose NFA instructions are those in the current set,
+// adding it if it doesn't exist yet. Returns false if there are too many states.
+static bool regex_builder__intern_set(RegexBuilder *self, uint32_t *result) {
+  if (self->set.size > 1) {
+    qsort(self->set.contents, self->set.size, sizeof(uint16_t), regex__compare_indices);
+  }
+
+  uint32_t hash = 2166136261u;
+  for (uint32_t i = 0; i < self->set.size; i++) {
+    hash = (hash ^ self->set.contents[i]) * 16777619u;
+  }
+
+  uint32_t table_size = MAX_STATE_COUNT * 2;
+  for (uint32_t slot = hash % table_size;; slot = (slot + 1) % table_size) {
+    uint32_t entry = self->state_table[slot];
+    if (entry == 0) {
+      if (self->states.size == MAX_STATE_COUNT) return false;
+      *result = self->states.size;
+      self->state_table[slot] = *result + 1;
+      break;
+    }
+    RegexStateMembers members = self->states.contents[entry - 1];
+    if (
+      members.length == self->set.size &&
+      !memcmp(&self->members.contents[members.offset], self->set.contents, members.length * sizeof(uint16_t))
+    ) {
+      *result = entry - 1;
+      return true;
+    }
+  }
+
+  uint8_t flags = 0;
+  for (uint32_t i = 0; i < self->set.size; i++) {
+    uint16_t index = self->set.contents[i];
+    switch (self->instructions.contents[index].type) {
+      case RegexInstructionTypeMatch:
+        flags |= RegexStateFlagMatch;
+        break;
+      case RegexInstructionTypeUnknown:
+        flags |= RegexStateFlagUnknown;
+        break;
+      case RegexInstructionTypeEnd:
+        if (regex_builder__matches_at_end(self, index)) flags |= RegexStateFlagMatchAtEnd;
+        break;
+      default:
+        break;
+    }
+  }
+
+  array_push(&self->states, ((RegexStateMembers) {self->members.size, self->set.size}));
+  array_extend(&self->members, self->set.size, self->set.contents);
+  array_push(&self->state_flags, flags);
+  return true;
+}
+
+static void regex_builder__delete(RegexBuilder *self) {
+  array_delete(&self->nodes);
+  array_delete(&self->ranges);
+  array_delete(&self->instructions);
+  array_delete(&self->states);
+  array_delete(&self->members);
+  array_delete(&self->set);
+  array_delete(&self->stack);
+  array_delete(&self->transitions);
+  array_delete(&self->state_flags);
+  ts_free(self->marks);
+  ts_free(self->state_table);
+}
+
+// Find the literal text that every match must begin with, if any.
+static void regex__find_prefix(Regex *self, const RegexBuilder *builder, uint32_t root) {
+  const RegexNode *node = &builder->nodes.contents[root];
+  uint32_t child = NO_NODE;
+  if (node->type == RegexNodeTypeConcatenation) {
+    child = node->first_child;
+    node = &builder->nodes.contents[child];
+  }
+
+  self->prefix_length = 0;
+  while (
+    node->type == RegexNodeTypeClass &&
+    node->matched_range_count == 1 &&
+    node->unknown_range_count == 0
+  ) {
+    RegexRange range = builder->ranges.contents[node->range_offset];
+    if (range.min != range.max) break;
+    uint8_t bytes[4];
+    unsigned length = regex__encode_utf8(range.min, bytes);
+    if (self->prefix_length + length > MAX_PREFIX_LENGTH) break;
+    memcpy(&self->prefix[self->prefix_length], bytes, length);
+    self->prefix_length += length;
+    if (child == NO_NODE) break;
+    child = node->next_sibling;
+    if (child == NO_NODE) break;
+    node = &builder->nodes.contents[child];
+  }
+}
+
+/*********************
+ * Public
+ *********************/
+
+Regex *ts_regex_new(const char *pattern, uint32_t length) {
+  RegexBuilder builder = {
+    .input = pattern,
+    .end = pattern + length,
+    .depth = 0,
+    .did_overflow = false,
+    .nodes = array_new(),
+    .ranges = array_new(),
+    .instructions = array_new(),
+    .states = array_new(),
+    .members = array_new(),
+    .set = array_new(),
+    .stack = array_new(),
+    .transitions = array_new(),
+    .state_flags = array_new(),
+    .marks = NULL,
+    .mark = 0,
+    .state_table = NULL,
+  };
+
+  uint32_t root;
+  if (
+    !regex_builder__parse_alternation(&builder, &root) ||
+    builder.input != builder.end
+  ) {
+    regex_builder__delete(&builder);
+    return NULL;
+  }
+
+  regex_builder__emit(&builder, (RegexInstruction) {RegexInstructionTypeUnknown, 0, 0, NONE, NONE});
+  uint16_t match = regex_builder__emit(&builder, (RegexInstruction) {RegexInstructionTypeMatch, 0, 0, NONE, NONE});
+  uint16_t entry = regex_builder__compile(&builder, root, match, 0);
+  if (builder.did_overflow) {
+    regex_builder__delete(&builder);
+    return NULL;
+  }
+
+  Regex *self = ts_calloc(1, sizeof(Regex));
+
+  // Divide the bytes into classes that no instruction distinguishes between.
+  bool is_boundary[257] = {false};
+  for (uint32_t i = 0; i < builder.instructions.size; i++) {
+    RegexInstruction instruction = builder.instructions.contents[i];
+    if (instruction.type == RegexInstructionTypeByte) {
+      is_boundary[instruction.min] = true;
+      is_boundary[instruction.max + 1] = true;
+    }
+  }
+  uint8_t class_bytes[256];
+  self->class_count = 0;
+  for (unsigned byte = 0; byte < 256; byte++) {
+    if (byte == 0 || is_boundary[byte]) class_bytes[self->class_count++] = byte;
+    self->byte_classes[byte] = self->class_count - 1;
+  }
+
+  // Build the DFA by following every transition from every state. The search
+  // is unanchored, so the regex's entry is added to each state's successors.
+  builder.marks = ts_calloc(builder.instructions.size, sizeof(uint32_t));
+  builder.state_table = ts_calloc(MAX_STATE_COUNT * 2, sizeof(uint32_t));
+  uint32_t state;
+  bool is_valid = regex_builder__intern_set(&builder, &state);
+
+  builder.mark++;
+  regex_builder__add_closure(&builder, entry, true);
+  is_valid = is_valid && regex_builder__intern_set(&builder, &self->start_state);
+
+  array_clear(&builder.set);
+  builder.mark++;
+  regex_builder__add_closure(&builder, entry, false);
+  uint32_t idle_state;
+  is_valid = is_valid && regex_builder__intern_set(&builder, &idle_state);
+
+  for (uint32_t i = 0; is_valid && i < builder.states.size; i++) {
+    bool is_final = i == DEAD_STATE || (builder.state_flags.contents[i] & RegexStateFlagMatch);
+    for (uint32_t j = 0; j < self->class_count; j++) {
+      uint32_t next_state = i;
+      if (!is_final) {
+        uint8_t byte = class_bytes[j];
+        RegexStateMembers members = builder.states.contents[i];
+        array_clear(&builder.set);
+        builder.mark++;
+        for (uint32_t k = 0; k < members.length; k++) {
+          uint16_t index = builder.members.contents[members.offset + k];
+          RegexInstruction instruction = builder.instructions.contents[index];
+          if (instruction.type == RegexInstructionTypeUnknown) {
+            regex_builder__add_closure(&builder, index, false);
+          } else if (
+            instruction.type == RegexInstructionTypeByte &&
+            instruction.min <= byte && byte <= instruction.max
+          ) {
+            regex_builder__add_closure(&builder, instruction.out, false);
+          }
+        }
+        regex_builder__add_closure(&builder, entry, false);
+        if (!regex_builder__intern_set(&builder, &next_state)) {
+          is_valid = false;
+          break;
+        }
+      }
+      array_push(&builder.transitions, next_state);
+    }
+  }
+
+  if (!is_valid) {
+    regex_builder__delete(&builder);
+    ts_free(self);
+    return NULL;
+  }
+
+  self->state_count = builder.states.size;
+  self->transitions = builder.transitions.contents;
+  self->state_flags = builder.state_flags.contents;
+  array_init(&builder.transitions);
+  array_init(&builder.state_flags);
+
+  // If every match begins with some literal text, then the search can skip
+  // directly to the places where that text occurs, whenever no match is in
+  // progress.
+  regex__find_prefix(self, &builder, root);
+  self->idle_state = self->prefix_length > 0 && idle_state == self->start_state
+    ? idle_state
+    : UINT32_MAX;
+
+  regex_builder__delete(&builder);
+  return self;
+}
+
+void ts_regex_delete(Regex *self) {
+  if (!self) return;
+  ts_free(self->transitions);
+  ts_free(self->state_flags);
+  ts_free(self);
+}
+
+uint32_t ts_regex_start(const Regex *self) {
+  return self->start_state;
+}
+
+// Advance the search through the next chunk of text. Returns false if the
+// result of the search has been decided, so that no more text is needed.
+bool ts_regex_advance(const Regex *self, uint32_t *state, const char *chunk, uint32_t length) {
+  const uint8_t *byte = (const uint8_t *)chunk;
+  const uint8_t *end = byte + length;
+  uint32_t current = *state;
+  while (byte < end) {
+    if (current == self->idle_state) {
+      byte = memchr(byte, self->prefix[0], end - byte);
+      if (!byte) break;
+      if (
+        (uint32_t)(end - byte) >= self->prefix_length &&
+        memcmp(byte, self->prefix, self->prefix_length) != 0
+      ) {
+        byte++;
+        continue;
+      }
+    }
+
+    current = self->transitions[current * self->class_count + self->byte_classes[*byte]];
+    byte++;
+    if (current == DEAD_STATE || (self->state_flags[current] & RegexStateFlagMatch)) {
+      *state = current;
+      return false;
+    }
+  }
+  *state = current;
+  return true;
+}
+
+RegexResult ts_regex_finish(const Regex *self, uint32_t state) {
+  uint8_t flags = self->state_flags[state];
+  if (flags & (RegexStateFlagMatch | RegexStateFlagMatchAtEnd)) return RegexResultMatch;
+  if (flags & RegexStateFlagUnknown) return RegexResultUnknown;
+  return RegexResultNoMatch;
+}
+
+// The DFA is written as-is, so that it can be restored without repeating the
+// work of compiling the pattern.
+void ts_regex_serialize(const Regex *self, SerializationBuffer *buffer) {
+  ts_serialization_write_uint(buffer, self->class_count);
+  ts_serialization_write_uint(buffer, self->state_count);
+  ts_serialization_write_uint(buffer, self->start_state);
+  ts_serialization_write_uint(buffer, self->idle_state);
+  ts_serialization_write_uint(buffer, self->prefix_length);
+  ts_serialization_write_bytes(buffer, (const char *)self->prefix, self->prefix_length);
+  ts_serialization_write_bytes(buffer, (const char *)self->byte_classes, sizeof(self->byte_classes));
+  ts_serialization_write_bytes(buffer, (const char *)self->state_flags, self->state_count);
+  uint32_t transition_count = self->state_count * self->class_count;
+  for (uint32_t i = 0; i < transition_count; i++) {
+    ts_serialization_write_uint(buffer, self->transitions[i]);
+  }
+}
+
+Regex *ts_regex_deserialize(SerializationReader *reader) {
+  uint32_t class_count, state_count, start_state, idle_state, prefix_length;
+  const char *prefix, *byte_classes, *state_flags;
+  if (
+    !ts_serialization_read_uint(reader, &class_count) ||
+    !ts_serialization_read_uint(reader, &state_count) ||
+    !ts_serialization_read_uint(reader, &start_state) ||
+    !ts_serialization_read_uint(reader, &idle_state) ||
+    !ts_serialization_read_uint(reader, &prefix_length) ||
+    class_count == 0 || class_count > 256 ||
+    state_count == 0 || state_count > MAX_STATE_COUNT ||
+    start_state >= state_count ||
+    prefix_length > MAX_PREFIX_LENGTH ||
+    (idle_state != UINT32_MAX && (idle_state >= state_count || prefix_length == 0)) ||
+    !ts_serialization_read_bytes(reader, prefix_length, &prefix) ||
+    !ts_serialization_read_bytes(reader, 256, &byte_classes) ||
+    !ts_serialization_read_bytes(reader, state_count, &state_flags) ||
+    state_count * class_count > ts_serialization_remaining(reader)
+  ) return NULL;
+
+  for (unsigned i = 0; i < 256; i++) {
+    if ((uint8_t)byte_classes[i] >= class_count) return NULL;
+  }
+
+  Regex *self = ts_calloc(1, sizeof(Regex));
+  self->class_count = class_count;
+  self->state_count = state_count;
+  self->start_state = start_state;
+  self->idle_state = idle_state;
+  self->prefix_length = prefix_length;
+  memcpy(self->prefix, prefix, prefix_length);
+  memcpy(self->byte_classes, byte_classes, sizeof(self->byte_classes));
+  self->state_flags = ts_malloc(state_count);
+  memcpy(self->state_flags, state_flags, state_count);
+  self->transitions = ts_malloc(state_count * class_count * sizeof(uint16_t));
+  for (uint32_t i = 0; i < state_count * class_count; i++) {
+    uint32_t next_state;
+    if (!ts_serialization_read_uint(reader, &next_state) || next_state >= state_count) {
+      ts_regex_delete(self);
+      return NULL;
+    }
+    self->transitions[i] = next_state;
+  }
+  return self;
+}
@@ -0,0 +1,44 @@
+#ifndef TREE_SITTER_REGEX_H_
+#define TREE_SITTER_REGEX_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "./serialization.h"
+
+// A regular expression, compiled into a DFA that operates on UTF-8 bytes, so
+// that text can be searched one chunk at a time, without being copied.
+//
+// The supported syntax is the common subset of the regex syntaxes used by the
+// language bindings: literals, `.`, character classes, the `\d`, `\w` and `\s`
+// escapes, groups, alternation, repetition, and the `^` and `$` anchors. Any
+// other pattern fails to compile, and must be evaluated by the caller.
+//
+// The `\d`, `\w` and `\s` classes are only known for ASCII characters. When
+// one of them is tested against any other character, the search can't be
+// decided, and produces `RegexResultUnknown` unless a match is found
+// elsewhere in the text.
+typedef struct Regex Regex;
+
+typedef enum {
+  RegexResultNoMatch,
+  RegexResultMatch,
+  RegexResultUnknown,
+} RegexResult;
+
+Regex *ts_regex_new(const char *pattern, uint32_t length);
+void ts_regex_delete(Regex *);
+uint32_t ts_regex_start(const Regex *);
+bool ts_regex_advance(const Regex *, uint32_t *state, const char *chunk, uint32_t length);
+RegexResult ts_regex_finish(const Regex *, uint32_t state);
+void ts_regex_serialize(const Regex *, SerializationBuffer *);
+Regex *ts_regex_deserialize(SerializationReader *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // TREE_SITTER_REGEX_H_
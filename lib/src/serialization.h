@@ -0,0 +1,122 @@
+#ifndef TREE_SITTER_SERIALIZATION_H_
+#define TREE_SITTER_SERIALIZATION_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "./array.h"
+#include "./length.h"
+
+// Helpers for reading and writing the binary formats that are used to persist
+// the library's data structures. Integers are written as variable-length
+// quantities, seven bits at a time, with the least significant bits first.
+// Signed integers are zigzag-encoded so that small negative numbers are short.
+
+typedef Array(char) SerializationBuffer;
+
+typedef struct {
+  const uint8_t *cursor;
+  const uint8_t *end;
+} SerializationReader;
+
+static inline void ts_serialization_write_uint(SerializationBuffer *self, uint32_t value) {
+  while (value >= 0x80) {
+    array_push(self, (char)(value | 0x80));
+    value >>= 7;
+  }
+  array_push(self, (char)value);
+}
+
+static inline void ts_serialization_write_int(SerializationBuffer *self, int32_t value) {
+  ts_serialization_write_uint(self, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+}
+
+static inline void ts_serialization_write_bytes(
+  SerializationBuffer *self,
+  const char *bytes,
+  uint32_t length
+) {
+  array_extend(self, length, bytes);
+}
+
+// Lengths that do not span any rows usually have as many columns as bytes, so
+// in that case, the column is omitted.
+static inline void ts_serialization_write_length(SerializationBuffer *self, Length length) {
+  bool has_column = length.extent.row > 0 || length.extent.column != length.bytes;
+  ts_serialization_write_uint(self, length.bytes);
+  ts_serialization_write_uint(self, length.extent.row << 1 | has_column);
+  if (has_column) ts_serialization_write_uint(self, length.extent.column);
+}
+
+static inline SerializationReader ts_serialization_reader_new(const void *data, uint32_t length) {
+  return (SerializationReader) {
+    .cursor = (const uint8_t *)data,
+    .end = (const uint8_t *)data + length,
+  };
+}
+
+static inline uint32_t ts_serialization_remaining(const SerializationReader *self) {
+  return (uint32_t)(self->end - self->cursor);
+}
+
+static inline bool ts_serialization_read_uint(SerializationReader *self, uint32_t *result) {
+  uint32_t value = 0;
+  for (unsigned shift = 0; shift < 35; shift += 7) {
+    if (self->cursor == self->end) return false;
+    uint8_t byte = *self->cursor++;
+    if (shift == 28 && byte > 0x0f) return false;
+    value |= (uint32_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      *result = value;
+      return true;
+    }
+  }
+  return false;
+}
+
+static inline bool ts_serialization_read_uint16(SerializationReader *self, uint16_t *result) {
+  uint32_t value;
+  if (!ts_serialization_read_uint(self, &value) || value > UINT16_MAX) return false;
+  *result = (uint16_t)value;
+  return true;
+}
+
+static inline bool ts_serialization_read_int(SerializationReader *self, int32_t *result) {
+  uint32_t value;
+  if (!ts_serialization_read_uint(self, &value)) return false;
+  *result = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+  return true;
+}
+
+static inline bool ts_serialization_read_bytes(
+  SerializationReader *self,
+  uint32_t length,
+  const char **result
+) {
+  if (ts_serialization_remaining(self) < length) return false;
+  *result = (const char *)self->cursor;
+  self->cursor += length;
+  return true;
+}
+
+static inline bool ts_serialization_read_length(SerializationReader *self, Length *result) {
+  uint32_t row;
+  if (
+    !ts_serialization_read_uint(self, &result->bytes) ||
+    !ts_serialization_read_uint(self, &row)
+  ) return false;
+  result->extent.row = row >> 1;
+  if (row & 1) return ts_serialization_read_uint(self, &result->extent.column);
+  result->extent.column = result->bytes;
+  return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // TREE_SITTER_SERIALIZATION_H_
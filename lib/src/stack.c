@@ -45,6 +45,13 @@ typedef struct {
 
 typedef Array(StackNode *) StackNodeArray;
 
+// Unused nodes are kept for reuse, and the memory used by the stack's live
+// nodes is counted, so that the parser can limit it.
+typedef struct {
+  StackNodeArray free_nodes;
+  size_t allocated_bytes;
+} StackNodePool;
+
 typedef enum {
   StackStatusActive,
   StackStatusPaused,
@@ -64,7 +71,7 @@ struct Stack {
   Array(StackHead) heads;
   StackSliceArray slices;
   Array(StackIterator) iterators;
-  StackNodeArray node_pool;
+  StackNodePool node_pool;
   StackNode *base_node;
   SubtreePool *subtree_pool;
 };
@@ -88,7 +95,7 @@ static void stack_node_retain(StackNode *self) {
 
 static void stack_node_release(
   StackNode *self,
-  StackNodeArray *pool,
+  StackNodePool *pool,
   SubtreePool *subtree_pool
 ) {
 recur:
@@ -108,8 +115,9 @@ recur:
     first_predecessor = self->links[0].node;
   }
 
-  if (pool->size < MAX_NODE_POOL_SIZE) {
-    array_push(pool, self);
+  pool->allocated_bytes -= sizeof(StackNode);
+  if (pool->free_nodes.size < MAX_NODE_POOL_SIZE) {
+    array_push(&pool->free_nodes, self);
   } else {
     ts_free(self);
   }
@@ -120,16 +128,20 @@ recur:
   }
 }
 
+static StackNode *stack_node_pool_allocate(StackNodePool *pool) {
+  pool->allocated_bytes += sizeof(StackNode);
+  if (pool->free_nodes.size > 0) return array_pop(&pool->free_nodes);
+  return ts_malloc(sizeof(StackNode));
+}
+
 static StackNode *stack_node_new(
   StackNode *previous_node,
   Subtree subtree,
   bool is_pending,
   TSStateId state,
-  StackNodeArray *pool
+  StackNodePool *pool
 ) {
-  StackNode *node = pool->size > 0
-    ? array_pop(pool)
-    : ts_malloc(sizeof(StackNode));
+  StackNode *node = stack_node_pool_allocate(pool);
   *node = (StackNode) {
     .ref_count = 1,
     .link_count = 0,
@@ -249,7 +261,7 @@ static void stack_node_add_link(
 
 static void stack_head_delete(
   StackHead *self,
-  StackNodeArray *pool,
+  StackNodePool *pool,
   SubtreePool *subtree_pool
 ) {
   if (self->node) {
@@ -408,11 +420,12 @@ Stack *ts_stack_new(SubtreePool *subtree_pool) {
   array_init(&self->heads);
   array_init(&self->slices);
   array_init(&self->iterators);
-  array_init(&self->node_pool);
+  array_init(&self->node_pool.free_nodes);
+  self->node_pool.allocated_bytes = 0;
   array_reserve(&self->heads, 4);
   array_reserve(&self->slices, 4);
   array_reserve(&self->iterators, 4);
-  array_reserve(&self->node_pool, MAX_NODE_POOL_SIZE);
+  array_reserve(&self->node_pool.free_nodes, MAX_NODE_POOL_SIZE);
 
   self->subtree_pool = subtree_pool;
   self->base_node = stack_node_new(NULL, NULL_SUBTREE, false, 1, &self->node_pool);
@@ -431,15 +444,19 @@ void ts_stack_delete(Stack *self) {
     stack_head_delete(&self->heads.contents[i], &self->node_pool, self->subtree_pool);
   }
   array_clear(&self->heads);
-  if (self->node_pool.contents) {
-    for (uint32_t i = 0; i < self->node_pool.size; i++)
-      ts_free(self->node_pool.contents[i]);
-    array_delete(&self->node_pool);
+  if (self->node_pool.free_nodes.contents) {
+    for (uint32_t i = 0; i < self->node_pool.free_nodes.size; i++)
+      ts_free(self->node_pool.free_nodes.contents[i]);
+    array_delete(&self->node_pool.free_nodes);
   }
   array_delete(&self->heads);
   ts_free(self);
 }
 
+size_t ts_stack_allocated_bytes(const Stack *self) {
+  return self->node_pool.allocated_bytes;
+}
+
 uint32_t ts_stack_version_count(const Stack *self) {
   return self->heads.size;
 }
@@ -456,6 +473,34 @@ Subtree ts_stack_last_external_token(const Stack *self, StackVersion version) {
   return array_get(&self->heads, version)->last_external_token;
 }
 
+static StackLink *ts_stack__bottom_link(const Stack *self, StackVersion version) {
+  StackNode *node = array_get(&self->heads, version)->node;
+  StackLink *link = NULL;
+  while (node->link_count == 1) {
+    link = &node->links[0];
+    node = link->node;
+  }
+  if (node->link_count > 0 || !link || link->is_pending || !link->subtree.ptr) return NULL;
+  return link;
+}
+
+Subtree ts_stack_bottom_subtree(const Stack *self, StackVersion version) {
+  StackLink *link = ts_stack__bottom_link(self, version);
+  return link ? link->subtree : NULL_SUBTREE;
+}
+
+void ts_stack_replace_bottom_subtree(Stack *self, StackVersion version, Subtree subtree) {
+  StackLink *link = ts_stack__bottom_link(self, version);
+  assert(link);
+  StackNode *base = link->node;
+  base->node_count += ts_subtree_node_count(link->subtree);
+  base->node_count -= ts_subtree_node_count(subtree);
+  base->dynamic_precedence += ts_subtree_dynamic_precedence(link->subtree);
+  base->dynamic_precedence -= ts_subtree_dynamic_precedence(subtree);
+  ts_subtree_release(self->subtree_pool, link->subtree);
+  link->subtree = subtree;
+}
+
 void ts_stack_set_last_external_token(Stack *self, StackVersion version, Subtree token) {
   StackHead *head = array_get(&self->heads, version);
   if (token.ptr) ts_subtree_retain(token);
@@ -735,6 +780,8 @@ Subtree ts_stack_resume(Stack *self, StackVersion version) {
 }
 
 void ts_stack_clear(Stack *self) {
+  self->base_node->node_count = 0;
+  self->base_node->dynamic_precedence = 0;
   stack_node_retain(self->base_node);
   for (uint32_t i = 0; i < self->heads.size; i++) {
     stack_head_delete(&self->heads.contents[i], &self->node_pool, self->subtree_pool);
@@ -748,6 +795,144 @@ void ts_stack_clear(Stack *self) {
   }));
 }
 
+typedef struct {
+  StackNode *original;
+  StackNode *copy;
+} StackNodeCopy;
+
+// A hash table that maps the nodes of another stack that are shared between
+// several paths to their copies, so that they are only copied once.
+typedef struct {
+  StackNodeCopy *entries;
+  uint32_t capacity;
+  uint32_t size;
+} StackNodeCopyMap;
+
+typedef Array(struct { StackNode **slot; StackNode *original; }) StackNodeCopyWorklist;
+
+inline uint32_t stack_node_copy_map__bucket(const StackNodeCopyMap *self, const StackNode *node) {
+  uint64_t hash = (uintptr_t)node * 0x9e3779b97f4a7c15ull;
+  return (uint32_t)(hash >> 32) & (self->capacity - 1);
+}
+
+static StackNode *stack_node_copy_map_get(const StackNodeCopyMap *self, const StackNode *original) {
+  if (self->size == 0) return NULL;
+  for (uint32_t i = stack_node_copy_map__bucket(self, original);; i = (i + 1) & (self->capacity - 1)) {
+    StackNodeCopy *entry = &self->entries[i];
+    if (!entry->original) return NULL;
+    if (entry->original == original) return entry->copy;
+  }
+}
+
+static void stack_node_copy_map_insert(StackNodeCopyMap *self, StackNode *original, StackNode *copy) {
+  // Keep the table at most half full, so that probe sequences stay short.
+  if (2 * (self->size + 1) > self->capacity) {
+    StackNodeCopyMap grown = {
+      .entries = ts_calloc(self->capacity ? self->capacity * 2 : 16, sizeof(StackNodeCopy)),
+      .capacity = self->capacity ? self->capacity * 2 : 16,
+      .size = 0,
+    };
+    for (uint32_t i = 0; i < self->capacity; i++) {
+      StackNodeCopy *entry = &self->entries[i];
+      if (entry->original) stack_node_copy_map_insert(&grown, entry->original, entry->copy);
+    }
+    ts_free(self->entries);
+    *self = grown;
+  }
+
+  uint32_t i = stack_node_copy_map__bucket(self, original);
+  while (self->entries[i].original) i = (i + 1) & (self->capacity - 1);
+  self->entries[i] = (StackNodeCopy) {original, copy};
+  self->size++;
+}
+
+// Copy the nodes that are reachable from the given node of another stack,
+// and store the copy of the given node in `result`. The nodes are visited
+// using an explicit worklist, because the stack can be arbitrarily deep.
+static void stack__copy_nodes(
+  Stack *self,
+  Stack *other,
+  StackNode **result,
+  StackNode *original,
+  StackNodeCopyMap *copied_nodes,
+  StackNodeCopyWorklist *worklist
+) {
+  array_clear(worklist);
+  array_grow_by(worklist, 1);
+  array_back(worklist)->slot = result;
+  array_back(worklist)->original = original;
+  while (worklist->size > 0) {
+    StackNode **slot = array_back(worklist)->slot;
+    StackNode *node = array_back(worklist)->original;
+    worklist->size--;
+
+    if (node->link_count == 0) {
+      stack_node_retain(self->base_node);
+      *slot = self->base_node;
+      continue;
+    }
+
+    if (node->ref_count > 1) {
+      StackNode *copy = stack_node_copy_map_get(copied_nodes, node);
+      if (copy) {
+        stack_node_retain(copy);
+        *slot = copy;
+        continue;
+      }
+    }
+
+    StackNode *copy = stack_node_pool_allocate(&self->node_pool);
+    *copy = *node;
+    copy->ref_count = 1;
+    *slot = copy;
+    if (node->ref_count > 1) stack_node_copy_map_insert(copied_nodes, node, copy);
+
+    for (unsigned i = 0; i < copy->link_count; i++) {
+      StackLink *link = &copy->links[i];
+      if (link->subtree.ptr) {
+        ts_subtree_retain(link->subtree);
+        ts_subtree_uncount(other->subtree_pool, link->subtree);
+      }
+      array_grow_by(worklist, 1);
+      array_back(worklist)->slot = &link->node;
+      array_back(worklist)->original = link->node;
+    }
+  }
+}
+
+void ts_stack_assign(Stack *self, Stack *other) {
+  for (uint32_t i = 0; i < self->heads.size; i++) {
+    stack_head_delete(&self->heads.contents[i], &self->node_pool, self->subtree_pool);
+  }
+  array_clear(&self->heads);
+  self->base_node->node_count = other->base_node->node_count;
+  self->base_node->dynamic_precedence = other->base_node->dynamic_precedence;
+
+  StackNodeCopyMap copied_nodes = {NULL, 0, 0};
+  StackNodeCopyWorklist worklist = array_new();
+  for (uint32_t i = 0; i < other->heads.size; i++) {
+    StackHead head = other->heads.contents[i];
+    stack__copy_nodes(self, other, &head.node, head.node, &copied_nodes, &worklist);
+    if (head.last_external_token.ptr) {
+      ts_subtree_retain(head.last_external_token);
+      ts_subtree_uncount(other->subtree_pool, head.last_external_token);
+    }
+    if (head.lookahead_when_paused.ptr) {
+      ts_subtree_retain(head.lookahead_when_paused);
+      ts_subtree_uncount(other->subtree_pool, head.lookahead_when_paused);
+    }
+    if (head.summary) {
+      StackSummary *summary = ts_malloc(sizeof(StackSummary));
+      array_init(summary);
+      array_push_all(summary, head.summary);
+      head.summary = summary;
+    }
+    array_push(&self->heads, head);
+  }
+  array_delete(&worklist);
+  ts_free(copied_nodes.entries);
+}
+
 bool ts_stack_print_dot_graph(Stack *self, const TSLanguage *language, FILE *f) {
   array_reserve(&self->iterators, 32);
   if (!f) f = stderr;
@@ -34,6 +34,9 @@ Stack *ts_stack_new(SubtreePool *);
 // Release the memory reserved for a given stack.
 void ts_stack_delete(Stack *);
 
+// Get the number of bytes used by the stack's live nodes.
+size_t ts_stack_allocated_bytes(const Stack *);
+
 // Get the stack's current number of versions.
 uint32_t ts_stack_version_count(const Stack *);
 
@@ -50,6 +53,19 @@ void ts_stack_set_last_external_token(Stack *, StackVersion, Subtree );
 // Get the position of the given version of the stack within the document.
 Length ts_stack_position(const Stack *, StackVersion);
 
+// Get the tree that is directly above the base of the given version of the
+// stack. This returns NULL_SUBTREE if there is more than one path from the
+// top of the stack to its base, or if the tree is pending.
+Subtree ts_stack_bottom_subtree(const Stack *, StackVersion);
+
+// Replace the tree that is directly above the base of the given version of
+// the stack with another tree that spans the same text. The node count and
+// dynamic precedence of the replaced tree are transferred to the base of the
+// stack, so that versions of the stack are compared in the same way as before.
+//
+// This transfers ownership of the new tree to the Stack.
+void ts_stack_replace_bottom_subtree(Stack *, StackVersion, Subtree);
+
 // Push a tree and state onto the given version of the stack.
 //
 // This transfers ownership of the tree to the Stack. Callers that
@@ -122,6 +138,11 @@ void ts_stack_remove_version(Stack *, StackVersion);
 
 void ts_stack_clear(Stack *);
 
+// Replace the contents of the stack with a copy of all of the versions
+// of another stack. The subtrees are shared between the two stacks, so
+// they are no longer counted by the other stack's subtree pool.
+void ts_stack_assign(Stack *, Stack *);
+
 bool ts_stack_print_dot_graph(Stack *, const TSLanguage *, FILE *);
 
 typedef void (*StackIterateCallback)(void *, TSStateId, uint32_t);
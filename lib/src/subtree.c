@@ -21,6 +21,32 @@ typedef struct {
 #define TS_MAX_INLINE_TREE_LENGTH UINT8_MAX
 #define TS_MAX_TREE_POOL_SIZE 32
 
+// Reference counts are updated atomically, so that copies of a tree can be
+// used on different threads. Embedders that only ever use trees on a single
+// thread can define `TS_NON_ATOMIC_REFCOUNTS` to use plain arithmetic instead,
+// which makes node reuse and tree deletion cheaper.
+#ifdef TS_NON_ATOMIC_REFCOUNTS
+
+static inline uint32_t ts_subtree__ref_inc(volatile uint32_t *ref_count) {
+  return ++*ref_count;
+}
+
+static inline uint32_t ts_subtree__ref_dec(volatile uint32_t *ref_count) {
+  return --*ref_count;
+}
+
+#else
+
+static inline uint32_t ts_subtree__ref_inc(volatile uint32_t *ref_count) {
+  return atomic_inc(ref_count);
+}
+
+static inline uint32_t ts_subtree__ref_dec(volatile uint32_t *ref_count) {
+  return atomic_dec(ref_count);
+}
+
+#endif
+
 // ExternalScannerState
 
 void ts_external_scanner_state_init(ExternalScannerState *self, const char *data, unsigned length) {
@@ -48,6 +74,11 @@ void ts_external_scanner_state_delete(ExternalScannerState *self) {
   }
 }
 
+// The number of bytes that are allocated separately for a long state.
+size_t ts_external_scanner_state_heap_bytes(const ExternalScannerState *self) {
+  return self->length > sizeof(self->short_data) ? self->length : 0;
+}
+
 const char *ts_external_scanner_state_data(const ExternalScannerState *self) {
   if (self->length > sizeof(self->short_data)) {
     return self->long_data;
@@ -118,7 +149,7 @@ void ts_subtree_array_reverse(SubtreeArray *self) {
 // SubtreePool
 
 SubtreePool ts_subtree_pool_new(uint32_t capacity) {
-  SubtreePool self = {array_new(), array_new()};
+  SubtreePool self = {array_new(), array_new(), 0, false};
   array_reserve(&self.free_trees, capacity);
   return self;
 }
@@ -151,14 +182,85 @@ static void ts_subtree_pool_free(SubtreePool *self, SubtreeHeapData *tree) {
 
 // Subtree
 
-static inline bool ts_subtree_can_inline(Length padding, Length size, uint32_t lookahead_bytes) {
-  return
+// The number of bytes used by a heap-allocated subtree, including its array
+// of children, its overflow record, and its external scanner state.
+static size_t ts_subtree__allocated_bytes(Subtree self) {
+  size_t result = ts_subtree_alloc_size(self.ptr->child_count);
+  if (self.ptr->has_overflow) result += sizeof(SubtreeOverflowData);
+  if (self.ptr->child_count == 0 && self.ptr->has_external_tokens) {
+    result += ts_external_scanner_state_heap_bytes(&self.ptr->external_scanner_state);
+  }
+  return result;
+}
+
+// Start counting a subtree's bytes, if the pool counts them and the subtree
+// isn't counted already.
+static inline void ts_subtree__count(SubtreePool *pool, MutableSubtree self) {
+  if (pool && pool->is_counting && !self.ptr->is_counted) {
+    self.ptr->is_counted = true;
+    pool->allocated_bytes += ts_subtree__allocated_bytes(ts_subtree_from_mut(self));
+  }
+}
+
+// Stop counting a subtree's bytes, if they are counted.
+static inline void ts_subtree__discount(SubtreePool *pool, MutableSubtree self) {
+  if (self.ptr->is_counted) {
+    self.ptr->is_counted = false;
+    pool->allocated_bytes -= ts_subtree__allocated_bytes(ts_subtree_from_mut(self));
+  }
+}
+
+// Store a leaf's symbol and sizes in its inline representation, using the
+// narrow encoding if they fit, and the wide encoding otherwise. Returns false,
+// leaving the subtree unchanged, if they fit in neither encoding.
+static inline bool ts_subtree_set_inline_sizes(
+  SubtreeInlineData *self,
+  TSSymbol symbol,
+  Length padding,
+  Length size,
+  uint32_t lookahead_bytes
+) {
+  if (size.extent.row > 0) return false;
+
+  if (
+    symbol <= UINT8_MAX &&
     padding.bytes < TS_MAX_INLINE_TREE_LENGTH &&
     padding.extent.row < 16 &&
     padding.extent.column < TS_MAX_INLINE_TREE_LENGTH &&
-    size.extent.row == 0 &&
     size.extent.column < TS_MAX_INLINE_TREE_LENGTH &&
-    lookahead_bytes < 16;
+    lookahead_bytes < 16
+  ) {
+    self->is_wide = false;
+    self->symbol = symbol;
+    self->padding_bytes = padding.bytes;
+    self->padding_rows = padding.extent.row;
+    self->padding_columns = padding.extent.column;
+    self->size_bytes = size.bytes;
+    self->lookahead_bytes = lookahead_bytes;
+    return true;
+  }
+
+  if (
+    padding.bytes >= padding.extent.column &&
+    padding.bytes - padding.extent.column < 16 &&
+    padding.extent.row < 4 &&
+    padding.extent.column < 64 &&
+    size.bytes < 1024 &&
+    size.extent.column == size.bytes &&
+    lookahead_bytes < 4
+  ) {
+    self->is_wide = true;
+    self->symbol = symbol & UINT8_MAX;
+    self->symbol_high = symbol >> 8;
+    self->wide_padding_extra_bytes = padding.bytes - padding.extent.column;
+    self->wide_padding_rows = padding.extent.row;
+    self->wide_padding_columns = padding.extent.column;
+    self->wide_size_bytes = size.bytes;
+    self->wide_lookahead_bytes = lookahead_bytes;
+    return true;
+  }
+
+  return false;
 }
 
 Subtree ts_subtree_new_leaf(
@@ -170,37 +272,29 @@ Subtree ts_subtree_new_leaf(
   TSSymbolMetadata metadata = ts_language_symbol_metadata(language, symbol);
   bool extra = symbol == ts_builtin_sym_end;
 
+  Subtree result = {{
+    .parse_state = parse_state,
+    .visible = metadata.visible,
+    .named = metadata.named,
+    .extra = extra,
+    .has_changes = false,
+    .is_missing = false,
+    .is_keyword = is_keyword,
+    .is_inline = true,
+  }};
+
   bool is_inline = (
-    symbol <= UINT8_MAX &&
+    symbol != ts_builtin_sym_error &&
     !has_external_tokens &&
-    ts_subtree_can_inline(padding, size, lookahead_bytes)
+    ts_subtree_set_inline_sizes(&result.data, symbol, padding, size, lookahead_bytes)
   );
 
   if (is_inline) {
-    return (Subtree) {{
-      .parse_state = parse_state,
-      .symbol = symbol,
-      .padding_bytes = padding.bytes,
-      .padding_rows = padding.extent.row,
-      .padding_columns = padding.extent.column,
-      .size_bytes = size.bytes,
-      .lookahead_bytes = lookahead_bytes,
-      .visible = metadata.visible,
-      .named = metadata.named,
-      .extra = extra,
-      .has_changes = false,
-      .is_missing = false,
-      .is_keyword = is_keyword,
-      .is_inline = true,
-    }};
+    return result;
   } else {
     SubtreeHeapData *data = ts_subtree_pool_allocate(pool);
     *data = (SubtreeHeapData) {
       .ref_count = 1,
-      .padding = padding,
-      .size = size,
-      .lookahead_bytes = lookahead_bytes,
-      .error_cost = 0,
       .child_count = 0,
       .symbol = symbol,
       .parse_state = parse_state,
@@ -215,28 +309,130 @@ Subtree ts_subtree_new_leaf(
       .depends_on_column = depends_on_column,
       .is_missing = false,
       .is_keyword = is_keyword,
+      .has_overflow = false,
+      .is_counted = false,
       {{.first_leaf = {.symbol = 0, .parse_state = 0}}}
     };
-    return (Subtree) {.ptr = data};
+    MutableSubtree result = {.ptr = data};
+    ts_subtree_set_sizes(pool, result, padding, size, lookahead_bytes, 0);
+    ts_subtree__count(pool, result);
+    return ts_subtree_from_mut(result);
   }
 }
 
+// Set the sizes of a heap-allocated subtree. The pool is only used if the
+// subtree is counted, to count the bytes of its overflow record.
+void ts_subtree_set_sizes(
+  SubtreePool *pool,
+  MutableSubtree self,
+  Length padding,
+  Length size,
+  uint32_t lookahead_bytes,
+  uint32_t error_cost
+) {
+  assert(!self.data.is_inline);
+  self.ptr->size_bytes = size.bytes;
+  if (
+    padding.bytes <= UINT16_MAX &&
+    padding.extent.row <= UINT16_MAX &&
+    padding.extent.column <= UINT16_MAX &&
+    size.extent.row <= UINT16_MAX &&
+    size.extent.column <= UINT16_MAX &&
+    lookahead_bytes <= UINT16_MAX &&
+    error_cost <= UINT16_MAX
+  ) {
+    if (self.ptr->has_overflow) {
+      ts_free(self.ptr->overflow);
+      self.ptr->has_overflow = false;
+      if (self.ptr->is_counted) pool->allocated_bytes -= sizeof(SubtreeOverflowData);
+    }
+    self.ptr->padding_bytes = padding.bytes;
+    self.ptr->padding_rows = padding.extent.row;
+    self.ptr->padding_columns = padding.extent.column;
+    self.ptr->size_rows = size.extent.row;
+    self.ptr->size_columns = size.extent.column;
+    self.ptr->lookahead_bytes = lookahead_bytes;
+    self.ptr->error_cost = error_cost;
+  } else {
+    if (!self.ptr->has_overflow) {
+      self.ptr->overflow = ts_malloc(sizeof(SubtreeOverflowData));
+      self.ptr->has_overflow = true;
+      if (self.ptr->is_counted) pool->allocated_bytes += sizeof(SubtreeOverflowData);
+    }
+    *self.ptr->overflow = (SubtreeOverflowData) {
+      .padding = padding,
+      .size_extent = size.extent,
+      .lookahead_bytes = lookahead_bytes,
+      .error_cost = error_cost,
+    };
+  }
+}
+
+// Get the error cost that is stored on a heap-allocated subtree, which is
+// ignored by `ts_subtree_error_cost` for missing subtrees.
+static inline uint32_t ts_subtree__stored_error_cost(Subtree self) {
+  if (self.data.is_inline) return 0;
+  return self.ptr->has_overflow ? self.ptr->overflow->error_cost : self.ptr->error_cost;
+}
+
+// Copy an inline leaf into a new heap-allocated subtree, with the given symbol
+// and sizes, for when they no longer fit in the inline representation.
+static MutableSubtree ts_subtree__new_heap_leaf(
+  SubtreePool *pool,
+  SubtreeInlineData leaf,
+  TSSymbol symbol,
+  Length padding,
+  Length size,
+  uint32_t lookahead_bytes
+) {
+  SubtreeHeapData *data = ts_subtree_pool_allocate(pool);
+  data->ref_count = 1;
+  data->has_overflow = false;
+  data->is_counted = false;
+  data->child_count = 0;
+  data->symbol = symbol;
+  data->parse_state = leaf.parse_state;
+  data->visible = leaf.visible;
+  data->named = leaf.named;
+  data->extra = leaf.extra;
+  data->fragile_left = false;
+  data->fragile_right = false;
+  data->has_changes = leaf.has_changes;
+  data->has_external_tokens = false;
+  data->has_external_scanner_state_change = false;
+  data->depends_on_column = false;
+  data->is_missing = leaf.is_missing;
+  data->is_keyword = leaf.is_keyword;
+  MutableSubtree result = {.ptr = data};
+  ts_subtree_set_sizes(pool, result, padding, size, lookahead_bytes, 0);
+  ts_subtree__count(pool, result);
+  return result;
+}
+
 void ts_subtree_set_symbol(
+  SubtreePool *pool,
   MutableSubtree *self,
   TSSymbol symbol,
   const TSLanguage *language
 ) {
   TSSymbolMetadata metadata = ts_language_symbol_metadata(language, symbol);
   if (self->data.is_inline) {
-    assert(symbol < UINT8_MAX);
-    self->data.symbol = symbol;
-    self->data.named = metadata.named;
-    self->data.visible = metadata.visible;
-  } else {
-    self->ptr->symbol = symbol;
-    self->ptr->named = metadata.named;
-    self->ptr->visible = metadata.visible;
+    // A symbol above 255 can only be stored inline using the wide encoding,
+    // which may not have room for the leaf's sizes.
+    Subtree tree = ts_subtree_from_mut(*self);
+    Length padding = ts_subtree_padding(tree);
+    Length size = ts_subtree_size(tree);
+    uint32_t lookahead_bytes = ts_subtree_lookahead_bytes(tree);
+    if (ts_subtree_set_inline_sizes(&self->data, symbol, padding, size, lookahead_bytes)) {
+      self->data.named = metadata.named;
+      self->data.visible = metadata.visible;
+      return;
+    }
+    *self = ts_subtree__new_heap_leaf(pool, self->data, symbol, padding, size, lookahead_bytes);
   }
+  self->ptr->symbol = symbol;
+  self->ptr->named = metadata.named;
+  self->ptr->visible = metadata.visible;
 }
 
 Subtree ts_subtree_new_error(
@@ -270,7 +466,12 @@ MutableSubtree ts_subtree_clone(Subtree self) {
       &self.ptr->external_scanner_state
     );
   }
+  if (self.ptr->has_overflow) {
+    result->overflow = ts_malloc(sizeof(SubtreeOverflowData));
+    *result->overflow = *self.ptr->overflow;
+  }
   result->ref_count = 1;
+  result->is_counted = false;
   return (MutableSubtree) {.ptr = result};
 }
 
@@ -283,11 +484,46 @@ MutableSubtree ts_subtree_make_mut(SubtreePool *pool, Subtree self) {
   if (self.data.is_inline) return (MutableSubtree) {self.data};
   if (self.ptr->ref_count == 1) return ts_subtree_to_mut_unsafe(self);
   MutableSubtree result = ts_subtree_clone(self);
+  ts_subtree__count(pool, result);
   ts_subtree_release(pool, self);
   return result;
 }
 
+// Copy a leaf's external scanner state onto it, counting the state's bytes if
+// the leaf is counted.
+void ts_subtree_set_external_scanner_state(
+  SubtreePool *pool,
+  MutableSubtree self,
+  const char *data,
+  unsigned length
+) {
+  ts_external_scanner_state_init(&self.ptr->external_scanner_state, data, length);
+  if (self.ptr->is_counted) {
+    pool->allocated_bytes += ts_external_scanner_state_heap_bytes(&self.ptr->external_scanner_state);
+  }
+}
+
+// Stop counting the bytes of a subtree and of all its counted descendants,
+// because they are now owned by something other than the pool's parse, such
+// as a finished tree.
+void ts_subtree_uncount(SubtreePool *pool, Subtree self) {
+  if (self.data.is_inline || !self.ptr->is_counted) return;
+  array_clear(&pool->tree_stack);
+  array_push(&pool->tree_stack, ts_subtree_to_mut_unsafe(self));
+  while (pool->tree_stack.size > 0) {
+    MutableSubtree tree = array_pop(&pool->tree_stack);
+    ts_subtree__discount(pool, tree);
+    for (uint32_t i = 0; i < tree.ptr->child_count; i++) {
+      Subtree child = ts_subtree_children(tree)[i];
+      if (!child.data.is_inline && child.ptr->is_counted) {
+        array_push(&pool->tree_stack, ts_subtree_to_mut_unsafe(child));
+      }
+    }
+  }
+}
+
 static void ts_subtree__compress(
+  SubtreePool *pool,
   MutableSubtree self,
   unsigned count,
   const TSLanguage *language,
@@ -327,12 +563,15 @@ static void ts_subtree__compress(
     tree = array_pop(stack);
     MutableSubtree child = ts_subtree_to_mut_unsafe(ts_subtree_children(tree)[0]);
     MutableSubtree grandchild = ts_subtree_to_mut_unsafe(ts_subtree_children(child)[child.ptr->child_count - 1]);
-    ts_subtree_summarize_children(grandchild, language);
-    ts_subtree_summarize_children(child, language);
-    ts_subtree_summarize_children(tree, language);
+    ts_subtree_summarize_children(pool, grandchild, language);
+    ts_subtree_summarize_children(pool, child, language);
+    ts_subtree_summarize_children(pool, tree, language);
   }
 }
 
+// Balance the repetitions within a subtree. The nodes that this can change
+// are owned only by the subtree, so they are counted by the pool, which keeps
+// any counted nodes that they are given from being hidden beneath them.
 void ts_subtree_balance(Subtree self, SubtreePool *pool, const TSLanguage *language) {
   array_clear(&pool->tree_stack);
 
@@ -342,6 +581,7 @@ void ts_subtree_balance(Subtree self, SubtreePool *pool, const TSLanguage *langu
 
   while (pool->tree_stack.size > 0) {
     MutableSubtree tree = array_pop(&pool->tree_stack);
+    ts_subtree__count(pool, tree);
 
     if (tree.ptr->repeat_depth > 0) {
       Subtree child1 = ts_subtree_children(tree)[0];
@@ -350,7 +590,7 @@ void ts_subtree_balance(Subtree self, SubtreePool *pool, const TSLanguage *langu
       if (repeat_delta > 0) {
         unsigned n = (unsigned)repeat_delta;
         for (unsigned i = n / 2; i > 0; i /= 2) {
-          ts_subtree__compress(tree, i, language, &pool->tree_stack);
+          ts_subtree__compress(pool, tree, i, language, &pool->tree_stack);
           n -= i;
         }
       }
@@ -367,6 +607,7 @@ void ts_subtree_balance(Subtree self, SubtreePool *pool, const TSLanguage *langu
 
 // Assign all of the node's properties that depend on its children.
 void ts_subtree_summarize_children(
+  SubtreePool *pool,
   MutableSubtree self,
   const TSLanguage *language
 ) {
@@ -374,7 +615,6 @@ void ts_subtree_summarize_children(
 
   self.ptr->named_child_count = 0;
   self.ptr->visible_child_count = 0;
-  self.ptr->error_cost = 0;
   self.ptr->repeat_depth = 0;
   self.ptr->node_count = 1;
   self.ptr->has_external_tokens = false;
@@ -385,13 +625,16 @@ void ts_subtree_summarize_children(
   uint32_t structural_index = 0;
   const TSSymbol *alias_sequence = ts_language_alias_sequence(language, self.ptr->production_id);
   uint32_t lookahead_end_byte = 0;
+  uint32_t error_cost = 0;
+  Length padding = ts_subtree_padding(ts_subtree_from_mut(self));
+  Length size = ts_subtree_size(ts_subtree_from_mut(self));
 
   const Subtree *children = ts_subtree_children(self);
   for (uint32_t i = 0; i < self.ptr->child_count; i++) {
     Subtree child = children[i];
 
     if (
-      self.ptr->size.extent.row == 0 &&
+      size.extent.row == 0 &&
       ts_subtree_depends_on_column(child)
     ) {
       self.ptr->depends_on_column = true;
@@ -402,22 +645,22 @@ void ts_subtree_summarize_children(
     }
 
     if (i == 0) {
-      self.ptr->padding = ts_subtree_padding(child);
-      self.ptr->size = ts_subtree_size(child);
+      padding = ts_subtree_padding(child);
+      size = ts_subtree_size(child);
     } else {
-      self.ptr->size = length_add(self.ptr->size, ts_subtree_total_size(child));
+      size = length_add(size, ts_subtree_total_size(child));
     }
 
     uint32_t child_lookahead_end_byte =
-      self.ptr->padding.bytes +
-      self.ptr->size.bytes +
+      padding.bytes +
+      size.bytes +
       ts_subtree_lookahead_bytes(child);
     if (child_lookahead_end_byte > lookahead_end_byte) {
       lookahead_end_byte = child_lookahead_end_byte;
     }
 
     if (ts_subtree_symbol(child) != ts_builtin_sym_error_repeat) {
-      self.ptr->error_cost += ts_subtree_error_cost(child);
+      error_cost += ts_subtree_error_cost(child);
     }
 
     uint32_t grandchild_count = ts_subtree_child_count(child);
@@ -427,9 +670,9 @@ void ts_subtree_summarize_children(
     ) {
       if (!ts_subtree_extra(child) && !(ts_subtree_is_error(child) && grandchild_count == 0)) {
         if (ts_subtree_visible(child)) {
-          self.ptr->error_cost += ERROR_COST_PER_SKIPPED_TREE;
+          error_cost += ERROR_COST_PER_SKIPPED_TREE;
         } else if (grandchild_count > 0) {
-          self.ptr->error_cost += ERROR_COST_PER_SKIPPED_TREE * child.ptr->visible_child_count;
+          error_cost += ERROR_COST_PER_SKIPPED_TREE * child.ptr->visible_child_count;
         }
       }
     }
@@ -460,18 +703,25 @@ void ts_subtree_summarize_children(
     if (!ts_subtree_extra(child)) structural_index++;
   }
 
-  self.ptr->lookahead_bytes = lookahead_end_byte - self.ptr->size.bytes - self.ptr->padding.bytes;
-
   if (
     self.ptr->symbol == ts_builtin_sym_error ||
     self.ptr->symbol == ts_builtin_sym_error_repeat
   ) {
-    self.ptr->error_cost +=
+    error_cost +=
       ERROR_COST_PER_RECOVERY +
-      ERROR_COST_PER_SKIPPED_CHAR * self.ptr->size.bytes +
-      ERROR_COST_PER_SKIPPED_LINE * self.ptr->size.extent.row;
+      ERROR_COST_PER_SKIPPED_CHAR * size.bytes +
+      ERROR_COST_PER_SKIPPED_LINE * size.extent.row;
   }
 
+  ts_subtree_set_sizes(
+    pool,
+    self,
+    padding,
+    size,
+    lookahead_end_byte - size.bytes - padding.bytes,
+    error_cost
+  );
+
   if (self.ptr->child_count > 0) {
     Subtree first_child = children[0];
     Subtree last_child = children[self.ptr->child_count - 1];
@@ -499,8 +749,10 @@ void ts_subtree_summarize_children(
 
 // Create a new parent node with the given children.
 //
-// This takes ownership of the children array.
+// This takes ownership of the children array. The pool may be NULL for a
+// temporary node that will never be released.
 MutableSubtree ts_subtree_new_node(
+  SubtreePool *pool,
   TSSymbol symbol,
   SubtreeArray *children,
   unsigned production_id,
@@ -528,6 +780,8 @@ MutableSubtree ts_subtree_new_node(
     .fragile_left = fragile,
     .fragile_right = fragile,
     .is_keyword = false,
+    .has_overflow = false,
+    .is_counted = false,
     {{
       .node_count = 0,
       .production_id = production_id,
@@ -535,7 +789,8 @@ MutableSubtree ts_subtree_new_node(
     }}
   };
   MutableSubtree result = {.ptr = data};
-  ts_subtree_summarize_children(result, language);
+  ts_subtree_summarize_children(pool, result, language);
+  ts_subtree__count(pool, result);
   return result;
 }
 
@@ -544,12 +799,13 @@ MutableSubtree ts_subtree_new_node(
 // This node is treated as 'extra'. Its children are prevented from having
 // having any effect on the parse state.
 Subtree ts_subtree_new_error_node(
+  SubtreePool *pool,
   SubtreeArray *children,
   bool extra,
   const TSLanguage *language
 ) {
   MutableSubtree result = ts_subtree_new_node(
-    ts_builtin_sym_error, children, 0, language
+    pool, ts_builtin_sym_error, children, 0, language
   );
   result.ptr->extra = extra;
   return ts_subtree_from_mut(result);
@@ -581,39 +837,56 @@ Subtree ts_subtree_new_missing_leaf(
 void ts_subtree_retain(Subtree self) {
   if (self.data.is_inline) return;
   assert(self.ptr->ref_count > 0);
-  atomic_inc((volatile uint32_t *)&self.ptr->ref_count);
+  ts_subtree__ref_inc((volatile uint32_t *)&self.ptr->ref_count);
   assert(self.ptr->ref_count != 0);
 }
 
 void ts_subtree_release(SubtreePool *pool, Subtree self) {
   if (self.data.is_inline) return;
   array_clear(&pool->tree_stack);
+  ts_subtree_release_deferred(pool, self);
+  ts_subtree_pool_free_released(pool, UINT32_MAX);
+}
 
+// Release a subtree without freeing any memory. If this was the last
+// reference to the subtree, it is pushed onto the pool's stack, so that it
+// can be freed later by `ts_subtree_pool_free_released`.
+void ts_subtree_release_deferred(SubtreePool *pool, Subtree self) {
+  if (self.data.is_inline) return;
   assert(self.ptr->ref_count > 0);
-  if (atomic_dec((volatile uint32_t *)&self.ptr->ref_count) == 0) {
+  if (ts_subtree__ref_dec((volatile uint32_t *)&self.ptr->ref_count) == 0) {
     array_push(&pool->tree_stack, ts_subtree_to_mut_unsafe(self));
   }
+}
 
-  while (pool->tree_stack.size > 0) {
+// Free at most `max_count` of the subtrees on the pool's stack, releasing
+// their children and pushing any that are no longer referenced. Returns true
+// if there are no subtrees left to free.
+bool ts_subtree_pool_free_released(SubtreePool *pool, uint32_t max_count) {
+  for (uint32_t count = 0; count < max_count && pool->tree_stack.size > 0; count++) {
     MutableSubtree tree = array_pop(&pool->tree_stack);
+    ts_subtree__discount(pool, tree);
     if (tree.ptr->child_count > 0) {
       Subtree *children = ts_subtree_children(tree);
       for (uint32_t i = 0; i < tree.ptr->child_count; i++) {
         Subtree child = children[i];
         if (child.data.is_inline) continue;
         assert(child.ptr->ref_count > 0);
-        if (atomic_dec((volatile uint32_t *)&child.ptr->ref_count) == 0) {
+        if (ts_subtree__ref_dec((volatile uint32_t *)&child.ptr->ref_count) == 0) {
           array_push(&pool->tree_stack, ts_subtree_to_mut_unsafe(child));
         }
       }
+      if (tree.ptr->has_overflow) ts_free(tree.ptr->overflow);
       ts_free(children);
     } else {
       if (tree.ptr->has_external_tokens) {
         ts_external_scanner_state_delete(&tree.ptr->external_scanner_state);
       }
+      if (tree.ptr->has_overflow) ts_free(tree.ptr->overflow);
       ts_subtree_pool_free(pool, tree.ptr);
     }
   }
+  return pool->tree_stack.size == 0;
 }
 
 int ts_subtree_compare(Subtree left, Subtree right) {
@@ -642,161 +915,514 @@ static inline void ts_subtree_set_has_changes(MutableSubtree *self) {
 }
 
 Subtree ts_subtree_edit(Subtree self, const TSInputEdit *edit, SubtreePool *pool) {
+  return ts_subtree_edit_batch(self, edit, 1, pool);
+}
+
+// Apply a set of edits to a subtree in a single traversal.
+//
+// The edits must be sorted by their start position and must not overlap. Each
+// edit is expressed in terms of the subtree's coordinates *before* any of the
+// edits are applied, so the result is the same as applying them one at a time,
+// from last to first. Every affected node is only copied once.
+Subtree ts_subtree_edit_batch(
+  Subtree self,
+  const TSInputEdit *input_edits,
+  uint32_t edit_count,
+  SubtreePool *pool
+) {
   typedef struct {
     Subtree *tree;
-    Edit edit;
+    uint32_t edit_index;
+    uint32_t edit_count;
   } StackEntry;
 
-  Array(StackEntry) stack = array_new();
-  array_push(&stack, ((StackEntry) {
-    .tree = &self,
-    .edit = (Edit) {
+  // The edits for every queued subtree are stored contiguously in this array,
+  // transformed into that subtree's coordinate space.
+  Array(Edit) edits = array_new();
+  array_reserve(&edits, edit_count);
+  for (uint32_t i = 0; i < edit_count; i++) {
+    const TSInputEdit *edit = &input_edits[i];
+    array_push(&edits, ((Edit) {
       .start = {edit->start_byte, edit->start_point},
       .old_end = {edit->old_end_byte, edit->old_end_point},
       .new_end = {edit->new_end_byte, edit->new_end_point},
-    },
+    }));
+  }
+
+  Array(StackEntry) stack = array_new();
+  array_push(&stack, ((StackEntry) {
+    .tree = &self,
+    .edit_index = 0,
+    .edit_count = edit_count,
   }));
 
   while (stack.size) {
     StackEntry entry = array_pop(&stack);
-    Edit edit = entry.edit;
-    bool is_noop = edit.old_end.bytes == edit.start.bytes && edit.new_end.bytes == edit.start.bytes;
-    bool is_pure_insertion = edit.old_end.bytes == edit.start.bytes;
     bool invalidate_first_row = ts_subtree_depends_on_column(*entry.tree);
 
     Length size = ts_subtree_size(*entry.tree);
     Length padding = ts_subtree_padding(*entry.tree);
-    Length total_size = length_add(padding, size);
     uint32_t lookahead_bytes = ts_subtree_lookahead_bytes(*entry.tree);
-    uint32_t end_byte = total_size.bytes + lookahead_bytes;
-    if (edit.start.bytes > end_byte || (is_noop && edit.start.bytes == end_byte)) continue;
+    bool is_affected = false;
+
+    // Resize the subtree according to each edit, starting with the last one, so that
+    // the positions of the earlier edits remain valid.
+    for (uint32_t i = entry.edit_count; i > 0; i--) {
+      Edit edit = edits.contents[entry.edit_index + i - 1];
+      bool is_noop = edit.old_end.bytes == edit.start.bytes && edit.new_end.bytes == edit.start.bytes;
+      bool is_pure_insertion = edit.old_end.bytes == edit.start.bytes;
+      Length total_size = length_add(padding, size);
+      uint32_t end_byte = total_size.bytes + lookahead_bytes;
+      if (edit.start.bytes > end_byte || (is_noop && edit.start.bytes == end_byte)) continue;
+      is_affected = true;
+
+      // If the edit is entirely within the space before this subtree, then shift this
+      // subtree over according to the edit without changing its size.
+      if (edit.old_end.bytes <= padding.bytes) {
+        padding = length_add(edit.new_end, length_sub(padding, edit.old_end));
+      }
 
-    // If the edit is entirely within the space before this subtree, then shift this
-    // subtree over according to the edit without changing its size.
-    if (edit.old_end.bytes <= padding.bytes) {
-      padding = length_add(edit.new_end, length_sub(padding, edit.old_end));
-    }
+      // If the edit starts in the space before this subtree and extends into this subtree,
+      // shrink the subtree's content to compensate for the change in the space before it.
+      else if (edit.start.bytes < padding.bytes) {
+        size = length_saturating_sub(size, length_sub(edit.old_end, padding));
+        padding = edit.new_end;
+      }
 
-    // If the edit starts in the space before this subtree and extends into this subtree,
-    // shrink the subtree's content to compensate for the change in the space before it.
-    else if (edit.start.bytes < padding.bytes) {
-      size = length_saturating_sub(size, length_sub(edit.old_end, padding));
-      padding = edit.new_end;
-    }
+      // If the edit is a pure insertion right at the start of the subtree,
+      // shift the subtree over according to the insertion.
+      else if (edit.start.bytes == padding.bytes && is_pure_insertion) {
+        padding = edit.new_end;
+      }
 
-    // If the edit is a pure insertion right at the start of the subtree,
-    // shift the subtree over according to the insertion.
-    else if (edit.start.bytes == padding.bytes && is_pure_insertion) {
-      padding = edit.new_end;
+      // If the edit is within this subtree, resize the subtree to reflect the edit.
+      else if (
+        edit.start.bytes < total_size.bytes ||
+        (edit.start.bytes == total_size.bytes && is_pure_insertion)
+      ) {
+        size = length_add(
+          length_sub(edit.new_end, padding),
+          length_saturating_sub(total_size, edit.old_end)
+        );
+      }
     }
 
-    // If the edit is within this subtree, resize the subtree to reflect the edit.
-    else if (
-      edit.start.bytes < total_size.bytes ||
-      (edit.start.bytes == total_size.bytes && is_pure_insertion)
-    ) {
-      size = length_add(
-        length_sub(edit.new_end, padding),
-        length_saturating_sub(total_size, edit.old_end)
-      );
-    }
+    if (!is_affected) continue;
 
     MutableSubtree result = ts_subtree_make_mut(pool, *entry.tree);
 
     if (result.data.is_inline) {
-      if (ts_subtree_can_inline(padding, size, lookahead_bytes)) {
-        result.data.padding_bytes = padding.bytes;
-        result.data.padding_rows = padding.extent.row;
-        result.data.padding_columns = padding.extent.column;
-        result.data.size_bytes = size.bytes;
-      } else {
-        SubtreeHeapData *data = ts_subtree_pool_allocate(pool);
-        data->ref_count = 1;
-        data->padding = padding;
-        data->size = size;
-        data->lookahead_bytes = lookahead_bytes;
-        data->error_cost = 0;
-        data->child_count = 0;
-        data->symbol = result.data.symbol;
-        data->parse_state = result.data.parse_state;
-        data->visible = result.data.visible;
-        data->named = result.data.named;
-        data->extra = result.data.extra;
-        data->fragile_left = false;
-        data->fragile_right = false;
-        data->has_changes = false;
-        data->has_external_tokens = false;
-        data->depends_on_column = false;
-        data->is_missing = result.data.is_missing;
-        data->is_keyword = result.data.is_keyword;
-        result.ptr = data;
+      TSSymbol symbol = ts_subtree_inline_symbol(result.data);
+      if (!ts_subtree_set_inline_sizes(&result.data, symbol, padding, size, lookahead_bytes)) {
+        result = ts_subtree__new_heap_leaf(pool, result.data, symbol, padding, size, lookahead_bytes);
       }
     } else {
-      result.ptr->padding = padding;
-      result.ptr->size = size;
+      ts_subtree_set_sizes(
+        pool,
+        result,
+        padding,
+        size,
+        lookahead_bytes,
+        ts_subtree__stored_error_cost(ts_subtree_from_mut(result))
+      );
     }
 
     ts_subtree_set_has_changes(&result);
     *entry.tree = ts_subtree_from_mut(result);
 
+    // Distribute the edits among the children. Because the edits are sorted and do not
+    // overlap, once an edit is finished with one child, it is finished with all of the
+    // following children as well.
+    uint32_t first_edit_index = entry.edit_index;
+    uint32_t end_edit_index = entry.edit_index + entry.edit_count;
     Length child_left, child_right = length_zero();
     for (uint32_t i = 0, n = ts_subtree_child_count(*entry.tree); i < n; i++) {
+      if (first_edit_index == end_edit_index) break;
+
       Subtree *child = &ts_subtree_children(*entry.tree)[i];
       Length child_size = ts_subtree_total_size(*child);
       child_left = child_right;
       child_right = length_add(child_left, child_size);
 
-      // If this child ends before the edit, it is not affected.
-      if (child_right.bytes + ts_subtree_lookahead_bytes(*child) < edit.start.bytes) continue;
-
-      // Keep editing child nodes until a node is reached that starts after the edit.
-      // Also, if this node's validity depends on its column position, then continue
-      // invaliditing child nodes until reaching a line break.
-      if ((
-        (child_left.bytes > edit.old_end.bytes) ||
-        (child_left.bytes == edit.old_end.bytes && child_size.bytes > 0 && i > 0)
-      ) && (
-        !invalidate_first_row ||
-        child_left.extent.row > entry.tree->ptr->padding.extent.row
-      )) {
-        break;
-      }
+      uint32_t child_edit_index = edits.size;
+      for (uint32_t j = first_edit_index; j < end_edit_index; j++) {
+        Edit edit = edits.contents[j];
+        bool is_pure_insertion = edit.old_end.bytes == edit.start.bytes;
+
+        // If this child ends before the edit, it is not affected by this edit or any
+        // of the following ones.
+        if (child_right.bytes + ts_subtree_lookahead_bytes(*child) < edit.start.bytes) break;
+
+        // Keep editing child nodes until a node is reached that starts after the edit.
+        // Also, if this node's validity depends on its column position, then continue
+        // invaliditing child nodes until reaching a line break.
+        if ((
+          (child_left.bytes > edit.old_end.bytes) ||
+          (child_left.bytes == edit.old_end.bytes && child_size.bytes > 0 && i > 0)
+        ) && (
+          !invalidate_first_row ||
+          child_left.extent.row > ts_subtree_padding(*entry.tree).extent.row
+        )) {
+          first_edit_index = j + 1;
+          continue;
+        }
 
-      // Transform edit into the child's coordinate space.
-      Edit child_edit = {
-        .start = length_saturating_sub(edit.start, child_left),
-        .old_end = length_saturating_sub(edit.old_end, child_left),
-        .new_end = length_saturating_sub(edit.new_end, child_left),
-      };
+        // Transform edit into the child's coordinate space.
+        Edit child_edit = {
+          .start = length_saturating_sub(edit.start, child_left),
+          .old_end = length_saturating_sub(edit.old_end, child_left),
+          .new_end = length_saturating_sub(edit.new_end, child_left),
+        };
+
+        // Interpret all inserted text as applying to the *first* child that touches the edit.
+        // Subsequent children are only never have any text inserted into them; they are only
+        // shrunk to compensate for the edit.
+        if (
+          child_right.bytes > edit.start.bytes ||
+          (child_right.bytes == edit.start.bytes && is_pure_insertion)
+        ) {
+          edits.contents[j].new_end = edit.start;
+        }
 
-      // Interpret all inserted text as applying to the *first* child that touches the edit.
-      // Subsequent children are only never have any text inserted into them; they are only
-      // shrunk to compensate for the edit.
-      if (
-        child_right.bytes > edit.start.bytes ||
-        (child_right.bytes == edit.start.bytes && is_pure_insertion)
-      ) {
-        edit.new_end = edit.start;
-      }
+        // Children that occur before the edit are not reshaped by the edit.
+        else {
+          child_edit.old_end = child_edit.start;
+          child_edit.new_end = child_edit.start;
+        }
 
-      // Children that occur before the edit are not reshaped by the edit.
-      else {
-        child_edit.old_end = child_edit.start;
-        child_edit.new_end = child_edit.start;
+        array_push(&edits, child_edit);
       }
 
       // Queue processing of this child's subtree.
-      array_push(&stack, ((StackEntry) {
-        .tree = child,
-        .edit = child_edit,
-      }));
+      if (edits.size > child_edit_index) {
+        array_push(&stack, ((StackEntry) {
+          .tree = child,
+          .edit_index = child_edit_index,
+          .edit_count = edits.size - child_edit_index,
+        }));
+      }
     }
   }
 
+  array_delete(&edits);
   array_delete(&stack);
   return self;
 }
 
+// Subtree - Serialization
+//
+// Subtrees are written in pre-order. Each one starts with its symbol, its
+// child count, any flags, its parse state and its error cost, if any.
+// Leaves are followed by their sizes and any error or external scanner data,
+// while the sizes of parent nodes are recomputed from their children when
+// they are read. Non-terminals are written as parent nodes even when they
+// have no children, so that they are rebuilt with their node-level data.
+
+typedef enum {
+  SerializedSubtreeFlagExtra = 1 << 0,
+  SerializedSubtreeFlagFragileLeft = 1 << 1,
+  SerializedSubtreeFlagFragileRight = 1 << 2,
+  SerializedSubtreeFlagHasChanges = 1 << 3,
+  SerializedSubtreeFlagHasExternalTokens = 1 << 4,
+  SerializedSubtreeFlagHasExternalScannerStateChange = 1 << 5,
+  SerializedSubtreeFlagDependsOnColumn = 1 << 6,
+  SerializedSubtreeFlagIsMissing = 1 << 7,
+  SerializedSubtreeFlagIsKeyword = 1 << 8,
+  SerializedSubtreeFlagHasErrorCost = 1 << 9,
+  SerializedSubtreeFlagHasDynamicPrecedence = 1 << 10,
+} SerializedSubtreeFlag;
+
+typedef struct {
+  TSSymbol symbol;
+  TSStateId parse_state;
+  uint16_t production_id;
+  uint32_t flags;
+  uint32_t child_count;
+  int32_t dynamic_precedence;
+  uint32_t error_cost;
+  uint32_t children_start;
+} SubtreeDeserializationFrame;
+
+static inline bool ts_subtree__is_serialized_as_node(
+  TSSymbol symbol,
+  uint32_t child_count,
+  const TSLanguage *language
+) {
+  return child_count > 0 || (symbol >= language->token_count && symbol != ts_builtin_sym_error);
+}
+
+void ts_subtree_serialize(Subtree self, SerializationBuffer *buffer, const TSLanguage *language) {
+  SubtreeArray stack = array_new();
+  array_push(&stack, self);
+  while (stack.size > 0) {
+    Subtree tree = array_pop(&stack);
+    uint32_t child_count = ts_subtree_child_count(tree);
+
+    uint32_t flags = 0;
+    if (ts_subtree_extra(tree)) flags |= SerializedSubtreeFlagExtra;
+    if (ts_subtree_fragile_left(tree)) flags |= SerializedSubtreeFlagFragileLeft;
+    if (ts_subtree_fragile_right(tree)) flags |= SerializedSubtreeFlagFragileRight;
+    if (ts_subtree_has_changes(tree)) flags |= SerializedSubtreeFlagHasChanges;
+    if (ts_subtree_has_external_tokens(tree)) flags |= SerializedSubtreeFlagHasExternalTokens;
+    if (ts_subtree_has_external_scanner_state_change(tree)) {
+      flags |= SerializedSubtreeFlagHasExternalScannerStateChange;
+    }
+    if (ts_subtree_depends_on_column(tree)) flags |= SerializedSubtreeFlagDependsOnColumn;
+    if (ts_subtree_missing(tree)) flags |= SerializedSubtreeFlagIsMissing;
+    if (ts_subtree_is_keyword(tree)) flags |= SerializedSubtreeFlagIsKeyword;
+    if (ts_subtree__stored_error_cost(tree) > 0) flags |= SerializedSubtreeFlagHasErrorCost;
+    if (ts_subtree_dynamic_precedence(tree) != 0) flags |= SerializedSubtreeFlagHasDynamicPrecedence;
+
+    // Most subtrees have no flags, so the flags are only written if the lowest
+    // bit of the child count is set.
+    ts_serialization_write_uint(buffer, ts_subtree_symbol(tree));
+    ts_serialization_write_uint(buffer, child_count << 1 | (flags != 0));
+    if (flags) ts_serialization_write_uint(buffer, flags);
+    ts_serialization_write_uint(buffer, ts_subtree_parse_state(tree));
+    if (flags & SerializedSubtreeFlagHasErrorCost) {
+      ts_serialization_write_uint(buffer, ts_subtree__stored_error_cost(tree));
+    }
+
+    if (ts_subtree__is_serialized_as_node(ts_subtree_symbol(tree), child_count, language)) {
+      ts_serialization_write_uint(buffer, tree.ptr->production_id);
+      if (flags & SerializedSubtreeFlagHasDynamicPrecedence) {
+        ts_serialization_write_int(buffer, tree.ptr->dynamic_precedence);
+      }
+      for (uint32_t i = child_count; i > 0; i--) {
+        array_push(&stack, ts_subtree_children(tree)[i - 1]);
+      }
+    } else {
+      ts_serialization_write_length(buffer, ts_subtree_padding(tree));
+      ts_serialization_write_length(buffer, ts_subtree_size(tree));
+      ts_serialization_write_uint(buffer, ts_subtree_lookahead_bytes(tree));
+      if (ts_subtree_is_error(tree)) {
+        ts_serialization_write_int(buffer, tree.ptr->lookahead_char);
+      } else if (flags & SerializedSubtreeFlagHasExternalTokens) {
+        const ExternalScannerState *state = &tree.ptr->external_scanner_state;
+        ts_serialization_write_uint(buffer, state->length);
+        ts_serialization_write_bytes(buffer, ts_external_scanner_state_data(state), state->length);
+      }
+    }
+  }
+  array_delete(&stack);
+}
+
+static Subtree ts_subtree__deserialize_leaf(
+  SerializationReader *reader,
+  SubtreePool *pool,
+  const TSLanguage *language,
+  TSSymbol symbol,
+  TSStateId parse_state,
+  uint32_t flags,
+  uint32_t error_cost
+) {
+  Length padding, size;
+  uint32_t lookahead_bytes;
+  if (
+    !ts_serialization_read_length(reader, &padding) ||
+    !ts_serialization_read_length(reader, &size) ||
+    !ts_serialization_read_uint(reader, &lookahead_bytes)
+  ) return NULL_SUBTREE;
+
+  int32_t lookahead_char = 0;
+  uint32_t state_length = 0;
+  const char *state_data = NULL;
+  bool has_external_tokens = flags & SerializedSubtreeFlagHasExternalTokens;
+  if (symbol == ts_builtin_sym_error) {
+    if (!ts_serialization_read_int(reader, &lookahead_char)) return NULL_SUBTREE;
+  } else if (has_external_tokens) {
+    if (
+      !ts_serialization_read_uint(reader, &state_length) ||
+      !ts_serialization_read_bytes(reader, state_length, &state_data)
+    ) return NULL_SUBTREE;
+  }
+
+  MutableSubtree mutable = ts_subtree_to_mut_unsafe(ts_subtree_new_leaf(
+    pool, symbol, padding, size, lookahead_bytes, parse_state,
+    has_external_tokens,
+    flags & SerializedSubtreeFlagDependsOnColumn,
+    flags & SerializedSubtreeFlagIsKeyword,
+    language
+  ));
+  if (mutable.data.is_inline) {
+    mutable.data.extra = flags & SerializedSubtreeFlagExtra;
+    mutable.data.has_changes = flags & SerializedSubtreeFlagHasChanges;
+    mutable.data.is_missing = flags & SerializedSubtreeFlagIsMissing;
+  } else {
+    mutable.ptr->extra = flags & SerializedSubtreeFlagExtra;
+    mutable.ptr->fragile_left = flags & SerializedSubtreeFlagFragileLeft;
+    mutable.ptr->fragile_right = flags & SerializedSubtreeFlagFragileRight;
+    mutable.ptr->has_changes = flags & SerializedSubtreeFlagHasChanges;
+    mutable.ptr->has_external_scanner_state_change =
+      flags & SerializedSubtreeFlagHasExternalScannerStateChange;
+    mutable.ptr->is_missing = flags & SerializedSubtreeFlagIsMissing;
+    ts_subtree_set_error_cost(pool, mutable, error_cost);
+    if (symbol == ts_builtin_sym_error) {
+      mutable.ptr->lookahead_char = lookahead_char;
+    } else if (has_external_tokens) {
+      ts_external_scanner_state_init(&mutable.ptr->external_scanner_state, state_data, state_length);
+    }
+  }
+  return ts_subtree_from_mut(mutable);
+}
+
+Subtree ts_subtree_deserialize(
+  SerializationReader *reader,
+  SubtreePool *pool,
+  const TSLanguage *language
+) {
+  Array(SubtreeDeserializationFrame) frames = array_new();
+  SubtreeArray children = array_new();
+  Subtree result = NULL_SUBTREE;
+
+  for (;;) {
+    uint32_t symbol, child_count, flags = 0, parse_state;
+    if (
+      !ts_serialization_read_uint(reader, &symbol) ||
+      !ts_serialization_read_uint(reader, &child_count) ||
+      ((child_count & 1) && !ts_serialization_read_uint(reader, &flags)) ||
+      !ts_serialization_read_uint(reader, &parse_state)
+    ) break;
+    child_count >>= 1;
+    if (
+      symbol >= language->symbol_count &&
+      symbol != ts_builtin_sym_error &&
+      symbol != ts_builtin_sym_error_repeat
+    ) break;
+    if (parse_state >= language->state_count && parse_state != TS_TREE_STATE_NONE) break;
+    uint32_t error_cost = 0;
+    if (
+      (flags & SerializedSubtreeFlagHasErrorCost) &&
+      !ts_serialization_read_uint(reader, &error_cost)
+    ) break;
+
+    // Parent nodes are built once all of their children have been read.
+    Subtree tree = NULL_SUBTREE;
+    if (ts_subtree__is_serialized_as_node(symbol, child_count, language)) {
+      uint32_t production_id;
+      int32_t dynamic_precedence = 0;
+      if (
+        !ts_serialization_read_uint(reader, &production_id) ||
+        ((flags & SerializedSubtreeFlagHasDynamicPrecedence) &&
+         !ts_serialization_read_int(reader, &dynamic_precedence))
+      ) break;
+      if (production_id > 0 && production_id >= language->production_id_count) break;
+      if (child_count > ts_serialization_remaining(reader)) break;
+      array_push(&frames, ((SubtreeDeserializationFrame) {
+        .symbol = symbol,
+        .parse_state = parse_state,
+        .production_id = production_id,
+        .flags = flags,
+        .child_count = child_count,
+        .dynamic_precedence = dynamic_precedence,
+        .error_cost = error_cost,
+        .children_start = children.size,
+      }));
+      if (child_count > 0) continue;
+    } else {
+      tree = ts_subtree__deserialize_leaf(
+        reader, pool, language, symbol, parse_state, flags, error_cost
+      );
+      if (!tree.ptr) break;
+    }
+
+    // Build each parent node whose last child has been read.
+    bool is_valid = true;
+    while (frames.size > 0) {
+      if (tree.ptr) {
+        array_push(&children, tree);
+        tree = NULL_SUBTREE;
+      }
+      SubtreeDeserializationFrame frame = *array_back(&frames);
+      if (children.size - frame.children_start < frame.child_count) break;
+
+      // Each child's alias is looked up using its index among the non-extra
+      // children, so that index must be within the production's alias sequence.
+      if (frame.production_id > 0) {
+        uint32_t structural_index = 0;
+        for (uint32_t i = frame.children_start; i < children.size; i++) {
+          if (structural_index >= language->max_alias_sequence_length) is_valid = false;
+          if (!ts_subtree_extra(children.contents[i])) structural_index++;
+        }
+        if (!is_valid) break;
+      }
+
+      SubtreeArray node_children = array_new();
+      array_extend(&node_children, frame.child_count, &children.contents[frame.children_start]);
+      children.size = frame.children_start;
+      frames.size--;
+
+      MutableSubtree node = ts_subtree_new_node(pool, frame.symbol, &node_children, frame.production_id, language);
+      node.ptr->parse_state = frame.parse_state;
+      node.ptr->dynamic_precedence = frame.dynamic_precedence;
+      ts_subtree_set_error_cost(pool, node, frame.error_cost);
+      node.ptr->extra = frame.flags & SerializedSubtreeFlagExtra;
+      node.ptr->fragile_left = frame.flags & SerializedSubtreeFlagFragileLeft;
+      node.ptr->fragile_right = frame.flags & SerializedSubtreeFlagFragileRight;
+      node.ptr->has_changes = frame.flags & SerializedSubtreeFlagHasChanges;
+      node.ptr->is_keyword = frame.flags & SerializedSubtreeFlagIsKeyword;
+      tree = ts_subtree_from_mut(node);
+    }
+    if (!is_valid) break;
+
+    if (frames.size == 0) {
+      result = tree;
+      break;
+    }
+  }
+
+  for (uint32_t i = 0; i < children.size; i++) {
+    ts_subtree_release(pool, children.contents[i]);
+  }
+  array_delete(&children);
+  array_delete(&frames);
+  return result;
+}
+
+// Measure the memory used by a subtree. Once a node is found that is
+// referenced from elsewhere, everything beneath it is counted as shared.
+void ts_subtree_memory_usage(Subtree self, TSTreeMemoryUsage *usage) {
+  typedef struct {
+    Subtree tree;
+    bool is_shared;
+  } MemoryUsageEntry;
+
+  Array(MemoryUsageEntry) stack = array_new();
+  array_push(&stack, ((MemoryUsageEntry) {self, false}));
+  while (stack.size > 0) {
+    MemoryUsageEntry entry = array_pop(&stack);
+    Subtree tree = entry.tree;
+    if (tree.data.is_inline) {
+      usage->inline_leaf_count++;
+      continue;
+    }
+
+    size_t child_array_bytes = tree.ptr->child_count * sizeof(Subtree);
+    size_t external_scanner_state_bytes = 0;
+    if (tree.ptr->child_count == 0 && tree.ptr->has_external_tokens) {
+      external_scanner_state_bytes = ts_external_scanner_state_heap_bytes(&tree.ptr->external_scanner_state);
+    }
+
+    size_t heap_node_bytes = sizeof(SubtreeHeapData);
+    if (tree.ptr->has_overflow) heap_node_bytes += sizeof(SubtreeOverflowData);
+
+    bool is_shared = entry.is_shared || tree.ptr->ref_count > 1;
+    usage->heap_node_count++;
+    usage->heap_node_bytes += heap_node_bytes;
+    usage->child_array_bytes += child_array_bytes;
+    usage->external_scanner_state_bytes += external_scanner_state_bytes;
+    if (is_shared) {
+      usage->shared_bytes +=
+        heap_node_bytes + child_array_bytes + external_scanner_state_bytes;
+    }
+
+    for (uint32_t i = 0; i < tree.ptr->child_count; i++) {
+      array_push(&stack, ((MemoryUsageEntry) {ts_subtree_children(tree)[i], is_shared}));
+    }
+  }
+  array_delete(&stack);
+}
+
 Subtree ts_subtree_last_external_token(Subtree tree) {
   if (!ts_subtree_has_external_tokens(tree)) return NULL_SUBTREE;
   while (tree.ptr->child_count > 0) {
@@ -857,7 +1483,7 @@ static size_t ts_subtree__write_to_string(
       }
     }
 
-    if (ts_subtree_is_error(self) && ts_subtree_child_count(self) == 0 && self.ptr->size.bytes > 0) {
+    if (ts_subtree_is_error(self) && ts_subtree_child_count(self) == 0 && self.ptr->size_bytes > 0) {
       cursor += snprintf(*writer, limit, "(UNEXPECTED ");
       cursor += ts_subtree__write_char_to_string(*writer, limit, self.ptr->lookahead_char);
     } else {
@@ -12,6 +12,7 @@ extern "C" {
 #include "./array.h"
 #include "./error_costs.h"
 #include "./host.h"
+#include "./serialization.h"
 #include "tree_sitter/api.h"
 #include "tree_sitter/parser.h"
 
@@ -27,11 +28,15 @@ extern "C" {
 // restored using its `deserialize` function.
 //
 // Small byte arrays are stored inline, and long ones are allocated
-// separately on the heap.
+// separately on the heap. The inline capacity is chosen so that this
+// struct is no larger than the data of a parent node. States of 17 to 24
+// bytes, which used to be stored inline, now take a separate allocation,
+// but that allocation is no larger than the 24 bytes that every heap node
+// saves by this choice.
 typedef struct {
   union {
     char *long_data;
-    char short_data[24];
+    char short_data[16];
   };
   uint32_t length;
 } ExternalScannerState;
@@ -47,6 +52,14 @@ typedef struct {
 // Because of alignment, for any valid pointer this will be 0, giving
 // us the opportunity to make use of this bit to signify whether to use
 // the pointer or the inline struct.
+//
+// The sizes of an inline subtree are stored in one of two encodings. The
+// narrow encoding allows larger padding, while the wide encoding, which is
+// used when the `is_wide` bit is set, borrows eight bits from the sizes to
+// store the high byte of the symbol, and allows longer tokens. In the wide
+// encoding, the padding is stored as its extent plus the number of bytes
+// that are not counted in its final column, which is usually just the
+// length of its line endings.
 typedef struct SubtreeInlineData SubtreeInlineData;
 
 #define SUBTREE_BITS    \
@@ -57,12 +70,24 @@ typedef struct SubtreeInlineData SubtreeInlineData;
   bool is_missing : 1;  \
   bool is_keyword : 1;
 
-#define SUBTREE_SIZE           \
-  uint8_t padding_columns;     \
-  uint8_t padding_rows : 4;    \
-  uint8_t lookahead_bytes : 4; \
-  uint8_t padding_bytes;       \
-  uint8_t size_bytes;
+#define SUBTREE_SIZE                         \
+  union {                                    \
+    struct {                                 \
+      uint8_t padding_columns;               \
+      uint8_t padding_rows : 4;              \
+      uint8_t lookahead_bytes : 4;           \
+      uint8_t padding_bytes;                 \
+      uint8_t size_bytes;                    \
+    };                                       \
+    struct {                                 \
+      uint8_t symbol_high;                   \
+      uint8_t wide_padding_columns : 6;      \
+      uint8_t wide_lookahead_bytes : 2;      \
+      uint16_t wide_padding_rows : 2;        \
+      uint16_t wide_padding_extra_bytes : 4; \
+      uint16_t wide_size_bytes : 10;         \
+    };                                       \
+  };
 
 #if TS_BIG_ENDIAN
 #if TS_PTR_SIZE == 32
@@ -71,7 +96,7 @@ struct SubtreeInlineData {
   uint16_t parse_state;
   uint8_t symbol;
   SUBTREE_BITS
-  bool unused : 1;
+  bool is_wide : 1;
   bool is_inline : 1;
   SUBTREE_SIZE
 };
@@ -83,7 +108,7 @@ struct SubtreeInlineData {
   uint16_t parse_state;
   uint8_t symbol;
   SUBTREE_BITS
-  bool unused : 1;
+  bool is_wide : 1;
   bool is_inline : 1;
 };
 
@@ -93,6 +118,7 @@ struct SubtreeInlineData {
 struct SubtreeInlineData {
   bool is_inline : 1;
   SUBTREE_BITS
+  bool is_wide : 1;
   uint8_t symbol;
   uint16_t parse_state;
   SUBTREE_SIZE
@@ -103,21 +129,46 @@ struct SubtreeInlineData {
 #undef SUBTREE_BITS
 #undef SUBTREE_SIZE
 
+// The sizes of a heap-allocated subtree that are too large to be stored in
+// its compact fields.
+typedef struct {
+  Length padding;
+  TSPoint size_extent;
+  uint32_t lookahead_bytes;
+  uint32_t error_cost;
+} SubtreeOverflowData;
+
 // A heap-allocated representation of a subtree.
 //
 // This representation is used for parent nodes, external tokens,
 // errors, and other leaf nodes whose data is too large to fit into
 // the inline representation.
+//
+// Apart from the number of bytes in the subtree, its sizes and its error
+// cost almost always fit into sixteen bits. When any of them do not, they
+// are all stored in a separate `overflow` record, whose pointer occupies
+// the space of the compact fields. These fields should be accessed using
+// the functions below, and set using `ts_subtree_set_sizes`.
 typedef struct {
   volatile uint32_t ref_count;
-  Length padding;
-  Length size;
-  uint32_t lookahead_bytes;
-  uint32_t error_cost;
+  uint32_t size_bytes;
   uint32_t child_count;
   TSSymbol symbol;
   TSStateId parse_state;
 
+  union {
+    struct {
+      uint16_t padding_bytes;
+      uint16_t padding_rows;
+      uint16_t padding_columns;
+      uint16_t size_rows;
+    };
+    SubtreeOverflowData *overflow;
+  };
+  uint16_t size_columns;
+  uint16_t lookahead_bytes;
+  uint16_t error_cost;
+
   bool visible : 1;
   bool named : 1;
   bool extra : 1;
@@ -129,6 +180,8 @@ typedef struct {
   bool depends_on_column: 1;
   bool is_missing : 1;
   bool is_keyword : 1;
+  bool has_overflow : 1;
+  bool is_counted : 1;
 
   union {
     // Non-terminal subtrees (`child_count > 0`)
@@ -168,15 +221,28 @@ typedef union {
 typedef Array(Subtree) SubtreeArray;
 typedef Array(MutableSubtree) MutableSubtreeArray;
 
+// A subtree pool keeps a limited number of unused leaves for reuse, and a
+// stack for traversing subtrees without recursion.
+//
+// If `is_counting` is set, the pool also counts the bytes used by the subtrees
+// that it creates, including their overflow records and external scanner
+// states. These subtrees are marked with the `is_counted` bit, and only their
+// bytes are subtracted when they are freed, or when they are handed off with
+// `ts_subtree_uncount`. A counted subtree is never the descendant of one that
+// isn't counted, so that the counted nodes of a tree can be found without
+// visiting the rest of it.
 typedef struct {
   MutableSubtreeArray free_trees;
   MutableSubtreeArray tree_stack;
+  size_t allocated_bytes;
+  bool is_counting;
 } SubtreePool;
 
 void ts_external_scanner_state_init(ExternalScannerState *, const char *, unsigned);
 const char *ts_external_scanner_state_data(const ExternalScannerState *);
 bool ts_external_scanner_state_eq(const ExternalScannerState *a, const char *, unsigned);
 void ts_external_scanner_state_delete(ExternalScannerState *self);
+size_t ts_external_scanner_state_heap_bytes(const ExternalScannerState *self);
 
 void ts_subtree_array_copy(SubtreeArray, SubtreeArray *);
 void ts_subtree_array_clear(SubtreePool *, SubtreeArray *);
@@ -194,27 +260,43 @@ Subtree ts_subtree_new_leaf(
 Subtree ts_subtree_new_error(
   SubtreePool *, int32_t, Length, Length, uint32_t, TSStateId, const TSLanguage *
 );
-MutableSubtree ts_subtree_new_node(TSSymbol, SubtreeArray *, unsigned, const TSLanguage *);
-Subtree ts_subtree_new_error_node(SubtreeArray *, bool, const TSLanguage *);
+MutableSubtree ts_subtree_new_node(SubtreePool *, TSSymbol, SubtreeArray *, unsigned, const TSLanguage *);
+Subtree ts_subtree_new_error_node(SubtreePool *, SubtreeArray *, bool, const TSLanguage *);
 Subtree ts_subtree_new_missing_leaf(SubtreePool *, TSSymbol, Length, uint32_t, const TSLanguage *);
 MutableSubtree ts_subtree_make_mut(SubtreePool *, Subtree);
+void ts_subtree_set_external_scanner_state(SubtreePool *, MutableSubtree, const char *, unsigned);
+void ts_subtree_uncount(SubtreePool *, Subtree);
+void ts_subtree_set_sizes(SubtreePool *, MutableSubtree, Length, Length, uint32_t, uint32_t);
 void ts_subtree_retain(Subtree);
 void ts_subtree_release(SubtreePool *, Subtree);
+void ts_subtree_release_deferred(SubtreePool *, Subtree);
+bool ts_subtree_pool_free_released(SubtreePool *, uint32_t);
 int ts_subtree_compare(Subtree, Subtree);
-void ts_subtree_set_symbol(MutableSubtree *, TSSymbol, const TSLanguage *);
+void ts_subtree_set_symbol(SubtreePool *, MutableSubtree *, TSSymbol, const TSLanguage *);
 void ts_subtree_summarize(MutableSubtree, const Subtree *, uint32_t, const TSLanguage *);
-void ts_subtree_summarize_children(MutableSubtree, const TSLanguage *);
+void ts_subtree_summarize_children(SubtreePool *, MutableSubtree, const TSLanguage *);
 void ts_subtree_balance(Subtree, SubtreePool *, const TSLanguage *);
 Subtree ts_subtree_edit(Subtree, const TSInputEdit *edit, SubtreePool *);
+Subtree ts_subtree_edit_batch(Subtree, const TSInputEdit *edits, uint32_t edit_count, SubtreePool *);
 char *ts_subtree_string(Subtree, const TSLanguage *, bool include_all);
 void ts_subtree_print_dot_graph(Subtree, const TSLanguage *, FILE *);
 Subtree ts_subtree_last_external_token(Subtree);
+void ts_subtree_memory_usage(Subtree, TSTreeMemoryUsage *);
+void ts_subtree_serialize(Subtree, SerializationBuffer *, const TSLanguage *);
+Subtree ts_subtree_deserialize(SerializationReader *, SubtreePool *, const TSLanguage *);
 const ExternalScannerState *ts_subtree_external_scanner_state(Subtree self);
 bool ts_subtree_external_scanner_state_eq(Subtree, Subtree);
 
+static inline TSSymbol ts_subtree_inline_symbol(SubtreeInlineData self) {
+  return self.is_wide ? self.symbol | (self.symbol_high << 8) : self.symbol;
+}
+
+static inline TSSymbol ts_subtree_symbol(Subtree self) {
+  return self.data.is_inline ? ts_subtree_inline_symbol(self.data) : self.ptr->symbol;
+}
+
 #define SUBTREE_GET(self, name) (self.data.is_inline ? self.data.name : self.ptr->name)
 
-static inline TSSymbol ts_subtree_symbol(Subtree self) { return SUBTREE_GET(self, symbol); }
 static inline bool ts_subtree_visible(Subtree self) { return SUBTREE_GET(self, visible); }
 static inline bool ts_subtree_named(Subtree self) { return SUBTREE_GET(self, named); }
 static inline bool ts_subtree_extra(Subtree self) { return SUBTREE_GET(self, extra); }
@@ -222,7 +304,6 @@ static inline bool ts_subtree_has_changes(Subtree self) { return SUBTREE_GET(sel
 static inline bool ts_subtree_missing(Subtree self) { return SUBTREE_GET(self, is_missing); }
 static inline bool ts_subtree_is_keyword(Subtree self) { return SUBTREE_GET(self, is_keyword); }
 static inline TSStateId ts_subtree_parse_state(Subtree self) { return SUBTREE_GET(self, parse_state); }
-static inline uint32_t ts_subtree_lookahead_bytes(Subtree self) { return SUBTREE_GET(self, lookahead_bytes); }
 
 #undef SUBTREE_GET
 
@@ -246,7 +327,7 @@ static inline void ts_subtree_set_extra(MutableSubtree *self, bool is_extra) {
 }
 
 static inline TSSymbol ts_subtree_leaf_symbol(Subtree self) {
-  if (self.data.is_inline) return self.data.symbol;
+  if (self.data.is_inline) return ts_subtree_inline_symbol(self.data);
   if (self.ptr->child_count == 0) return self.ptr->symbol;
   return self.ptr->first_leaf.symbol;
 }
@@ -258,21 +339,43 @@ static inline TSStateId ts_subtree_leaf_parse_state(Subtree self) {
 }
 
 static inline Length ts_subtree_padding(Subtree self) {
-  if (self.data.is_inline) {
+  if (self.data.is_inline && self.data.is_wide) {
+    Length result = {
+      self.data.wide_padding_columns + self.data.wide_padding_extra_bytes,
+      {self.data.wide_padding_rows, self.data.wide_padding_columns}
+    };
+    return result;
+  } else if (self.data.is_inline) {
     Length result = {self.data.padding_bytes, {self.data.padding_rows, self.data.padding_columns}};
     return result;
+  } else if (self.ptr->has_overflow) {
+    return self.ptr->overflow->padding;
   } else {
-    return self.ptr->padding;
+    Length result = {self.ptr->padding_bytes, {self.ptr->padding_rows, self.ptr->padding_columns}};
+    return result;
   }
 }
 
 static inline Length ts_subtree_size(Subtree self) {
   if (self.data.is_inline) {
-    Length result = {self.data.size_bytes, {0, self.data.size_bytes}};
+    uint32_t bytes = self.data.is_wide ? self.data.wide_size_bytes : self.data.size_bytes;
+    Length result = {bytes, {0, bytes}};
+    return result;
+  } else if (self.ptr->has_overflow) {
+    Length result = {self.ptr->size_bytes, self.ptr->overflow->size_extent};
     return result;
   } else {
-    return self.ptr->size;
+    Length result = {self.ptr->size_bytes, {self.ptr->size_rows, self.ptr->size_columns}};
+    return result;
+  }
+}
+
+static inline uint32_t ts_subtree_lookahead_bytes(Subtree self) {
+  if (self.data.is_inline) {
+    return self.data.is_wide ? self.data.wide_lookahead_bytes : self.data.lookahead_bytes;
   }
+  if (self.ptr->has_overflow) return self.ptr->overflow->lookahead_bytes;
+  return self.ptr->lookahead_bytes;
 }
 
 static inline Length ts_subtree_total_size(Subtree self) {
@@ -313,7 +416,9 @@ static inline uint32_t ts_subtree_error_cost(Subtree self) {
   if (ts_subtree_missing(self)) {
     return ERROR_COST_PER_MISSING_TREE + ERROR_COST_PER_RECOVERY;
   } else {
-    return self.data.is_inline ? 0 : self.ptr->error_cost;
+    if (self.data.is_inline) return 0;
+    if (self.ptr->has_overflow) return self.ptr->overflow->error_cost;
+    return self.ptr->error_cost;
   }
 }
 
@@ -373,6 +478,18 @@ static inline MutableSubtree ts_subtree_to_mut_unsafe(Subtree self) {
   return result;
 }
 
+static inline void ts_subtree_set_error_cost(SubtreePool *pool, MutableSubtree self, uint32_t error_cost) {
+  Subtree tree = ts_subtree_from_mut(self);
+  ts_subtree_set_sizes(
+    pool,
+    self,
+    ts_subtree_padding(tree),
+    ts_subtree_size(tree),
+    ts_subtree_lookahead_bytes(tree),
+    error_cost
+  );
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,299 @@
+#include <assert.h>
+#include <stdlib.h>
+#include "./alloc.h"
+#include "./language.h"
+#include "./subtree_cache.h"
+
+static const uint32_t INITIAL_BUCKET_COUNT = 256;
+static const uint32_t BUCKETS_PER_ENTRY = 4;
+static const size_t DEFAULT_MEMORY_LIMIT = 64 * 1024 * 1024;
+
+static inline uint32_t ts_subtree_cache__bucket(
+  const TSSubtreeCache *self,
+  const TSLanguage *language,
+  TSStateId parse_state,
+  uint64_t prefix_hash
+) {
+  uint64_t hash = prefix_hash ^ (uintptr_t)language;
+  hash = (hash ^ parse_state) * 0x9e3779b97f4a7c15ull;
+  return (uint32_t)(hash >> 32) & (self->bucket_count - 1);
+}
+
+static inline bool ts_subtree_cache__has_key(
+  const SubtreeCacheEntry *self,
+  const TSLanguage *language,
+  TSStateId parse_state,
+  uint64_t prefix_hash
+) {
+  return
+    self->language == language &&
+    self->parse_state == parse_state &&
+    self->prefix_hash == prefix_hash;
+}
+
+static void ts_subtree_cache__rehash(TSSubtreeCache *self, uint32_t bucket_count) {
+  ts_free(self->buckets);
+  self->bucket_count = bucket_count;
+  self->buckets = ts_calloc(bucket_count, sizeof(uint32_t));
+
+  // Re-link the entries in reverse order, so that each chain has the same
+  // order as when the entries were inserted.
+  for (uint32_t i = self->entries.size; i > 0; i--) {
+    SubtreeCacheEntry *entry = &self->entries.contents[i - 1];
+    uint32_t bucket = ts_subtree_cache__bucket(
+      self, entry->language, entry->parse_state, entry->prefix_hash
+    );
+    uint32_t *next = &self->buckets[bucket];
+    while (*next && self->entries.contents[*next - 1].hashed_bytes > entry->hashed_bytes) {
+      next = &self->entries.contents[*next - 1].next;
+    }
+    entry->next = *next;
+    *next = i;
+  }
+}
+
+static SubtreeCacheLanguage *ts_subtree_cache__language(
+  const TSSubtreeCache *self,
+  const TSLanguage *language
+) {
+  for (uint32_t i = 0; i < self->languages.size; i++) {
+    SubtreeCacheLanguage *entry = &self->languages.contents[i];
+    if (entry->language == language) return entry;
+  }
+  return NULL;
+}
+
+bool ts_subtree_cache_has_state(
+  const TSSubtreeCache *self,
+  const TSLanguage *language,
+  TSStateId parse_state
+) {
+  const SubtreeCacheLanguage *entry = ts_subtree_cache__language(self, language);
+  return entry && (entry->state_bits[parse_state / 32] & (1u << (parse_state % 32)));
+}
+
+// Find the longest entry with the given key.
+const SubtreeCacheEntry *ts_subtree_cache_find(
+  const TSSubtreeCache *self,
+  const TSLanguage *language,
+  TSStateId parse_state,
+  uint64_t prefix_hash
+) {
+  if (!self->bucket_count) return NULL;
+  uint32_t bucket = ts_subtree_cache__bucket(self, language, parse_state, prefix_hash);
+  for (uint32_t i = self->buckets[bucket]; i;) {
+    const SubtreeCacheEntry *entry = &self->entries.contents[i - 1];
+    if (ts_subtree_cache__has_key(entry, language, parse_state, prefix_hash)) return entry;
+    i = entry->next;
+  }
+  return NULL;
+}
+
+// Find the next entry with the same key as the given entry, which is no longer
+// than the given entry.
+const SubtreeCacheEntry *ts_subtree_cache_find_next(
+  const TSSubtreeCache *self,
+  const SubtreeCacheEntry *entry
+) {
+  for (uint32_t i = entry->next; i;) {
+    const SubtreeCacheEntry *next = &self->entries.contents[i - 1];
+    if (ts_subtree_cache__has_key(next, entry->language, entry->parse_state, entry->prefix_hash)) {
+      return next;
+    }
+    i = next->next;
+  }
+  return NULL;
+}
+
+// Add an entry to the cache, retaining its subtrees. If an entry for the same
+// text is already present, the cache is unchanged and this returns false.
+bool ts_subtree_cache_insert(TSSubtreeCache *self, const SubtreeCacheEntry *entry) {
+  if (self->entries.size * BUCKETS_PER_ENTRY >= self->bucket_count) {
+    ts_subtree_cache__rehash(
+      self,
+      self->bucket_count ? self->bucket_count * 2 : INITIAL_BUCKET_COUNT
+    );
+  }
+
+  uint32_t bucket = ts_subtree_cache__bucket(
+    self, entry->language, entry->parse_state, entry->prefix_hash
+  );
+  uint32_t previous = 0, next = self->buckets[bucket];
+  while (next) {
+    const SubtreeCacheEntry *other = &self->entries.contents[next - 1];
+    if (other->hashed_bytes < entry->hashed_bytes) break;
+    if (
+      other->hashed_bytes == entry->hashed_bytes &&
+      other->hash == entry->hash &&
+      other->is_at_start == entry->is_at_start &&
+      ts_subtree_cache__has_key(other, entry->language, entry->parse_state, entry->prefix_hash)
+    ) return false;
+    previous = next;
+    next = other->next;
+  }
+
+  SubtreeCacheLanguage *language = ts_subtree_cache__language(self, entry->language);
+  if (!language) {
+    uint32_t word_count = (entry->language->state_count + 31) / 32;
+    array_push(&self->languages, ((SubtreeCacheLanguage) {
+      .language = entry->language,
+      .state_bits = ts_calloc(word_count, sizeof(uint32_t)),
+    }));
+    language = array_back(&self->languages);
+  }
+  language->state_bits[entry->parse_state / 32] |= 1u << (entry->parse_state % 32);
+
+  ts_subtree_retain(entry->tree);
+  if (entry->last_external_token.ptr) ts_subtree_retain(entry->last_external_token);
+  entry->text->ref_count++;
+  array_push(&self->entries, *entry);
+  array_back(&self->entries)->next = next;
+  array_back(&self->entries)->last_use = ++self->clock;
+  if (previous) {
+    self->entries.contents[previous - 1].next = self->entries.size;
+  } else {
+    self->buckets[bucket] = self->entries.size;
+  }
+  self->memory_usage += sizeof(SubtreeCacheEntry);
+  return true;
+}
+
+// Record that an entry has been used, so that it is evicted after the entries
+// that have not been used more recently.
+void ts_subtree_cache_touch(TSSubtreeCache *self, const SubtreeCacheEntry *entry) {
+  self->entries.contents[entry - self->entries.contents].last_use = ++self->clock;
+}
+
+static void ts_subtree_cache__release_entry(
+  TSSubtreeCache *self,
+  SubtreeCacheEntry *entry,
+  SubtreePool *pool
+) {
+  ts_subtree_release(pool, entry->tree);
+  if (entry->last_external_token.ptr) {
+    ts_subtree_release(pool, entry->last_external_token);
+  }
+  ts_subtree_cache_text_release(self, entry->text);
+  self->memory_usage -= sizeof(SubtreeCacheEntry);
+}
+
+typedef struct {
+  uint64_t last_use;
+  uint32_t index;
+} SubtreeCacheUse;
+
+static int ts_subtree_cache__compare_uses(const void *a, const void *b) {
+  uint64_t left = ((const SubtreeCacheUse *)a)->last_use;
+  uint64_t right = ((const SubtreeCacheUse *)b)->last_use;
+  return (left > right) - (left < right);
+}
+
+// If the cache is using more memory than its limit, evict the least recently
+// used entries until it is using three quarters of the limit, so that the
+// cost of evicting entries is spread over many insertions.
+void ts_subtree_cache_trim(TSSubtreeCache *self) {
+  if (!self->memory_limit || self->memory_usage <= self->memory_limit) return;
+  size_t target = self->memory_limit / 4 * 3;
+
+  Array(SubtreeCacheUse) uses = array_new();
+  array_reserve(&uses, self->entries.size);
+  for (uint32_t i = 0; i < self->entries.size; i++) {
+    array_push(&uses, ((SubtreeCacheUse) {self->entries.contents[i].last_use, i}));
+  }
+  qsort(uses.contents, uses.size, sizeof(SubtreeCacheUse), ts_subtree_cache__compare_uses);
+
+  // Evicted entries are marked by clearing their subtree.
+  SubtreePool pool = ts_subtree_pool_new(0);
+  for (uint32_t i = 0; i < uses.size && self->memory_usage > target; i++) {
+    SubtreeCacheEntry *entry = &self->entries.contents[uses.contents[i].index];
+    ts_subtree_cache__release_entry(self, entry, &pool);
+    entry->tree = NULL_SUBTREE;
+  }
+  ts_subtree_pool_delete(&pool);
+  array_delete(&uses);
+
+  uint32_t kept_count = 0;
+  for (uint32_t i = 0; i < self->entries.size; i++) {
+    if (self->entries.contents[i].tree.ptr) {
+      self->entries.contents[kept_count++] = self->entries.contents[i];
+    }
+  }
+  self->entries.size = kept_count;
+  ts_subtree_cache__rehash(self, self->bucket_count);
+}
+
+// Create a copy of some text for a new cache entry, with room for the given
+// number of bytes. The caller owns one reference to the text.
+SubtreeCacheText *ts_subtree_cache_text_new(
+  TSSubtreeCache *self,
+  uint32_t length,
+  size_t node_bytes
+) {
+  size_t size = sizeof(SubtreeCacheText) + length;
+  SubtreeCacheText *text = ts_malloc(size);
+  text->ref_count = 1;
+  text->length = length;
+  text->size = size + node_bytes;
+  self->memory_usage += text->size;
+  return text;
+}
+
+void ts_subtree_cache_text_release(TSSubtreeCache *self, SubtreeCacheText *text) {
+  assert(text->ref_count > 0);
+  if (--text->ref_count == 0) {
+    self->memory_usage -= text->size;
+    ts_free(text);
+  }
+}
+
+// Public
+
+TSSubtreeCache *ts_subtree_cache_new(void) {
+  TSSubtreeCache *self = ts_malloc(sizeof(TSSubtreeCache));
+  array_init(&self->entries);
+  array_init(&self->languages);
+  self->buckets = NULL;
+  self->bucket_count = 0;
+  self->clock = 0;
+  self->memory_usage = 0;
+  self->memory_limit = DEFAULT_MEMORY_LIMIT;
+  return self;
+}
+
+void ts_subtree_cache_clear(TSSubtreeCache *self) {
+  SubtreePool pool = ts_subtree_pool_new(0);
+  for (uint32_t i = 0; i < self->entries.size; i++) {
+    ts_subtree_cache__release_entry(self, &self->entries.contents[i], &pool);
+  }
+  ts_subtree_pool_delete(&pool);
+
+  for (uint32_t i = 0; i < self->languages.size; i++) {
+    ts_free(self->languages.contents[i].state_bits);
+  }
+  array_clear(&self->entries);
+  array_clear(&self->languages);
+  ts_free(self->buckets);
+  self->buckets = NULL;
+  self->bucket_count = 0;
+}
+
+void ts_subtree_cache_delete(TSSubtreeCache *self) {
+  if (!self) return;
+  ts_subtree_cache_clear(self);
+  array_delete(&self->entries);
+  array_delete(&self->languages);
+  ts_free(self);
+}
+
+void ts_subtree_cache_set_memory_limit(TSSubtreeCache *self, size_t bytes) {
+  self->memory_limit = bytes;
+  ts_subtree_cache_trim(self);
+}
+
+size_t ts_subtree_cache_memory_limit(const TSSubtreeCache *self) {
+  return self->memory_limit;
+}
+
+size_t ts_subtree_cache_memory_usage(const TSSubtreeCache *self) {
+  return self->memory_usage;
+}
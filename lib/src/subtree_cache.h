@@ -0,0 +1,88 @@
+#ifndef TREE_SITTER_SUBTREE_CACHE_H_
+#define TREE_SITTER_SUBTREE_CACHE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "./array.h"
+#include "./subtree.h"
+#include "tree_sitter/api.h"
+
+// A copy of the text of a cached subtree, which is compared to the current text
+// before the subtree is reused, so that a hash collision can never produce a
+// wrong tree. The descendants of a subtree that are cached along with it refer
+// to the same text. The text's size includes the memory used by the subtree's
+// nodes, which is charged to the cache for as long as the text is alive.
+typedef struct {
+  uint32_t ref_count;
+  uint32_t length;
+  size_t size;
+  char contents[];
+} SubtreeCacheText;
+
+// An entry in a subtree cache describes a subtree, along with everything that
+// determines whether the subtree can be reused when parsing a different text:
+// the state in which the parser began lexing its first token, the external
+// scanner state at that point, and the subtree's text, including any text
+// that the lexer looked at beyond the end of the subtree.
+typedef struct {
+  const TSLanguage *language;
+  uint64_t prefix_hash;
+  uint64_t hash;
+  uint64_t last_use;
+  SubtreeCacheText *text;
+  uint32_t text_offset;
+  uint32_t hashed_bytes;
+  uint32_t next;
+  TSStateId parse_state;
+  bool is_at_start;
+  Subtree tree;
+  Subtree last_external_token;
+} SubtreeCacheEntry;
+
+// The set of parse states in which a language has cached subtrees, which
+// allows the parser to avoid hashing any text in other states.
+typedef struct {
+  const TSLanguage *language;
+  uint32_t *state_bits;
+} SubtreeCacheLanguage;
+
+// Entries are stored in a sparse hash table keyed by language, parse state and
+// a hash of the first few bytes of text, so that most lookups can be rejected
+// by examining a single bucket. Each chain of entries is ordered from the
+// longest to the shortest, and is linked by the entries' one-based `next`
+// indices.
+//
+// When the memory used by the cache exceeds its limit, the least recently used
+// entries are evicted.
+struct TSSubtreeCache {
+  Array(SubtreeCacheEntry) entries;
+  Array(SubtreeCacheLanguage) languages;
+  uint32_t *buckets;
+  uint32_t bucket_count;
+  uint64_t clock;
+  size_t memory_usage;
+  size_t memory_limit;
+};
+
+bool ts_subtree_cache_has_state(const TSSubtreeCache *, const TSLanguage *, TSStateId);
+const SubtreeCacheEntry *ts_subtree_cache_find(
+  const TSSubtreeCache *, const TSLanguage *, TSStateId, uint64_t
+);
+const SubtreeCacheEntry *ts_subtree_cache_find_next(
+  const TSSubtreeCache *, const SubtreeCacheEntry *
+);
+bool ts_subtree_cache_insert(TSSubtreeCache *, const SubtreeCacheEntry *);
+void ts_subtree_cache_touch(TSSubtreeCache *, const SubtreeCacheEntry *);
+void ts_subtree_cache_trim(TSSubtreeCache *);
+SubtreeCacheText *ts_subtree_cache_text_new(TSSubtreeCache *, uint32_t, size_t);
+void ts_subtree_cache_text_release(TSSubtreeCache *, SubtreeCacheText *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // TREE_SITTER_SUBTREE_CACHE_H_
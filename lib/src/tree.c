@@ -1,11 +1,15 @@
 #include "tree_sitter/api.h"
 #include "./array.h"
+#include "./clock.h"
 #include "./get_changed_ranges.h"
+#include "./language.h"
 #include "./length.h"
 #include "./subtree.h"
 #include "./tree_cursor.h"
 #include "./tree.h"
 
+static const uint32_t NODE_COUNT_PER_TIMEOUT_CHECK = 100;
+
 TSTree *ts_tree_new(
   Subtree root, const TSLanguage *language,
   const TSRange *included_ranges, unsigned included_range_count
@@ -16,22 +20,101 @@ TSTree *ts_tree_new(
   result->included_ranges = ts_calloc(included_range_count, sizeof(TSRange));
   memcpy(result->included_ranges, included_ranges, included_range_count * sizeof(TSRange));
   result->included_range_count = included_range_count;
+  result->is_partial = false;
+  result->allocator = ts_allocator_current();
   return result;
 }
 
 TSTree *ts_tree_copy(const TSTree *self) {
+  const TSAllocator *previous_allocator = ts_allocator_enter(&self->allocator);
   ts_subtree_retain(self->root);
-  return ts_tree_new(self->root, self->language, self->included_ranges, self->included_range_count);
+  TSTree *result = ts_tree_new(self->root, self->language, self->included_ranges, self->included_range_count);
+  result->is_partial = self->is_partial;
+  ts_allocator_leave(previous_allocator);
+  return result;
 }
 
 void ts_tree_delete(TSTree *self) {
   if (!self) return;
 
+  // The tree's allocator must outlive the tree itself.
+  TSAllocator allocator = self->allocator;
+  const TSAllocator *previous_allocator = ts_allocator_enter(&allocator);
   SubtreePool pool = ts_subtree_pool_new(0);
   ts_subtree_release(&pool, self->root);
   ts_subtree_pool_delete(&pool);
   ts_free(self->included_ranges);
   ts_free(self);
+  ts_allocator_leave(previous_allocator);
+}
+
+void ts_tree_delete_deferred(TSTree *self, TSDeletionQueue *queue) {
+  if (!self) return;
+
+  // The nodes of trees with different allocators are kept in separate pools,
+  // each of which is only ever used with its own allocator.
+  DeletionQueueEntry *entry = NULL;
+  for (uint32_t i = 0; i < queue->entries.size; i++) {
+    if (ts_allocator_eq(&queue->entries.contents[i].allocator, &self->allocator)) {
+      entry = &queue->entries.contents[i];
+      break;
+    }
+  }
+  if (!entry) {
+    array_push(&queue->entries, ((DeletionQueueEntry) {
+      .allocator = self->allocator,
+      .pool = ts_subtree_pool_new(0),
+    }));
+    entry = array_back(&queue->entries);
+  }
+
+  const TSAllocator *previous_allocator = ts_allocator_enter(&entry->allocator);
+  ts_subtree_release_deferred(&entry->pool, self->root);
+  ts_free(self->included_ranges);
+  ts_free(self);
+  ts_allocator_leave(previous_allocator);
+}
+
+TSDeletionQueue *ts_deletion_queue_new(void) {
+  TSDeletionQueue *self = ts_malloc(sizeof(TSDeletionQueue));
+  array_init(&self->entries);
+  return self;
+}
+
+bool ts_deletion_queue_drain(TSDeletionQueue *self, uint64_t timeout_micros) {
+  TSClock end_clock = timeout_micros
+    ? clock_after(clock_now(), duration_from_micros(timeout_micros))
+    : clock_null();
+
+  for (uint32_t i = 0; i < self->entries.size; i++) {
+    DeletionQueueEntry *entry = &self->entries.contents[i];
+    const TSAllocator *previous_allocator = ts_allocator_enter(&entry->allocator);
+    bool is_empty;
+    if (clock_is_null(end_clock)) {
+      is_empty = ts_subtree_pool_free_released(&entry->pool, UINT32_MAX);
+    } else {
+      while (
+        !(is_empty = ts_subtree_pool_free_released(&entry->pool, NODE_COUNT_PER_TIMEOUT_CHECK)) &&
+        !clock_is_gt(clock_now(), end_clock)
+      ) {}
+    }
+    ts_allocator_leave(previous_allocator);
+    if (!is_empty) return false;
+  }
+  return true;
+}
+
+void ts_deletion_queue_delete(TSDeletionQueue *self) {
+  if (!self) return;
+  for (uint32_t i = 0; i < self->entries.size; i++) {
+    DeletionQueueEntry *entry = &self->entries.contents[i];
+    const TSAllocator *previous_allocator = ts_allocator_enter(&entry->allocator);
+    ts_subtree_pool_free_released(&entry->pool, UINT32_MAX);
+    ts_subtree_pool_delete(&entry->pool);
+    ts_allocator_leave(previous_allocator);
+  }
+  array_delete(&self->entries);
+  ts_free(self);
 }
 
 TSNode ts_tree_root_node(const TSTree *self) {
@@ -51,7 +134,7 @@ const TSLanguage *ts_tree_language(const TSTree *self) {
   return self->language;
 }
 
-void ts_tree_edit(TSTree *self, const TSInputEdit *edit) {
+static void ts_tree__edit_included_ranges(TSTree *self, const TSInputEdit *edit) {
   for (unsigned i = 0; i < self->included_range_count; i++) {
     TSRange *range = &self->included_ranges[i];
     if (range->end_byte >= edit->old_end_byte) {
@@ -85,20 +168,81 @@ void ts_tree_edit(TSTree *self, const TSInputEdit *edit) {
       range->start_point = edit->start_point;
     }
   }
+}
 
+void ts_tree_edit(TSTree *self, const TSInputEdit *edit) {
+  ts_tree__edit_included_ranges(self, edit);
+
+  const TSAllocator *previous_allocator = ts_allocator_enter(&self->allocator);
   SubtreePool pool = ts_subtree_pool_new(0);
   self->root = ts_subtree_edit(self->root, edit, &pool);
   ts_subtree_pool_delete(&pool);
+  ts_allocator_leave(previous_allocator);
+}
+
+bool ts_tree_edit_batch(TSTree *self, const TSInputEdit *edits, uint32_t count) {
+  if (count == 0) return true;
+  const TSAllocator *previous_allocator = ts_allocator_enter(&self->allocator);
+
+  // Sort the edits by their start position. Batches are usually sorted already,
+  // so use an insertion sort, which also keeps ties in their original order.
+  TSInputEdit *sorted_edits = ts_malloc(count * sizeof(TSInputEdit));
+  memcpy(sorted_edits, edits, count * sizeof(TSInputEdit));
+  for (uint32_t i = 1; i < count; i++) {
+    TSInputEdit edit = sorted_edits[i];
+    uint32_t j = i;
+    while (j > 0 && sorted_edits[j - 1].start_byte > edit.start_byte) {
+      sorted_edits[j] = sorted_edits[j - 1];
+      j--;
+    }
+    sorted_edits[j] = edit;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    const TSInputEdit *edit = &sorted_edits[i];
+    if (
+      edit->old_end_byte < edit->start_byte ||
+      edit->new_end_byte < edit->start_byte ||
+      (i > 0 && edit->start_byte < sorted_edits[i - 1].old_end_byte)
+    ) {
+      ts_free(sorted_edits);
+      ts_allocator_leave(previous_allocator);
+      return false;
+    }
+  }
+
+  // Each edit is expressed in terms of the original document, so the included
+  // ranges are updated from the last edit to the first.
+  for (uint32_t i = count; i > 0; i--) {
+    ts_tree__edit_included_ranges(self, &sorted_edits[i - 1]);
+  }
+
+  SubtreePool pool = ts_subtree_pool_new(0);
+  self->root = ts_subtree_edit_batch(self->root, sorted_edits, count, &pool);
+  ts_subtree_pool_delete(&pool);
+  ts_free(sorted_edits);
+  ts_allocator_leave(previous_allocator);
+  return true;
+}
+
+bool ts_tree_is_partial(const TSTree *self) {
+  return self->is_partial;
 }
 
 TSRange *ts_tree_included_ranges(const TSTree *self, uint32_t *length) {
   *length = self->included_range_count;
   TSRange *ranges = ts_calloc(self->included_range_count, sizeof(TSRange));
   memcpy(ranges, self->included_ranges, self->included_range_count * sizeof(TSRange));
+  ts_disown(ranges);
   return ranges;
 }
 
-TSRange *ts_tree_get_changed_ranges(const TSTree *self, const TSTree *other, uint32_t *count) {
+TSRange *ts_tree__get_changed_ranges(
+  const TSTree *self,
+  const TSTree *other,
+  uint32_t *count,
+  TSNodeChangeArray *changes
+) {
   TreeCursor cursor1 = {NULL, array_new()};
   TreeCursor cursor2 = {NULL, array_new()};
   ts_tree_cursor_init(&cursor1, ts_tree_root_node(self));
@@ -114,7 +258,7 @@ TSRange *ts_tree_get_changed_ranges(const TSTree *self, const TSTree *other, uin
   TSRange *result;
   *count = ts_subtree_get_changed_ranges(
     &self->root, &other->root, &cursor1, &cursor2,
-    self->language, &included_range_differences, &result
+    self->language, &included_range_differences, &result, changes
   );
 
   array_delete(&included_range_differences);
@@ -123,6 +267,126 @@ TSRange *ts_tree_get_changed_ranges(const TSTree *self, const TSTree *other, uin
   return result;
 }
 
+TSRange *ts_tree_get_changed_ranges(const TSTree *self, const TSTree *other, uint32_t *count) {
+  TSRange *ranges = ts_tree__get_changed_ranges(self, other, count, NULL);
+  ts_disown(ranges);
+  return ranges;
+}
+
+TSNodeChange *ts_tree_get_changed_nodes(const TSTree *self, const TSTree *other, uint32_t *count) {
+  TSNodeChangeArray changes = array_new();
+  uint32_t range_count;
+  ts_free(ts_tree__get_changed_ranges(self, other, &range_count, &changes));
+  *count = changes.size;
+  ts_disown(changes.contents);
+  return changes.contents;
+}
+
+void ts_tree_memory_usage(const TSTree *self, TSTreeMemoryUsage *usage) {
+  *usage = (TSTreeMemoryUsage) {0};
+  ts_subtree_memory_usage(self->root, usage);
+  usage->total_bytes =
+    sizeof(TSTree) +
+    self->included_range_count * sizeof(TSRange) +
+    usage->heap_node_bytes +
+    usage->child_array_bytes +
+    usage->external_scanner_state_bytes;
+}
+
+// The serialized format starts with a magic number and a version, followed by
+// a description of the language, which is used to reject trees that were
+// produced by a different grammar, the tree's included ranges, and finally
+// its nodes.
+static const char TREE_SERIALIZATION_MAGIC[4] = {'T', 'S', 'T', 'R'};
+static const uint32_t TREE_SERIALIZATION_VERSION = 2;
+
+char *ts_tree_serialize(const TSTree *self, uint32_t *length) {
+  SerializationBuffer buffer = array_new();
+  ts_serialization_write_bytes(&buffer, TREE_SERIALIZATION_MAGIC, sizeof(TREE_SERIALIZATION_MAGIC));
+  ts_serialization_write_uint(&buffer, TREE_SERIALIZATION_VERSION);
+  ts_serialization_write_uint(&buffer, self->language->version);
+  ts_serialization_write_uint(&buffer, self->language->symbol_count);
+  ts_serialization_write_uint(&buffer, self->language->state_count);
+  ts_serialization_write_uint(&buffer, self->language->production_id_count);
+  ts_serialization_write_uint(&buffer, ts_language_name_hash(self->language));
+  ts_serialization_write_uint(&buffer, self->is_partial);
+  ts_serialization_write_uint(&buffer, self->included_range_count);
+  for (unsigned i = 0; i < self->included_range_count; i++) {
+    const TSRange *range = &self->included_ranges[i];
+    ts_serialization_write_uint(&buffer, range->start_byte);
+    ts_serialization_write_uint(&buffer, range->end_byte);
+    ts_serialization_write_uint(&buffer, range->start_point.row);
+    ts_serialization_write_uint(&buffer, range->start_point.column);
+    ts_serialization_write_uint(&buffer, range->end_point.row);
+    ts_serialization_write_uint(&buffer, range->end_point.column);
+  }
+  ts_subtree_serialize(self->root, &buffer, self->language);
+  *length = buffer.size;
+  ts_disown(buffer.contents);
+  return buffer.contents;
+}
+
+TSTree *ts_tree_deserialize(const TSLanguage *language, const char *data, uint32_t length) {
+  SerializationReader reader = ts_serialization_reader_new(data, length);
+  const char *magic;
+  uint32_t version, language_version, symbol_count, state_count, production_id_count;
+  uint32_t language_hash;
+  uint32_t is_partial, range_count;
+  if (
+    !ts_serialization_read_bytes(&reader, sizeof(TREE_SERIALIZATION_MAGIC), &magic) ||
+    memcmp(magic, TREE_SERIALIZATION_MAGIC, sizeof(TREE_SERIALIZATION_MAGIC)) != 0 ||
+    !ts_serialization_read_uint(&reader, &version) ||
+    version != TREE_SERIALIZATION_VERSION ||
+    !ts_serialization_read_uint(&reader, &language_version) ||
+    !ts_serialization_read_uint(&reader, &symbol_count) ||
+    !ts_serialization_read_uint(&reader, &state_count) ||
+    !ts_serialization_read_uint(&reader, &production_id_count) ||
+    !ts_serialization_read_uint(&reader, &language_hash) ||
+    language_version != language->version ||
+    symbol_count != language->symbol_count ||
+    state_count != language->state_count ||
+    production_id_count != language->production_id_count ||
+    language_hash != ts_language_name_hash(language) ||
+    !ts_serialization_read_uint(&reader, &is_partial) ||
+    !ts_serialization_read_uint(&reader, &range_count) ||
+    range_count > ts_serialization_remaining(&reader)
+  ) return NULL;
+
+  Array(TSRange) ranges = array_new();
+  uint32_t previous_byte = 0;
+  for (unsigned i = 0; i < range_count; i++) {
+    TSRange range;
+    if (
+      !ts_serialization_read_uint(&reader, &range.start_byte) ||
+      !ts_serialization_read_uint(&reader, &range.end_byte) ||
+      !ts_serialization_read_uint(&reader, &range.start_point.row) ||
+      !ts_serialization_read_uint(&reader, &range.start_point.column) ||
+      !ts_serialization_read_uint(&reader, &range.end_point.row) ||
+      !ts_serialization_read_uint(&reader, &range.end_point.column) ||
+      range.start_byte < previous_byte ||
+      range.end_byte < range.start_byte
+    ) {
+      array_delete(&ranges);
+      return NULL;
+    }
+    previous_byte = range.end_byte;
+    array_push(&ranges, range);
+  }
+
+  SubtreePool pool = ts_subtree_pool_new(0);
+  Subtree root = ts_subtree_deserialize(&reader, &pool, language);
+  TSTree *result = NULL;
+  if (root.ptr && ts_serialization_remaining(&reader) == 0) {
+    result = ts_tree_new(root, language, ranges.contents, ranges.size);
+    result->is_partial = is_partial;
+  } else if (root.ptr) {
+    ts_subtree_release(&pool, root);
+  }
+  ts_subtree_pool_delete(&pool);
+  array_delete(&ranges);
+  return result;
+}
+
 #ifdef _WIN32
 
 void ts_tree_print_dot_graph(const TSTree *self, int fd) {
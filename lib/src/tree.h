@@ -1,6 +1,7 @@
 #ifndef TREE_SITTER_TREE_H_
 #define TREE_SITTER_TREE_H_
 
+#include "./array.h"
 #include "./subtree.h"
 
 #ifdef __cplusplus
@@ -19,6 +20,20 @@ struct TSTree {
   const TSLanguage *language;
   TSRange *included_ranges;
   unsigned included_range_count;
+  bool is_partial;
+  TSAllocator allocator;
+};
+
+typedef struct {
+  TSAllocator allocator;
+  SubtreePool pool;
+} DeletionQueueEntry;
+
+// A deletion queue holds the nodes of deleted trees whose memory has not yet
+// been freed, on the stacks of its subtree pools. There is one pool for each
+// allocator that the trees use.
+struct TSDeletionQueue {
+  Array(DeletionQueueEntry) entries;
 };
 
 TSTree *ts_tree_new(Subtree root, const TSLanguage *language, const TSRange *, unsigned);
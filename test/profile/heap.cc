@@ -39,4 +39,13 @@ int main() {
     source_code.c_str(),
     source_code.size()
   );
+
+  TSTreeMemoryUsage usage;
+  ts_tree_memory_usage(tree, &usage);
+  printf("Heap nodes:         %zu (%zu bytes)\n", usage.heap_node_count, usage.heap_node_bytes);
+  printf("Per heap node:      %.1f bytes\n", usage.heap_node_count ? (double)usage.heap_node_bytes / usage.heap_node_count : 0.0);
+  printf("Inline leaves:      %zu\n", usage.inline_leaf_count);
+  printf("Child arrays:       %zu bytes\n", usage.child_array_bytes);
+  printf("Scanner states:     %zu bytes\n", usage.external_scanner_state_bytes);
+  printf("Total:              %zu bytes\n", usage.total_bytes);
 }